@@ -5,61 +5,663 @@ const fz = require('zigbee-herdsman-converters/converters/fromZigbee');
 const tz = require('zigbee-herdsman-converters/converters/toZigbee');
 const exposes = require('zigbee-herdsman-converters/lib/exposes');
 const reporting = require('zigbee-herdsman-converters/lib/reporting');
+const {Zcl} = require('zigbee-herdsman');
 const e = exposes.presets;
 const ea = exposes.access;
 
-const definition = {
-    zigbeeModel: ['WS2812_Light'],
-    model: 'WS2812_ESP32H2',
-    vendor: 'Custom',
-    description: 'ESP32-H2 WS2812 LED Strip Controller avec effets',
-    
-    exposes: [
-        e.light_brightness_colorxy(),
-        exposes.enum('effect', ea.SET, ['none', 'rainbow', 'strobe', 'twinkle'])
-            .withDescription('Effet d\'animation'),
-        exposes.numeric('speed_rainbow', ea.SET)
+// Doit correspondre a LIGHT_SEGMENT_COUNT dans main.h (un endpoint par segment : 10, 11, ...)
+const SEGMENT_COUNT = 1;
+const FIRST_ENDPOINT = 10;
+
+// Plage de temperature de couleur (COLOR_CORRECTION_MIREDS_MIN/MAX dans color_correction.h)
+const COLOR_TEMP_RANGE = [153, 500];
+
+// Degrades predefinis (ordre de gradient_preset_t dans effects.h)
+const GRADIENTS = ['none', 'ocean', 'lava', 'forest', 'party', 'sunset', 'heat'];
+const GRADIENT_CUSTOM = 0xFF;
+const GRADIENT_MAX_STOPS = 16;
+
+// "0:#000050,128:#ff0000,255:#ffffff" -> [0xFF, pos, r, g, b, ...]
+const parseGradientStops = (value) => {
+    const stops = String(value).split(',').map((s) => s.trim()).filter((s) => s.length > 0);
+    if (stops.length === 0 || stops.length > GRADIENT_MAX_STOPS) {
+        throw new Error(`Degrade : 1 a ${GRADIENT_MAX_STOPS} points attendus`);
+    }
+    const bytes = [GRADIENT_CUSTOM];
+    for (const stop of stops) {
+        const match = stop.match(/^(\d{1,3})\s*:\s*#?([0-9a-fA-F]{6})$/);
+        if (!match || Number(match[1]) > 255) {
+            throw new Error(`Point de degrade invalide : '${stop}' (attendu position:#rrggbb)`);
+        }
+        const rgb = parseInt(match[2], 16);
+        bytes.push(Number(match[1]), (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF);
+    }
+    return bytes;
+};
+
+// Courbes niveau -> luminosite (ordre de effects_level_curve_t dans effects.h)
+const LEVEL_CURVES = ['linear', 'cie_lstar', 'gamma_2_2', 'custom'];
+const LEVEL_CURVE_MAX_POINTS = 16;
+
+// "0:0,127:8000,254:65535" -> [niveau, luminosite (u16 LE), ...]
+const parseLevelCurvePoints = (value) => {
+    const points = String(value).split(',').map((s) => s.trim()).filter((s) => s.length > 0);
+    if (points.length > LEVEL_CURVE_MAX_POINTS) {
+        throw new Error(`Courbe : ${LEVEL_CURVE_MAX_POINTS} points maximum`);
+    }
+    const bytes = [];
+    let lastLevel = -1;
+    for (const point of points) {
+        const match = point.match(/^(\d{1,3})\s*:\s*(\d{1,5})$/);
+        if (!match || Number(match[1]) > 254 || Number(match[1]) < lastLevel || Number(match[2]) > 65535) {
+            throw new Error(`Point de courbe invalide : '${point}' (attendu niveau:luminosite, niveaux croissants)`);
+        }
+        lastLevel = Number(match[1]);
+        const output = Number(match[2]);
+        bytes.push(lastLevel, output & 0xFF, (output >> 8) & 0xFF);
+    }
+    return bytes;
+};
+
+// Types de ruban (ordre de light_strip_type_t dans main.c)
+const STRIP_TYPES = ['ws2812', 'sk6812_rgb', 'sk6812_rgbw'];
+
+// Calibrage : {red: {x, y}, green: {x, y}, blue: {x, y}, [gain: {r, g, b}], [gamma: {r, g, b}]}
+// -> x, y des primaires, gains (65535 = 1), gamma (centiemes) ; u16 little-endian. {} = calibrage par defaut
+const encodeColorCalibration = (value) => {
+    const bytes = [];
+    if (!value.red && !value.green && !value.blue) {
+        return bytes;
+    }
+    const u16 = (v) => bytes.push(v & 0xFF, (v >> 8) & 0xFF);
+    for (const primary of ['red', 'green', 'blue']) {
+        const c = value[primary];
+        if (!c || c.x === undefined || c.y === undefined) {
+            throw new Error(`Calibrage : ${primary} {x, y} requis`);
+        }
+        u16(Math.round(Math.max(0, Math.min(1, c.x)) * 65535));
+        u16(Math.round(Math.max(0, Math.min(1, c.y)) * 65535));
+    }
+    const gain = value.gain || {};
+    for (const ch of ['r', 'g', 'b']) {
+        u16(Math.round(Math.max(0, Math.min(1, gain[ch] === undefined ? 1 : gain[ch])) * 65535));
+    }
+    const gamma = value.gamma || {};
+    for (const ch of ['r', 'g', 'b']) {
+        u16(Math.round(Math.max(0.1, Math.min(5, gamma[ch] === undefined ? 1 : gamma[ch])) * 100));
+    }
+    return bytes;
+};
+
+// Fondu long : {duration (s), brightness, [color: {x, y}], [from_brightness, from_color: {x, y}]}
+// -> duree (u32), niveau (u8), X, Y (u16), niveau, X, Y de depart ; little-endian
+const encodeFade = (value) => {
+    const bytes = [];
+    const u16 = (v) => bytes.push(v & 0xFF, (v >> 8) & 0xFF);
+    const xy = (c) => {
+        u16(Math.round(Math.max(0, Math.min(1, c.x)) * 65535));
+        u16(Math.round(Math.max(0, Math.min(1, c.y)) * 65535));
+    };
+    const duration = Math.max(0, Math.round(Number(value.duration) || 0));
+    bytes.push(duration & 0xFF, (duration >> 8) & 0xFF, (duration >> 16) & 0xFF, (duration >>> 24) & 0xFF);
+    bytes.push(Math.max(0, Math.min(254, Math.round(Number(value.brightness) || 0))));
+    if (value.color || value.from_color || value.from_brightness !== undefined) {
+        if (!value.color) {
+            throw new Error('Fondu : color requis avec un etat de depart');
+        }
+        xy(value.color);
+    }
+    if (value.from_brightness !== undefined || value.from_color) {
+        if (value.from_brightness === undefined || !value.from_color) {
+            throw new Error('Fondu : from_brightness et from_color vont ensemble');
+        }
+        bytes.push(Math.max(0, Math.min(254, Math.round(Number(value.from_brightness)))));
+        xy(value.from_color);
+    }
+    return bytes;
+};
+
+const segmentEndpoints = {};
+for (let i = 0; i < SEGMENT_COUNT; i++) {
+    segmentEndpoints[`l${i + 1}`] = FIRST_ENDPOINT + i;
+}
+
+const EFFECTS = ['none', 'rainbow', 'strobe', 'twinkle', 'program'];
+
+// Cluster fabricant 0xFC00 : changement complet d'un segment en une commande (LIGHT_CMD_* dans main.h)
+const LIGHT_CLUSTER = 'ws2812Light';
+const KEEP_U8 = 0xFF;
+const KEEP_U16 = 0xFFFF;
+const setEffectParameters = [
+    {name: 'effectId', type: Zcl.DataType.UINT8},
+    {name: 'speed', type: Zcl.DataType.UINT8},
+    {name: 'colorX', type: Zcl.DataType.UINT16},
+    {name: 'colorY', type: Zcl.DataType.UINT16},
+    {name: 'level', type: Zcl.DataType.UINT8},
+    {name: 'transition', type: Zcl.DataType.UINT16},
+];
+const addLightCluster = (device) => {
+    if (device.customClusters[LIGHT_CLUSTER]) {
+        return;
+    }
+    device.addCustomCluster(LIGHT_CLUSTER, {
+        ID: 0xFC00,
+        manufacturerCode: 0x1234,
+        attributes: {
+            version: {ID: 0x0000, type: Zcl.DataType.UINT8},
+            syncGroup: {ID: 0x0020, type: Zcl.DataType.UINT16},
+            syncState: {ID: 0x0021, type: Zcl.DataType.UINT8},
+            syncOffset: {ID: 0x0022, type: Zcl.DataType.INT32},
+            syncDrift: {ID: 0x0023, type: Zcl.DataType.INT16},
+            syncError: {ID: 0x0024, type: Zcl.DataType.INT16},
+            syncSource: {ID: 0x0025, type: Zcl.DataType.UINT16},
+        },
+        commands: {
+            setEffect: {ID: 0x00, parameters: setEffectParameters},
+            setSegment: {ID: 0x01, parameters: [
+                {name: 'segments', type: Zcl.DataType.UINT8},
+                {name: 'onOff', type: Zcl.DataType.UINT8},
+            ].concat(setEffectParameters)},
+            streamChunk: {ID: 0x02, parameters: [
+                {name: 'frame', type: Zcl.DataType.UINT8},
+                {name: 'segment', type: Zcl.DataType.UINT8},
+                {name: 'offset', type: Zcl.DataType.UINT16},
+                {name: 'encoding', type: Zcl.DataType.UINT8},
+                {name: 'data', type: Zcl.BuffaloZclDataType.BUFFER},
+            ]},
+            streamPresent: {ID: 0x03, parameters: [
+                {name: 'frame', type: Zcl.DataType.UINT8},
+                {name: 'segments', type: Zcl.DataType.UINT8},
+            ]},
+            programWrite: {ID: 0x04, parameters: [
+                {name: 'slot', type: Zcl.DataType.UINT8},
+                {name: 'offset', type: Zcl.DataType.UINT16},
+                {name: 'data', type: Zcl.BuffaloZclDataType.BUFFER},
+            ]},
+            programCommit: {ID: 0x05, parameters: [
+                {name: 'slot', type: Zcl.DataType.UINT8},
+                {name: 'length', type: Zcl.DataType.UINT16},
+            ]},
+            programRun: {ID: 0x06, parameters: [
+                {name: 'slot', type: Zcl.DataType.UINT8},
+                {name: 'speed', type: Zcl.DataType.UINT8},
+                {name: 'p0', type: Zcl.DataType.UINT8},
+                {name: 'p1', type: Zcl.DataType.UINT8},
+                {name: 'p2', type: Zcl.DataType.UINT8},
+                {name: 'p3', type: Zcl.DataType.UINT8},
+            ]},
+            timeSync: {ID: 0x07, parameters: [
+                {name: 'time', type: Zcl.DataType.UINT32},
+                {name: 'epoch', type: Zcl.DataType.UINT32},
+            ]},
+            commission: {ID: 0x08, parameters: [
+                {name: 'modes', type: Zcl.DataType.UINT8},
+                {name: 'duration', type: Zcl.DataType.UINT16},
+            ]},
+        },
+        commandsResponse: {},
+    });
+};
+
+// Champs SetEffect depuis une valeur MQTT (champ absent = inchange)
+const lightCommandPayload = (value) => {
+    const payload = {effectId: KEEP_U8, speed: 0, colorX: KEEP_U16, colorY: KEEP_U16, level: KEEP_U8, transition: 0};
+    if (value.effect !== undefined) {
+        const id = EFFECTS.indexOf(String(value.effect).toLowerCase());
+        if (id < 0) {
+            throw new Error(`Effet inconnu: ${value.effect}`);
+        }
+        payload.effectId = id;
+    }
+    if (value.speed !== undefined) {
+        payload.speed = Math.max(1, Math.min(255, Math.round(Number(value.speed))));
+    }
+    if (value.color !== undefined) {
+        payload.colorX = Math.max(0, Math.min(0xFEFF, Math.round(Number(value.color.x) * 65535)));
+        payload.colorY = Math.max(0, Math.min(0xFEFF, Math.round(Number(value.color.y) * 65535)));
+    }
+    if (value.brightness !== undefined) {
+        payload.level = Math.max(0, Math.min(254, Math.round(Number(value.brightness))));
+    }
+    if (value.transition !== undefined) {
+        payload.transition = Math.max(0, Math.min(0xFFFE, Math.round(Number(value.transition) * 10)));
+    }
+    return payload;
+};
+
+// Flux de trames : blocs RAW ou RLE (le plus court), tailles qui tiennent dans une trame radio
+const STREAM_RAW = 0;
+const STREAM_RLE = 1;
+const STREAM_CHUNK_MAX = 60;
+const streamFrames = {};
+const parsePixels = (value) => {
+    const list = Array.isArray(value) ? value : String(value).split(',');
+    return list.map((p) => {
+        const match = String(p).trim().match(/^#?([0-9a-fA-F]{6})$/);
+        if (!match) {
+            throw new Error(`Pixel invalide: ${p} (attendu #rrggbb)`);
+        }
+        const rgb = parseInt(match[1], 16);
+        return [(rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF];
+    });
+};
+const encodeStreamChunks = (pixels) => {
+    const chunks = [];
+    for (let offset = 0; offset < pixels.length;) {
+        // Plages de pixels identiques a partir de offset, tant que le bloc RLE tient
+        const runs = [];
+        let end = offset;
+        while (end < pixels.length && runs.length < STREAM_CHUNK_MAX) {
+            const c = pixels[end];
+            let run = 1;
+            while (end + run < pixels.length && run < 255 &&
+                   pixels[end + run].every((v, k) => v === c[k])) {
+                run++;
+            }
+            runs.push(run, ...c);
+            end += run;
+        }
+        const rawCount = Math.min(pixels.length - offset, STREAM_CHUNK_MAX / 3);
+        if (end - offset > rawCount) {
+            chunks.push({offset, encoding: STREAM_RLE, data: Buffer.from(runs)});
+            offset = end;
+        } else {
+            chunks.push({offset, encoding: STREAM_RAW, data: Buffer.from([].concat(...pixels.slice(offset, offset + rawCount)))});
+            offset += rawCount;
+        }
+    }
+    return chunks;
+};
+
+// Programmes d'effets (tools/effect_vm_asm.py --hex) : 4 emplacements, morceaux dans l'ordre
+const PROGRAM_SLOTS = 4;
+const PROGRAM_CHUNK_MAX = 48;
+const programSlot = (value) => {
+    const slot = Number(value.slot || 0);
+    if (!Number.isInteger(slot) || slot < 0 || slot >= PROGRAM_SLOTS) {
+        throw new Error(`Emplacement invalide: ${value.slot} (0-${PROGRAM_SLOTS - 1})`);
+    }
+    return slot;
+};
+
+// Etat publie apres une commande complete (le rapport 0xF00A suit de toute facon)
+const lightCommandState = (value) => {
+    const state = {};
+    if (value.effect !== undefined) state.effect = String(value.effect).toLowerCase();
+    if (value.brightness !== undefined) state.brightness = value.brightness;
+    if (value.color !== undefined) state.color = {x: value.color.x, y: value.color.y};
+    return state;
+};
+
+// Etat complet d'un segment (0xF00A, version 1) : on/off, level, x, y, color mode, temperature,
+// effet, vitesses, degrade (voir LIGHT_STATE_LEN dans main.c)
+const LIGHT_STATE_VERSION = 1;
+const decodeLightState = (buf) => {
+    if (!buf || buf.length < 15 || buf[0] !== LIGHT_STATE_VERSION) {
+        return null;
+    }
+    const state = {
+        state: buf[1] ? 'ON' : 'OFF',
+        brightness: buf[2],
+        color: {x: buf.readUInt16LE(3) / 65535, y: buf.readUInt16LE(5) / 65535},
+        color_mode: buf[7] === 2 ? 'color_temp' : 'xy',
+        color_temp: buf.readUInt16LE(8),
+        effect: EFFECTS[buf[10]] || 'none',
+        speed_rainbow: buf[11],
+        speed_strobe: buf[12],
+        speed_twinkle: buf[13],
+    };
+    if (buf[14] !== GRADIENT_CUSTOM) {
+        state.gradient = GRADIENTS[buf[14]] || 'none';
+    }
+    return state;
+};
+
+// Reports des attributs fabricant du cluster Color Control : effet et vitesses (0xF000 - 0xF003),
+// etat complet (0xF00A)
+const fzLightState = {
+    cluster: 'lightingColorCtrl',
+    type: ['attributeReport', 'readResponse'],
+    convert: (model, msg, publish, options, meta) => {
+        const name = Object.keys(segmentEndpoints).find((k) => segmentEndpoints[k] === msg.endpoint.ID);
+        const key = (base) => (SEGMENT_COUNT > 1 && name ? `${base}_${name}` : base);
+        const result = {};
+        const state = decodeLightState(msg.data['61450']);
+        if (state) {
+            for (const [k, v] of Object.entries(state)) {
+                result[key(k)] = v;
+            }
+        }
+        if (msg.data['61440'] !== undefined) {
+            result[key('effect')] = EFFECTS[msg.data['61440']] || 'none';
+        }
+        if (msg.data['61441'] !== undefined) {
+            result[key('speed_rainbow')] = msg.data['61441'];
+        }
+        if (msg.data['61442'] !== undefined) {
+            result[key('speed_strobe')] = msg.data['61442'];
+        }
+        if (msg.data['61443'] !== undefined) {
+            result[key('speed_twinkle')] = msg.data['61443'];
+        }
+        return result;
+    },
+};
+
+// Synchronisation des effets (light_sync.h) : etat, ecart et reference de l'horloge du groupe
+const SYNC_STATES = ['off', 'searching', 'follower', 'leader'];
+
+// Modes d'une fenetre d'appairage (masque, commissioning_mode_t)
+const PAIRING_MODES = {binding: 0x01, green_power: 0x02, touchlink: 0x04};
+const fzLightSync = {
+    cluster: LIGHT_CLUSTER,
+    type: ['attributeReport', 'readResponse'],
+    convert: (model, msg, publish, options, meta) => {
+        const result = {};
+        if (msg.data.syncGroup !== undefined) {
+            result.sync_group = msg.data.syncGroup;
+        }
+        if (msg.data.syncState !== undefined) {
+            result.sync_state = SYNC_STATES[msg.data.syncState] || 'off';
+        }
+        if (msg.data.syncOffset !== undefined) {
+            result.sync_offset = msg.data.syncOffset;
+        }
+        if (msg.data.syncDrift !== undefined) {
+            result.sync_drift = msg.data.syncDrift;
+        }
+        if (msg.data.syncError !== undefined) {
+            result.sync_error = msg.data.syncError;
+        }
+        if (msg.data.syncSource !== undefined) {
+            result.sync_source = `0x${msg.data.syncSource.toString(16).padStart(4, '0')}`;
+        }
+        return result;
+    },
+};
+
+// Exposes d'un segment (sans suffixe si un seul segment)
+const segmentExposes = (name) => {
+    const withEp = (expose) => (name ? expose.withEndpoint(name) : expose);
+    return [
+        withEp(e.light_brightness_colortemp_colorxy(COLOR_TEMP_RANGE)),
+        withEp(exposes.enum('effect', ea.SET, EFFECTS)
+            .withDescription('Effet d\'animation')),
+        withEp(exposes.numeric('speed_rainbow', ea.SET)
             .withValueMin(1)
             .withValueMax(255)
-            .withDescription('Vitesse Rainbow (1=lent, 255=rapide)'),
-        exposes.numeric('speed_strobe', ea.SET)
+            .withDescription('Vitesse Rainbow (1=lent, 255=rapide)')),
+        withEp(exposes.numeric('speed_strobe', ea.SET)
             .withValueMin(1)
             .withValueMax(255)
-            .withDescription('Vitesse Strobe (1=lent, 255=rapide)'),
-        exposes.numeric('speed_twinkle', ea.SET)
+            .withDescription('Vitesse Strobe (1=lent, 255=rapide)')),
+        withEp(exposes.numeric('speed_twinkle', ea.SET)
             .withValueMin(1)
             .withValueMax(255)
-            .withDescription('Vitesse Twinkle (1=lent, 255=rapide)'),
-    ],
+            .withDescription('Vitesse Twinkle (1=lent, 255=rapide)')),
+        withEp(exposes.enum('gradient', ea.SET, GRADIENTS)
+            .withDescription('Degrade utilise par les effets (none = roue HSV / couleur de base)')),
+        withEp(exposes.text('gradient_stops', ea.SET)
+            .withDescription('Degrade personnalise : position:#rrggbb separes par des virgules (16 points max)')),
+        withEp(exposes.composite('fade', 'fade', ea.SET)
+            .withFeature(exposes.numeric('duration', ea.SET)
+                .withValueMin(0)
+                .withUnit('s')
+                .withDescription('Duree du fondu (0 = arret)'))
+            .withFeature(exposes.numeric('brightness', ea.SET)
+                .withValueMin(0)
+                .withValueMax(254)
+                .withDescription('Luminosite d\'arrivee (0 = eteint a la fin)'))
+            .withDescription('Fondu long (lever/coucher de soleil). Optionnel : color {x, y}, from_brightness, from_color {x, y}')),
+        withEp(exposes.composite('set_effect', 'set_effect', ea.SET)
+            .withFeature(exposes.enum('effect', ea.SET, EFFECTS))
+            .withFeature(exposes.numeric('speed', ea.SET)
+                .withValueMin(1)
+                .withValueMax(255))
+            .withFeature(exposes.numeric('brightness', ea.SET)
+                .withValueMin(0)
+                .withValueMax(254))
+            .withFeature(exposes.numeric('transition', ea.SET)
+                .withValueMin(0)
+                .withUnit('s')
+                .withDescription('Couleur fixe uniquement'))
+            .withDescription('Effet, vitesse, couleur {x, y}, luminosite et transition appliques ensemble ' +
+                '(champ absent = inchange)')),
+        withEp(exposes.composite('program_run', 'program_run', ea.SET)
+            .withFeature(exposes.numeric('slot', ea.SET)
+                .withValueMin(0)
+                .withValueMax(PROGRAM_SLOTS - 1))
+            .withFeature(exposes.numeric('speed', ea.SET)
+                .withValueMin(1)
+                .withValueMax(255))
+            .withDescription('Lance un programme telecharge. Optionnel : params [p0, p1, p2, p3] (0-255)')),
+    ];
+};
+
+const definition = {
+    zigbeeModel: ['WS2812_Light'],
+    model: 'WS2812_ESP32H2',
+    vendor: 'Custom',
+    description: 'ESP32-H2 WS2812 LED Strip Controller avec effets',
+    
+    exposes: (SEGMENT_COUNT === 1 ?
+        segmentExposes(null) :
+        [].concat(...Object.keys(segmentEndpoints).map((name) => segmentExposes(name))))
+        // Consommation estimee de tout le ruban (premier endpoint)
+        .concat([e.power(), e.current(), e.voltage()])
+        // Courbe de luminosite commune a tous les segments
+        .concat([
+            exposes.enum('level_curve', ea.SET, LEVEL_CURVES)
+                .withDescription('Courbe niveau -> luminosite (cie_lstar = pas reguliers a l\'oeil)'),
+            exposes.text('level_curve_points', ea.SET)
+                .withDescription('Courbe personnalisee : niveau:luminosite (0-254:0-65535) separes par des virgules'),
+            exposes.composite('color_calibration', 'color_calibration', ea.SET)
+                .withDescription('Calibrage des couleurs (enregistre) : red/green/blue {x, y} des LEDs, ' +
+                    'gain {r, g, b} (0-1, balance des blancs), gamma {r, g, b}. {} = calibrage par defaut'),
+            exposes.enum('strip_type', ea.SET, STRIP_TYPES)
+                .withDescription('Type de ruban (enregistre, l\'appareil redemarre)'),
+            exposes.text('white_point', ea.SET)
+                .withDescription('Rubans RGBW : couleur de la LED blanche (#rrggbb, #ffffff = min(R, G, B))'),
+        ])
+        // Effets synchronises entre les appareils d'un groupe
+        .concat([
+            exposes.numeric('sync_group', ea.ALL)
+                .withValueMin(0)
+                .withValueMax(0xFFF7)
+                .withDescription('Groupe des balises de temps (l\'appareil doit en etre membre, 0 = desactive)'),
+            exposes.enum('sync_state', ea.STATE_GET, SYNC_STATES)
+                .withDescription('Role dans la synchronisation du groupe'),
+            exposes.numeric('sync_error', ea.STATE_GET)
+                .withUnit('ms')
+                .withDescription('Ecart de la derniere balise a l\'horloge corrigee (negatif = balise retardee)'),
+            exposes.numeric('sync_offset', ea.STATE_GET)
+                .withUnit('ms')
+                .withDescription('Temps du groupe - temps local'),
+            exposes.numeric('sync_drift', ea.STATE_GET)
+                .withUnit('ppm')
+                .withDescription('Derive estimee de l\'horloge locale'),
+            exposes.enum('sync_effects', ea.SET, ['restart'])
+                .withDescription('Balise du coordinateur : a publier sur le groupe, relance les animations en phase'),
+        ])
+        // Telecommandes et interrupteurs lies directement au ruban
+        .concat([
+            exposes.composite('pairing_window', 'pairing_window', ea.SET)
+                .withDescription('Fenetre d\'appairage : {modes [binding, green_power, touchlink], duration (s, 0 = 180)}, ' +
+                    'green_power sur le routeur uniquement'),
+        ])
+        // Trame de pixels envoyee par blocs puis affichee d'un coup
+        .concat([
+            exposes.composite('program_upload', 'program_upload', ea.SET)
+                .withDescription('Programme d\'effet : {slot (0-3), code (hexadecimal de effect_vm_asm.py)}, ' +
+                    'code vide = efface l\'emplacement'),
+            exposes.text('stream_frame', ea.SET)
+                .withDescription('Pixels #rrggbb separes par des virgules (ou {segment, pixels}), ' +
+                    'affiches ensemble a la fin de l\'envoi'),
+        ])
+        // Plusieurs segments changes ensemble (une commande, un seul rendu)
+        .concat(SEGMENT_COUNT > 1 ? [
+            exposes.composite('set_segments', 'set_segments', ea.SET)
+                .withDescription('segments [l1, l2, ...], state ON/OFF, puis les champs de set_effect'),
+        ] : []),
+
+    meta: {multiEndpoint: SEGMENT_COUNT > 1},
+    endpoint: (device) => segmentEndpoints,
     
     fromZigbee: [
         fz.on_off,
         fz.brightness,
         fz.color_colortemp,
+        fz.electrical_measurement,
+        fzLightState,
+        fzLightSync,
     ],
     
     toZigbee: [
         tz.light_onoff_brightness,
         tz.light_color,
+        tz.light_colortemp,
         {
-            key: ['effect'],
-            convertSet: async (entity, key, value, meta) => {
-                const effects = {
-                    'none': 0,
-                    'rainbow': 1,
-                    'strobe': 2,
-                    'twinkle': 3,
-                };
-                
-                const effectId = effects[value.toLowerCase()] || 0;
-                
-                await entity.write('lightingColorCtrl', {
-                    '61440': {value: effectId, type: 0x20},
-                }, {
-                    manufacturerCode: 0x1234,
+            key: ['effect', 'set_effect'],
+            convertSet: async (entity, key, value, meta) => {
+                // Une seule trame : l'appareil applique tout avant le prochain rendu
+                const command = key === 'effect' ? {effect: value} : value;
+                addLightCluster(meta.device);
+                await entity.command(LIGHT_CLUSTER, 'setEffect', lightCommandPayload(command),
+                    {manufacturerCode: 0x1234, disableDefaultResponse: true});
+                return {state: lightCommandState(command)};
+            },
+        },
+        {
+            key: ['program_upload'],
+            convertSet: async (entity, key, value, meta) => {
+                const slot = programSlot(value);
+                const code = Buffer.from(String(value.code || '').replace(/\s+/g, ''), 'hex');
+                addLightCluster(meta.device);
+                const endpoint = meta.device.getEndpoint(FIRST_ENDPOINT);
+                const options = {manufacturerCode: 0x1234};
+                for (let offset = 0; offset < code.length; offset += PROGRAM_CHUNK_MAX) {
+                    await endpoint.command(LIGHT_CLUSTER, 'programWrite',
+                        {slot, offset, data: code.subarray(offset, offset + PROGRAM_CHUNK_MAX)}, options);
+                }
+                // Verifie et enregistre par l'appareil : un programme refuse renvoie une erreur
+                await endpoint.command(LIGHT_CLUSTER, 'programCommit', {slot, length: code.length}, options);
+            },
+        },
+        {
+            key: ['program_run'],
+            convertSet: async (entity, key, value, meta) => {
+                const slot = programSlot(value);
+                const params = [].concat(value.params || []).slice(0, 4);
+                const payload = {slot, speed: value.speed === undefined ? 0 : Math.max(1, Math.min(255, value.speed))};
+                ['p0', 'p1', 'p2', 'p3'].forEach((p, k) => {
+                    payload[p] = Math.max(0, Math.min(255, Math.round(Number(params[k] || 0))));
                 });
-                
-                return {state: {effect: value}};
+                addLightCluster(meta.device);
+                await entity.command(LIGHT_CLUSTER, 'programRun', payload, {manufacturerCode: 0x1234});
+                return {state: {effect: 'program', program_run: value}};
+            },
+        },
+        {
+            key: ['stream_frame'],
+            convertSet: async (entity, key, value, meta) => {
+                const segment = (typeof value === 'object' && !Array.isArray(value) && value.segment !== undefined) ?
+                    segmentEndpoints[value.segment] - FIRST_ENDPOINT : 0;
+                if (Number.isNaN(segment)) {
+                    throw new Error(`Segment inconnu: ${value.segment}`);
+                }
+                const pixels = parsePixels(typeof value === 'object' && !Array.isArray(value) ? value.pixels : value);
+                const id = meta.device.ieeeAddr;
+                const frame = streamFrames[id] = ((streamFrames[id] || 0) + 1) & 0xFF;
+                addLightCluster(meta.device);
+                const endpoint = meta.device.getEndpoint(FIRST_ENDPOINT);
+                const options = {manufacturerCode: 0x1234, disableDefaultResponse: true};
+                for (const chunk of encodeStreamChunks(pixels)) {
+                    await endpoint.command(LIGHT_CLUSTER, 'streamChunk', {frame, segment, ...chunk}, options);
+                }
+                await endpoint.command(LIGHT_CLUSTER, 'streamPresent', {frame, segments: 1 << segment}, options);
+            },
+        },
+        {
+            key: ['set_segments'],
+            convertSet: async (entity, key, value, meta) => {
+                const segments = [].concat(value.segments || Object.keys(segmentEndpoints));
+                let mask = 0;
+                for (const name of segments) {
+                    if (segmentEndpoints[name] === undefined) {
+                        throw new Error(`Segment inconnu: ${name}`);
+                    }
+                    mask |= 1 << (segmentEndpoints[name] - FIRST_ENDPOINT);
+                }
+                const onOff = value.state === undefined ? KEEP_U8 : (String(value.state).toUpperCase() === 'ON' ? 1 : 0);
+                addLightCluster(meta.device);
+                const endpoint = meta.device.getEndpoint(FIRST_ENDPOINT);
+                await endpoint.command(LIGHT_CLUSTER, 'setSegment',
+                    {segments: mask, onOff, ...lightCommandPayload(value)},
+                    {manufacturerCode: 0x1234, disableDefaultResponse: true});
+                const state = lightCommandState(value);
+                if (value.state !== undefined) state.state = onOff ? 'ON' : 'OFF';
+                const result = {};
+                for (const name of segments) {
+                    for (const [k, v] of Object.entries(state)) {
+                        result[`${k}_${name}`] = v;
+                    }
+                }
+                return {state: result};
+            },
+        },
+        {
+            key: ['sync_group'],
+            convertSet: async (entity, key, value, meta) => {
+                const group = Math.max(0, Math.min(0xFFF7, Math.round(Number(value))));
+                addLightCluster(meta.device);
+                await meta.device.getEndpoint(FIRST_ENDPOINT).write(LIGHT_CLUSTER, {syncGroup: group},
+                    {manufacturerCode: 0x1234});
+                return {state: {sync_group: group}};
+            },
+            convertGet: async (entity, key, meta) => {
+                addLightCluster(meta.device);
+                await meta.device.getEndpoint(FIRST_ENDPOINT).read(LIGHT_CLUSTER, ['syncGroup'],
+                    {manufacturerCode: 0x1234});
+            },
+        },
+        {
+            key: ['sync_state', 'sync_offset', 'sync_error', 'sync_drift'],
+            convertGet: async (entity, key, meta) => {
+                addLightCluster(meta.device);
+                await meta.device.getEndpoint(FIRST_ENDPOINT).read(LIGHT_CLUSTER,
+                    ['syncState', 'syncOffset', 'syncDrift', 'syncError', 'syncSource'], {manufacturerCode: 0x1234});
+            },
+        },
+        {
+            key: ['sync_effects'],
+            convertSet: async (entity, key, value, meta) => {
+                // Le coordinateur (adresse 0) prime sur le meneur : son temps devient celui du groupe,
+                // les animations repartent de maintenant sur tous les membres qui recoivent la balise
+                const time = Date.now() % 0x100000000;
+                if (meta.device) {
+                    addLightCluster(meta.device);
+                }
+                await entity.command(LIGHT_CLUSTER, 'timeSync', {time, epoch: time},
+                    {manufacturerCode: 0x1234, disableDefaultResponse: true});
+            },
+        },
+        {
+            key: ['pairing_window'],
+            convertSet: async (entity, key, value, meta) => {
+                let modes = Array.isArray(value) ? value : (value.modes ?? ['binding']);
+                if (typeof modes === 'string') {
+                    modes = modes.split(',').map((m) => m.trim());
+                }
+                const mask = modes.reduce((acc, m) => {
+                    if (PAIRING_MODES[m] === undefined) {
+                        throw new Error(`Mode d'appairage inconnu : ${m}`);
+                    }
+                    return acc | PAIRING_MODES[m];
+                }, 0);
+                const duration = Math.max(0, Math.min(0xFFFF, Math.round(Number(value.duration ?? 0))));
+                addLightCluster(meta.device);
+                await meta.device.getEndpoint(FIRST_ENDPOINT).command(LIGHT_CLUSTER, 'commission',
+                    {modes: mask, duration}, {manufacturerCode: 0x1234});
             },
         },
         {
@@ -92,19 +694,133 @@ const definition = {
                 return {state: {speed_twinkle: speed}};
             },
         },
+        {
+            key: ['fade'],
+            convertSet: async (entity, key, value, meta) => {
+                await entity.write('lightingColorCtrl', {
+                    '61445': {value: Buffer.from(encodeFade(value)), type: 0x41},
+                }, {manufacturerCode: 0x1234});
+                return {state: {fade: value}};
+            },
+        },
+        {
+            key: ['level_curve', 'level_curve_points'],
+            convertSet: async (entity, key, value, meta) => {
+                if (key === 'level_curve') {
+                    const id = LEVEL_CURVES.indexOf(String(value).toLowerCase());
+                    if (id < 0) {
+                        throw new Error(`Courbe inconnue : '${value}'`);
+                    }
+                    await entity.write('lightingColorCtrl', {
+                        '61446': {value: id, type: 0x20},
+                    }, {manufacturerCode: 0x1234});
+                    return {state: {level_curve: LEVEL_CURVES[id]}};
+                }
+                await entity.write('lightingColorCtrl', {
+                    '61447': {value: Buffer.from(parseLevelCurvePoints(value)), type: 0x41},
+                }, {manufacturerCode: 0x1234});
+                return {state: {level_curve_points: value}};
+            },
+        },
+        {
+            key: ['color_calibration'],
+            convertSet: async (entity, key, value, meta) => {
+                await entity.write('lightingColorCtrl', {
+                    '61448': {value: Buffer.from(encodeColorCalibration(value)), type: 0x41},
+                }, {manufacturerCode: 0x1234});
+                return {state: {color_calibration: value}};
+            },
+        },
+        {
+            key: ['strip_type', 'white_point'],
+            convertSet: async (entity, key, value, meta) => {
+                let bytes;
+                if (key === 'strip_type') {
+                    const id = STRIP_TYPES.indexOf(String(value).toLowerCase());
+                    if (id < 0) {
+                        throw new Error(`Type de ruban inconnu : '${value}'`);
+                    }
+                    bytes = [id];
+                } else {
+                    const match = String(value).match(/^#?([0-9a-fA-F]{6})$/);
+                    if (!match) {
+                        throw new Error(`Point blanc invalide : '${value}' (attendu #rrggbb)`);
+                    }
+                    const rgb = parseInt(match[1], 16);
+                    const type = STRIP_TYPES.indexOf(meta.state.strip_type);
+                    bytes = [type < 0 ? STRIP_TYPES.indexOf('sk6812_rgbw') : type,
+                        (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF];
+                }
+                await entity.write('lightingColorCtrl', {
+                    '61449': {value: Buffer.from(bytes), type: 0x41},
+                }, {manufacturerCode: 0x1234});
+                return {state: {[key]: value}};
+            },
+        },
+        {
+            key: ['gradient', 'gradient_stops'],
+            convertSet: async (entity, key, value, meta) => {
+                let bytes;
+                if (key === 'gradient') {
+                    const id = GRADIENTS.indexOf(String(value).toLowerCase());
+                    bytes = [id < 0 ? 0 : id];
+                } else {
+                    bytes = parseGradientStops(value);
+                }
+                await entity.write('lightingColorCtrl', {
+                    '61444': {value: Buffer.from(bytes), type: 0x41},
+                }, {manufacturerCode: 0x1234});
+                return key === 'gradient' ?
+                    {state: {gradient: GRADIENTS[bytes[0]]}} :
+                    {state: {gradient_stops: value}};
+            },
+        },
     ],
     
     configure: async (device, coordinatorEndpoint, logger) => {
-        const endpoint = device.getEndpoint(10);
-        
-        await reporting.bind(endpoint, coordinatorEndpoint, [
-            'genOnOff',
-            'genLevelCtrl',
-            'lightingColorCtrl',
-        ]);
-        
-        await reporting.onOff(endpoint);
-        await reporting.brightness(endpoint);
+        addLightCluster(device);
+        for (const id of Object.values(segmentEndpoints)) {
+            const endpoint = device.getEndpoint(id);
+            
+            await reporting.bind(endpoint, coordinatorEndpoint, [
+                'genOnOff',
+                'genLevelCtrl',
+                'lightingColorCtrl',
+            ]);
+            
+            // Memes seuils que le reporting configure par l'appareil (light_reports dans main.c)
+            await reporting.onOff(endpoint, {min: 0, max: 600});
+            await reporting.brightness(endpoint, {min: 1, max: 600, change: 3});
+            await endpoint.configureReporting('lightingColorCtrl', [
+                {attribute: 'currentX', minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 328},
+                {attribute: 'currentY', minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 328},
+                {attribute: 'colorTemperature', minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 10},
+                {attribute: 'colorMode', minimumReportInterval: 0, maximumReportInterval: 600, reportableChange: 0},
+            ]);
+            await endpoint.configureReporting('lightingColorCtrl', [
+                {attribute: {ID: 0xF000, type: 0x20}, minimumReportInterval: 0, maximumReportInterval: 600, reportableChange: 1},
+                {attribute: {ID: 0xF001, type: 0x20}, minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 1},
+                {attribute: {ID: 0xF002, type: 0x20}, minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 1},
+                {attribute: {ID: 0xF003, type: 0x20}, minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 1},
+                {attribute: {ID: 0xF00A, type: 0x41}, minimumReportInterval: 1, maximumReportInterval: 600, reportableChange: 0},
+            ], {manufacturerCode: 0x1234});
+            // Etat complet en une seule lecture
+            await endpoint.read('lightingColorCtrl', [0xF00A], {manufacturerCode: 0x1234});
+        }
+
+        // Puissance et courant estimes (0.5 W / 50 mA de variation minimum)
+        const endpoint = device.getEndpoint(FIRST_ENDPOINT);
+        // Synchronisation des effets : role et qualite de l'horloge du groupe
+        await reporting.bind(endpoint, coordinatorEndpoint, [LIGHT_CLUSTER]);
+        await endpoint.configureReporting(LIGHT_CLUSTER, [
+            {attribute: 'syncState', minimumReportInterval: 0, maximumReportInterval: 3600, reportableChange: 0},
+            {attribute: 'syncOffset', minimumReportInterval: 60, maximumReportInterval: 3600, reportableChange: 10},
+            {attribute: 'syncError', minimumReportInterval: 60, maximumReportInterval: 3600, reportableChange: 5},
+        ], {manufacturerCode: 0x1234});
+        await reporting.bind(endpoint, coordinatorEndpoint, ['haElectricalMeasurement']);
+        await reporting.readEletricalMeasurementMultiplierDivisors(endpoint);
+        await reporting.activePower(endpoint, {min: 5, max: 300, change: 5});
+        await reporting.rmsCurrent(endpoint, {min: 5, max: 300, change: 50});
     },
 };
 
@@ -0,0 +1,214 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_rmt.h"
+#include "esp_idf_version.h"
+
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 1, 0)
+#include "led_strip_spi.h"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Set RGB for a specific pixel
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ *
+ * @return
+ *      - ESP_OK: Set RGB for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set RGB for a specific pixel failed because of invalid parameters
+ *      - ESP_FAIL: Set RGB for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue);
+
+/**
+ * @brief Set RGBW for a specific pixel
+ *
+ * @note Only call this function if your led strip does have the white component (e.g. SK6812-RGBW)
+ * @note Also see `led_strip_set_pixel` if you only want to specify the RGB part of the color and bypass the white component
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ * @param white: separate white component
+ *
+ * @return
+ *      - ESP_OK: Set RGBW color for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set RGBW color for a specific pixel failed because of an invalid argument
+ *      - ESP_FAIL: Set RGBW color for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+/**
+ * @brief Set HSV for a specific pixel
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param hue: hue part of color (0 - 360)
+ * @param saturation: saturation part of color (0 - 255, rescaled from 0 - 1. e.g. saturation = 0.5, rescaled to 127)
+ * @param value: value part of color (0 - 255, rescaled from 0 - 1. e.g. value = 0.5, rescaled to 127)
+ *
+ * @return
+ *      - ESP_OK: Set HSV color for a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set HSV color for a specific pixel failed because of an invalid argument
+ *      - ESP_FAIL: Set HSV color for a specific pixel failed because other error occurred
+ */
+esp_err_t led_strip_set_pixel_hsv(led_strip_handle_t strip, uint32_t index, uint16_t hue, uint8_t saturation, uint8_t value);
+
+/**
+ * @brief Set the palette index of a specific pixel, for strips created with a palette
+ *
+ * @param strip: LED strip
+ * @param index: index of pixel to set
+ * @param color_index: index of the color in the palette (0-15 or 0-255)
+ *
+ * @return
+ *      - ESP_OK: Set the index of a specific pixel successfully
+ *      - ESP_ERR_INVALID_ARG: Set the index failed because of invalid parameters
+ *      - ESP_ERR_INVALID_STATE: The strip doesn't use a palette
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support palettes
+ */
+esp_err_t led_strip_set_pixel_index(led_strip_handle_t strip, uint32_t index, uint32_t color_index);
+
+/**
+ * @brief Set a color of the palette, for strips created with a palette
+ *
+ * @param strip: LED strip
+ * @param entry: index of the color in the palette (0-15 or 0-255)
+ * @param red: red part of color
+ * @param green: green part of color
+ * @param blue: blue part of color
+ * @param white: separate white component (ignored by RGB strips)
+ *
+ * @return
+ *      - ESP_OK: Set the palette color successfully
+ *      - ESP_ERR_INVALID_ARG: Set the palette color failed because of invalid parameters
+ *      - ESP_ERR_INVALID_STATE: The strip doesn't use a palette
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support palettes
+ *
+ * @note:
+ *      The palette is expanded when the frame is encoded: changing a color updates every pixel using it,
+ *      at the cost of a single call.
+ */
+esp_err_t led_strip_set_palette_entry(led_strip_handle_t strip, uint32_t entry, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+/**
+ * @brief Refresh memory colors to LEDs
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Refresh successfully
+ *      - ESP_FAIL: Refresh failed because some other error occurred
+ *
+ * @note:
+ *      After updating the LED colors in the memory, a following invocation of this API is needed to flush colors to strip.
+ */
+esp_err_t led_strip_refresh(led_strip_handle_t strip);
+
+/**
+ * @brief Start flushing memory colors to LEDs, return without waiting for the transmission to finish
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Transmission started successfully
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support asynchronous refresh
+ *      - ESP_FAIL: Start transmission failed because some other error occurred
+ *
+ * @note:
+ *      Several strips can be refreshed in parallel by calling this API on each of them, then `led_strip_refresh_wait`.
+ *      The pixels of the strip must not be modified until `led_strip_refresh_wait` returns, except with the SPI
+ *      backend which encodes the frame into its own buffer: with DMA, calling this API again encodes the next frame
+ *      while the previous one is still being transmitted (double buffering).
+ */
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip);
+
+/**
+ * @brief Wait for the transmission started by `led_strip_refresh_async` to finish
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Transmission finished
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support asynchronous refresh
+ *      - ESP_FAIL: Wait failed because some other error occurred
+ */
+esp_err_t led_strip_refresh_wait(led_strip_handle_t strip);
+
+/**
+ * @brief Set the output stage of the LED strip, applied from the next refresh
+ *
+ * @param strip: LED strip
+ * @param config: Output stage configuration (copied, except the lookup tables which are referenced)
+ *
+ * @return
+ *      - ESP_OK: Output stage set successfully
+ *      - ESP_ERR_INVALID_ARG: Set output stage failed because of invalid parameters
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support an output stage
+ *
+ * @note:
+ *      The transformation is done while encoding the frame: changing the global brightness or the color
+ *      correction only needs a refresh, the pixels don't have to be set again.
+ */
+esp_err_t led_strip_set_output(led_strip_handle_t strip, const led_strip_output_config_t *config);
+
+/**
+ * @brief Produce the pixels of the LED strip with a generator, applied from the next refresh
+ *
+ * @param strip: LED strip
+ * @param generator: Pixel generator, called while the frame is transmitted. NULL to send the pixel buffer again
+ * @param user_ctx: Context passed to the generator
+ *
+ * @return
+ *      - ESP_OK: Generator set successfully
+ *      - ESP_ERR_INVALID_ARG: Set generator failed because of invalid parameters
+ *      - ESP_ERR_INVALID_STATE: The strip has no pixel buffer, a generator is required
+ *      - ESP_ERR_NOT_SUPPORTED: The backend doesn't support pixel generators
+ *
+ * @note:
+ *      Combined with the `without_framebuffer` flag of the RMT backend, procedural effects need no memory per LED.
+ *      The output stage (see `led_strip_set_output`) is applied to the generated pixels.
+ */
+esp_err_t led_strip_set_pixel_generator(led_strip_handle_t strip, led_strip_pixel_generator_t generator, void *user_ctx);
+
+/**
+ * @brief Clear LED strip (turn off all LEDs)
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Clear LEDs successfully
+ *      - ESP_FAIL: Clear LEDs failed because some other error occurred
+ */
+esp_err_t led_strip_clear(led_strip_handle_t strip);
+
+/**
+ * @brief Free LED strip resources
+ *
+ * @param strip: LED strip
+ *
+ * @return
+ *      - ESP_OK: Free resources successfully
+ *      - ESP_FAIL: Free resources failed because error occurred
+ */
+esp_err_t led_strip_del(led_strip_handle_t strip);
+
+#ifdef __cplusplus
+}
+#endif
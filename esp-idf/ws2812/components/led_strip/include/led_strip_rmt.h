@@ -29,8 +29,12 @@ typedef struct {
     uint32_t resolution_hz;     /*!< RMT tick resolution, if set to zero, a default resolution (10MHz) will be applied */
 #endif
     size_t mem_block_symbols;   /*!< How many RMT symbols can one RMT channel hold at one time. Set to 0 will fallback to use the default size. */
+    uint8_t palette_bits;       /*!< 0: each pixel stores its color. 4 or 8: each pixel stores an index into a palette of 16 or 256 colors,
+                                     set with `led_strip_set_pixel_index` and `led_strip_set_palette_entry` */
     struct {
         uint32_t with_dma: 1;   /*!< Use DMA to transmit data */
+        uint32_t without_framebuffer: 1; /*!< Don't allocate the pixel buffer, the pixels are produced by the generator
+                                              set with `led_strip_set_pixel_generator` while the frame is transmitted */
     } flags;                    /*!< Extra driver flags */
 } led_strip_rmt_config_t;
 
@@ -48,6 +52,26 @@ typedef struct {
  */
 esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip);
 
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 0, 0)
+/**
+ * @brief Synchronize the transmissions of several RMT LED strips
+ *
+ * Once grouped, the RMT channels of the strips stay enabled and the transmissions started by
+ * `led_strip_refresh_async` only go out on the wire when every strip of the group has been refreshed,
+ * so all the strips start sending their pixels at the same time.
+ *
+ * @param strips Array of LED strips created by `led_strip_new_rmt_device`
+ * @param num_strips Number of strips in the array
+ * @param ret_synchro Returned RMT sync manager handle
+ * @return
+ *      - ESP_OK: Create sync group successfully
+ *      - ESP_ERR_INVALID_ARG: Create sync group failed because of invalid argument
+ *      - ESP_ERR_NOT_SUPPORTED: The target doesn't support RMT TX synchronization
+ *      - ESP_FAIL: Create sync group failed because some other error
+ */
+esp_err_t led_strip_rmt_new_sync_group(const led_strip_handle_t *strips, size_t num_strips, rmt_sync_manager_handle_t *ret_synchro);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,101 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief LED strip pixel format
+ */
+typedef enum {
+    LED_PIXEL_FORMAT_GRB,    /*!< Pixel format: GRB */
+    LED_PIXEL_FORMAT_GRBW,   /*!< Pixel format: GRBW */
+    LED_PIXEL_FORMAT_INVALID /*!< Invalid pixel format */
+} led_pixel_format_t;
+
+/**
+ * @brief LED strip model
+ * @note Different led model may have different timing parameters, so we need to distinguish them.
+ */
+typedef enum {
+    LED_MODEL_WS2812, /*!< LED strip model: WS2812 */
+    LED_MODEL_SK6812, /*!< LED strip model: SK6812 */
+    LED_MODEL_INVALID /*!< Invalid LED strip model */
+} led_model_t;
+
+/**
+ * @brief LED strip handle
+ */
+typedef struct led_strip_t *led_strip_handle_t;
+
+/**
+ * @brief Maximum number of zones of the output stage
+ */
+#define LED_STRIP_MAX_ZONES 8
+
+/**
+ * @brief Range of LEDs sharing the same brightness in the output stage
+ */
+typedef struct {
+    uint32_t start;          /*!< First LED of the zone */
+    uint32_t count;          /*!< Number of LEDs in the zone */
+    uint16_t scale;          /*!< Brightness of the zone, applied after the lookup tables (65535 = unchanged) */
+} led_strip_zone_t;
+
+/**
+ * @brief Output stage configuration: transformation applied to the pixels while they are sent to the LEDs
+ *
+ * @note Pixels are stored as they are set, so changing the output stage doesn't require to set them again.
+ */
+typedef struct {
+    const uint16_t (*lut)[256];  /*!< One lookup table per component (R, G, B, then W for RGBW strips), 8.8 fixed point output.
+                                      NULL for identity. The tables must stay valid and unchanged while they are in use */
+    led_strip_zone_t zones[LED_STRIP_MAX_ZONES]; /*!< Zones sorted by start index, LEDs outside any zone are not scaled */
+    uint8_t num_zones;           /*!< Number of valid entries in `zones` */
+    uint8_t white_point[3];      /*!< Color of the white LED at full power, expressed in R, G, B, used by `flags.extract_white`.
+                                      {255, 255, 255} (or all zero) moves min(R, G, B) to the white channel */
+    struct {
+        uint32_t dither: 1;      /*!< Keep the fractional part of the lookup tables and zone brightness with a temporal dithering:
+                                      frame-to-frame error diffusion when the strip has a framebuffer (one extra byte per
+                                      component and LED), ordered pattern otherwise. Needs a steady refresh rate to be invisible */
+        uint32_t extract_white: 1; /*!< RGBW strips: the part of R, G, B that the white LED reproduces (see `white_point`) is moved
+                                      to W before the lookup tables. Ignored for 3-component formats */
+    } flags;                     /*!< Extra output flags */
+} led_strip_output_config_t;
+
+/**
+ * @brief Pixel generator, produces the color of a LED while the frame is being transmitted
+ *
+ * @note Called from the transmission interrupt, a few pixels at a time: it must be short and must not block.
+ *
+ * @param index Index of the LED
+ * @param time_ms Time of the frame (captured when the refresh started), in milliseconds
+ * @param color Components to fill, in native order (R, G, B, then W for RGBW strips)
+ * @param user_ctx User context given to `led_strip_set_pixel_generator`
+ */
+typedef void (*led_strip_pixel_generator_t)(uint32_t index, uint32_t time_ms, uint8_t *color, void *user_ctx);
+
+/**
+ * @brief LED Strip Configuration
+ */
+typedef struct {
+    int strip_gpio_num;      /*!< GPIO number that used by LED strip */
+    uint32_t max_leds;       /*!< Maximum LEDs in a single strip */
+    led_pixel_format_t led_pixel_format; /*!< LED pixel format */
+    led_model_t led_model;   /*!< LED model */
+
+    struct {
+        uint32_t invert_out: 1; /*!< Invert output signal */
+    } flags;                    /*!< Extra driver flags */
+} led_strip_config_t;
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,177 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct led_strip_t led_strip_t; /*!< Type of LED strip */
+
+/**
+ * @brief LED strip interface definition
+ */
+struct led_strip_t {
+    /**
+     * @brief Set RGB for a specific pixel
+     *
+     * @param strip: LED strip
+     * @param index: index of pixel to set
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     *
+     * @return
+     *      - ESP_OK: Set RGB for a specific pixel successfully
+     *      - ESP_ERR_INVALID_ARG: Set RGB for a specific pixel failed because of invalid parameters
+     *      - ESP_FAIL: Set RGB for a specific pixel failed because other error occurred
+     */
+    esp_err_t (*set_pixel)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue);
+
+    /**
+     * @brief Set RGBW for a specific pixel. Similar to `set_pixel` but also set the white component
+     *
+     * @param strip: LED strip
+     * @param index: index of pixel to set
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     * @param white: separate white component
+     *
+     * @return
+     *      - ESP_OK: Set RGBW color for a specific pixel successfully
+     *      - ESP_ERR_INVALID_ARG: Set RGBW color for a specific pixel failed because of an invalid argument
+     *      - ESP_FAIL: Set RGBW color for a specific pixel failed because other error occurred
+     */
+    esp_err_t (*set_pixel_rgbw)(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+    /**
+     * @brief Set the palette index of a specific pixel (palette-indexed strips)
+     *
+     * @param strip: LED strip
+     * @param index: index of pixel to set
+     * @param color_index: index of the color in the palette
+     *
+     * @return
+     *      - ESP_OK: Set the index of a specific pixel successfully
+     *      - ESP_ERR_INVALID_ARG: Set the index failed because of invalid parameters
+     *      - ESP_ERR_INVALID_STATE: The strip doesn't use a palette
+     */
+    esp_err_t (*set_pixel_index)(led_strip_t *strip, uint32_t index, uint32_t color_index);
+
+    /**
+     * @brief Set a color of the palette (palette-indexed strips)
+     *
+     * @param strip: LED strip
+     * @param entry: index of the color in the palette
+     * @param red: red part of color
+     * @param green: green part of color
+     * @param blue: blue part of color
+     * @param white: separate white component
+     *
+     * @return
+     *      - ESP_OK: Set the palette color successfully
+     *      - ESP_ERR_INVALID_ARG: Set the palette color failed because of invalid parameters
+     *      - ESP_ERR_INVALID_STATE: The strip doesn't use a palette
+     */
+    esp_err_t (*set_palette_entry)(led_strip_t *strip, uint32_t entry, uint32_t red, uint32_t green, uint32_t blue, uint32_t white);
+
+    /**
+     * @brief Refresh memory colors to LEDs
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: timeout value for refreshing task
+     *
+     * @return
+     *      - ESP_OK: Refresh successfully
+     *      - ESP_FAIL: Refresh failed because some other error occurred
+     *
+     * @note:
+     *      After updating the LED colors in the memory, a following invocation of this API is needed to flush colors to strip.
+     */
+    esp_err_t (*refresh)(led_strip_t *strip);
+
+    /**
+     * @brief Start flushing memory colors to LEDs, without waiting for the transmission to finish
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Transmission started successfully
+     *      - ESP_FAIL: Start transmission failed because some other error occurred
+     *
+     * @note:
+     *      The pixel buffer must not be modified until `refresh_wait` returns.
+     */
+    esp_err_t (*refresh_async)(led_strip_t *strip);
+
+    /**
+     * @brief Wait for the transmission started by `refresh_async` to finish
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Transmission finished
+     *      - ESP_FAIL: Wait failed because some other error occurred
+     */
+    esp_err_t (*refresh_wait)(led_strip_t *strip);
+
+    /**
+     * @brief Set the output stage (lookup tables, zone brightness, dithering), applied from the next refresh
+     *
+     * @param strip: LED strip
+     * @param config: output stage configuration, copied by the driver
+     *
+     * @return
+     *      - ESP_OK: Output stage set successfully
+     *      - ESP_ERR_INVALID_ARG: Set output stage failed because of an invalid argument
+     */
+    esp_err_t (*set_output)(led_strip_t *strip, const led_strip_output_config_t *config);
+
+    /**
+     * @brief Produce the pixels with a generator instead of the pixel buffer, from the next refresh
+     *
+     * @param strip: LED strip
+     * @param generator: pixel generator, NULL to use the pixel buffer again
+     * @param user_ctx: context passed to the generator
+     *
+     * @return
+     *      - ESP_OK: Generator set successfully
+     *      - ESP_ERR_INVALID_STATE: No generator and no pixel buffer
+     */
+    esp_err_t (*set_pixel_generator)(led_strip_t *strip, led_strip_pixel_generator_t generator, void *user_ctx);
+
+    /**
+     * @brief Clear LED strip (turn off all LEDs)
+     *
+     * @param strip: LED strip
+     * @param timeout_ms: timeout value for clearing task
+     *
+     * @return
+     *      - ESP_OK: Clear LEDs successfully
+     *      - ESP_FAIL: Clear LEDs failed because some other error occurred
+     */
+    esp_err_t (*clear)(led_strip_t *strip);
+
+    /**
+     * @brief Free LED strip resources
+     *
+     * @param strip: LED strip
+     *
+     * @return
+     *      - ESP_OK: Free resources successfully
+     *      - ESP_FAIL: Free resources failed because error occurred
+     */
+    esp_err_t (*del)(led_strip_t *strip);
+};
+
+#ifdef __cplusplus
+}
+#endif
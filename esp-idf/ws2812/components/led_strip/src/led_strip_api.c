@@ -75,12 +75,54 @@ esp_err_t led_strip_set_pixel_rgbw(led_strip_handle_t strip, uint32_t index, uin
     return strip->set_pixel_rgbw(strip, index, red, green, blue, white);
 }
 
+esp_err_t led_strip_set_pixel_index(led_strip_handle_t strip, uint32_t index, uint32_t color_index)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_pixel_index, ESP_ERR_NOT_SUPPORTED, TAG, "palette not supported");
+    return strip->set_pixel_index(strip, index, color_index);
+}
+
+esp_err_t led_strip_set_palette_entry(led_strip_handle_t strip, uint32_t entry, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_palette_entry, ESP_ERR_NOT_SUPPORTED, TAG, "palette not supported");
+    return strip->set_palette_entry(strip, entry, red, green, blue, white);
+}
+
 esp_err_t led_strip_refresh(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
     return strip->refresh(strip);
 }
 
+esp_err_t led_strip_refresh_async(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->refresh_async, ESP_ERR_NOT_SUPPORTED, TAG, "async refresh not supported");
+    return strip->refresh_async(strip);
+}
+
+esp_err_t led_strip_refresh_wait(led_strip_handle_t strip)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->refresh_wait, ESP_ERR_NOT_SUPPORTED, TAG, "async refresh not supported");
+    return strip->refresh_wait(strip);
+}
+
+esp_err_t led_strip_set_output(led_strip_handle_t strip, const led_strip_output_config_t *config)
+{
+    ESP_RETURN_ON_FALSE(strip && config, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_output, ESP_ERR_NOT_SUPPORTED, TAG, "output stage not supported");
+    return strip->set_output(strip, config);
+}
+
+esp_err_t led_strip_set_pixel_generator(led_strip_handle_t strip, led_strip_pixel_generator_t generator, void *user_ctx)
+{
+    ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    ESP_RETURN_ON_FALSE(strip->set_pixel_generator, ESP_ERR_NOT_SUPPORTED, TAG, "pixel generator not supported");
+    return strip->set_pixel_generator(strip, generator, user_ctx);
+}
+
 esp_err_t led_strip_clear(led_strip_handle_t strip)
 {
     ESP_RETURN_ON_FALSE(strip, ESP_ERR_INVALID_ARG, TAG, "invalid argument");
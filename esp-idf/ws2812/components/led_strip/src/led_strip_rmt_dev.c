@@ -0,0 +1,341 @@
+/*
+ * SPDX-FileCopyrightText: 2022-2023 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "driver/rmt_tx.h"
+#include "soc/soc_caps.h"
+#include "led_strip.h"
+#include "led_strip_interface.h"
+#include "led_strip_rmt_encoder.h"
+
+#define LED_STRIP_RMT_DEFAULT_RESOLUTION 10000000 // 10MHz resolution
+#define LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE 4
+// the memory size of each RMT channel, in words (4 bytes)
+#if CONFIG_IDF_TARGET_ESP32 || CONFIG_IDF_TARGET_ESP32S2
+#define LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS 64
+#else
+#define LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS 48
+#endif
+
+static const char *TAG = "led_strip_rmt";
+
+typedef struct {
+    led_strip_t base;
+    rmt_channel_handle_t rmt_chan;
+    rmt_encoder_handle_t strip_encoder;
+    uint32_t strip_len;
+    uint8_t bytes_per_pixel;
+    bool enabled;        // RMT channel currently enabled
+    bool keep_enabled;   // channel belongs to a sync group, never disable it between frames
+    bool output_pending; // `output` must be handed to the encoder at the next refresh
+    led_strip_output_config_t output;
+    led_strip_pixel_generator_t generator; // pixel source, NULL to send pixel_buf
+    void *generator_ctx;
+    uint8_t palette_bits;               // 0 when pixel_buf holds colors, else bits per palette index
+    uint8_t (*palette)[4];              // palette in native order (R, G, B, W), points to pixel_mem
+    uint8_t *pixel_buf;  // points to pixel_mem, NULL without framebuffer
+    uint8_t *dither_error; // quantization error carried between frames, allocated when dithering is first enabled
+    uint8_t pixel_mem[];
+} led_strip_rmt_obj;
+
+static size_t led_strip_rmt_pixel_buf_size(uint32_t strip_len, uint8_t bytes_per_pixel, uint8_t palette_bits)
+{
+    if (palette_bits) {
+        return (strip_len * palette_bits + 7) / 8;
+    }
+    return strip_len * bytes_per_pixel;
+}
+
+// Pixel source of a strip without framebuffer nor generator: every LED off
+static void led_strip_rmt_black_pixel(uint32_t index, uint32_t time_ms, uint8_t *color, void *user_ctx)
+{
+}
+
+static esp_err_t led_strip_rmt_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(rmt_strip->pixel_buf, ESP_ERR_INVALID_STATE, TAG, "strip created without framebuffer");
+    ESP_RETURN_ON_FALSE(!rmt_strip->palette_bits, ESP_ERR_INVALID_STATE, TAG, "strip uses a palette, set pixel indexes");
+    uint32_t start = index * rmt_strip->bytes_per_pixel;
+    // Native RGB order, the encoder sends the components in the order expected by the LEDs
+    rmt_strip->pixel_buf[start + 0] = red & 0xFF;
+    rmt_strip->pixel_buf[start + 1] = green & 0xFF;
+    rmt_strip->pixel_buf[start + 2] = blue & 0xFF;
+    if (rmt_strip->bytes_per_pixel > 3) {
+        rmt_strip->pixel_buf[start + 3] = 0;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(rmt_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
+    ESP_RETURN_ON_FALSE(rmt_strip->pixel_buf, ESP_ERR_INVALID_STATE, TAG, "strip created without framebuffer");
+    ESP_RETURN_ON_FALSE(!rmt_strip->palette_bits, ESP_ERR_INVALID_STATE, TAG, "strip uses a palette, set pixel indexes");
+    uint8_t *buf_start = rmt_strip->pixel_buf + index * 4;
+    // Native RGBW order, the encoder sends them as GRBW (SK6812 component order)
+    *buf_start = red & 0xFF;
+    *++buf_start = green & 0xFF;
+    *++buf_start = blue & 0xFF;
+    *++buf_start = white & 0xFF;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_pixel_index(led_strip_t *strip, uint32_t index, uint32_t color_index)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(index < rmt_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
+    ESP_RETURN_ON_FALSE(rmt_strip->palette_bits && rmt_strip->pixel_buf, ESP_ERR_INVALID_STATE, TAG, "strip doesn't use a palette");
+    ESP_RETURN_ON_FALSE(color_index < (1U << rmt_strip->palette_bits), ESP_ERR_INVALID_ARG, TAG, "color index out of palette");
+    if (rmt_strip->palette_bits == 8) {
+        rmt_strip->pixel_buf[index] = color_index;
+    } else {
+        // two pixels per byte, even pixel in the low nibble
+        uint8_t shift = (index & 1) * 4;
+        uint8_t *byte = &rmt_strip->pixel_buf[index >> 1];
+        *byte = (*byte & ~(0x0F << shift)) | (color_index << shift);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_palette_entry(led_strip_t *strip, uint32_t entry, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(rmt_strip->palette_bits, ESP_ERR_INVALID_STATE, TAG, "strip doesn't use a palette");
+    ESP_RETURN_ON_FALSE(entry < (1U << rmt_strip->palette_bits), ESP_ERR_INVALID_ARG, TAG, "entry out of palette");
+    uint8_t *color = rmt_strip->palette[entry];
+    color[0] = red & 0xFF;
+    color[1] = green & 0xFF;
+    color[2] = blue & 0xFF;
+    color[3] = white & 0xFF;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_refresh_async(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    rmt_transmit_config_t tx_conf = {
+        .loop_count = 0,
+    };
+
+    if (!rmt_strip->enabled) {
+        ESP_RETURN_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), TAG, "enable RMT channel failed");
+        rmt_strip->enabled = true;
+    }
+    // the previous frame is done (refresh_wait), the encoder is idle
+    if (rmt_strip->output_pending) {
+        rmt_led_strip_encoder_set_output(rmt_strip->strip_encoder, &rmt_strip->output);
+        rmt_strip->output_pending = false;
+    }
+    led_strip_encoder_source_t source = {
+        .num_pixels = rmt_strip->strip_len,
+        .generator = rmt_strip->generator,
+        .generator_ctx = rmt_strip->generator_ctx,
+        .time_ms = (uint32_t)(esp_timer_get_time() / 1000),
+        .palette = rmt_strip->palette_bits ? (const uint8_t (*)[4])rmt_strip->palette : NULL,
+        .palette_bits = rmt_strip->palette_bits,
+        .dither_error = rmt_strip->dither_error,
+    };
+    if (!source.generator && !rmt_strip->pixel_buf) {
+        source.generator = led_strip_rmt_black_pixel;
+    }
+    rmt_led_strip_encoder_set_source(rmt_strip->strip_encoder, &source);
+    // with a generator the payload is not read, but RMT requires one
+    const void *payload = rmt_strip->pixel_buf ? (const void *)rmt_strip->pixel_buf : (const void *)rmt_strip;
+    size_t payload_size = rmt_strip->pixel_buf ? led_strip_rmt_pixel_buf_size(rmt_strip->strip_len, rmt_strip->bytes_per_pixel, rmt_strip->palette_bits) : 1;
+    ESP_RETURN_ON_ERROR(rmt_transmit(rmt_strip->rmt_chan, rmt_strip->strip_encoder, payload,
+                                     payload_size, &tx_conf), TAG, "transmit pixels by RMT failed");
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_refresh_wait(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(rmt_strip->rmt_chan, -1), TAG, "flush RMT channel failed");
+    if (rmt_strip->enabled && !rmt_strip->keep_enabled) {
+        ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+        rmt_strip->enabled = false;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_refresh(led_strip_t *strip)
+{
+    ESP_RETURN_ON_ERROR(led_strip_rmt_refresh_async(strip), TAG, "start refresh failed");
+    return led_strip_rmt_refresh_wait(strip);
+}
+
+static esp_err_t led_strip_rmt_set_output(led_strip_t *strip, const led_strip_output_config_t *config)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    ESP_RETURN_ON_FALSE(config->num_zones <= LED_STRIP_MAX_ZONES, ESP_ERR_INVALID_ARG, TAG, "too many zones");
+    // error diffusion needs one byte per component and LED: only with a framebuffer, the
+    // strips without one are meant to be too long for it and keep the ordered dithering
+    if (config->flags.dither && rmt_strip->pixel_buf && !rmt_strip->dither_error) {
+        rmt_strip->dither_error = calloc(rmt_strip->strip_len, rmt_strip->bytes_per_pixel);
+        if (!rmt_strip->dither_error) {
+            ESP_LOGW(TAG, "no mem for dithering error, fall back to ordered dithering");
+        }
+    }
+    rmt_strip->output = *config;
+    rmt_strip->output_pending = true;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_set_pixel_generator(led_strip_t *strip, led_strip_pixel_generator_t generator, void *user_ctx)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    rmt_strip->generator = generator;
+    rmt_strip->generator_ctx = user_ctx;
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_rmt_clear(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    if (!rmt_strip->pixel_buf) {
+        // without framebuffer, drop the generator: every LED is sent off
+        rmt_strip->generator = NULL;
+        return led_strip_rmt_refresh(strip);
+    }
+    // Write zero to turn off all leds (with a palette: every pixel on entry 0, set to black)
+    memset(rmt_strip->pixel_buf, 0, led_strip_rmt_pixel_buf_size(rmt_strip->strip_len, rmt_strip->bytes_per_pixel, rmt_strip->palette_bits));
+    if (rmt_strip->palette_bits) {
+        memset(rmt_strip->palette[0], 0, sizeof(rmt_strip->palette[0]));
+    }
+    return led_strip_rmt_refresh(strip);
+}
+
+static esp_err_t led_strip_rmt_del(led_strip_t *strip)
+{
+    led_strip_rmt_obj *rmt_strip = __containerof(strip, led_strip_rmt_obj, base);
+    if (rmt_strip->enabled) {
+        ESP_RETURN_ON_ERROR(rmt_disable(rmt_strip->rmt_chan), TAG, "disable RMT channel failed");
+    }
+    ESP_RETURN_ON_ERROR(rmt_del_channel(rmt_strip->rmt_chan), TAG, "delete RMT channel failed");
+    ESP_RETURN_ON_ERROR(rmt_del_encoder(rmt_strip->strip_encoder), TAG, "delete strip encoder failed");
+    free(rmt_strip->dither_error);
+    free(rmt_strip);
+    return ESP_OK;
+}
+
+esp_err_t led_strip_new_rmt_device(const led_strip_config_t *led_config, const led_strip_rmt_config_t *rmt_config, led_strip_handle_t *ret_strip)
+{
+    led_strip_rmt_obj *rmt_strip = NULL;
+    esp_err_t ret = ESP_OK;
+    ESP_GOTO_ON_FALSE(led_config && rmt_config && ret_strip, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(led_config->led_pixel_format < LED_PIXEL_FORMAT_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led_pixel_format");
+    uint8_t bytes_per_pixel = 3;
+    if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRBW) {
+        bytes_per_pixel = 4;
+    } else if (led_config->led_pixel_format == LED_PIXEL_FORMAT_GRB) {
+        bytes_per_pixel = 3;
+    } else {
+        assert(false);
+    }
+    ESP_GOTO_ON_FALSE(rmt_config->palette_bits == 0 || rmt_config->palette_bits == 4 || rmt_config->palette_bits == 8,
+                      ESP_ERR_INVALID_ARG, err, TAG, "palette_bits must be 0, 4 or 8");
+    size_t palette_size = rmt_config->palette_bits ? (1U << rmt_config->palette_bits) * 4 : 0;
+    size_t pixel_buf_size = rmt_config->flags.without_framebuffer ? 0 :
+                            led_strip_rmt_pixel_buf_size(led_config->max_leds, bytes_per_pixel, rmt_config->palette_bits);
+    rmt_strip = calloc(1, sizeof(led_strip_rmt_obj) + palette_size + pixel_buf_size);
+    ESP_GOTO_ON_FALSE(rmt_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for rmt strip");
+    rmt_strip->palette_bits = rmt_config->palette_bits;
+    rmt_strip->palette = palette_size ? (uint8_t (*)[4])rmt_strip->pixel_mem : NULL;
+    rmt_strip->pixel_buf = pixel_buf_size ? rmt_strip->pixel_mem + palette_size : NULL;
+    uint32_t resolution = rmt_config->resolution_hz ? rmt_config->resolution_hz : LED_STRIP_RMT_DEFAULT_RESOLUTION;
+
+    // for backward compatibility, if the user does not set the clk_src, use the default value
+    rmt_clock_source_t clk_src = RMT_CLK_SRC_DEFAULT;
+    if (rmt_config->clk_src) {
+        clk_src = rmt_config->clk_src;
+    }
+    size_t mem_block_symbols = LED_STRIP_RMT_DEFAULT_MEM_BLOCK_SYMBOLS;
+    // override the default value if the user sets it
+    if (rmt_config->mem_block_symbols) {
+        mem_block_symbols = rmt_config->mem_block_symbols;
+    }
+    rmt_tx_channel_config_t rmt_chan_config = {
+        .clk_src = clk_src,
+        .gpio_num = led_config->strip_gpio_num,
+        .mem_block_symbols = mem_block_symbols,
+        .resolution_hz = resolution,
+        .trans_queue_depth = LED_STRIP_RMT_DEFAULT_TRANS_QUEUE_SIZE,
+        .flags.with_dma = rmt_config->flags.with_dma,
+        .flags.invert_out = led_config->flags.invert_out,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&rmt_chan_config, &rmt_strip->rmt_chan), err, TAG, "create RMT TX channel failed");
+
+    led_strip_encoder_config_t strip_encoder_conf = {
+        .resolution = resolution,
+        .led_model = led_config->led_model,
+        .led_pixel_format = led_config->led_pixel_format,
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_led_strip_encoder(&strip_encoder_conf, &rmt_strip->strip_encoder), err, TAG, "create LED strip encoder failed");
+
+
+    rmt_strip->bytes_per_pixel = bytes_per_pixel;
+    rmt_strip->strip_len = led_config->max_leds;
+    rmt_strip->base.set_pixel = led_strip_rmt_set_pixel;
+    rmt_strip->base.set_pixel_rgbw = led_strip_rmt_set_pixel_rgbw;
+    rmt_strip->base.set_pixel_index = led_strip_rmt_set_pixel_index;
+    rmt_strip->base.set_palette_entry = led_strip_rmt_set_palette_entry;
+    rmt_strip->base.refresh = led_strip_rmt_refresh;
+    rmt_strip->base.refresh_async = led_strip_rmt_refresh_async;
+    rmt_strip->base.refresh_wait = led_strip_rmt_refresh_wait;
+    rmt_strip->base.set_output = led_strip_rmt_set_output;
+    rmt_strip->base.set_pixel_generator = led_strip_rmt_set_pixel_generator;
+    rmt_strip->base.clear = led_strip_rmt_clear;
+    rmt_strip->base.del = led_strip_rmt_del;
+
+    *ret_strip = &rmt_strip->base;
+    return ESP_OK;
+err:
+    if (rmt_strip) {
+        if (rmt_strip->rmt_chan) {
+            rmt_del_channel(rmt_strip->rmt_chan);
+        }
+        if (rmt_strip->strip_encoder) {
+            rmt_del_encoder(rmt_strip->strip_encoder);
+        }
+        free(rmt_strip);
+    }
+    return ret;
+}
+
+esp_err_t led_strip_rmt_new_sync_group(const led_strip_handle_t *strips, size_t num_strips, rmt_sync_manager_handle_t *ret_synchro)
+{
+#if SOC_RMT_SUPPORT_TX_SYNCHRO
+    ESP_RETURN_ON_FALSE(strips && num_strips > 0 && num_strips <= SOC_RMT_TX_CANDIDATES_PER_GROUP && ret_synchro,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid argument");
+    rmt_channel_handle_t channels[SOC_RMT_TX_CANDIDATES_PER_GROUP] = {0};
+    for (size_t i = 0; i < num_strips; i++) {
+        ESP_RETURN_ON_FALSE(strips[i], ESP_ERR_INVALID_ARG, TAG, "invalid strip");
+        led_strip_rmt_obj *rmt_strip = __containerof(strips[i], led_strip_rmt_obj, base);
+        // the sync manager only accepts enabled channels
+        if (!rmt_strip->enabled) {
+            ESP_RETURN_ON_ERROR(rmt_enable(rmt_strip->rmt_chan), TAG, "enable RMT channel failed");
+            rmt_strip->enabled = true;
+        }
+        rmt_strip->keep_enabled = true;
+        channels[i] = rmt_strip->rmt_chan;
+    }
+    rmt_sync_manager_config_t sync_config = {
+        .tx_channel_array = channels,
+        .array_size = num_strips,
+    };
+    return rmt_new_sync_manager(&sync_config, ret_synchro);
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
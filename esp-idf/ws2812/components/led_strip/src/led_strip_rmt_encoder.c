@@ -0,0 +1,287 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "esp_check.h"
+#include "led_strip_rmt_encoder.h"
+
+static const char *TAG = "led_rmt_encoder";
+
+// number of pixels transformed at once before being handed to the bytes encoder
+// kept small: with a generator the chunk is produced in the refill interrupt
+#define LED_STRIP_ENCODER_CHUNK_PIXELS 8
+#define LED_STRIP_ENCODER_MAX_BYTES_PER_PIXEL 4
+
+typedef struct {
+    rmt_encoder_t base;
+    rmt_encoder_t *bytes_encoder;
+    rmt_encoder_t *copy_encoder;
+    int state;
+    rmt_symbol_word_t reset_code;
+    uint8_t bytes_per_pixel;
+    uint8_t order[LED_STRIP_ENCODER_MAX_BYTES_PER_PIXEL]; // wire position -> native component (R=0, G=1, B=2, W=3)
+    led_strip_output_config_t output;
+    uint16_t white_inv[3];   // 255 / white point in 8.8 fixed point, 0 when the white LED has none of this component
+    bool extract_white;      // white extraction enabled on a 4-component strip
+    led_strip_encoder_source_t source;
+    uint32_t frame;          // frame counter, moves the dithering pattern
+    uint32_t next_pixel;     // next pixel to transform
+    uint8_t zone;            // current zone, pixels are encoded in increasing order
+    size_t chunk_size;       // bytes of `chunk` not yet fully encoded, 0 when a new chunk is needed
+    uint8_t chunk[LED_STRIP_ENCODER_CHUNK_PIXELS * LED_STRIP_ENCODER_MAX_BYTES_PER_PIXEL];
+} rmt_led_strip_encoder_t;
+
+// Ordered dithering thresholds (bit reversed sequence), their average is 0.5 LSB
+static const uint8_t s_dither_threshold[8] = {16, 144, 80, 208, 48, 176, 112, 240};
+
+// Transform the next pixels into `chunk`, in wire order
+static void led_strip_encoder_fill_chunk(rmt_led_strip_encoder_t *led_encoder, const uint8_t *pixels)
+{
+    const led_strip_output_config_t *output = &led_encoder->output;
+    const led_strip_encoder_source_t *source = &led_encoder->source;
+    uint32_t count = source->num_pixels - led_encoder->next_pixel;
+    if (count > LED_STRIP_ENCODER_CHUNK_PIXELS) {
+        count = LED_STRIP_ENCODER_CHUNK_PIXELS;
+    }
+    uint8_t *out = led_encoder->chunk;
+    for (uint32_t i = led_encoder->next_pixel; i < led_encoder->next_pixel + count; i++) {
+        uint8_t generated[LED_STRIP_ENCODER_MAX_BYTES_PER_PIXEL] = {0};
+        const uint8_t *src = generated;
+        if (source->generator) {
+            source->generator(i, source->time_ms, generated, source->generator_ctx);
+        } else if (source->palette) {
+            // 4 bits per pixel: even pixel in the low nibble
+            uint8_t index = (source->palette_bits == 8) ? pixels[i] : (pixels[i >> 1] >> ((i & 1) * 4)) & 0x0F;
+            src = source->palette[index];
+        } else {
+            src = pixels + i * led_encoder->bytes_per_pixel;
+        }
+        uint8_t rgbw[LED_STRIP_ENCODER_MAX_BYTES_PER_PIXEL];
+        if (led_encoder->extract_white) {
+            // largest white the R, G, B components can give to the white LED
+            uint32_t w = 255;
+            for (int c = 0; c < 3; c++) {
+                if (led_encoder->white_inv[c]) {
+                    uint32_t k = (src[c] * led_encoder->white_inv[c]) >> 8;
+                    if (k < w) {
+                        w = k;
+                    }
+                }
+            }
+            for (int c = 0; c < 3; c++) {
+                // w * white_point / 255, never more than the component
+                uint32_t sub = (w * output->white_point[c] * 257 + 257) >> 16;
+                rgbw[c] = sub > src[c] ? 0 : src[c] - sub;
+            }
+            w += src[3];
+            rgbw[3] = w > 255 ? 255 : w;
+            src = rgbw;
+        }
+        while (led_encoder->zone < output->num_zones &&
+                i >= output->zones[led_encoder->zone].start + output->zones[led_encoder->zone].count) {
+            led_encoder->zone++;
+        }
+        uint32_t scale = 65536;
+        if (led_encoder->zone < output->num_zones && i >= output->zones[led_encoder->zone].start) {
+            scale = output->zones[led_encoder->zone].scale + 1;
+        }
+        uint32_t threshold = output->flags.dither ? s_dither_threshold[(i + led_encoder->frame) & 7] : 128;
+        uint8_t *error = (output->flags.dither && source->dither_error) ? source->dither_error + i * led_encoder->bytes_per_pixel : NULL;
+        for (int c = 0; c < led_encoder->bytes_per_pixel; c++) {
+            uint8_t comp = led_encoder->order[c];
+            // 8.8 fixed point value after the lookup table and the zone brightness
+            uint32_t value = output->lut ? output->lut[comp][src[comp]] : (uint32_t)src[comp] << 8;
+            value = value * scale >> 16;
+            if (error) {
+                // error diffusion: the fraction dropped in this frame is added to the next one
+                value += error[comp];
+                error[comp] = value > 0xFFFF ? 0 : value & 0xFF;
+                value >>= 8;
+            } else {
+                value = (value + threshold) >> 8;
+            }
+            *out++ = value > 255 ? 255 : value;
+        }
+    }
+    led_encoder->next_pixel += count;
+    led_encoder->chunk_size = count * led_encoder->bytes_per_pixel;
+}
+
+static size_t rmt_encode_led_strip(rmt_encoder_t *encoder, rmt_channel_handle_t channel, const void *primary_data, size_t data_size, rmt_encode_state_t *ret_state)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_encoder_handle_t bytes_encoder = led_encoder->bytes_encoder;
+    rmt_encoder_handle_t copy_encoder = led_encoder->copy_encoder;
+    rmt_encode_state_t session_state = 0;
+    rmt_encode_state_t state = 0;
+    size_t encoded_symbols = 0;
+    switch (led_encoder->state) {
+    case 0: // send RGB data, transformed chunk by chunk
+        while (1) {
+            if (led_encoder->chunk_size == 0) {
+                if (led_encoder->next_pixel >= led_encoder->source.num_pixels) {
+                    led_encoder->state = 1; // switch to next state when all the pixels are encoded
+                    break;
+                }
+                led_strip_encoder_fill_chunk(led_encoder, primary_data);
+            }
+            encoded_symbols += bytes_encoder->encode(bytes_encoder, channel, led_encoder->chunk, led_encoder->chunk_size, &session_state);
+            if (session_state & RMT_ENCODING_COMPLETE) {
+                led_encoder->chunk_size = 0;
+            }
+            if (session_state & RMT_ENCODING_MEM_FULL) {
+                state |= RMT_ENCODING_MEM_FULL;
+                goto out; // yield if there's no free space for encoding artifacts
+            }
+        }
+    // fall-through
+    case 1: // send reset code
+        encoded_symbols += copy_encoder->encode(copy_encoder, channel, &led_encoder->reset_code,
+                                                sizeof(led_encoder->reset_code), &session_state);
+        if (session_state & RMT_ENCODING_COMPLETE) {
+            // back to the initial encoding session: the next refresh starts from the first pixel,
+            // reset() is only called by the driver on an aborted transfer
+            led_encoder->state = 0;
+            led_encoder->next_pixel = 0;
+            led_encoder->zone = 0;
+            led_encoder->chunk_size = 0;
+            led_encoder->frame++;
+            state |= RMT_ENCODING_COMPLETE;
+        }
+        if (session_state & RMT_ENCODING_MEM_FULL) {
+            state |= RMT_ENCODING_MEM_FULL;
+            goto out; // yield if there's no free space for encoding artifacts
+        }
+    }
+out:
+    *ret_state = state;
+    return encoded_symbols;
+}
+
+static esp_err_t rmt_del_led_strip_encoder(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_del_encoder(led_encoder->bytes_encoder);
+    rmt_del_encoder(led_encoder->copy_encoder);
+    free(led_encoder);
+    return ESP_OK;
+}
+
+static esp_err_t rmt_led_strip_encoder_reset(rmt_encoder_t *encoder)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    rmt_encoder_reset(led_encoder->bytes_encoder);
+    rmt_encoder_reset(led_encoder->copy_encoder);
+    led_encoder->state = 0;
+    led_encoder->next_pixel = 0;
+    led_encoder->zone = 0;
+    led_encoder->chunk_size = 0;
+    led_encoder->frame++;
+    return ESP_OK;
+}
+
+void rmt_led_strip_encoder_set_source(rmt_encoder_handle_t encoder, const led_strip_encoder_source_t *source)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    led_encoder->source = *source;
+}
+
+void rmt_led_strip_encoder_set_output(rmt_encoder_handle_t encoder, const led_strip_output_config_t *config)
+{
+    rmt_led_strip_encoder_t *led_encoder = __containerof(encoder, rmt_led_strip_encoder_t, base);
+    led_encoder->output = *config;
+    if (led_encoder->output.num_zones > LED_STRIP_MAX_ZONES) {
+        led_encoder->output.num_zones = LED_STRIP_MAX_ZONES;
+    }
+    uint8_t *white = led_encoder->output.white_point;
+    if (!white[0] && !white[1] && !white[2]) {
+        white[0] = white[1] = white[2] = 255;
+    }
+    for (int c = 0; c < 3; c++) {
+        led_encoder->white_inv[c] = white[c] ? (255 << 8) / white[c] : 0;
+    }
+    led_encoder->extract_white = config->flags.extract_white && led_encoder->bytes_per_pixel == 4;
+}
+
+esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder)
+{
+    esp_err_t ret = ESP_OK;
+    rmt_led_strip_encoder_t *led_encoder = NULL;
+    ESP_GOTO_ON_FALSE(config && ret_encoder, ESP_ERR_INVALID_ARG, err, TAG, "invalid argument");
+    ESP_GOTO_ON_FALSE(config->led_model < LED_MODEL_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led model");
+    ESP_GOTO_ON_FALSE(config->led_pixel_format < LED_PIXEL_FORMAT_INVALID, ESP_ERR_INVALID_ARG, err, TAG, "invalid led pixel format");
+    led_encoder = calloc(1, sizeof(rmt_led_strip_encoder_t));
+    ESP_GOTO_ON_FALSE(led_encoder, ESP_ERR_NO_MEM, err, TAG, "no mem for led strip encoder");
+    // WS2812 and SK6812 both expect G, R, B (then W)
+    led_encoder->bytes_per_pixel = (config->led_pixel_format == LED_PIXEL_FORMAT_GRBW) ? 4 : 3;
+    led_encoder->order[0] = 1;
+    led_encoder->order[1] = 0;
+    led_encoder->order[2] = 2;
+    led_encoder->order[3] = 3;
+    led_encoder->base.encode = rmt_encode_led_strip;
+    led_encoder->base.del = rmt_del_led_strip_encoder;
+    led_encoder->base.reset = rmt_led_strip_encoder_reset;
+    rmt_bytes_encoder_config_t bytes_encoder_config;
+    if (config->led_model == LED_MODEL_SK6812) {
+        bytes_encoder_config = (rmt_bytes_encoder_config_t) {
+            .bit0 = {
+                .level0 = 1,
+                .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
+                .level1 = 0,
+                .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
+            },
+            .bit1 = {
+                .level0 = 1,
+                .duration0 = 0.6 * config->resolution / 1000000, // T1H=0.6us
+                .level1 = 0,
+                .duration1 = 0.6 * config->resolution / 1000000, // T1L=0.6us
+            },
+            .flags.msb_first = 1 // SK6812 transfer bit order: G7...G0R7...R0B7...B0(W7...W0)
+        };
+    } else if (config->led_model == LED_MODEL_WS2812) {
+        // different led strip might have its own timing requirements, following parameter is for WS2812
+        bytes_encoder_config = (rmt_bytes_encoder_config_t) {
+            .bit0 = {
+                .level0 = 1,
+                .duration0 = 0.3 * config->resolution / 1000000, // T0H=0.3us
+                .level1 = 0,
+                .duration1 = 0.9 * config->resolution / 1000000, // T0L=0.9us
+            },
+            .bit1 = {
+                .level0 = 1,
+                .duration0 = 0.9 * config->resolution / 1000000, // T1H=0.9us
+                .level1 = 0,
+                .duration1 = 0.3 * config->resolution / 1000000, // T1L=0.3us
+            },
+            .flags.msb_first = 1 // WS2812 transfer bit order: G7...G0R7...R0B7...B0
+        };
+    } else {
+        assert(false);
+    }
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &led_encoder->bytes_encoder), err, TAG, "create bytes encoder failed");
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &led_encoder->copy_encoder), err, TAG, "create copy encoder failed");
+
+    uint32_t reset_ticks = config->resolution / 1000000 * 280 / 2; // reset code duration defaults to 280us to accomodate WS2812B-V5
+    led_encoder->reset_code = (rmt_symbol_word_t) {
+        .level0 = 0,
+        .duration0 = reset_ticks,
+        .level1 = 0,
+        .duration1 = reset_ticks,
+    };
+    *ret_encoder = &led_encoder->base;
+    return ESP_OK;
+err:
+    if (led_encoder) {
+        if (led_encoder->bytes_encoder) {
+            rmt_del_encoder(led_encoder->bytes_encoder);
+        }
+        if (led_encoder->copy_encoder) {
+            rmt_del_encoder(led_encoder->copy_encoder);
+        }
+        free(led_encoder);
+    }
+    return ret;
+}
@@ -0,0 +1,79 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include "driver/rmt_encoder.h"
+#include "led_strip_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @brief Type of led strip encoder configuration
+ */
+typedef struct {
+    uint32_t resolution;   /*!< Encoder resolution, in Hz */
+    led_model_t led_model; /*!< LED model */
+    led_pixel_format_t led_pixel_format; /*!< Order of the components on the wire */
+} led_strip_encoder_config_t;
+
+/**
+ * @brief Create RMT encoder for encoding LED strip pixels into RMT symbols
+ *
+ * @param[in] config Encoder configuration
+ * @param[out] ret_encoder Returned encoder handle
+ * @return
+ *      - ESP_ERR_INVALID_ARG for any invalid arguments
+ *      - ESP_ERR_NO_MEM out of memory when creating led strip encoder
+ *      - ESP_OK if creating encoder successfully
+ */
+esp_err_t rmt_new_led_strip_encoder(const led_strip_encoder_config_t *config, rmt_encoder_handle_t *ret_encoder);
+
+/**
+ * @brief Set the output stage applied by the encoder
+ *
+ * The encoder reads pixels in native order (R, G, B, W) and applies the white extraction, the lookup tables, the zone brightness
+ * and the dithering while producing the RMT symbols, then sends the components in the wire order.
+ *
+ * @note Must not be called while a transmission using this encoder is in progress.
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_led_strip_encoder`
+ * @param[in] config Output stage configuration
+ */
+void rmt_led_strip_encoder_set_output(rmt_encoder_handle_t encoder, const led_strip_output_config_t *config);
+
+/**
+ * @brief Type of pixel source of the led strip encoder
+ */
+typedef struct {
+    uint32_t num_pixels;                     /*!< Number of pixels of the frame */
+    led_strip_pixel_generator_t generator;   /*!< Pixel generator, NULL to read the pixels from the payload */
+    void *generator_ctx;                     /*!< Context passed to the generator */
+    uint32_t time_ms;                        /*!< Time of the frame passed to the generator */
+    const uint8_t (*palette)[4];             /*!< Palette in native order (R, G, B, W), NULL if the payload holds colors */
+    uint8_t palette_bits;                    /*!< Bits per pixel index in the payload (4 or 8) when a palette is used */
+    uint8_t *dither_error;                   /*!< Quantization error of each component of each pixel, carried to the next frame
+                                                  when dithering is enabled. NULL for ordered dithering */
+} led_strip_encoder_source_t;
+
+/**
+ * @brief Set the pixel source of the encoder
+ *
+ * The payload given to `rmt_transmit` holds colors, or palette indexes when a palette is set.
+ * With a generator the payload is not read.
+ *
+ * @note Must not be called while a transmission using this encoder is in progress.
+ *
+ * @param[in] encoder Encoder handle created by `rmt_new_led_strip_encoder`
+ * @param[in] source Pixel source, copied
+ */
+void rmt_led_strip_encoder_set_source(rmt_encoder_handle_t encoder, const led_strip_encoder_source_t *source);
+
+#ifdef __cplusplus
+}
+#endif
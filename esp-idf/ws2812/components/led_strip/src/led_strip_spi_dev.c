@@ -19,46 +19,70 @@
 
 #define SPI_BYTES_PER_COLOR_BYTE 3
 #define SPI_BITS_PER_COLOR_BYTE (SPI_BYTES_PER_COLOR_BYTE * 8)
+// Low level appended to every frame, so that back-to-back frames still latch (280us at 2.5MHz)
+#define SPI_RESET_BYTES 88
+// Two encoded buffers with DMA: the next frame is encoded while the previous one is on the wire
+#define SPI_MAX_TX_BUFFERS 2
 
 static const char *TAG = "led_strip_spi";
 
+// Each color of 1 bit is represented by 3 bits of SPI, low_level:100 ,high_level:110
+// So a color byte occupies 3 bytes of SPI, MSB first.
+#define SPI_ENC_BIT(d, n) ((0x4u | ((((d) >> (n)) & 1u) << 1)) << (3 * (n)))
+#define SPI_ENC(d) (SPI_ENC_BIT(d, 0) | SPI_ENC_BIT(d, 1) | SPI_ENC_BIT(d, 2) | SPI_ENC_BIT(d, 3) | \
+                    SPI_ENC_BIT(d, 4) | SPI_ENC_BIT(d, 5) | SPI_ENC_BIT(d, 6) | SPI_ENC_BIT(d, 7))
+#define SPI_ENC_ROW(d) { (uint8_t)(SPI_ENC(d) >> 16), (uint8_t)(SPI_ENC(d) >> 8), (uint8_t)SPI_ENC(d) }
+#define SPI_ENC_ROW4(d) SPI_ENC_ROW(d), SPI_ENC_ROW(d + 1), SPI_ENC_ROW(d + 2), SPI_ENC_ROW(d + 3)
+#define SPI_ENC_ROW16(d) SPI_ENC_ROW4(d), SPI_ENC_ROW4(d + 4), SPI_ENC_ROW4(d + 8), SPI_ENC_ROW4(d + 12)
+#define SPI_ENC_ROW64(d) SPI_ENC_ROW16(d), SPI_ENC_ROW16(d + 16), SPI_ENC_ROW16(d + 32), SPI_ENC_ROW16(d + 48)
+
+// SPI encoding of every color byte value, built at compile time
+static const uint8_t s_spi_encode_table[256][SPI_BYTES_PER_COLOR_BYTE] = {
+    SPI_ENC_ROW64(0), SPI_ENC_ROW64(64), SPI_ENC_ROW64(128), SPI_ENC_ROW64(192)
+};
+
 typedef struct {
     led_strip_t base;
     spi_host_device_t spi_host;
     spi_device_handle_t spi_device;
+    spi_transaction_t tx_conf;
+    bool tx_pending;
     uint32_t strip_len;
     uint8_t bytes_per_pixel;
-    uint8_t pixel_buf[];
+    uint8_t num_tx_bufs;
+    uint8_t tx_buf_index;                       // buffer to encode the next frame into
+    uint8_t *tx_buf[SPI_MAX_TX_BUFFERS];        // SPI encoded frames (DMA capable when DMA is used)
+    uint8_t pixel_buf[];                        // raw color bytes, in the order sent to the LEDs
 } led_strip_spi_obj;
 
-// please make sure to zero-initialize the buf before calling this function
-static void __led_strip_spi_bit(uint8_t data, uint8_t *buf)
+static inline size_t led_strip_spi_frame_bytes(const led_strip_spi_obj *spi_strip)
+{
+    return spi_strip->strip_len * spi_strip->bytes_per_pixel;
+}
+
+// Encode a whole frame of color bytes in one pass
+static void led_strip_spi_encode(const uint8_t *src, uint8_t *dst, size_t len)
 {
-    // Each color of 1 bit is represented by 3 bits of SPI, low_level:100 ,high_level:110
-    // So a color byte occupies 3 bytes of SPI.
-    *(buf + 2) |= data & BIT(0) ? BIT(2) | BIT(1) : BIT(2);
-    *(buf + 2) |= data & BIT(1) ? BIT(5) | BIT(4) : BIT(5);
-    *(buf + 2) |= data & BIT(2) ? BIT(7) : 0x00;
-    *(buf + 1) |= BIT(0);
-    *(buf + 1) |= data & BIT(3) ? BIT(3) | BIT(2) : BIT(3);
-    *(buf + 1) |= data & BIT(4) ? BIT(6) | BIT(5) : BIT(6);
-    *(buf + 0) |= data & BIT(5) ? BIT(1) | BIT(0) : BIT(1);
-    *(buf + 0) |= data & BIT(6) ? BIT(4) | BIT(3) : BIT(4);
-    *(buf + 0) |= data & BIT(7) ? BIT(7) | BIT(6) : BIT(7);
+    for (size_t i = 0; i < len; i++) {
+        const uint8_t *code = s_spi_encode_table[src[i]];
+        dst[0] = code[0];
+        dst[1] = code[1];
+        dst[2] = code[2];
+        dst += SPI_BYTES_PER_COLOR_BYTE;
+    }
 }
 
 static esp_err_t led_strip_spi_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
     ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
-    // LED_PIXEL_FORMAT_GRB takes 72bits(9bytes)
-    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
-    memset(spi_strip->pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
-    __led_strip_spi_bit(green, &spi_strip->pixel_buf[start]);
-    __led_strip_spi_bit(red, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE]);
-    __led_strip_spi_bit(blue, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 2]);
+    // LED_PIXEL_FORMAT_GRB takes 72bits(9bytes) once encoded
+    uint8_t *pixel = &spi_strip->pixel_buf[index * spi_strip->bytes_per_pixel];
+    pixel[0] = green & 0xFF;
+    pixel[1] = red & 0xFF;
+    pixel[2] = blue & 0xFF;
     if (spi_strip->bytes_per_pixel > 3) {
-        __led_strip_spi_bit(0, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 3]);
+        pixel[3] = 0;
     }
     return ESP_OK;
 }
@@ -68,42 +92,65 @@ static esp_err_t led_strip_spi_set_pixel_rgbw(led_strip_t *strip, uint32_t index
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
     ESP_RETURN_ON_FALSE(index < spi_strip->strip_len, ESP_ERR_INVALID_ARG, TAG, "index out of maximum number of LEDs");
     ESP_RETURN_ON_FALSE(spi_strip->bytes_per_pixel == 4, ESP_ERR_INVALID_ARG, TAG, "wrong LED pixel format, expected 4 bytes per pixel");
-    // LED_PIXEL_FORMAT_GRBW takes 96bits(12bytes)
-    uint32_t start = index * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE;
+    // LED_PIXEL_FORMAT_GRBW takes 96bits(12bytes) once encoded
     // SK6812 component order is GRBW
-    memset(spi_strip->pixel_buf + start, 0, spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
-    __led_strip_spi_bit(green, &spi_strip->pixel_buf[start]);
-    __led_strip_spi_bit(red, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE]);
-    __led_strip_spi_bit(blue, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 2]);
-    __led_strip_spi_bit(white, &spi_strip->pixel_buf[start + SPI_BYTES_PER_COLOR_BYTE * 3]);
+    uint8_t *pixel = &spi_strip->pixel_buf[index * spi_strip->bytes_per_pixel];
+    pixel[0] = green & 0xFF;
+    pixel[1] = red & 0xFF;
+    pixel[2] = blue & 0xFF;
+    pixel[3] = white & 0xFF;
 
     return ESP_OK;
 }
 
-static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+static esp_err_t led_strip_spi_refresh_wait(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
-    spi_transaction_t tx_conf;
-    memset(&tx_conf, 0, sizeof(tx_conf));
+    spi_transaction_t *done_trans = NULL;
+    if (!spi_strip->tx_pending) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(spi_device_get_trans_result(spi_strip->spi_device, &done_trans, portMAX_DELAY), TAG, "wait SPI transaction failed");
+    spi_strip->tx_pending = false;
 
-    tx_conf.length = spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BITS_PER_COLOR_BYTE;
-    tx_conf.tx_buffer = spi_strip->pixel_buf;
-    tx_conf.rx_buffer = NULL;
-    ESP_RETURN_ON_ERROR(spi_device_transmit(spi_strip->spi_device, &tx_conf), TAG, "transmit pixels by SPI failed");
+    return ESP_OK;
+}
+
+static esp_err_t led_strip_spi_refresh_async(led_strip_t *strip)
+{
+    led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
+    if (spi_strip->num_tx_bufs < 2) {
+        // single buffer: it can't be rewritten while it's being transmitted
+        ESP_RETURN_ON_ERROR(led_strip_spi_refresh_wait(strip), TAG, "wait previous refresh failed");
+    }
+    uint8_t *tx_buf = spi_strip->tx_buf[spi_strip->tx_buf_index];
+    // the reset tail at the end of the buffer stays zero
+    led_strip_spi_encode(spi_strip->pixel_buf, tx_buf, led_strip_spi_frame_bytes(spi_strip));
+    // double buffering: the previous frame was on the wire while this one was encoded
+    ESP_RETURN_ON_ERROR(led_strip_spi_refresh_wait(strip), TAG, "wait previous refresh failed");
+
+    memset(&spi_strip->tx_conf, 0, sizeof(spi_strip->tx_conf));
+    spi_strip->tx_conf.length = (led_strip_spi_frame_bytes(spi_strip) * SPI_BYTES_PER_COLOR_BYTE + SPI_RESET_BYTES) * 8;
+    spi_strip->tx_conf.tx_buffer = tx_buf;
+    spi_strip->tx_conf.rx_buffer = NULL;
+    ESP_RETURN_ON_ERROR(spi_device_queue_trans(spi_strip->spi_device, &spi_strip->tx_conf, portMAX_DELAY), TAG, "transmit pixels by SPI failed");
+    spi_strip->tx_pending = true;
+    spi_strip->tx_buf_index = (spi_strip->tx_buf_index + 1) % spi_strip->num_tx_bufs;
 
     return ESP_OK;
 }
 
+static esp_err_t led_strip_spi_refresh(led_strip_t *strip)
+{
+    ESP_RETURN_ON_ERROR(led_strip_spi_refresh_async(strip), TAG, "start refresh failed");
+    return led_strip_spi_refresh_wait(strip);
+}
+
 static esp_err_t led_strip_spi_clear(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
     //Write zero to turn off all leds
-    memset(spi_strip->pixel_buf, 0, spi_strip->strip_len * spi_strip->bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE);
-    uint8_t *buf = spi_strip->pixel_buf;
-    for (int index = 0; index < spi_strip->strip_len * spi_strip->bytes_per_pixel; index++) {
-        __led_strip_spi_bit(0, buf);
-        buf += SPI_BYTES_PER_COLOR_BYTE;
-    }
+    memset(spi_strip->pixel_buf, 0, led_strip_spi_frame_bytes(spi_strip));
 
     return led_strip_spi_refresh(strip);
 }
@@ -112,9 +159,13 @@ static esp_err_t led_strip_spi_del(led_strip_t *strip)
 {
     led_strip_spi_obj *spi_strip = __containerof(strip, led_strip_spi_obj, base);
 
+    ESP_RETURN_ON_ERROR(led_strip_spi_refresh_wait(strip), TAG, "wait pending refresh failed");
     ESP_RETURN_ON_ERROR(spi_bus_remove_device(spi_strip->spi_device), TAG, "delete spi device failed");
     ESP_RETURN_ON_ERROR(spi_bus_free(spi_strip->spi_host), TAG, "free spi bus failed");
 
+    for (int i = 0; i < spi_strip->num_tx_bufs; i++) {
+        free(spi_strip->tx_buf[i]);
+    }
     free(spi_strip);
     return ESP_OK;
 }
@@ -133,14 +184,20 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
     } else {
         assert(false);
     }
+    spi_strip = calloc(1, sizeof(led_strip_spi_obj) + led_config->max_leds * bytes_per_pixel);
+    ESP_GOTO_ON_FALSE(spi_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for spi strip");
+
     uint32_t mem_caps = MALLOC_CAP_DEFAULT;
     if (spi_config->flags.with_dma) {
         // DMA buffer must be placed in internal SRAM
         mem_caps |= MALLOC_CAP_INTERNAL | MALLOC_CAP_DMA;
     }
-    spi_strip = heap_caps_calloc(1, sizeof(led_strip_spi_obj) + led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE, mem_caps);
-
-    ESP_GOTO_ON_FALSE(spi_strip, ESP_ERR_NO_MEM, err, TAG, "no mem for spi strip");
+    size_t tx_buf_size = led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE + SPI_RESET_BYTES;
+    spi_strip->num_tx_bufs = spi_config->flags.with_dma ? SPI_MAX_TX_BUFFERS : 1;
+    for (int i = 0; i < spi_strip->num_tx_bufs; i++) {
+        spi_strip->tx_buf[i] = heap_caps_calloc(1, tx_buf_size, mem_caps);
+        ESP_GOTO_ON_FALSE(spi_strip->tx_buf[i], ESP_ERR_NO_MEM, err, TAG, "no mem for spi tx buffer");
+    }
 
     spi_strip->spi_host = spi_config->spi_bus;
     // for backward compatibility, if the user does not set the clk_src, use the default value
@@ -156,7 +213,7 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
         .sclk_io_num = -1,
         .quadwp_io_num = -1,
         .quadhd_io_num = -1,
-        .max_transfer_sz = led_config->max_leds * bytes_per_pixel * SPI_BYTES_PER_COLOR_BYTE,
+        .max_transfer_sz = tx_buf_size,
     };
     ESP_GOTO_ON_ERROR(spi_bus_initialize(spi_strip->spi_host, &spi_bus_cfg, spi_config->flags.with_dma ? SPI_DMA_CH_AUTO : SPI_DMA_DISABLED), err, TAG, "create SPI bus failed");
 
@@ -192,6 +249,8 @@ esp_err_t led_strip_new_spi_device(const led_strip_config_t *led_config, const l
     spi_strip->base.set_pixel = led_strip_spi_set_pixel;
     spi_strip->base.set_pixel_rgbw = led_strip_spi_set_pixel_rgbw;
     spi_strip->base.refresh = led_strip_spi_refresh;
+    spi_strip->base.refresh_async = led_strip_spi_refresh_async;
+    spi_strip->base.refresh_wait = led_strip_spi_refresh_wait;
     spi_strip->base.clear = led_strip_spi_clear;
     spi_strip->base.del = led_strip_spi_del;
 
@@ -205,6 +264,9 @@ err:
         if (spi_strip->spi_host) {
             spi_bus_free(spi_strip->spi_host);
         }
+        for (int i = 0; i < SPI_MAX_TX_BUFFERS; i++) {
+            free(spi_strip->tx_buf[i]);
+        }
         free(spi_strip);
     }
     return ret;
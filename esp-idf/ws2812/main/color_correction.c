@@ -0,0 +1,326 @@
+/*
+ * Correction des couleurs : matrice de gamut des primaires reelles du ruban
+ * et tables par canal (balance des blancs, reponse) appliquees par l'etage de sortie
+ */
+
+#include "color_correction.h"
+#include <math.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "nvs.h"
+#include "effects.h"
+
+static const char *TAG = "COLOR";
+
+#define NVS_NAMESPACE   "color"
+#define NVS_KEY         "calib"
+
+// Blanc de reference D65 (XYZ, Y = 1)
+#define WHITE_X         0.95047f
+#define WHITE_Z         1.08883f
+
+static color_calibration_t g_calibration = COLOR_CALIBRATION_DEFAULT();
+static float g_xyz_to_rgb[3][3];
+
+// Tables par canal en 8.8, doublees : l'etage de sortie garde l'ancienne jusqu'a la trame suivante
+static uint16_t g_lut[2][4][256];
+static uint8_t g_lut_index = 0;
+
+#define MIREDS_COUNT    (COLOR_CORRECTION_MIREDS_MAX - COLOR_CORRECTION_MIREDS_MIN + 1)
+
+// Lieu de Planck (approximation de Kim et al.), x, y de COLOR_CORRECTION_MIREDS_MIN a _MAX par pas de 1 mired
+static const uint16_t s_planckian_xy[MIREDS_COUNT][2] = {
+    { 20508, 21176 }, { 20551, 21218 }, { 20595, 21260 }, { 20638, 21302 }, { 20681, 21343 }, { 20724, 21385 },
+    { 20768, 21427 }, { 20811, 21468 }, { 20855, 21510 }, { 20898, 21551 }, { 20942, 21592 }, { 20986, 21634 },
+    { 21030, 21675 }, { 21074, 21716 }, { 21118, 21757 }, { 21162, 21797 }, { 21206, 21838 }, { 21251, 21879 },
+    { 21295, 21919 }, { 21340, 21960 }, { 21384, 22000 }, { 21429, 22040 }, { 21473, 22080 }, { 21518, 22120 },
+    { 21563, 22160 }, { 21608, 22199 }, { 21653, 22239 }, { 21698, 22279 }, { 21743, 22318 }, { 21788, 22357 },
+    { 21833, 22396 }, { 21878, 22435 }, { 21924, 22474 }, { 21969, 22513 }, { 22014, 22551 }, { 22060, 22590 },
+    { 22105, 22628 }, { 22151, 22667 }, { 22196, 22705 }, { 22242, 22743 }, { 22288, 22780 }, { 22334, 22818 },
+    { 22379, 22856 }, { 22425, 22893 }, { 22471, 22930 }, { 22517, 22967 }, { 22563, 23004 }, { 22609, 23041 },
+    { 22655, 23078 }, { 22701, 23114 }, { 22747, 23151 }, { 22793, 23187 }, { 22840, 23223 }, { 22886, 23259 },
+    { 22932, 23295 }, { 22978, 23331 }, { 23025, 23366 }, { 23071, 23402 }, { 23117, 23437 }, { 23164, 23472 },
+    { 23210, 23507 }, { 23257, 23542 }, { 23303, 23576 }, { 23350, 23611 }, { 23396, 23645 }, { 23443, 23679 },
+    { 23489, 23713 }, { 23536, 23747 }, { 23582, 23781 }, { 23629, 23814 }, { 23675, 23847 }, { 23722, 23881 },
+    { 23769, 23914 }, { 23815, 23947 }, { 23862, 23979 }, { 23908, 24012 }, { 23955, 24044 }, { 24002, 24076 },
+    { 24048, 24108 }, { 24095, 24140 }, { 24142, 24172 }, { 24188, 24204 }, { 24235, 24235 }, { 24282, 24266 },
+    { 24328, 24297 }, { 24375, 24328 }, { 24421, 24359 }, { 24468, 24390 }, { 24515, 24420 }, { 24561, 24450 },
+    { 24608, 24480 }, { 24654, 24510 }, { 24701, 24540 }, { 24747, 24569 }, { 24794, 24599 }, { 24840, 24628 },
+    { 24887, 24657 }, { 24938, 24689 }, { 24984, 24719 }, { 25031, 24748 }, { 25077, 24776 }, { 25124, 24805 },
+    { 25170, 24834 }, { 25216, 24862 }, { 25263, 24890 }, { 25309, 24918 }, { 25355, 24946 }, { 25401, 24973 },
+    { 25447, 25000 }, { 25493, 25027 }, { 25538, 25054 }, { 25584, 25081 }, { 25630, 25108 }, { 25676, 25134 },
+    { 25721, 25160 }, { 25767, 25186 }, { 25812, 25212 }, { 25858, 25237 }, { 25903, 25263 }, { 25949, 25288 },
+    { 25994, 25313 }, { 26039, 25338 }, { 26084, 25362 }, { 26129, 25387 }, { 26174, 25411 }, { 26219, 25435 },
+    { 26264, 25459 }, { 26309, 25483 }, { 26354, 25506 }, { 26398, 25530 }, { 26443, 25553 }, { 26488, 25576 },
+    { 26532, 25598 }, { 26577, 25621 }, { 26621, 25643 }, { 26666, 25665 }, { 26710, 25688 }, { 26754, 25709 },
+    { 26798, 25731 }, { 26842, 25752 }, { 26886, 25774 }, { 26930, 25795 }, { 26974, 25816 }, { 27018, 25837 },
+    { 27062, 25857 }, { 27106, 25878 }, { 27150, 25898 }, { 27193, 25918 }, { 27237, 25938 }, { 27280, 25957 },
+    { 27324, 25977 }, { 27367, 25996 }, { 27410, 26015 }, { 27454, 26034 }, { 27497, 26053 }, { 27540, 26072 },
+    { 27583, 26090 }, { 27626, 26109 }, { 27669, 26127 }, { 27712, 26145 }, { 27755, 26162 }, { 27797, 26180 },
+    { 27840, 26197 }, { 27883, 26215 }, { 27925, 26232 }, { 27968, 26249 }, { 28010, 26266 }, { 28053, 26282 },
+    { 28095, 26299 }, { 28137, 26315 }, { 28179, 26331 }, { 28221, 26347 }, { 28263, 26363 }, { 28305, 26378 },
+    { 28347, 26394 }, { 28389, 26409 }, { 28431, 26424 }, { 28473, 26439 }, { 28514, 26454 }, { 28556, 26468 },
+    { 28597, 26483 }, { 28639, 26497 }, { 28680, 26511 }, { 28722, 26525 }, { 28763, 26539 }, { 28804, 26553 },
+    { 28845, 26566 }, { 28886, 26580 }, { 28927, 26593 }, { 28968, 26606 }, { 29009, 26619 }, { 29050, 26631 },
+    { 29090, 26644 }, { 29131, 26656 }, { 29172, 26669 }, { 29212, 26681 }, { 29253, 26693 }, { 29293, 26704 },
+    { 29333, 26716 }, { 29374, 26728 }, { 29414, 26739 }, { 29454, 26750 }, { 29494, 26761 }, { 29534, 26772 },
+    { 29574, 26783 }, { 29614, 26793 }, { 29654, 26804 }, { 29693, 26814 }, { 29733, 26824 }, { 29773, 26834 },
+    { 29812, 26844 }, { 29852, 26854 }, { 29891, 26864 }, { 29930, 26873 }, { 29969, 26882 }, { 30009, 26891 },
+    { 30048, 26900 }, { 30087, 26909 }, { 30126, 26918 }, { 30165, 26927 }, { 30203, 26935 }, { 30242, 26943 },
+    { 30281, 26952 }, { 30319, 26960 }, { 30358, 26968 }, { 30396, 26975 }, { 30435, 26983 }, { 30473, 26990 },
+    { 30511, 26998 }, { 30550, 27005 }, { 30588, 27012 }, { 30626, 27019 }, { 30664, 27026 }, { 30702, 27033 },
+    { 30739, 27039 }, { 30777, 27046 }, { 30815, 27052 }, { 30853, 27058 }, { 30890, 27064 }, { 30928, 27070 },
+    { 30965, 27076 }, { 31002, 27082 }, { 31040, 27087 }, { 31077, 27092 }, { 31114, 27098 }, { 31151, 27103 },
+    { 31188, 27108 }, { 31225, 27113 }, { 31262, 27118 }, { 31298, 27122 }, { 31335, 27127 }, { 31372, 27131 },
+    { 31408, 27136 }, { 31445, 27140 }, { 31481, 27144 }, { 31517, 27148 }, { 31554, 27152 }, { 31590, 27155 },
+    { 31626, 27159 }, { 31662, 27162 }, { 31698, 27166 }, { 31734, 27169 }, { 31769, 27172 }, { 31805, 27175 },
+    { 31841, 27178 }, { 31876, 27181 }, { 31912, 27183 }, { 31947, 27186 }, { 31983, 27188 }, { 32018, 27191 },
+    { 32053, 27193 }, { 32088, 27195 }, { 32123, 27197 }, { 32158, 27199 }, { 32193, 27201 }, { 32228, 27203 },
+    { 32263, 27204 }, { 32297, 27206 }, { 32332, 27207 }, { 32367, 27208 }, { 32401, 27209 }, { 32435, 27210 },
+    { 32470, 27211 }, { 32504, 27212 }, { 32538, 27213 }, { 32572, 27214 }, { 32606, 27214 }, { 32640, 27215 },
+    { 32674, 27215 }, { 32708, 27215 }, { 32741, 27215 }, { 32775, 27215 }, { 32808, 27215 }, { 32842, 27215 },
+    { 32875, 27215 }, { 32909, 27215 }, { 32942, 27214 }, { 32975, 27214 }, { 33008, 27213 }, { 33041, 27213 },
+    { 33074, 27212 }, { 33107, 27211 }, { 33139, 27210 }, { 33172, 27209 }, { 33205, 27208 }, { 33237, 27207 },
+    { 33270, 27206 }, { 33302, 27205 }, { 33334, 27203 }, { 33366, 27202 }, { 33399, 27200 }, { 33431, 27199 },
+    { 33463, 27197 }, { 33495, 27195 }, { 33526, 27193 }, { 33558, 27191 }, { 33590, 27189 }, { 33621, 27187 },
+    { 33653, 27185 }, { 33684, 27182 }, { 33715, 27180 }, { 33747, 27177 }, { 33778, 27174 }, { 33809, 27172 },
+    { 33840, 27169 }, { 33871, 27166 }, { 33902, 27163 }, { 33932, 27160 }, { 33963, 27157 }, { 33994, 27154 },
+    { 34024, 27151 }, { 34055, 27147 }, { 34085, 27144 }, { 34115, 27140 }, { 34146, 27137 }, { 34176, 27133 },
+    { 34206, 27129 }, { 34236, 27125 }, { 34265, 27122 }, { 34295, 27118 }, { 34325, 27114 }, { 34355, 27109 },
+    { 34384, 27105 }, { 34414, 27101 }, { 34443, 27097 }, { 34472, 27092 }, { 34501, 27088 }, { 34531, 27083 },
+};
+
+// Couleur corrigee de chaque temperature, recalculee avec le calibrage
+static uint8_t g_mired_rgb[MIREDS_COUNT][3];
+
+/* Inverse d'une matrice 3x3, false si elle est singuliere */
+static bool invert3(const float m[3][3], float inv[3][3])
+{
+    float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+    if (fabsf(det) < 1e-6f) {
+        return false;
+    }
+    float k = 1.0f / det;
+    inv[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * k;
+    inv[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * k;
+    inv[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * k;
+    inv[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * k;
+    inv[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * k;
+    inv[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * k;
+    inv[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * k;
+    inv[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * k;
+    inv[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * k;
+    return true;
+}
+
+/* Matrice XYZ -> RGB des primaires, normalisee pour que le blanc D65 donne R = G = B = 1 */
+static bool build_matrix(const color_calibration_t *cal, float xyz_to_rgb[3][3])
+{
+    // Colonnes : XYZ de chaque primaire a Y = 1
+    float p[3][3];
+    for (int c = 0; c < 3; c++) {
+        float x = cal->primaries[c][0] / (float)COLOR_CORRECTION_UNIT;
+        float y = cal->primaries[c][1] / (float)COLOR_CORRECTION_UNIT;
+        if (y < 0.0001f) {
+            return false;
+        }
+        p[0][c] = x / y;
+        p[1][c] = 1.0f;
+        p[2][c] = (1.0f - x - y) / y;
+    }
+
+    // Intensite de chaque primaire pour reproduire le blanc
+    float p_inv[3][3];
+    if (!invert3(p, p_inv)) {
+        return false;
+    }
+    float s[3];
+    for (int c = 0; c < 3; c++) {
+        s[c] = p_inv[c][0] * WHITE_X + p_inv[c][1] + p_inv[c][2] * WHITE_Z;
+    }
+
+    float rgb_to_xyz[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int c = 0; c < 3; c++) {
+            rgb_to_xyz[i][c] = p[i][c] * s[c];
+        }
+    }
+    return invert3(rgb_to_xyz, xyz_to_rgb);
+}
+
+/* Tables par canal : sortie = gain * entree^gamma, en 8.8 ; blanc (rubans RGBW) sans correction */
+static void build_luts(const color_calibration_t *cal, uint16_t lut[4][256])
+{
+    for (int v = 0; v < 256; v++) {
+        lut[3][v] = v << 8;
+    }
+    for (int c = 0; c < 3; c++) {
+        float gain = cal->gain[c] / (float)COLOR_CORRECTION_UNIT;
+        float gamma = (cal->gamma[c] ? cal->gamma[c] : COLOR_CORRECTION_GAMMA_UNIT) / (float)COLOR_CORRECTION_GAMMA_UNIT;
+        for (int v = 0; v < 256; v++) {
+            float out = gain * powf(v / 255.0f, gamma) * 255.0f * 256.0f;
+            lut[c][v] = out > 65280.0f ? 65280 : (uint16_t)(out + 0.5f);
+        }
+    }
+}
+
+/* Vrai si les tables ne changent rien (pas besoin de lookup a l'encodage) */
+static bool is_identity(const color_calibration_t *cal)
+{
+    for (int c = 0; c < 3; c++) {
+        if (cal->gain[c] != COLOR_CORRECTION_UNIT ||
+            (cal->gamma[c] != COLOR_CORRECTION_GAMMA_UNIT && cal->gamma[c] != 0)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void xyz_to_rgb(float X, float Y, float Z, float *r, float *g, float *b)
+{
+    *r = g_xyz_to_rgb[0][0] * X + g_xyz_to_rgb[0][1] * Y + g_xyz_to_rgb[0][2] * Z;
+    *g = g_xyz_to_rgb[1][0] * X + g_xyz_to_rgb[1][1] * Y + g_xyz_to_rgb[1][2] * Z;
+    *b = g_xyz_to_rgb[2][0] * X + g_xyz_to_rgb[2][1] * Y + g_xyz_to_rgb[2][2] * Z;
+}
+
+/* Composante lineaire vers 8 bits (gamma sRGB, bornee) */
+static uint8_t encode_channel(float v)
+{
+    v = (v > 0.0031308f) ? (1.055f * powf(v, 1.0f / 2.4f) - 0.055f) : (12.92f * v);
+    if (v < 0.0f) {
+        v = 0.0f;
+    }
+    if (v > 1.0f) {
+        v = 1.0f;
+    }
+    return (uint8_t)(v * 255.0f);
+}
+
+static esp_err_t apply(const color_calibration_t *cal)
+{
+    float xyz_to_rgb[3][3];
+    ESP_RETURN_ON_FALSE(build_matrix(cal, xyz_to_rgb), ESP_ERR_INVALID_ARG, TAG, "primaires invalides");
+    memcpy(g_xyz_to_rgb, xyz_to_rgb, sizeof(g_xyz_to_rgb));
+    g_calibration = *cal;
+
+    if (is_identity(cal)) {
+        effects_set_color_lut(NULL);
+    } else {
+        g_lut_index ^= 1;
+        build_luts(cal, g_lut[g_lut_index]);
+        effects_set_color_lut((const uint16_t (*)[256])g_lut[g_lut_index]);
+    }
+
+    // Les changements de temperature ne font ensuite qu'une lecture
+    for (int m = 0; m < MIREDS_COUNT; m++) {
+        color_correction_xy_to_rgb(s_planckian_xy[m][0], s_planckian_xy[m][1],
+                                   &g_mired_rgb[m][0], &g_mired_rgb[m][1], &g_mired_rgb[m][2]);
+    }
+    ESP_LOGI(TAG, "Calibrage: gains %u/%u/%u, gamma %u/%u/%u",
+             cal->gain[0], cal->gain[1], cal->gain[2], cal->gamma[0], cal->gamma[1], cal->gamma[2]);
+    return ESP_OK;
+}
+
+esp_err_t color_correction_init(void)
+{
+    color_calibration_t cal = COLOR_CALIBRATION_DEFAULT();
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_OK) {
+        size_t len = sizeof(cal);
+        err = nvs_get_blob(nvs, NVS_KEY, &cal, &len);
+        nvs_close(nvs);
+        if (err == ESP_OK && len != sizeof(cal)) {
+            err = ESP_ERR_INVALID_SIZE;
+        }
+    }
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    } else if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Calibrage illisible (%s), valeurs par defaut", esp_err_to_name(err));
+        cal = (color_calibration_t)COLOR_CALIBRATION_DEFAULT();
+    }
+
+    if (apply(&cal) != ESP_OK) {
+        cal = (color_calibration_t)COLOR_CALIBRATION_DEFAULT();
+        apply(&cal);
+    }
+    return err;
+}
+
+esp_err_t color_correction_set(const color_calibration_t *calibration)
+{
+    color_calibration_t cal = COLOR_CALIBRATION_DEFAULT();
+    if (calibration) {
+        cal = *calibration;
+    }
+    ESP_RETURN_ON_ERROR(apply(&cal), TAG, "calibrage refuse");
+
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "echec ouverture NVS");
+    esp_err_t err = calibration ? nvs_set_blob(nvs, NVS_KEY, &cal, sizeof(cal)) : nvs_erase_key(nvs, NVS_KEY);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    ESP_RETURN_ON_ERROR(err, TAG, "echec enregistrement du calibrage");
+    return ESP_OK;
+}
+
+void color_correction_get(color_calibration_t *calibration)
+{
+    *calibration = g_calibration;
+}
+
+void color_correction_xy_to_rgb(uint16_t x, uint16_t y, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    float fx = (float)x / 65535.0f;
+    float fy = (float)y / 65535.0f;
+
+    if (fy < 0.0001f) {
+        fy = 0.0001f;
+    }
+
+    // Pleine luminosite : Y = 1, la luminosite est appliquee par l'etage de sortie
+    float X = fx / fy;
+    float Z = (1.0f - fx - fy) / fy;
+    float fr, fg, fb;
+    xyz_to_rgb(X, 1.0f, Z, &fr, &fg, &fb);
+
+    *r = encode_channel(fr);
+    *g = encode_channel(fg);
+    *b = encode_channel(fb);
+}
+
+/* Index de table d'une temperature, bornee a la plage supportee */
+static int mired_index(uint16_t mireds)
+{
+    if (mireds < COLOR_CORRECTION_MIREDS_MIN) {
+        mireds = COLOR_CORRECTION_MIREDS_MIN;
+    }
+    if (mireds > COLOR_CORRECTION_MIREDS_MAX) {
+        mireds = COLOR_CORRECTION_MIREDS_MAX;
+    }
+    return mireds - COLOR_CORRECTION_MIREDS_MIN;
+}
+
+void color_correction_mired_to_xy(uint16_t mireds, uint16_t *x, uint16_t *y)
+{
+    int m = mired_index(mireds);
+    *x = s_planckian_xy[m][0];
+    *y = s_planckian_xy[m][1];
+}
+
+void color_correction_mired_to_rgb(uint16_t mireds, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    int m = mired_index(mireds);
+    *r = g_mired_rgb[m][0];
+    *g = g_mired_rgb[m][1];
+    *b = g_mired_rgb[m][2];
+}
@@ -0,0 +1,93 @@
+#ifndef COLOR_CORRECTION_H
+#define COLOR_CORRECTION_H
+
+#include <stdint.h>
+#include "esp_err.h"
+
+/* Valeur d'un gain ou d'une chromaticité égale à 1 */
+#define COLOR_CORRECTION_UNIT       65535
+/* Gamma d'un canal égal à 1 (gamma en centièmes) */
+#define COLOR_CORRECTION_GAMMA_UNIT 100
+
+/* Plage de température de couleur : 6500 K - 2000 K */
+#define COLOR_CORRECTION_MIREDS_MIN 153
+#define COLOR_CORRECTION_MIREDS_MAX 500
+
+/* Calibrage du ruban, conservé en NVS */
+typedef struct {
+    uint16_t primaries[3][2];   // Chromaticités x, y des LEDs rouge, verte, bleue (0-65535 = 0-1)
+    uint16_t gain[3];           // Balance des blancs : gain de chaque canal (65535 = 1)
+    uint16_t gamma[3];          // Réponse de chaque canal, en centièmes (100 = linéaire)
+} color_calibration_t;
+
+/* Calibrage par défaut : primaires sRGB, pas de correction (rendu identique à l'absence de calibrage) */
+#define COLOR_CALIBRATION_DEFAULT() {                                       \
+    .primaries = { { 41942, 21627 }, { 19661, 39321 }, { 9830, 3932 } },    \
+    .gain = { COLOR_CORRECTION_UNIT, COLOR_CORRECTION_UNIT, COLOR_CORRECTION_UNIT }, \
+    .gamma = { COLOR_CORRECTION_GAMMA_UNIT, COLOR_CORRECTION_GAMMA_UNIT, COLOR_CORRECTION_GAMMA_UNIT }, \
+}
+
+/**
+ * @brief Charge le calibrage depuis la NVS (ou le calibrage par défaut) et l'applique
+ *
+ * Le moteur d'effets doit être initialisé : les tables par canal sont passées à l'étage de sortie.
+ *
+ * @return
+ *      - ESP_OK en cas de succès (y compris sans calibrage enregistré)
+ *      - Erreur NVS si la lecture a échoué (le calibrage par défaut est alors appliqué)
+ */
+esp_err_t color_correction_init(void);
+
+/**
+ * @brief Applique un nouveau calibrage et l'enregistre en NVS
+ *
+ * La matrice de gamut est recalculée à partir des primaires (blanc D65), les tables par canal
+ * (256 entrées, gain et gamma) sont reconstruites puis passées à l'étage de sortie, et la table
+ * des températures de couleur est recalculée.
+ *
+ * @param calibration Calibrage (NULL pour revenir au calibrage par défaut)
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - ESP_ERR_INVALID_ARG si les primaires ne forment pas un triangle valide
+ *      - Erreur NVS si l'enregistrement a échoué (le calibrage est tout de même appliqué)
+ */
+esp_err_t color_correction_set(const color_calibration_t *calibration);
+
+/**
+ * @brief Calibrage courant
+ *
+ * @param calibration Calibrage à remplir
+ */
+void color_correction_get(color_calibration_t *calibration);
+
+/**
+ * @brief Convertit une couleur CIE 1931 x, y en RGB pour les primaires réelles du ruban
+ *
+ * Couleur à pleine luminosité (Y = 1), gamma sRGB, composantes hors gamut bornées.
+ *
+ * @param x, y Chromaticité (0-65535 = 0-1)
+ * @param r, g, b Composantes RGB
+ */
+void color_correction_xy_to_rgb(uint16_t x, uint16_t y, uint8_t *r, uint8_t *g, uint8_t *b);
+
+/**
+ * @brief Chromaticité du corps noir (lieu de Planck) pour une température de couleur
+ *
+ * Lecture d'une table en flash, sans calcul flottant.
+ *
+ * @param mireds Température en mireds, bornée à COLOR_CORRECTION_MIREDS_MIN-COLOR_CORRECTION_MIREDS_MAX
+ * @param x, y Chromaticité (0-65535 = 0-1)
+ */
+void color_correction_mired_to_xy(uint16_t mireds, uint16_t *x, uint16_t *y);
+
+/**
+ * @brief Couleur RGB corrigée d'une température de couleur
+ *
+ * Lecture d'une table recalculée à chaque changement de calibrage, sans calcul flottant.
+ *
+ * @param mireds Température en mireds, bornée à COLOR_CORRECTION_MIREDS_MIN-COLOR_CORRECTION_MIREDS_MAX
+ * @param r, g, b Composantes RGB
+ */
+void color_correction_mired_to_rgb(uint16_t mireds, uint8_t *r, uint8_t *g, uint8_t *b);
+
+#endif /* COLOR_CORRECTION_H */
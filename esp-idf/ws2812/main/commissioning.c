@@ -0,0 +1,208 @@
+/*
+ * Liaison directe des telecommandes : cible Touchlink, cible Finding & Binding
+ * et puits Green Power (routeur)
+ */
+
+#include "commissioning.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "zboss_api.h"
+#include "main.h"
+#if CONFIG_ZB_GP_ENABLED
+#include "zgp/esp_zigbee_zgpd.h"
+#include "zgp/esp_zigbee_zgps.h"
+#endif
+
+static const char *TAG = "COMMISSIONING";
+
+// Une commande de telecommande ne peut changer de reseau qu'a travers une fenetre ouverte
+static bool s_touchlink_open = false;
+
+static void network_steering_cb(uint8_t param)
+{
+    esp_err_t ret = esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG, "Echec network steering : %s", esp_err_to_name(ret));
+    }
+}
+
+// Fin d'une fenetre Finding & Binding plus courte que le minimum de la pile
+static void finding_binding_stop_cb(uint8_t param)
+{
+    zb_bdb_finding_binding_target_cancel();
+    ESP_LOGI(TAG, "Finding & Binding: fin de la fenetre");
+}
+
+// Initiateur Touchlink : rejoindre ou former un reseau avec lui (appareil neuf ou fenetre ouverte)
+static bool touchlink_action_allowed(uint8_t action)
+{
+    bool allowed = !esp_zb_bdb_dev_joined() || s_touchlink_open;
+    ESP_LOGI(TAG, "Touchlink: action %d %s", action, allowed ? "acceptee" : "refusee (deja sur un reseau)");
+    return allowed;
+}
+
+#if CONFIG_ZB_GP_ENABLED
+
+// Interrupteur Green Power : accepte s'il envoie des commandes d'eclairage (On/Off, Level, Color, scenes)
+static bool gp_device_supported(const esp_zgp_approve_comm_params_t *param)
+{
+    switch (param->device_id) {
+    case ESP_ZB_ZGP_ON_OFF_SWITCH_DEV_ID:
+    case ESP_ZB_ZGP_LEVEL_CONTROL_SWITCH_DEV_ID:
+    case ESP_ZB_ZGP_COLOR_DIMMER_SWITCH_DEV_ID:
+        return true;
+    default:
+        break;
+    }
+    for (uint8_t i = 0; i < param->gpd_cmds_list.num && i < ZB_ZGP_MAX_PAIRED_CONF_GPD_COMMANDS; i++) {
+        uint8_t cmd = param->gpd_cmds_list.cmds[i];
+        if (cmd >= ESP_ZB_GPDF_CMD_RECALL_SCENE0 && cmd <= ESP_ZB_GPDF_CMD_STEP_COLOR) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void gp_handle_signal(esp_zb_app_signal_type_t sig_type, void *params)
+{
+    switch (sig_type) {
+    case ESP_ZB_ZGP_SIGNAL_APPROVE_COMMISSIONING: {
+        const esp_zgp_approve_comm_params_t *param = ((esp_zb_zgp_signal_approve_comm_params_t *)params)->param;
+        bool accepted = gp_device_supported(param);
+        ESP_LOGI(TAG, "Green Power: interrupteur 0x%08lX (type 0x%02X) %s", (unsigned long)param->zgpd_id.addr.src_id,
+                 param->device_id, accepted ? "accepte" : "refuse (pas de commande d'eclairage)");
+        esp_zb_zgps_accept_commissioning(accepted);
+        break;
+    }
+    case ESP_ZB_ZGP_SIGNAL_COMMISSIONING: {
+        const esp_zb_zgp_signal_commissioning_params_t *param = params;
+        if (param->result == ESP_ZB_ZGP_COMMISSIONING_COMPLETED) {
+            ESP_LOGI(TAG, "Green Power: interrupteur 0x%08lX appaire", (unsigned long)param->zgpd_id.addr.src_id);
+        } else if (param->result == ESP_ZB_ZGP_ZGPD_DECOMMISSIONED) {
+            ESP_LOGI(TAG, "Green Power: interrupteur 0x%08lX retire", (unsigned long)param->zgpd_id.addr.src_id);
+        } else {
+            ESP_LOGW(TAG, "Green Power: echec de l'appairage (%d)", param->result);
+        }
+        break;
+    }
+    case ESP_ZB_ZGP_SIGNAL_MODE_CHANGE: {
+        const esp_zb_zgp_signal_mode_change_params_t *param = params;
+        ESP_LOGI(TAG, "Green Power: mode %s", param->new_mode == ESP_ZB_ZGP_COMMISSIONING_MODE ? "appairage" : "normal");
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+#endif /* CONFIG_ZB_GP_ENABLED */
+
+void commissioning_init(void)
+{
+    esp_zb_zdo_touchlink_target_set_timeout(COMMISSIONING_TOUCHLINK_S);
+    esp_zb_touchlink_action_check_register(touchlink_action_allowed);
+
+#if CONFIG_ZB_GP_ENABLED
+    // Interrupteurs du commerce : trames authentifiees sans chiffrement au minimum
+    esp_zb_zgps_set_security_level(ESP_ZB_ZGP_FILL_GPS_SECURITY_LEVEL(ESP_ZB_ZGP_SEC_LEVEL_FULL_NO_ENC,
+        ESP_ZB_ZGP_SEC_LEVEL_PROTECTION_WITHOUT_GP_LINK_KEY, ESP_ZB_ZGP_SEC_LEVEL_PROTECTION_DO_NOT_INVOLVE_TC));
+    esp_zb_zgps_set_communication_mode(ESP_ZB_ZGP_COMMUNICATION_MODE_LIGHTWEIGHT_UNICAST);
+    esp_zb_zgps_set_commissioning_exit_mode(ESP_ZGP_COMMISSIONING_EXIT_MODE_ON_CWE_OR_PS);
+    esp_zb_zgps_set_commissioning_window(COMMISSIONING_WINDOW_S);
+#endif
+}
+
+void commissioning_cluster_add(esp_zb_cluster_list_t *cluster_list)
+{
+    esp_zb_touchlink_commissioning_cfg_t touchlink_cfg = { };
+    esp_zb_cluster_list_add_touchlink_commissioning_cluster(cluster_list,
+        esp_zb_touchlink_commissioning_cluster_create(&touchlink_cfg), ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+}
+
+void commissioning_touchlink_target(void)
+{
+    ESP_LOGI(TAG, "Cible Touchlink pendant %d s", COMMISSIONING_TOUCHLINK_S);
+    esp_err_t ret = esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_TOUCHLINK_TARGET);
+    if (ret != ESP_OK) {
+        ESP_LOGW(TAG, "Touchlink indisponible (%s), appairage classique", esp_err_to_name(ret));
+        esp_zb_scheduler_alarm(network_steering_cb, 0, 1000);
+    }
+}
+
+esp_err_t commissioning_open(uint8_t modes, uint16_t duration_s)
+{
+    ESP_RETURN_ON_FALSE(esp_zb_bdb_dev_joined(), ESP_ERR_INVALID_STATE, TAG, "Pas de reseau");
+    if (duration_s == 0) {
+        duration_s = COMMISSIONING_WINDOW_S;
+    }
+#if !CONFIG_ZB_GP_ENABLED
+    if (modes & COMMISSIONING_GREEN_POWER) {
+        ESP_LOGW(TAG, "Green Power: puits disponible sur le routeur uniquement");
+        modes &= ~COMMISSIONING_GREEN_POWER;
+        ESP_RETURN_ON_FALSE(modes != 0, ESP_ERR_NOT_SUPPORTED, TAG, "Aucun mode disponible");
+    }
+#endif
+
+    if (modes & COMMISSIONING_FINDING_BINDING) {
+        // Identification de chaque endpoint : une telecommande s'y lie ou l'ajoute a son groupe.
+        // La pile refuse moins de COMMISSIONING_WINDOW_S : une fenetre plus courte est annulee a l'echeance.
+        uint16_t identify_s = duration_s < COMMISSIONING_WINDOW_S ? COMMISSIONING_WINDOW_S : duration_s;
+        esp_zb_scheduler_alarm_cancel(finding_binding_stop_cb, 0);
+        zb_bdb_finding_binding_target_cancel();
+        for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+            zb_ret_t ret = zb_bdb_finding_binding_target_ext(HA_ESP_LIGHT_ENDPOINT + seg, identify_s);
+            if (ret != RET_OK) {
+                ESP_LOGW(TAG, "Finding & Binding: echec sur l'endpoint %d (%d)", HA_ESP_LIGHT_ENDPOINT + seg, ret);
+            }
+        }
+        if (duration_s < identify_s) {
+            esp_zb_scheduler_alarm(finding_binding_stop_cb, 0, duration_s * 1000);
+        }
+        ESP_LOGI(TAG, "Finding & Binding: cible pendant %d s", duration_s);
+    }
+#if CONFIG_ZB_GP_ENABLED
+    if (modes & COMMISSIONING_GREEN_POWER) {
+        // Tous les endpoints correspondants sont lies ; fin a la premiere paire ou a l'expiration
+        esp_zb_zgps_set_commissioning_window(duration_s);
+        esp_zb_zgps_start_commissioning_on_endpoint(HA_ESP_LIGHT_ENDPOINT, 0);
+        ESP_LOGI(TAG, "Green Power: appairage pendant %d s", duration_s);
+    }
+#endif
+    if (modes & COMMISSIONING_TOUCHLINK) {
+        s_touchlink_open = true;
+        ESP_RETURN_ON_ERROR(esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_TOUCHLINK_TARGET), TAG,
+                            "Echec cible Touchlink");
+        ESP_LOGI(TAG, "Cible Touchlink pendant %d s", COMMISSIONING_TOUCHLINK_S);
+    }
+    return ESP_OK;
+}
+
+bool commissioning_handle_signal(esp_zb_app_signal_t *signal_struct)
+{
+    esp_zb_app_signal_type_t sig_type = *signal_struct->p_app_signal;
+
+    switch (sig_type) {
+    case ESP_ZB_BDB_SIGNAL_TOUCHLINK_TARGET:
+        if (signal_struct->esp_err_status == ESP_OK) {
+            ESP_LOGI(TAG, "Touchlink: initiateur detecte");
+        }
+        return true;
+    case ESP_ZB_BDB_SIGNAL_TOUCHLINK_TARGET_FINISHED:
+        s_touchlink_open = false;
+        // Appareil neuf sans initiateur : appairage classique, puis de nouveau Touchlink en cas d'echec
+        if (!esp_zb_bdb_dev_joined()) {
+            ESP_LOGI(TAG, "Touchlink: aucun initiateur, appairage classique");
+            esp_zb_scheduler_alarm(network_steering_cb, 0, 100);
+        }
+        return true;
+#if CONFIG_ZB_GP_ENABLED
+    case ESP_ZB_ZGP_SIGNAL_APPROVE_COMMISSIONING:
+    case ESP_ZB_ZGP_SIGNAL_COMMISSIONING:
+    case ESP_ZB_ZGP_SIGNAL_MODE_CHANGE:
+        gp_handle_signal(sig_type, esp_zb_app_signal_get_params(signal_struct->p_app_signal));
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
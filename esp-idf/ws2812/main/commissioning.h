@@ -0,0 +1,85 @@
+#ifndef COMMISSIONING_H
+#define COMMISSIONING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_err.h"
+#include "esp_zigbee_core.h"
+
+/*
+ * Liaison directe des télécommandes et interrupteurs au ruban
+ *
+ * - Touchlink (cible) : un appareil neuf attend une télécommande Touchlink avant l'appairage
+ *   classique, puis en alternance tant qu'il n'a pas rejoint de réseau.
+ * - Finding & Binding (cible) : les endpoints s'identifient, une télécommande On/Off, Level ou
+ *   Color Control s'y lie ou les ajoute à son groupe (Add Group If Identifying).
+ * - Green Power (puits, routeur uniquement) : les interrupteurs sans pile sont appairés aux
+ *   endpoints, leurs commandes traduites en commandes ZCL par la pile.
+ *
+ * Les commandes de la télécommande arrivent directement au ruban (unicast lié ou groupe) et sont
+ * traitées sur place, sans passer par le coordinateur.
+ */
+
+/* Durée par défaut d'une fenêtre d'appairage (bdbcMinCommissioningTime) */
+#define COMMISSIONING_WINDOW_S          180
+
+/* Fenêtre d'attente Touchlink avant l'appairage classique (appareil neuf) */
+#define COMMISSIONING_TOUCHLINK_S       20
+
+/* Modes d'une fenêtre d'appairage (masque, LIGHT_CMD_COMMISSION) */
+typedef enum {
+    COMMISSIONING_FINDING_BINDING   = 0x01,     // Cible Finding & Binding sur tous les endpoints
+    COMMISSIONING_GREEN_POWER       = 0x02,     // Puits Green Power en mode appairage
+    COMMISSIONING_TOUCHLINK         = 0x04,     // Cible Touchlink (appareil déjà sur le réseau)
+} commissioning_mode_t;
+
+/**
+ * @brief Configure Touchlink et le puits Green Power
+ *
+ * À appeler après esp_zb_init() et avant esp_zb_start().
+ */
+void commissioning_init(void);
+
+/**
+ * @brief Ajoute le cluster Touchlink Commissioning (serveur) à un endpoint
+ *
+ * À appeler pour un seul endpoint, avant esp_zb_device_register().
+ *
+ * @param cluster_list Liste des clusters de l'endpoint
+ */
+void commissioning_cluster_add(esp_zb_cluster_list_t *cluster_list);
+
+/**
+ * @brief Attend une télécommande Touchlink (COMMISSIONING_TOUCHLINK_S)
+ *
+ * Sans initiateur, l'appairage classique (network steering) démarre à la fin de la fenêtre.
+ */
+void commissioning_touchlink_target(void);
+
+/**
+ * @brief Ouvre une fenêtre d'appairage pour les télécommandes et interrupteurs
+ *
+ * Finding & Binding et Green Power durent duration_s ; la fenêtre Touchlink dure
+ * COMMISSIONING_TOUCHLINK_S.
+ *
+ * @param modes Masque de commissioning_mode_t
+ * @param duration_s Durée de la fenêtre (0 : COMMISSIONING_WINDOW_S)
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - ESP_ERR_INVALID_STATE si l'appareil n'est pas sur un réseau
+ *      - ESP_ERR_NOT_SUPPORTED si aucun mode demandé n'est disponible (Green Power sur end device)
+ */
+esp_err_t commissioning_open(uint8_t modes, uint16_t duration_s);
+
+/**
+ * @brief Traite les signaux Touchlink et Green Power
+ *
+ * ESP_ZB_BDB_SIGNAL_TOUCHLINK_NWK (réseau rejoint) reste au gestionnaire principal.
+ *
+ * @param signal_struct Signal reçu par esp_zb_app_signal_handler()
+ * @return true si le signal a été traité
+ */
+bool commissioning_handle_signal(esp_zb_app_signal_t *signal_struct);
+
+#endif /* COMMISSIONING_H */
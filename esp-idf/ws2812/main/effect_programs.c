@@ -0,0 +1,116 @@
+/*
+ * Programmes d'effets (bytecode effect_vm) : telechargement par morceaux,
+ * verification et conservation en NVS
+ */
+
+#include "effect_programs.h"
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "nvs.h"
+
+static const char *TAG = "PROGRAMS";
+
+#define NVS_NAMESPACE   "fxvm"
+#define PROGRAM_MAX_LEN (EFFECT_VM_HEADER_LEN + EFFECT_VM_MAX_CODE)
+
+static effect_vm_program_t g_programs[EFFECT_PROGRAMS_SLOTS];
+
+// Telechargement en cours : un seul a la fois, morceaux dans l'ordre
+static uint8_t g_upload[PROGRAM_MAX_LEN];
+static uint16_t g_upload_len = 0;
+static uint8_t g_upload_slot = 0xFF;
+
+static void slot_key(uint8_t slot, char *key, size_t size)
+{
+    snprintf(key, size, "p%u", slot);
+}
+
+esp_err_t effect_programs_init(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        return ESP_OK;
+    }
+    ESP_RETURN_ON_ERROR(err, TAG, "echec ouverture NVS");
+
+    for (uint8_t slot = 0; slot < EFFECT_PROGRAMS_SLOTS; slot++) {
+        char key[8];
+        size_t len = sizeof(g_upload);
+        slot_key(slot, key, sizeof(key));
+        if (nvs_get_blob(nvs, key, g_upload, &len) != ESP_OK) {
+            continue;
+        }
+        uint16_t pc;
+        effect_vm_status_t status = effect_vm_load(&g_programs[slot], g_upload, len, &pc);
+        if (status != EFFECT_VM_OK) {
+            ESP_LOGW(TAG, "Programme %u refuse (erreur %d a %u)", slot, status, pc);
+            continue;
+        }
+        ESP_LOGI(TAG, "Programme %u: %u octets, budget %u", slot, g_programs[slot].code_len, g_programs[slot].budget);
+    }
+    nvs_close(nvs);
+    return ESP_OK;
+}
+
+esp_err_t effect_programs_write(uint8_t slot, uint16_t offset, const uint8_t *data, uint16_t len)
+{
+    ESP_RETURN_ON_FALSE(slot < EFFECT_PROGRAMS_SLOTS, ESP_ERR_INVALID_ARG, TAG, "emplacement invalide (%u)", slot);
+    ESP_RETURN_ON_FALSE(offset + len <= PROGRAM_MAX_LEN, ESP_ERR_INVALID_SIZE, TAG, "programme trop long");
+
+    if (offset == 0) {
+        g_upload_slot = slot;
+        g_upload_len = 0;
+    }
+    // Un morceau perdu ou repete invalide le telechargement : il faut recommencer a 0
+    if (slot != g_upload_slot || offset != g_upload_len) {
+        g_upload_slot = 0xFF;
+        ESP_LOGW(TAG, "Morceau hors sequence (emplacement %u, offset %u)", slot, offset);
+        return ESP_ERR_INVALID_STATE;
+    }
+    memcpy(&g_upload[offset], data, len);
+    g_upload_len += len;
+    return ESP_OK;
+}
+
+esp_err_t effect_programs_commit(uint8_t slot, uint16_t len)
+{
+    ESP_RETURN_ON_FALSE(slot < EFFECT_PROGRAMS_SLOTS, ESP_ERR_INVALID_ARG, TAG, "emplacement invalide (%u)", slot);
+
+    char key[8];
+    slot_key(slot, key, sizeof(key));
+    if (len == 0) {
+        memset(&g_programs[slot], 0, sizeof(g_programs[slot]));
+    } else {
+        ESP_RETURN_ON_FALSE(slot == g_upload_slot && len == g_upload_len, ESP_ERR_INVALID_STATE, TAG,
+                            "telechargement incomplet (%u/%u octets)", g_upload_len, len);
+        effect_vm_program_t program;
+        uint16_t pc;
+        effect_vm_status_t status = effect_vm_load(&program, g_upload, len, &pc);
+        ESP_RETURN_ON_FALSE(status == EFFECT_VM_OK, ESP_ERR_INVALID_RESPONSE, TAG,
+                            "programme refuse (erreur %d a %u)", status, pc);
+        g_programs[slot] = program;
+    }
+    g_upload_slot = 0xFF;
+
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "echec ouverture NVS");
+    esp_err_t err = len ? nvs_set_blob(nvs, key, g_upload, len) : nvs_erase_key(nvs, key);
+    if (err == ESP_ERR_NVS_NOT_FOUND) {
+        err = ESP_OK;
+    }
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    ESP_RETURN_ON_ERROR(err, TAG, "echec enregistrement du programme");
+    ESP_LOGI(TAG, "Programme %u %s (%u octets)", slot, len ? "enregistre" : "efface", len);
+    return ESP_OK;
+}
+
+const effect_vm_program_t *effect_programs_get(uint8_t slot)
+{
+    return (slot < EFFECT_PROGRAMS_SLOTS) ? &g_programs[slot] : NULL;
+}
@@ -0,0 +1,67 @@
+#ifndef EFFECT_PROGRAMS_H
+#define EFFECT_PROGRAMS_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "effect_vm.h"
+
+/* Emplacements de programmes, conservés en NVS */
+#define EFFECT_PROGRAMS_SLOTS       4
+
+/**
+ * @brief Charge les programmes enregistrés en NVS
+ *
+ * Un programme illisible ou refusé par le vérificateur laisse son emplacement vide.
+ *
+ * @return
+ *      - ESP_OK en cas de succès (y compris sans programme enregistré)
+ *      - Erreur NVS si la lecture a échoué
+ */
+esp_err_t effect_programs_init(void);
+
+/**
+ * @brief Écrit un morceau de programme dans le buffer de téléchargement
+ *
+ * Le buffer est commun à tous les emplacements : un téléchargement commence à l'offset 0
+ * et se termine par effect_programs_commit() sur le même emplacement.
+ *
+ * @param slot Emplacement visé
+ * @param offset Position dans le programme (en-tête compris)
+ * @param data Données
+ * @param len Taille des données
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - ESP_ERR_INVALID_ARG si l'emplacement est invalide
+ *      - ESP_ERR_INVALID_SIZE si le morceau dépasse la taille maximale d'un programme
+ *      - ESP_ERR_INVALID_STATE si le morceau ne suit pas le précédent
+ */
+esp_err_t effect_programs_write(uint8_t slot, uint16_t offset, const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Vérifie le programme téléchargé, l'enregistre en NVS et le rend disponible
+ *
+ * Le programme remplace celui de l'emplacement, y compris sur les segments qui l'exécutent :
+ * à appeler entre effects_begin_update() et effects_end_update().
+ *
+ * @param slot Emplacement visé
+ * @param len Taille totale du programme (0 : efface l'emplacement)
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - ESP_ERR_INVALID_ARG si l'emplacement est invalide
+ *      - ESP_ERR_INVALID_STATE si le téléchargement est incomplet ou vise un autre emplacement
+ *      - ESP_ERR_INVALID_RESPONSE si le vérificateur refuse le programme
+ *      - Erreur NVS si l'enregistrement a échoué (le programme est tout de même chargé)
+ */
+esp_err_t effect_programs_commit(uint8_t slot, uint16_t len);
+
+/**
+ * @brief Programme d'un emplacement
+ *
+ * Le pointeur reste valide : un nouveau programme est chargé au même endroit.
+ *
+ * @param slot Emplacement
+ * @return Programme (code_len = 0 si l'emplacement est vide), NULL si l'emplacement est invalide
+ */
+const effect_vm_program_t *effect_programs_get(uint8_t slot);
+
+#endif /* EFFECT_PROGRAMS_H */
@@ -0,0 +1,327 @@
+/*
+ * Interpreteur de bytecode des effets : machine a pile sur entiers 32 bits,
+ * code verifie au chargement, budget d'instructions par pixel
+ */
+
+#include "effect_vm.h"
+#include <string.h>
+
+// Quart de periode de SIN8 : 127 sin(pi/2 k/64), k = 0-64
+static const uint8_t s_sin_quarter[65] = {
+      0,   3,   6,   9,  12,  16,  19,  22,  25,  28,  31,  34,  37,
+     40,  43,  46,  49,  51,  54,  57,  60,  63,  65,  68,  71,  73,
+     76,  78,  81,  83,  85,  88,  90,  92,  94,  96,  98, 100, 102,
+    104, 106, 107, 109, 111, 112, 113, 115, 116, 117, 118, 120, 121,
+    122, 122, 123, 124, 125, 125, 126, 126, 126, 127, 127, 127, 127,
+};
+
+/* Taille des operandes d'un opcode, -1 si l'opcode est inconnu */
+static int operand_size(uint8_t op)
+{
+    switch (op) {
+        case EFFECT_VM_OP_PUSH8:
+        case EFFECT_VM_OP_IN:
+        case EFFECT_VM_OP_LD:
+        case EFFECT_VM_OP_ST:
+            return 1;
+        case EFFECT_VM_OP_PUSH16:
+        case EFFECT_VM_OP_JMP:
+        case EFFECT_VM_OP_JZ:
+        case EFFECT_VM_OP_JNZ:
+            return 2;
+        case EFFECT_VM_OP_PUSH32:
+            return 4;
+        default:
+            break;
+    }
+    if (op <= EFFECT_VM_OP_OVER || (op >= EFFECT_VM_OP_ADD && op <= EFFECT_VM_OP_GT) ||
+        (op >= EFFECT_VM_OP_SIN8 && op <= EFFECT_VM_OP_HSV)) {
+        return 0;
+    }
+    return -1;
+}
+
+static uint16_t get_u16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+effect_vm_status_t effect_vm_load(effect_vm_program_t *program, const uint8_t *data, size_t len, uint16_t *error_pc)
+{
+    uint8_t starts[EFFECT_VM_MAX_CODE / 8] = {0};
+    uint16_t pc = 0;
+
+    memset(program, 0, sizeof(*program));
+    if (error_pc) {
+        *error_pc = 0;
+    }
+    if (len < EFFECT_VM_HEADER_LEN || data[0] != EFFECT_VM_MAGIC_0 || data[1] != EFFECT_VM_MAGIC_1 ||
+        data[2] != EFFECT_VM_VERSION) {
+        return EFFECT_VM_ERR_FORMAT;
+    }
+    uint16_t code_len = get_u16(&data[4]);
+    if (code_len == 0 || code_len > EFFECT_VM_MAX_CODE || len < EFFECT_VM_HEADER_LEN + (size_t)code_len) {
+        return EFFECT_VM_ERR_FORMAT;
+    }
+    const uint8_t *code = &data[EFFECT_VM_HEADER_LEN];
+
+    // Premiere passe : decodage de chaque instruction, debuts d'instruction notes pour les sauts
+    while (pc < code_len) {
+        uint8_t op = code[pc];
+        int size = operand_size(op);
+        if (error_pc) {
+            *error_pc = pc;
+        }
+        if (size < 0) {
+            return EFFECT_VM_ERR_OPCODE;
+        }
+        if (pc + 1 + size > code_len) {
+            return EFFECT_VM_ERR_OPERAND;
+        }
+        if ((op == EFFECT_VM_OP_IN && code[pc + 1] >= EFFECT_VM_IN_MAX) ||
+            ((op == EFFECT_VM_OP_LD || op == EFFECT_VM_OP_ST) && code[pc + 1] >= EFFECT_VM_REGS)) {
+            return EFFECT_VM_ERR_OPERAND;
+        }
+        starts[pc / 8] |= 1 << (pc % 8);
+        pc += 1 + size;
+    }
+
+    // Seconde passe : chaque saut vise le debut d'une instruction
+    for (pc = 0; pc < code_len; pc += 1 + operand_size(code[pc])) {
+        uint8_t op = code[pc];
+        if (op != EFFECT_VM_OP_JMP && op != EFFECT_VM_OP_JZ && op != EFFECT_VM_OP_JNZ) {
+            continue;
+        }
+        uint16_t target = get_u16(&code[pc + 1]);
+        if (target >= code_len || !(starts[target / 8] & (1 << (target % 8)))) {
+            if (error_pc) {
+                *error_pc = pc;
+            }
+            return EFFECT_VM_ERR_JUMP;
+        }
+    }
+
+    program->budget = data[3] ? data[3] : EFFECT_VM_BUDGET_DEFAULT;
+    program->code_len = code_len;
+    memcpy(program->code, code, code_len);
+    return EFFECT_VM_OK;
+}
+
+static int32_t sin8(int32_t x)
+{
+    uint8_t k = x & 63;
+    switch ((x >> 6) & 3) {
+        case 0: return 128 + s_sin_quarter[k];
+        case 1: return 128 + s_sin_quarter[64 - k];
+        case 2: return 128 - s_sin_quarter[k];
+        default: return 128 - s_sin_quarter[64 - k];
+    }
+}
+
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint8_t clamp8(int32_t v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/* HSV sur 8 bits (teinte 0-255 pour un tour) */
+static void hsv8(int32_t h, int32_t s, int32_t v, int32_t *out)
+{
+    uint8_t sat = clamp8(s);
+    uint8_t val = clamp8(v);
+    uint16_t h6 = (h & 255) * 6;
+    uint8_t region = h6 >> 8;
+    uint8_t rem = h6 & 255;
+    int32_t p = val * (255 - sat) / 255;
+    int32_t q = val * (255 - sat * rem / 255) / 255;
+    int32_t t = val * (255 - sat * (255 - rem) / 255) / 255;
+
+    switch (region) {
+        case 0: out[0] = val; out[1] = t; out[2] = p; break;
+        case 1: out[0] = q; out[1] = val; out[2] = p; break;
+        case 2: out[0] = p; out[1] = val; out[2] = t; break;
+        case 3: out[0] = p; out[1] = q; out[2] = val; break;
+        case 4: out[0] = t; out[1] = p; out[2] = val; break;
+        default: out[0] = val; out[1] = p; out[2] = q; break;
+    }
+}
+
+// Controles de pile : l'instruction fautive arrete le pixel
+#define NEED(k)     if (sp < (k)) { status = EFFECT_VM_ERR_STACK; break; }
+#define ROOM(k)     if (sp + (k) > EFFECT_VM_STACK_SIZE) { status = EFFECT_VM_ERR_STACK; break; }
+
+effect_vm_status_t effect_vm_run(const effect_vm_program_t *program, const int32_t in[EFFECT_VM_IN_MAX],
+                                 uint8_t rgb[3], uint32_t *steps)
+{
+    const uint8_t *code = program->code;
+    int32_t stack[EFFECT_VM_STACK_SIZE];
+    int32_t reg[EFFECT_VM_REGS] = {0};
+    effect_vm_status_t status = EFFECT_VM_OK;
+    uint32_t count = 0;
+    uint16_t pc = 0;
+    int sp = 0;
+    int32_t a, b;
+
+    rgb[0] = rgb[1] = rgb[2] = 0;
+    if (program->code_len == 0) {
+        status = EFFECT_VM_ERR_FORMAT;
+    }
+
+    while (status == EFFECT_VM_OK) {
+        if (count >= program->budget) {
+            status = EFFECT_VM_ERR_BUDGET;
+            break;
+        }
+        if (pc >= program->code_len) {
+            // Fin du code sans END
+            status = EFFECT_VM_ERR_JUMP;
+            break;
+        }
+        count++;
+
+        uint8_t op = code[pc++];
+        switch (op) {
+            case EFFECT_VM_OP_END:
+                NEED(3);
+                rgb[0] = clamp8(stack[sp - 3]);
+                rgb[1] = clamp8(stack[sp - 2]);
+                rgb[2] = clamp8(stack[sp - 1]);
+                if (steps) {
+                    *steps = count;
+                }
+                return EFFECT_VM_OK;
+
+            case EFFECT_VM_OP_PUSH8:
+                ROOM(1);
+                stack[sp++] = (int8_t)code[pc];
+                pc += 1;
+                break;
+            case EFFECT_VM_OP_PUSH16:
+                ROOM(1);
+                stack[sp++] = (int16_t)get_u16(&code[pc]);
+                pc += 2;
+                break;
+            case EFFECT_VM_OP_PUSH32:
+                ROOM(1);
+                stack[sp++] = (int32_t)(get_u16(&code[pc]) | ((uint32_t)get_u16(&code[pc + 2]) << 16));
+                pc += 4;
+                break;
+            case EFFECT_VM_OP_IN:
+                ROOM(1);
+                stack[sp++] = in[code[pc]];
+                pc += 1;
+                break;
+            case EFFECT_VM_OP_LD:
+                ROOM(1);
+                stack[sp++] = reg[code[pc]];
+                pc += 1;
+                break;
+            case EFFECT_VM_OP_ST:
+                NEED(1);
+                reg[code[pc]] = stack[--sp];
+                pc += 1;
+                break;
+            case EFFECT_VM_OP_DUP:
+                NEED(1);
+                ROOM(1);
+                stack[sp] = stack[sp - 1];
+                sp++;
+                break;
+            case EFFECT_VM_OP_DROP:
+                NEED(1);
+                sp--;
+                break;
+            case EFFECT_VM_OP_SWAP:
+                NEED(2);
+                a = stack[sp - 2];
+                stack[sp - 2] = stack[sp - 1];
+                stack[sp - 1] = a;
+                break;
+            case EFFECT_VM_OP_OVER:
+                NEED(2);
+                ROOM(1);
+                stack[sp] = stack[sp - 2];
+                sp++;
+                break;
+
+            // Operations a un operande : le sommet est remplace
+            case EFFECT_VM_OP_NEG:
+            case EFFECT_VM_OP_SIN8:
+            case EFFECT_VM_OP_TRI8:
+            case EFFECT_VM_OP_HASH:
+            case EFFECT_VM_OP_CLAMP8:
+                NEED(1);
+                a = stack[sp - 1];
+                switch (op) {
+                    case EFFECT_VM_OP_NEG:    a = (int32_t)(0U - (uint32_t)a); break;
+                    case EFFECT_VM_OP_SIN8:   a = sin8(a); break;
+                    case EFFECT_VM_OP_TRI8:   a = (a & 128) ? 255 - ((a & 127) << 1) : ((a & 127) << 1); break;
+                    case EFFECT_VM_OP_HASH:   a = (int32_t)hash32((uint32_t)a); break;
+                    default:                  a = clamp8(a); break;
+                }
+                stack[sp - 1] = a;
+                break;
+
+            case EFFECT_VM_OP_HSV:
+                NEED(3);
+                hsv8(stack[sp - 3], stack[sp - 2], stack[sp - 1], &stack[sp - 3]);
+                break;
+
+            case EFFECT_VM_OP_JMP:
+                pc = get_u16(&code[pc]);
+                break;
+            case EFFECT_VM_OP_JZ:
+            case EFFECT_VM_OP_JNZ:
+                NEED(1);
+                a = stack[--sp];
+                pc = ((a == 0) == (op == EFFECT_VM_OP_JZ)) ? get_u16(&code[pc]) : pc + 2;
+                break;
+
+            // Operations a deux operandes (verifiees au chargement : tout autre opcode est binaire)
+            default:
+                NEED(2);
+                b = stack[--sp];
+                a = stack[sp - 1];
+                switch (op) {
+                    case EFFECT_VM_OP_ADD:    a = (int32_t)((uint32_t)a + (uint32_t)b); break;
+                    case EFFECT_VM_OP_SUB:    a = (int32_t)((uint32_t)a - (uint32_t)b); break;
+                    case EFFECT_VM_OP_MUL:    a = (int32_t)((uint32_t)a * (uint32_t)b); break;
+                    case EFFECT_VM_OP_DIV:    a = (b == 0) ? 0 : (b == -1) ? (int32_t)(0U - (uint32_t)a) : a / b; break;
+                    case EFFECT_VM_OP_MOD:
+                        a = (b == 0 || b == -1) ? 0 : a % b;
+                        if (a != 0 && (a < 0) != (b < 0)) {
+                            a += b;
+                        }
+                        break;
+                    case EFFECT_VM_OP_AND:    a &= b; break;
+                    case EFFECT_VM_OP_OR:     a |= b; break;
+                    case EFFECT_VM_OP_XOR:    a ^= b; break;
+                    case EFFECT_VM_OP_SHL:    a = (int32_t)((uint32_t)a << (b & 31)); break;
+                    case EFFECT_VM_OP_SHR:    a >>= (b & 31); break;
+                    case EFFECT_VM_OP_MIN:    a = (a < b) ? a : b; break;
+                    case EFFECT_VM_OP_MAX:    a = (a > b) ? a : b; break;
+                    case EFFECT_VM_OP_LT:     a = (a < b); break;
+                    case EFFECT_VM_OP_EQ:     a = (a == b); break;
+                    case EFFECT_VM_OP_GT:     a = (a > b); break;
+                    default:                  a = (int32_t)((int64_t)a * b / 255); break;  // SCALE8
+                }
+                stack[sp - 1] = a;
+                break;
+        }
+    }
+
+    rgb[0] = rgb[1] = rgb[2] = 0;
+    if (steps) {
+        *steps = count;
+    }
+    return status;
+}
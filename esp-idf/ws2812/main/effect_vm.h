@@ -0,0 +1,134 @@
+#ifndef EFFECT_VM_H
+#define EFFECT_VM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Interpréteur de bytecode des effets : (index de la LED, temps, paramètres) -> R, G, B
+ *
+ * Machine à pile, entiers 32 bits uniquement, sans accès mémoire hors de sa pile et de ses
+ * registres. Le code est vérifié au chargement (opcodes, opérandes, cibles de saut) et chaque
+ * pixel est borné en nombre d'instructions. Aucune dépendance à ESP-IDF : le même fichier est
+ * compilé par l'assembleur et le banc de test de tools/.
+ */
+
+/* Programme stocké : en-tête EFFECT_VM_HEADER_LEN octets puis le code */
+#define EFFECT_VM_MAGIC_0           'F'
+#define EFFECT_VM_MAGIC_1           'X'
+#define EFFECT_VM_VERSION           1
+#define EFFECT_VM_HEADER_LEN        6   // Magic (2), version (u8), budget (u8, 0 = défaut), longueur du code (u16)
+#define EFFECT_VM_MAX_CODE          256
+
+#define EFFECT_VM_STACK_SIZE        16
+#define EFFECT_VM_REGS              8
+#define EFFECT_VM_PARAMS            4
+
+/* Instructions exécutées au plus par pixel si l'en-tête n'en fixe pas (255 au plus) */
+#define EFFECT_VM_BUDGET_DEFAULT    64
+
+/* Entrées lues par IN */
+typedef enum {
+    EFFECT_VM_IN_INDEX = 0,     // Index de la LED dans le segment
+    EFFECT_VM_IN_COUNT,         // Nombre de LEDs du segment
+    EFFECT_VM_IN_TIME,          // Temps en ms (cyclique sur 32 bits)
+    EFFECT_VM_IN_FRAME,         // Pas d'animation (avance selon la vitesse)
+    EFFECT_VM_IN_P0,            // Paramètres 0-3 (0-255), fixés au lancement
+    EFFECT_VM_IN_P1,
+    EFFECT_VM_IN_P2,
+    EFFECT_VM_IN_P3,
+    EFFECT_VM_IN_R,             // Couleur de base du segment
+    EFFECT_VM_IN_G,
+    EFFECT_VM_IN_B,
+    EFFECT_VM_IN_MAX
+} effect_vm_input_t;
+
+/* Jeu d'instructions. Sauf mention, les opérandes sont dépilés et le résultat empilé ;
+ * a est l'avant-dernier élément, b le sommet de la pile. */
+typedef enum {
+    EFFECT_VM_OP_END = 0x00,    // Fin : le sommet de la pile est B, puis G, puis R (bornés à 0-255)
+    EFFECT_VM_OP_PUSH8,         // + i8 : empile une constante
+    EFFECT_VM_OP_PUSH16,        // + i16 (little-endian)
+    EFFECT_VM_OP_PUSH32,        // + i32 (little-endian)
+    EFFECT_VM_OP_IN,            // + u8 : empile l'entrée effect_vm_input_t
+    EFFECT_VM_OP_LD,            // + u8 : empile un registre
+    EFFECT_VM_OP_ST,            // + u8 : dépile dans un registre
+    EFFECT_VM_OP_DUP,
+    EFFECT_VM_OP_DROP,
+    EFFECT_VM_OP_SWAP,
+    EFFECT_VM_OP_OVER,
+    EFFECT_VM_OP_ADD = 0x10,
+    EFFECT_VM_OP_SUB,
+    EFFECT_VM_OP_MUL,
+    EFFECT_VM_OP_DIV,           // Division par 0 : 0
+    EFFECT_VM_OP_MOD,           // Modulo 0 : 0, résultat du signe de b
+    EFFECT_VM_OP_AND,
+    EFFECT_VM_OP_OR,
+    EFFECT_VM_OP_XOR,
+    EFFECT_VM_OP_SHL,           // Décalage de b & 31
+    EFFECT_VM_OP_SHR,           // Décalage arithmétique de b & 31
+    EFFECT_VM_OP_MIN,
+    EFFECT_VM_OP_MAX,
+    EFFECT_VM_OP_NEG,           // Un opérande
+    EFFECT_VM_OP_LT,            // 1 si a < b, 0 sinon
+    EFFECT_VM_OP_EQ,
+    EFFECT_VM_OP_GT,
+    EFFECT_VM_OP_SIN8 = 0x20,   // Un opérande : 128 + 127 sin(2 pi x / 256), x pris modulo 256
+    EFFECT_VM_OP_TRI8,          // Un opérande : triangle 0-255-0 sur x modulo 256
+    EFFECT_VM_OP_HASH,          // Un opérande : hachage 32 bits (bruit reproductible)
+    EFFECT_VM_OP_SCALE8,        // a * b / 255
+    EFFECT_VM_OP_CLAMP8,        // Un opérande : borné à 0-255
+    EFFECT_VM_OP_HSV,           // h, s, v (0-255) -> r, g, b
+    EFFECT_VM_OP_JMP = 0x30,    // + u16 : saut à une adresse du code
+    EFFECT_VM_OP_JZ,            // + u16 : dépile, saute si nul
+    EFFECT_VM_OP_JNZ,           // + u16 : dépile, saute si non nul
+} effect_vm_op_t;
+
+/* Résultat du chargement ou de l'exécution */
+typedef enum {
+    EFFECT_VM_OK = 0,
+    EFFECT_VM_ERR_FORMAT,       // En-tête invalide ou code absent
+    EFFECT_VM_ERR_OPCODE,       // Opcode inconnu
+    EFFECT_VM_ERR_OPERAND,      // Opérande tronqué, entrée ou registre hors limites
+    EFFECT_VM_ERR_JUMP,         // Cible de saut hors du code ou au milieu d'une instruction
+    EFFECT_VM_ERR_STACK,        // Débordement de la pile (exécution)
+    EFFECT_VM_ERR_BUDGET,       // Budget d'instructions du pixel épuisé (exécution)
+} effect_vm_status_t;
+
+/* Programme chargé et vérifié */
+typedef struct {
+    uint8_t budget;             // Instructions exécutées au plus par pixel
+    uint16_t code_len;          // 0 : emplacement vide
+    uint8_t code[EFFECT_VM_MAX_CODE];
+} effect_vm_program_t;
+
+/**
+ * @brief Charge et vérifie un programme (en-tête puis code)
+ *
+ * Chaque instruction est décodée une fois : opcodes, opérandes, index d'entrée et de registre,
+ * cibles de saut (début d'une instruction du code). La pile n'est vérifiée qu'à l'exécution.
+ *
+ * @param program Programme à remplir
+ * @param data Programme stocké
+ * @param len Taille de data
+ * @param[out] error_pc Adresse de l'instruction fautive (peut être NULL)
+ * @return EFFECT_VM_OK ou la cause du refus
+ */
+effect_vm_status_t effect_vm_load(effect_vm_program_t *program, const uint8_t *data, size_t len, uint16_t *error_pc);
+
+/**
+ * @brief Calcule la couleur d'un pixel
+ *
+ * Court et sans allocation : appelable depuis la boucle de rendu pour chaque LED.
+ *
+ * @param program Programme chargé par effect_vm_load()
+ * @param in Entrées effect_vm_input_t
+ * @param[out] rgb Couleur (noir en cas d'erreur)
+ * @param[out] steps Instructions exécutées (peut être NULL)
+ * @return EFFECT_VM_OK ou l'erreur d'exécution
+ */
+effect_vm_status_t effect_vm_run(const effect_vm_program_t *program, const int32_t in[EFFECT_VM_IN_MAX],
+                                 uint8_t rgb[3], uint32_t *steps);
+
+#endif /* EFFECT_VM_H */
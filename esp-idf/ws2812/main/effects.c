@@ -6,30 +6,285 @@
 #include "effects.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "esp_random.h"
+#include "esp_timer.h"
 #include <math.h>
 #include <stdlib.h>
+#include <string.h>
 
 static const char *TAG = "EFFECTS";
 
+// Dithering temporel : rafraichissement continu a cette periode, desactive si une trame
+// ne peut pas etre envoyee au moins DITHER_MIN_FPS fois par seconde
+#define DITHER_PERIOD_MS    10
+#define DITHER_MIN_FPS      100
+
+// Pile de la tache de rendu : interpreteur effect_vm, limiteur, etage de sortie et journaux.
+// La marge restante est journalisee a chaque nouveau minimum sous EFFECT_TASK_STACK_MARGIN.
+#define EFFECT_TASK_STACK           4096
+#define EFFECT_TASK_STACK_MARGIN    1024
+
+// Tables de correction par canal de l'etage de sortie (NULL : aucune)
+static const uint16_t (*g_color_lut)[256] = NULL;
+
+// Extraction du blanc (rubans RGBW) : couleur de la LED blanche en R, G, B
+static bool g_extract_white = false;
+static rgb_color_t g_white_point = {255, 255, 255};
+
+// Courbe niveau -> luminosite 16 bits, une entree par niveau 0-EFFECTS_LEVEL_MAX
+static uint16_t g_level_curve[EFFECTS_LEVEL_MAX + 1];
+static effects_level_curve_t g_level_curve_id = EFFECTS_CURVE_LINEAR;
+static curve_point_t g_custom_curve[EFFECTS_CURVE_MAX_POINTS];
+static uint8_t g_custom_curve_len = 0;
+
+// Fondu long : periode de mise a jour de la luminosite et de la couleur
+#define FADE_PERIOD_MS      20
+
+/* Fondu long en cours : luminosite et couleur interpolees sur 16 bits, couleur en lumiere lineaire */
+typedef struct {
+    bool running;
+    int64_t start_us;
+    int64_t duration_us;
+    uint16_t from[4];           // Luminosite, R, G, B lineaires de depart (16 bits)
+    uint16_t to[4];             // Luminosite, R, G, B lineaires d'arrivee (16 bits)
+    rgb_color_t to_color;       // Couleur d'arrivee telle que demandee
+    rgb_color_t color;          // Couleur atteinte arrondie a 8 bits (arret du fondu)
+} fade_t;
+
+/* Flux de trames d'un segment : buffers alloues au premier bloc, jamais liberes */
+typedef struct {
+    rgb_color_t *front;         // Trame affichee
+    rgb_color_t *back;          // Trame en cours de reception
+    rgb_color_t *shown;         // Rendu dans l'encodeur : copie lue pendant la transmission
+    bool active;                // Le segment affiche le flux
+    bool pending;               // Le buffer arriere a recu des blocs non presentes
+    bool presented;             // last_frame est valide
+    uint8_t back_frame;         // Numero de la trame en cours de reception
+    uint8_t last_frame;         // Numero de la derniere trame presentee
+} stream_t;
+
+/* Etat d'un segment (plage de LEDs pilotee par un endpoint Zigbee) */
+typedef struct {
+    uint16_t start;             // Premiere LED du segment
+    uint16_t count;             // Nombre de LEDs du segment
+    effect_config_t config;
+    rgb_color_t base_color;
+    uint8_t level;              // Niveau demande (0-255), converti par la courbe de luminosite
+    uint16_t brightness;        // Luminosite du segment en 16 bits (0-65535)
+    uint16_t color_gain;        // Intensite de la couleur de base (fondu), appliquee avec la luminosite
+    bool on;
+    bool dirty;                 // Doit etre redessine au prochain tick
+    uint32_t frame;
+    TickType_t next_frame;      // Tick du prochain pas d'animation
+    rgb_color_t *gradient;      // Table du degrade (allouee au premier usage, jamais liberee)
+    rgb_color_t *gradient_back; // Rendu dans l'encodeur : degrade suivant, echange par take_snapshot()
+    bool gradient_pending;      // gradient_back contient un degrade pas encore affiche
+    bool gradient_on;           // false : roue HSV / couleur de base
+    uint8_t layout;             // Disposition des index (mode palette)
+    uint32_t power[3];          // Somme des canaux R, G, B avant luminosite (estimation du courant)
+    fade_t fade;
+    stream_t stream;
+    const effect_vm_program_t *program; // Programme de EFFECT_PROGRAM (NULL : couleur de base)
+    uint8_t program_params[EFFECT_VM_PARAMS];
+    bool program_fault;         // Arrete apres une erreur, jusqu'au prochain effects_set_program()
+} segment_t;
+
+/* Disposition des index d'un segment dans le framebuffer indexe */
+enum {
+    LAYOUT_NONE = 0,            // Inconnue : a reecrire
+    LAYOUT_FLAT,                // Toutes les LEDs sur la premiere entree du segment
+    LAYOUT_GRADIENT,            // LEDs reparties sur toutes les entrees du segment
+    LAYOUT_TWINKLE,             // Ecrite a chaque pas par l'effet
+};
+
 /* Variables globales */
 static led_strip_handle_t g_led_strip = NULL;
 static uint16_t g_num_leds = 0;
-static effect_config_t g_effect_config = {
-    .type = EFFECT_NONE,
-    .speed = 50,
-    .active = false
-};
-static rgb_color_t g_base_color = {255, 255, 255};
-static uint8_t g_brightness = 255;  // Luminosite globale (0-255)
+static uint8_t g_num_segments = 0;
+static segment_t g_segments[EFFECTS_MAX_SEGMENTS];
+static SemaphoreHandle_t g_lock = NULL;
 static TaskHandle_t g_effect_task_handle = NULL;
-static TaskHandle_t g_identify_task_handle = NULL;
+
+// Identification : clignotement blanc de tout le ruban jusqu'a ce tick
 static bool g_identify_running = false;
+static TickType_t g_identify_until = 0;
+
+// Luminosite des segments appliquee par l'etage de sortie du ruban (sinon par logiciel)
+static bool g_hw_output = false;
+static bool g_output_dirty = false;
+
+// Dithering temporel de l'etage de sortie : la luminosite garde 16 bits jusqu'a l'encodeur
+static bool g_dither_enabled = true;
+static bool g_dither_active = false;
+static uint32_t g_frame_us = 0;         // Duree d'envoi d'une trame (mesuree)
+
+_Static_assert(EFFECTS_MAX_SEGMENTS <= LED_STRIP_MAX_ZONES, "un segment = une zone de l'etage de sortie");
+
+// Limiteur de courant : facteur lisse en 16 bits, applique a tous les segments par l'etage de sortie
+static effects_power_config_t g_power_config = EFFECTS_POWER_CONFIG_DEFAULT(0);
+static effects_power_status_t g_power_status = { .scale = 255 };
+static uint32_t g_limiter = 0xFFFF;
+static uint32_t g_limiter_target = 0xFFFF;
+static TickType_t g_limiter_tick = 0;
+
+// Rendu dans l'encodeur : parametres des segments figes pour la trame en cours de transmission
+typedef struct {
+    uint16_t start;
+    uint16_t count;
+    bool on;
+    effect_type_t type;         // EFFECT_NONE si pas d'animation
+    rgb_color_t color;
+    uint32_t frame;
+    const rgb_color_t *gradient;    // NULL si pas de degrade
+    const rgb_color_t *pixels;      // Trame du flux affichee, NULL sinon
+} segment_snapshot_t;
+
+static bool g_generator = false;
+static uint16_t g_segment_len = 0;
+static segment_snapshot_t g_snapshot[EFFECTS_MAX_SEGMENTS];
+static int16_t g_snapshot_identify = -1;    // Niveau de l'identification en cours, -1 sinon
+static uint8_t g_identify_level = 0;
+
+// Rendu dans l'encodeur : sommes des canaux de chaque segment pour la trame en cours de transmission
+static volatile uint32_t g_generator_power[EFFECTS_MAX_SEGMENTS][3];
+
+// Flux de trames : compteurs de tous les segments
+static effects_stream_stats_t g_stream_stats;
+
+// Framebuffer indexe : entrees de la palette du ruban reservees a chaque segment
+static bool g_indexed = false;
+static uint16_t g_palette_entries = 0;
+
+// Degrades predefinis (cycliques sauf Heat, pour que Rainbow boucle sans saut)
+static const gradient_stop_t s_gradient_ocean[] = {
+    {0, {0, 0, 80}}, {85, {0, 90, 200}}, {170, {0, 200, 180}}, {255, {0, 0, 80}},
+};
+static const gradient_stop_t s_gradient_lava[] = {
+    {0, {40, 0, 0}}, {64, {200, 20, 0}}, {128, {255, 140, 0}}, {192, {255, 230, 120}}, {255, {40, 0, 0}},
+};
+static const gradient_stop_t s_gradient_forest[] = {
+    {0, {0, 60, 0}}, {85, {40, 140, 20}}, {170, {120, 180, 40}}, {255, {0, 60, 0}},
+};
+static const gradient_stop_t s_gradient_party[] = {
+    {0, {85, 0, 171}}, {64, {181, 0, 75}}, {128, {232, 23, 0}}, {192, {184, 71, 0}}, {255, {85, 0, 171}},
+};
+static const gradient_stop_t s_gradient_sunset[] = {
+    {0, {120, 0, 0}}, {51, {255, 104, 0}}, {85, {167, 22, 18}}, {135, {100, 0, 103}}, {198, {16, 0, 130}},
+    {255, {120, 0, 0}},
+};
+static const gradient_stop_t s_gradient_heat[] = {
+    {0, {0, 0, 0}}, {128, {255, 0, 0}}, {224, {255, 255, 0}}, {255, {255, 255, 255}},
+};
+
+static const struct {
+    const char *name;
+    const gradient_stop_t *stops;
+    uint8_t num_stops;
+} s_gradient_presets[GRADIENT_MAX] = {
+    [GRADIENT_NONE]   = {"None", NULL, 0},
+    [GRADIENT_OCEAN]  = {"Ocean", s_gradient_ocean, sizeof(s_gradient_ocean) / sizeof(s_gradient_ocean[0])},
+    [GRADIENT_LAVA]   = {"Lava", s_gradient_lava, sizeof(s_gradient_lava) / sizeof(s_gradient_lava[0])},
+    [GRADIENT_FOREST] = {"Forest", s_gradient_forest, sizeof(s_gradient_forest) / sizeof(s_gradient_forest[0])},
+    [GRADIENT_PARTY]  = {"Party", s_gradient_party, sizeof(s_gradient_party) / sizeof(s_gradient_party[0])},
+    [GRADIENT_SUNSET] = {"Sunset", s_gradient_sunset, sizeof(s_gradient_sunset) / sizeof(s_gradient_sunset[0])},
+    [GRADIENT_HEAT]   = {"Heat", s_gradient_heat, sizeof(s_gradient_heat) / sizeof(s_gradient_heat[0])},
+};
 
 // Buffer pour stocker l'etat de chaque LED (pour twinkle)
 static uint8_t *g_led_brightness = NULL;
 
+// Synchronisation entre appareils : pas d'animation donne par le temps ecoule depuis l'origine
+static bool g_sync_enabled = false;
+static int64_t g_sync_epoch_us = 0;     // Origine commune en temps local
+
+static segment_t *get_segment(uint8_t segment)
+{
+    if (segment >= g_num_segments) {
+        ESP_LOGW(TAG, "Segment invalide: %d", segment);
+        return NULL;
+    }
+    return &g_segments[segment];
+}
+
+/* Reveille la boucle de rendu : les demandes rapprochees sont fusionnees en une seule trame */
+static void request_render(void)
+{
+    if (g_effect_task_handle != NULL) {
+        xTaskNotifyGive(g_effect_task_handle);
+    }
+}
+
+// Verrou recursif : effects_begin_update() le garde pendant plusieurs appels de l'API
+static void lock(void)
+{
+    xSemaphoreTakeRecursive(g_lock, portMAX_DELAY);
+}
+
+static void unlock(void)
+{
+    xSemaphoreGiveRecursive(g_lock);
+}
+
+/* Luminosite effective d'un segment en 16 bits : la sienne, reduite par le limiteur de courant */
+static uint16_t segment_scale16(const segment_t *seg)
+{
+    return ((uint64_t)seg->brightness * seg->color_gain / 0xFFFF * g_limiter) / 0xFFFF;
+}
+
+/* Luminosite effective sur 8 bits, pour le rendu logiciel */
+static uint8_t segment_scale(const segment_t *seg)
+{
+    return segment_scale16(seg) >> 8;
+}
+
+/* Ajoute une couleur portee par 'leds' LEDs a l'estimation du courant du segment */
+static inline void add_power(segment_t *seg, uint8_t r, uint8_t g, uint8_t b, uint32_t leds)
+{
+    seg->power[0] += r * leds;
+    seg->power[1] += g * leds;
+    seg->power[2] += b * leds;
+}
+
+/* Ecrit un pixel du segment, luminosite appliquee ici si l'etage de sortie ne le fait pas */
+static void put_pixel(segment_t *seg, uint16_t index, uint8_t r, uint8_t g, uint8_t b)
+{
+    add_power(seg, r, g, b, 1);
+    if (!g_hw_output) {
+        uint8_t scale = segment_scale(seg);
+        r = (r * scale) / 255;
+        g = (g * scale) / 255;
+        b = (b * scale) / 255;
+    }
+    led_strip_set_pixel(g_led_strip, index, r, g, b);
+}
+
+/* Met a jour l'etage de sortie : une zone par segment, tout le ruban pendant l'identification */
+static void apply_output(void)
+{
+    led_strip_output_config_t output = {
+        .lut = g_color_lut,
+        .white_point = { g_white_point.r, g_white_point.g, g_white_point.b },
+        .flags.extract_white = g_extract_white,
+    };
+    if (g_identify_running) {
+        output.zones[0].start = 0;
+        output.zones[0].count = g_num_leds;
+        output.zones[0].scale = g_limiter;
+        output.num_zones = 1;
+    } else {
+        for (int s = 0; s < g_num_segments; s++) {
+            output.zones[s].start = g_segments[s].start;
+            output.zones[s].count = g_segments[s].count;
+            output.zones[s].scale = segment_scale16(&g_segments[s]);
+        }
+        output.num_zones = g_num_segments;
+    }
+    output.flags.dither = g_dither_active;
+    led_strip_set_output(g_led_strip, &output);
+}
+
 /* Conversion HSV vers RGB (pour effet rainbow) */
 static void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g, uint8_t *b)
 {
@@ -40,7 +295,7 @@ static void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g,
 
     uint8_t region = h / 60;
     uint8_t remainder = (h % 60) * 255 / 60;
-    
+
     uint8_t p = (v * (255 - s)) / 255;
     uint8_t q = (v * (255 - ((s * remainder) / 255))) / 255;
     uint8_t t = (v * (255 - ((s * (255 - remainder)) / 255))) / 255;
@@ -55,62 +310,169 @@ static void hsv_to_rgb(uint16_t h, uint8_t s, uint8_t v, uint8_t *r, uint8_t *g,
     }
 }
 
-/* Effet 1 : Arc-en-ciel (Rainbow) - Degrade sur tout le ruban */
-static void effect_rainbow(uint32_t frame)
+/* Developpe les points d'un degrade (tries) en une table de EFFECTS_GRADIENT_SIZE couleurs */
+static void expand_gradient(rgb_color_t *table, const gradient_stop_t *stops, uint8_t num_stops)
 {
-    for (int i = 0; i < g_num_leds; i++) {
-        // Chaque LED a une teinte differente, le tout defile avec le temps
-        uint16_t hue = ((frame * 3) + (i * 360 / g_num_leds)) % 360;
+    int k = 0;
+    for (int i = 0; i < EFFECTS_GRADIENT_SIZE; i++) {
+        while (k + 1 < num_stops && stops[k + 1].pos <= i) {
+            k++;
+        }
+        const gradient_stop_t *a = &stops[k];
+        // Avant le premier point ou apres le dernier : couleur du point le plus proche
+        if (i <= a->pos || k + 1 >= num_stops) {
+            table[i] = a->color;
+            continue;
+        }
+        const gradient_stop_t *b = &stops[k + 1];
+        int span = b->pos - a->pos;
+        int t = i - a->pos;
+        table[i].r = a->color.r + ((b->color.r - a->color.r) * t) / span;
+        table[i].g = a->color.g + ((b->color.g - a->color.g) * t) / span;
+        table[i].b = a->color.b + ((b->color.b - a->color.b) * t) / span;
+    }
+}
+
+/* Couleur a une position de la roue (0-359) : roue HSV, ou lecture dans le degrade du segment */
+static void wheel_color(const rgb_color_t *gradient, uint16_t hue, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    if (gradient == NULL) {
+        hsv_to_rgb(hue, 255, 255, r, g, b);
+        return;
+    }
+    const rgb_color_t *c = &gradient[hue * EFFECTS_GRADIENT_SIZE / 360];
+    *r = c->r;
+    *g = c->g;
+    *b = c->b;
+}
+
+/* Couleur d'une LED de l'arc-en-ciel */
+static void rainbow_color(const rgb_color_t *gradient, uint16_t i, uint16_t count, uint32_t frame,
+                          uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    // Chaque LED a une teinte differente, le tout defile avec le temps
+    uint16_t hue = ((frame * 3) + (i * 360 / count)) % 360;
+    wheel_color(gradient, hue, r, g, b);
+}
+
+/* Couleur d'un flash du strobe : couleur de base, ou pas de 32 dans le degrade a chaque flash */
+static rgb_color_t strobe_color(const rgb_color_t *gradient, rgb_color_t base, uint32_t frame)
+{
+    if (gradient == NULL) {
+        return base;
+    }
+    return gradient[((frame / 2) * 32) % EFFECTS_GRADIENT_SIZE];
+}
+
+/* Melange d'entiers (pseudo-aleatoire reproductible) */
+static uint32_t hash32(uint32_t x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+/* Couleur d'une etoile du twinkle : couleur de base, ou position fixe dans le degrade par LED */
+static rgb_color_t star_color(const rgb_color_t *gradient, rgb_color_t base, uint32_t index)
+{
+    if (gradient == NULL) {
+        return base;
+    }
+    return gradient[hash32(index) % EFFECTS_GRADIENT_SIZE];
+}
+
+/* Degrade actif du segment, NULL sinon */
+static const rgb_color_t *segment_gradient(const segment_t *seg)
+{
+    return seg->gradient_on ? seg->gradient : NULL;
+}
+
+/* Twinkle sans etat : chaque LED alterne allumee/eteinte par tranches d'environ 12 pas,
+ * comme le twinkle avec buffer (8% de chance de changer d'etat a chaque pas) */
+static uint8_t twinkle_level(uint32_t index, uint32_t frame)
+{
+    uint32_t slot = (frame + hash32(index) % 12) / 12;
+    uint32_t h = hash32(index * 2654435761u ^ slot);
+    if (h & 1) {
+        return 0;
+    }
+    return 180 + ((h >> 8) % 76);
+}
+
+/* Couleur fixe (pas d'effet) */
+static void render_solid(segment_t *seg)
+{
+    for (int i = 0; i < seg->count; i++) {
+        put_pixel(seg, seg->start + i, seg->base_color.r, seg->base_color.g, seg->base_color.b);
+    }
+}
+
+/* Segment eteint */
+static void render_off(const segment_t *seg)
+{
+    for (int i = 0; i < seg->count; i++) {
+        led_strip_set_pixel(g_led_strip, seg->start + i, 0, 0, 0);
+    }
+}
+
+/* Flux de trames : derniere trame presentee */
+static void render_stream(segment_t *seg)
+{
+    for (int i = 0; i < seg->count; i++) {
+        const rgb_color_t *c = &seg->stream.front[i];
+        put_pixel(seg, seg->start + i, c->r, c->g, c->b);
+    }
+}
+
+/* Effet 1 : Arc-en-ciel (Rainbow) - Degrade sur tout le segment */
+static void effect_rainbow(segment_t *seg, uint32_t frame)
+{
+    for (int i = 0; i < seg->count; i++) {
         uint8_t r, g, b;
-        hsv_to_rgb(hue, 255, 255, &r, &g, &b);
-        
-        // Appliquer la luminosite globale
-        r = (r * g_brightness) / 255;
-        g = (g * g_brightness) / 255;
-        b = (b * g_brightness) / 255;
-        
-        led_strip_set_pixel(g_led_strip, i, r, g, b);
-    }
-    led_strip_refresh(g_led_strip);
-    
+        rainbow_color(segment_gradient(seg), i, seg->count, frame, &r, &g, &b);
+        put_pixel(seg, seg->start + i, r, g, b);
+    }
+
     // Log pour debug (seulement toutes les 100 frames)
     if (frame % 100 == 0) {
-        ESP_LOGI(TAG, "Rainbow frame=%lu, brightness=%d", frame, g_brightness);
+        ESP_LOGI(TAG, "Rainbow frame=%lu, brightness=%d", (unsigned long)frame, seg->brightness >> 8);
     }
 }
 
 /* Effet 2 : Strobe (Clignotement) */
-static void effect_strobe(uint32_t frame)
+static void effect_strobe(segment_t *seg, uint32_t frame)
 {
     bool on = (frame % 2) == 0;
-    
-    for (int i = 0; i < g_num_leds; i++) {
-        if (on) {
-            // Appliquer la luminosite globale
-            uint8_t r = (g_base_color.r * g_brightness) / 255;
-            uint8_t g = (g_base_color.g * g_brightness) / 255;
-            uint8_t b = (g_base_color.b * g_brightness) / 255;
-            led_strip_set_pixel(g_led_strip, i, r, g, b);
-        } else {
-            led_strip_set_pixel(g_led_strip, i, 0, 0, 0);
-        }
+    rgb_color_t c = strobe_color(segment_gradient(seg), seg->base_color, frame);
+
+    uint8_t r = on ? c.r : 0;
+    uint8_t g = on ? c.g : 0;
+    uint8_t b = on ? c.b : 0;
+
+    for (int i = 0; i < seg->count; i++) {
+        put_pixel(seg, seg->start + i, r, g, b);
     }
-    led_strip_refresh(g_led_strip);
 }
 
 /* Effet 3 : Twinkle (Scintillement etoiles) */
-static void effect_twinkle(uint32_t frame)
+static void effect_twinkle(segment_t *seg, uint32_t frame)
 {
     if (g_led_brightness == NULL) {
         return;
     }
-    
-    for (int i = 0; i < g_num_leds; i++) {
+    const rgb_color_t *gradient = segment_gradient(seg);
+
+    for (int i = seg->start; i < seg->start + seg->count; i++) {
         uint32_t rand_val = esp_random();
-        
-        // Chaque LED a une chance de changer d'etat (ON ou OFF)
-        if ((rand_val % 100) < 8) {
-            // 8% de chance de changer d'etat
+
+        if (g_sync_enabled) {
+            // Synchronise : etoiles tirees du pas, identiques sur tous les appareils du groupe
+            g_led_brightness[i] = twinkle_level(i, frame);
+        } else if ((rand_val % 100) < 8) {
+            // Chaque LED a 8% de chance de changer d'etat (ON ou OFF)
             if (g_led_brightness[i] == 0) {
                 // Allumer avec luminosite aleatoire (180-255)
                 g_led_brightness[i] = 180 + (rand_val % 76);
@@ -119,224 +481,1603 @@ static void effect_twinkle(uint32_t frame)
                 g_led_brightness[i] = 0;
             }
         }
-        
-        // Appliquer la luminosite de l'etoile ET la luminosite globale
+
+        // Appliquer la luminosite de l'etoile (celle du segment est appliquee par put_pixel)
         uint8_t star_brightness = g_led_brightness[i];
-        uint8_t total_brightness = (star_brightness * g_brightness) / 255;
-        
-        uint8_t r = (g_base_color.r * total_brightness) / 255;
-        uint8_t g = (g_base_color.g * total_brightness) / 255;
-        uint8_t b = (g_base_color.b * total_brightness) / 255;
-        
-        led_strip_set_pixel(g_led_strip, i, r, g, b);
+        rgb_color_t c = star_color(gradient, seg->base_color, i);
+
+        uint8_t r = (c.r * star_brightness) / 255;
+        uint8_t g = (c.g * star_brightness) / 255;
+        uint8_t b = (c.b * star_brightness) / 255;
+
+        put_pixel(seg, i, r, g, b);
     }
-    
-    led_strip_refresh(g_led_strip);
 }
 
-/* Tache FreeRTOS pour gerer les effets */
-static void effect_task(void *pvParameters)
+/* Effet 4 : programme telecharge. Retourne false (segment a dessiner en couleur de base) si le
+ * programme est absent ou s'est arrete sur une erreur. Calcule 'points' couleurs reparties sur le segment. */
+static bool run_program(segment_t *seg, uint32_t frame, uint16_t points,
+                        void (*emit)(segment_t *seg, uint16_t k, const uint8_t *rgb))
 {
-    uint32_t frame = 0;
-    
-    ESP_LOGI(TAG, "Tache d'effets demarree");
-    
-    while (1) {
-        if (g_effect_config.active && g_led_strip != NULL) {
-            switch (g_effect_config.type) {
-                case EFFECT_RAINBOW:
-                    effect_rainbow(frame);
-                    break;
-                    
-                case EFFECT_STROBE:
-                    effect_strobe(frame);
-                    break;
-                    
-                case EFFECT_TWINKLE:
-                    effect_twinkle(frame);
-                    break;
-                    
-                case EFFECT_NONE:
-                default:
-                    break;
-            }
-            
-            frame++;
-            
-            // Delai base sur la vitesse
-            uint32_t delay_ms = 200 - ((g_effect_config.speed * 190) / 255);
-            if (delay_ms < 20) delay_ms = 20;  // Minimum 20ms
-            vTaskDelay(pdMS_TO_TICKS(delay_ms));
-        } else {
-            frame = 0;
-            vTaskDelay(pdMS_TO_TICKS(100));
+    const effect_vm_program_t *program = seg->program;
+    if (program == NULL || program->code_len == 0 || seg->program_fault) {
+        return false;
+    }
+
+    int32_t in[EFFECT_VM_IN_MAX] = {
+        [EFFECT_VM_IN_COUNT] = seg->count,
+        [EFFECT_VM_IN_TIME] = (int32_t)((esp_timer_get_time() - (g_sync_enabled ? g_sync_epoch_us : 0)) / 1000),
+        [EFFECT_VM_IN_FRAME] = frame,
+        [EFFECT_VM_IN_P0] = seg->program_params[0],
+        [EFFECT_VM_IN_P1] = seg->program_params[1],
+        [EFFECT_VM_IN_P2] = seg->program_params[2],
+        [EFFECT_VM_IN_P3] = seg->program_params[3],
+        [EFFECT_VM_IN_R] = seg->base_color.r,
+        [EFFECT_VM_IN_G] = seg->base_color.g,
+        [EFFECT_VM_IN_B] = seg->base_color.b,
+    };
+    uint32_t used = 0;
+    for (uint16_t k = 0; k < points; k++) {
+        uint8_t rgb[3];
+        uint32_t steps = 0;
+        in[EFFECT_VM_IN_INDEX] = (uint32_t)k * seg->count / points;
+        effect_vm_status_t status = effect_vm_run(program, in, rgb, &steps);
+        used += steps;
+        if (status != EFFECT_VM_OK || used > EFFECTS_PROGRAM_FRAME_BUDGET) {
+            ESP_LOGW(TAG, "Segment %d: programme arrete (erreur %d, LED %d, %lu instructions)",
+                     (int)(seg - g_segments), status, (int)in[EFFECT_VM_IN_INDEX], (unsigned long)used);
+            seg->program_fault = true;
+            return false;
         }
+        emit(seg, k, rgb);
+    }
+    return true;
+}
+
+static void emit_pixel(segment_t *seg, uint16_t k, const uint8_t *rgb)
+{
+    put_pixel(seg, seg->start + k, rgb[0], rgb[1], rgb[2]);
+}
+
+static void effect_program(segment_t *seg, uint32_t frame)
+{
+    if (!run_program(seg, frame, seg->count, emit_pixel)) {
+        memset(seg->power, 0, sizeof(seg->power));
+        render_solid(seg);
+    }
+}
+
+/* Delai entre deux pas d'animation, base sur la vitesse */
+static uint32_t effect_period_ms(uint8_t speed)
+{
+    uint32_t delay_ms = 200 - ((speed * 190) / 255);
+    if (delay_ms < 20) delay_ms = 20;  // Minimum 20ms
+    return delay_ms;
+}
+
+static TickType_t effect_period(uint8_t speed)
+{
+    return pdMS_TO_TICKS(effect_period_ms(speed));
+}
+
+/* Mode palette : ecrit une entree de la palette du segment */
+static void set_entry(const segment_t *seg, uint16_t entry, uint8_t r, uint8_t g, uint8_t b)
+{
+    if (!g_hw_output) {
+        uint8_t scale = segment_scale(seg);
+        r = (r * scale) / 255;
+        g = (g * scale) / 255;
+        b = (b * scale) / 255;
+    }
+    uint16_t base = (seg - g_segments) * g_palette_entries;
+    led_strip_set_palette_entry(g_led_strip, base + entry, r, g, b, 0);
+}
+
+/* Mode palette : reecrit les index des LEDs du segment si la disposition change */
+static void set_layout(segment_t *seg, uint8_t layout)
+{
+    if (seg->layout == layout) {
+        return;
     }
+    uint16_t base = (seg - g_segments) * g_palette_entries;
+    for (int i = 0; i < seg->count; i++) {
+        uint16_t entry = (layout == LAYOUT_GRADIENT) ? (i * g_palette_entries / seg->count) : 0;
+        led_strip_set_pixel_index(g_led_strip, seg->start + i, base + entry);
+    }
+    seg->layout = layout;
+}
+
+/* Mode palette : couleur de l'entree k (>= 1) du twinkle */
+static rgb_color_t twinkle_entry_color(const segment_t *seg, const rgb_color_t *gradient, uint16_t k)
+{
+    uint16_t entries = g_palette_entries;
+    if (gradient != NULL) {
+        return gradient[(k - 1) * EFFECTS_GRADIENT_SIZE / (entries - 1)];
+    }
+    uint8_t level = 180 + (k - 1) * 76 / (entries - 1);
+    return (rgb_color_t){ (seg->base_color.r * level) / 255, (seg->base_color.g * level) / 255,
+                          (seg->base_color.b * level) / 255 };
+}
+
+/* Mode palette : entree k du programme, les index des LEDs suivent la disposition en degrade */
+static void emit_entry(segment_t *seg, uint16_t k, const uint8_t *rgb)
+{
+    set_entry(seg, k, rgb[0], rgb[1], rgb[2]);
+    add_power(seg, rgb[0], rgb[1], rgb[2], 1);
 }
 
-/* Tache FreeRTOS pour l'identification (clignotement) */
-static void identify_task(void *pvParameters)
+/* Mode palette : seuls les effets par LED (twinkle) touchent aux pixels.
+ * Le courant est estime a partir des entrees, ponderees par le nombre de LEDs qui les utilisent. */
+static void draw_segment_indexed(segment_t *seg)
 {
-    uint16_t duration_sec = (uint32_t)pvParameters;
-    // Sauvegarder l'etat actuel
-    effect_config_t saved_cfg = g_effect_config;
-    rgb_color_t saved_base = g_base_color;
-    uint8_t saved_brightness = g_brightness;
+    uint16_t entries = g_palette_entries;
+    uint16_t base = (seg - g_segments) * entries;
+    const rgb_color_t *gradient = segment_gradient(seg);
+    rgb_color_t c;
+    uint8_t r, g, b;
 
-    // Mettre en pause les effets pendant l'identify
-    g_effect_config.active = false;
-    g_effect_config.type = EFFECT_NONE;
+    if (!seg->on) {
+        set_layout(seg, LAYOUT_FLAT);
+        set_entry(seg, 0, 0, 0, 0);
+        return;
+    }
+
+    switch (seg->config.active ? seg->config.type : EFFECT_NONE) {
+        case EFFECT_RAINBOW:
+            // Rotation de la palette, les index des LEDs ne bougent pas
+            set_layout(seg, LAYOUT_GRADIENT);
+            for (int k = 0; k < entries; k++) {
+                rainbow_color(gradient, k, entries, seg->frame, &r, &g, &b);
+                set_entry(seg, k, r, g, b);
+                add_power(seg, r, g, b, 1);
+            }
+            // Chaque entree porte en moyenne count / entries LEDs
+            for (int ch = 0; ch < 3; ch++) {
+                seg->power[ch] = (uint64_t)seg->power[ch] * seg->count / entries;
+            }
+            break;
 
-    for (uint16_t i = 0; i < duration_sec * 4; i++) { // 4 clignotements par seconde
-        bool on = (i % 2) == 0;
-        for (int j = 0; j < g_num_leds; j++) {
-            if (on) {
-                led_strip_set_pixel(g_led_strip, j, 255, 255, 255);
+        case EFFECT_STROBE:
+            set_layout(seg, LAYOUT_FLAT);
+            if ((seg->frame % 2) == 0) {
+                c = strobe_color(gradient, seg->base_color, seg->frame);
+                set_entry(seg, 0, c.r, c.g, c.b);
+                add_power(seg, c.r, c.g, c.b, seg->count);
             } else {
-                led_strip_set_pixel(g_led_strip, j, 0, 0, 0);
+                set_entry(seg, 0, 0, 0, 0);
             }
-        }
-        led_strip_refresh(g_led_strip);
-        vTaskDelay(pdMS_TO_TICKS(250));
+            break;
+
+        case EFFECT_TWINKLE:
+            if (entries < 2) {
+                set_layout(seg, LAYOUT_FLAT);
+                set_entry(seg, 0, seg->base_color.r, seg->base_color.g, seg->base_color.b);
+                add_power(seg, seg->base_color.r, seg->base_color.g, seg->base_color.b, seg->count);
+                break;
+            }
+            // Entree 0 : eteinte, entrees suivantes : niveaux 180-255 de la couleur de base,
+            // ou echantillons du degrade (une couleur fixe par LED, sans variation de niveau)
+            set_entry(seg, 0, 0, 0, 0);
+            for (int k = 1; k < entries; k++) {
+                c = twinkle_entry_color(seg, gradient, k);
+                set_entry(seg, k, c.r, c.g, c.b);
+            }
+            for (int i = 0; i < seg->count; i++) {
+                uint8_t level = twinkle_level(seg->start + i, seg->frame);
+                uint16_t entry = 0;
+                if (level && gradient != NULL) {
+                    entry = 1 + hash32(seg->start + i) % (entries - 1);
+                } else if (level) {
+                    entry = 1 + (level - 180) * (entries - 1) / 76;
+                }
+                if (entry) {
+                    c = twinkle_entry_color(seg, gradient, entry);
+                    add_power(seg, c.r, c.g, c.b, 1);
+                }
+                led_strip_set_pixel_index(g_led_strip, seg->start + i, base + entry);
+            }
+            seg->layout = LAYOUT_TWINKLE;
+            break;
+
+        case EFFECT_PROGRAM:
+            set_layout(seg, LAYOUT_GRADIENT);
+            if (run_program(seg, seg->frame, entries, emit_entry)) {
+                for (int ch = 0; ch < 3; ch++) {
+                    seg->power[ch] = (uint64_t)seg->power[ch] * seg->count / entries;
+                }
+                break;
+            }
+            memset(seg->power, 0, sizeof(seg->power));
+            /* fall through */
+        case EFFECT_NONE:
+        default:
+            set_layout(seg, LAYOUT_FLAT);
+            set_entry(seg, 0, seg->base_color.r, seg->base_color.g, seg->base_color.b);
+            add_power(seg, seg->base_color.r, seg->base_color.g, seg->base_color.b, seg->count);
+            break;
+    }
+}
+
+/* Dessine l'etat courant d'un segment dans le buffer du ruban */
+static void draw_segment(segment_t *seg)
+{
+    if (g_generator) {
+        // Les pixels sont calcules par l'encodeur a partir de l'instantane
+        return;
+    }
+    // Estimation du courant recalculee pendant le dessin
+    memset(seg->power, 0, sizeof(seg->power));
+    if (g_indexed) {
+        draw_segment_indexed(seg);
+        return;
+    }
+    if (!seg->on) {
+        render_off(seg);
+        return;
+    }
+    if (seg->stream.active) {
+        render_stream(seg);
+        return;
     }
+    switch (seg->config.active ? seg->config.type : EFFECT_NONE) {
+        case EFFECT_RAINBOW:
+            effect_rainbow(seg, seg->frame);
+            break;
+
+        case EFFECT_STROBE:
+            effect_strobe(seg, seg->frame);
+            break;
 
-    // Eteindre a la fin
-    led_strip_clear(g_led_strip);
-    led_strip_refresh(g_led_strip);
+        case EFFECT_TWINKLE:
+            effect_twinkle(seg, seg->frame);
+            break;
 
-    // Restaurer l'etat precedent si actif
-    g_base_color = saved_base;
-    g_brightness = saved_brightness;
-    if (saved_cfg.active && saved_cfg.type != EFFECT_NONE) {
-        g_effect_config.type = saved_cfg.type;
-        g_effect_config.speed = saved_cfg.speed;
-        g_effect_config.active = true;
+        case EFFECT_PROGRAM:
+            effect_program(seg, seg->frame);
+            break;
+
+        case EFFECT_NONE:
+        default:
+            render_solid(seg);
+            break;
     }
+}
 
-    g_identify_running = false;
-    g_identify_task_handle = NULL;
-    vTaskDelete(NULL);
+/* Le segment avance a chaque pas d'animation (le flux n'est redessine qu'a la presentation) */
+static bool segment_animated(const segment_t *seg)
+{
+    return seg->on && seg->config.active && !seg->stream.active;
 }
 
-void effects_init(led_strip_handle_t strip, uint16_t num_leds)
+/* Fait avancer un segment. Retourne true si des pixels ont change. */
+static bool render_segment(segment_t *seg, TickType_t now)
 {
-    g_led_strip = strip;
-    g_num_leds = num_leds;
-    
-    // Allouer le buffer pour twinkle
-    if (g_led_brightness != NULL) {
-        free(g_led_brightness);
+    if (!segment_animated(seg)) {
+        if (!seg->dirty) {
+            return false;
+        }
+        draw_segment(seg);
+        seg->dirty = false;
+        return true;
     }
-    g_led_brightness = (uint8_t *)calloc(num_leds, sizeof(uint8_t));
-    if (g_led_brightness == NULL) {
-        ESP_LOGE(TAG, "Echec allocation buffer LED");
+
+    // Synchronise : pas calcule depuis l'origine commune, redessine quand il change
+    if (g_sync_enabled) {
+        uint32_t period_ms = effect_period_ms(seg->config.speed);
+        int64_t elapsed_ms = (esp_timer_get_time() - g_sync_epoch_us) / 1000;
+        if (elapsed_ms < 0) {
+            elapsed_ms = 0;
+        }
+        uint32_t frame = (uint32_t)(elapsed_ms / period_ms);
+        seg->next_frame = now + pdMS_TO_TICKS(period_ms - (uint32_t)(elapsed_ms % period_ms));
+        if (!seg->dirty && frame == seg->frame) {
+            return false;
+        }
+        seg->frame = frame;
+        draw_segment(seg);
+        seg->dirty = false;
+        return true;
     }
-    
-    // Creer la tache d'effet
-    BaseType_t ret = xTaskCreate(
-        effect_task,
-        "effect_task",
-        2048,
-        NULL,
-        5,
-        &g_effect_task_handle
-    );
-    
-    if (ret != pdPASS) {
-        ESP_LOGE(TAG, "Echec creation tache d'effet");
-        g_effect_task_handle = NULL;
-    } else {
-        ESP_LOGI(TAG, "Systeme d'effets initialise (%d LEDs)", num_leds);
+
+    // Effet anime : avancer d'un pas si l'echeance est atteinte (ou si l'etat a change)
+    if (!seg->dirty && (int32_t)(now - seg->next_frame) < 0) {
+        return false;
     }
+
+    draw_segment(seg);
+    seg->frame++;
+    seg->next_frame = now + effect_period(seg->config.speed);
+    seg->dirty = false;
+    return true;
 }
 
-void effects_start(effect_type_t type, uint8_t speed)
+/* Fige les parametres des segments pour la trame que l'encodeur va calculer */
+static void take_snapshot(void)
 {
-    if (type >= EFFECT_MAX) {
-        ESP_LOGW(TAG, "Type d'effet invalide: %d", type);
+    for (int s = 0; s < g_num_segments; s++) {
+        segment_t *seg = &g_segments[s];
+        segment_snapshot_t *snap = &g_snapshot[s];
+        if (seg->gradient_pending) {
+            // Aucune transmission en cours : l'encodeur passe au nouveau degrade avec cette trame
+            rgb_color_t *shown = seg->gradient_back;
+            seg->gradient_back = seg->gradient;
+            seg->gradient = shown;
+            seg->gradient_pending = false;
+        }
+        snap->start = seg->start;
+        snap->count = seg->count;
+        snap->on = seg->on;
+        snap->type = seg->config.active ? seg->config.type : EFFECT_NONE;
+        snap->color = seg->base_color;
+        snap->frame = seg->frame;
+        snap->gradient = segment_gradient(seg);
+        snap->pixels = NULL;
+        if (seg->stream.active) {
+            // Copie propre a l'encodeur : une trame presentee pendant la transmission ne la modifie pas
+            memcpy(seg->stream.shown, seg->stream.front, seg->count * sizeof(rgb_color_t));
+            snap->pixels = seg->stream.shown;
+        }
+    }
+    g_snapshot_identify = g_identify_running ? g_identify_level : -1;
+}
+
+/* Generateur de pixels appele par l'encodeur pendant la transmission (interruption : court, sans attente) */
+static void generate_pixel(uint32_t index, uint32_t time_ms, uint8_t *color, void *user_ctx)
+{
+    if (g_snapshot_identify >= 0) {
+        color[0] = color[1] = color[2] = g_snapshot_identify;
         return;
     }
-    
-    // Reset le buffer twinkle quand on demarre un effet
-    if (g_led_brightness != NULL) {
-        memset(g_led_brightness, 0, g_num_leds * sizeof(uint8_t));
+
+    uint32_t s = index / g_segment_len;
+    if (s >= g_num_segments) {
+        s = g_num_segments - 1;
+    }
+    const segment_snapshot_t *snap = &g_snapshot[s];
+    if (!snap->on) {
+        return;
+    }
+
+    uint8_t level;
+    rgb_color_t c;
+    if (snap->pixels != NULL) {
+        c = snap->pixels[index - snap->start];
+        color[0] = c.r;
+        color[1] = c.g;
+        color[2] = c.b;
+        g_generator_power[s][0] += c.r;
+        g_generator_power[s][1] += c.g;
+        g_generator_power[s][2] += c.b;
+        return;
     }
-    
-    g_effect_config.type = type;
-    g_effect_config.speed = (speed == 0) ? 50 : speed;
-    g_effect_config.active = (type != EFFECT_NONE);
-    
-    const char *effect_names[] = {"None", "Rainbow", "Strobe", "Twinkle"};
-    ESP_LOGI(TAG, "Effet demarre: %s (vitesse=%d)", effect_names[type], g_effect_config.speed);
+    switch (snap->type) {
+        case EFFECT_RAINBOW:
+            rainbow_color(snap->gradient, index - snap->start, snap->count, snap->frame,
+                          &color[0], &color[1], &color[2]);
+            break;
+
+        case EFFECT_STROBE:
+            if ((snap->frame % 2) == 0) {
+                c = strobe_color(snap->gradient, snap->color, snap->frame);
+                color[0] = c.r;
+                color[1] = c.g;
+                color[2] = c.b;
+            }
+            break;
+
+        case EFFECT_TWINKLE:
+            level = twinkle_level(index, snap->frame);
+            c = star_color(snap->gradient, snap->color, index);
+            color[0] = (c.r * level) / 255;
+            color[1] = (c.g * level) / 255;
+            color[2] = (c.b * level) / 255;
+            break;
+
+        case EFFECT_NONE:
+        default:
+            color[0] = snap->color.r;
+            color[1] = snap->color.g;
+            color[2] = snap->color.b;
+            break;
+    }
+
+    g_generator_power[s][0] += color[0];
+    g_generator_power[s][1] += color[1];
+    g_generator_power[s][2] += color[2];
 }
 
-void effects_stop(void)
+/* Rendu dans l'encodeur : recupere les sommes de la trame qui vient d'etre transmise */
+static void collect_generator_power(void)
 {
-    g_effect_config.active = false;
-    g_effect_config.type = EFFECT_NONE;
-    ESP_LOGI(TAG, "Effet arrete");
+    if (g_snapshot_identify >= 0) {
+        return;
+    }
+    for (int s = 0; s < g_num_segments; s++) {
+        for (int ch = 0; ch < 3; ch++) {
+            g_segments[s].power[ch] = g_generator_power[s][ch];
+            g_generator_power[s][ch] = 0;
+        }
+    }
 }
 
-void effects_set_base_color(uint8_t r, uint8_t g, uint8_t b)
+/* Estime le courant de la trame composee et fait evoluer le limiteur.
+ * Retourne true si le facteur applique aux segments a change. */
+static bool update_limiter(TickType_t now)
 {
-    g_base_color.r = r;
-    g_base_color.g = g;
-    g_base_color.b = b;
+    const effects_power_config_t *cfg = &g_power_config;
+
+    // Somme des canaux ponderee par la luminosite et le courant de chaque canal (mA * 255 * 65535)
+    uint64_t weighted = 0;
+    for (int ch = 0; ch < 3; ch++) {
+        if (g_identify_running) {
+            weighted += (uint64_t)g_identify_level * 0xFFFF * g_num_leds * cfg->channel_ma[ch];
+            continue;
+        }
+        for (int s = 0; s < g_num_segments; s++) {
+            const segment_t *seg = &g_segments[s];
+            if (seg->on) {
+                weighted += (uint64_t)seg->power[ch] * ((uint32_t)seg->brightness * seg->color_gain / 0xFFFF) *
+                            cfg->channel_ma[ch];
+            }
+        }
+    }
+    uint32_t idle = (uint32_t)g_num_leds * cfg->idle_ua / 1000;
+    uint32_t active = weighted / (255 * 0xFFFF);
+    g_power_status.requested_ma = idle + active;
+
+    g_limiter_target = 0xFFFF;
+    if (cfg->max_current_ma > 0 && g_power_status.requested_ma > cfg->max_current_ma) {
+        g_limiter_target = (cfg->max_current_ma > idle) ? (uint64_t)(cfg->max_current_ma - idle) * 0xFFFF / active : 0;
+    }
+
+    // Lissage : reduction en attack_ms, retour en release_ms
+    uint32_t previous = g_limiter;
+    uint32_t dt = pdTICKS_TO_MS(now - g_limiter_tick);
+    uint32_t tc = (g_limiter_target < g_limiter) ? cfg->attack_ms : cfg->release_ms;
+    g_limiter_tick = now;
+    if (tc == 0 || dt >= tc) {
+        g_limiter = g_limiter_target;
+    } else {
+        int64_t step = ((int64_t)g_limiter_target - g_limiter) * dt / tc;
+        if (step == 0) {
+            step = (g_limiter_target > g_limiter) ? 1 : -1;
+        }
+        g_limiter += step;
+    }
+
+    g_power_status.scale = g_limiter >> 8;
+    g_power_status.output_ma = idle + (uint64_t)active * g_limiter / 0xFFFF;
+    return g_limiter != previous;
 }
 
-void effects_set_brightness(uint8_t brightness)
+/* Le dithering n'est invisible qu'avec un rafraichissement rapide : il est coupe si l'envoi
+ * d'une trame est trop long. Retourne true si l'etat a change. */
+static bool update_dither(void)
 {
-    g_brightness = brightness;
-    ESP_LOGI(TAG, "Luminosite effet: %d", brightness);
+    bool active = g_dither_enabled && g_hw_output && g_frame_us > 0 &&
+                  (uint64_t)g_frame_us * DITHER_MIN_FPS <= 1000000;
+    if (active == g_dither_active) {
+        return false;
+    }
+    g_dither_active = active;
+    ESP_LOGI(TAG, "Dithering %s (trame: %lu us)", active ? "actif" : "inactif", (unsigned long)g_frame_us);
+    return true;
 }
 
-void effects_set_speed(uint8_t speed)
+/* Une partie de la luminosite tombe entre deux pas de 8 bits : le dithering doit tourner en continu */
+static bool dither_needed(void)
 {
-    g_effect_config.speed = (speed == 0) ? 50 : speed;
-    ESP_LOGI(TAG, "Vitesse effet: %d", g_effect_config.speed);
+    if (!g_dither_active) {
+        return false;
+    }
+    if (g_identify_running) {
+        return g_limiter < 0xFFFF;
+    }
+    for (int s = 0; s < g_num_segments; s++) {
+        uint16_t scale = segment_scale16(&g_segments[s]);
+        if (g_segments[s].on && scale > 0 && scale < 0xFFFF) {
+            return true;
+        }
+    }
+    return false;
 }
 
-void effects_identify(uint16_t duration_sec)
+/* Precalcule la table de la courbe niveau -> luminosite */
+static void build_level_curve(effects_level_curve_t curve)
 {
-    ESP_LOGI(TAG, "Identify: clignotement pendant %d secondes", duration_sec);
-    
-    // Sauvegarder l'etat actuel
-    effect_type_t saved_type = g_effect_config.type;
-    bool saved_active = g_effect_config.active;
-    
-    // Lancer la tache d'identification si pas deja en cours
-    if (!g_identify_running) {
-        g_identify_running = true;
-        BaseType_t ret = xTaskCreate(
-            identify_task,
-            "identify_task",
-            2048,
-            (void *)duration_sec,
-            5,
-            &g_identify_task_handle
-        );
-        
-        if (ret != pdPASS) {
-            ESP_LOGE(TAG, "Echec creation tache d'identification");
-            g_identify_running = false;
-        } else {
-            ESP_LOGI(TAG, "Tache d'identification demarree");
+    for (int level = 0; level <= EFFECTS_LEVEL_MAX; level++) {
+        float x = (float)level / EFFECTS_LEVEL_MAX;
+        float y = x;
+        switch (curve) {
+            case EFFECTS_CURVE_CIE_LSTAR: {
+                // L* = 100 x, luminance relative Y (CIE 1976)
+                float l = x * 100.0f;
+                y = (l <= 8.0f) ? (l / 903.3f) : powf((l + 16.0f) / 116.0f, 3.0f);
+                break;
+            }
+            case EFFECTS_CURVE_GAMMA_2_2:
+                y = powf(x, 2.2f);
+                break;
+            case EFFECTS_CURVE_CUSTOM:
+                if (g_custom_curve_len > 0) {
+                    // Interpolation entre les points encadrants, constante au-dela des extremites
+                    int k = 0;
+                    while (k + 1 < g_custom_curve_len && g_custom_curve[k + 1].level <= level) {
+                        k++;
+                    }
+                    const curve_point_t *a = &g_custom_curve[k];
+                    const curve_point_t *b = (k + 1 < g_custom_curve_len) ? &g_custom_curve[k + 1] : a;
+                    y = a->output / 65535.0f;
+                    if (level > a->level && b->level > a->level) {
+                        y += (b->output - (float)a->output) * (level - a->level) / (b->level - a->level) / 65535.0f;
+                    }
+                }
+                break;
+            case EFFECTS_CURVE_LINEAR:
+            default:
+                break;
+        }
+        // Un niveau non nul ne doit jamais eteindre le segment
+        uint32_t v = (uint32_t)(y * 65535.0f + 0.5f);
+        if (v > 0xFFFF) {
+            v = 0xFFFF;
+        }
+        if (level > 0 && v == 0) {
+            v = 1;
+        }
+        g_level_curve[level] = v;
+    }
+    g_level_curve[0] = 0;
+    g_level_curve_id = curve;
+}
+
+/* Luminosite 16 bits d'un niveau (0-255) */
+static uint16_t level_to_brightness(uint8_t level)
+{
+    return g_level_curve[level > EFFECTS_LEVEL_MAX ? EFFECTS_LEVEL_MAX : level];
+}
+
+/* Niveau le plus proche d'une luminosite 16 bits (courbe croissante) */
+static uint8_t brightness_to_level(uint16_t brightness)
+{
+    int lo = 0;
+    int hi = EFFECTS_LEVEL_MAX;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (g_level_curve[mid] < brightness) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && brightness - g_level_curve[lo - 1] < g_level_curve[lo] - brightness) {
+        lo--;
+    }
+    return lo;
+}
+
+/* Composante sRGB 8 bits vers lumiere lineaire 16 bits */
+static uint16_t srgb_to_linear16(uint8_t v)
+{
+    float x = v / 255.0f;
+    x = (x > 0.04045f) ? powf((x + 0.055f) / 1.055f, 2.4f) : (x / 12.92f);
+    return (uint16_t)(x * 65535.0f + 0.5f);
+}
+
+/* Lumiere lineaire 16 bits vers composante sRGB en 8.8 (0-65280) */
+static uint32_t linear16_to_srgb88(uint16_t v)
+{
+    float x = v / 65535.0f;
+    x = (x > 0.0031308f) ? (1.055f * powf(x, 1.0f / 2.4f) - 0.055f) : (12.92f * x);
+    return (x >= 1.0f) ? 0xFF00 : (uint32_t)(x * 65280.0f + 0.5f);
+}
+
+/* Pilotage d'un canal apres la table de correction (8.8) pour une composante en 8.8, interpole */
+static uint32_t channel_drive(int c, uint32_t v88)
+{
+    uint32_t i = v88 >> 8;
+    if (g_color_lut == NULL) {
+        return v88;
+    }
+    if (i >= 255) {
+        return g_color_lut[c][255];
+    }
+    return g_color_lut[c][i] + (((int32_t)g_color_lut[c][i + 1] - g_color_lut[c][i]) * (int32_t)(v88 & 0xFF) >> 8);
+}
+
+/* Composante 8 bits dont le pilotage est le plus proche de drive (tables croissantes) */
+static uint8_t channel_from_drive(int c, uint32_t drive)
+{
+    uint32_t lo = 0, hi = 255;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (channel_drive(c, mid << 8) < drive) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0 && drive - channel_drive(c, (lo - 1) << 8) < channel_drive(c, lo << 8) - drive) {
+        lo--;
+    }
+    return lo;
+}
+
+/* Couleur et intensite du segment : redessine si la couleur change, etage de sortie si l'intensite change */
+static void set_segment_color(segment_t *seg, rgb_color_t color, uint16_t gain)
+{
+    if (color.r != seg->base_color.r || color.g != seg->base_color.g || color.b != seg->base_color.b) {
+        seg->base_color = color;
+        seg->dirty = true;
+    }
+    if (gain != seg->color_gain) {
+        seg->color_gain = gain;
+        if (g_hw_output) {
+            g_output_dirty = true;
+        } else {
+            seg->dirty = true;
+        }
+    }
+}
+
+/* Couleur d'un pas de fondu (composantes sRGB en 8.8). Avec l'etage de sortie, le buffer ne garde que la
+ * teinte, a pleine intensite, et l'intensite passe par le gain 16 bits du segment : la couleur garde
+ * 16 bits jusqu'au dithering. Sans etage de sortie, la couleur est arrondie a 8 bits. */
+static void set_fade_color(segment_t *seg, const uint32_t enc[3])
+{
+    if (!g_hw_output) {
+        set_segment_color(seg, seg->fade.color, 0xFFFF);
+        return;
+    }
+
+    uint32_t drive[3];
+    uint32_t gain = 0;
+    for (int c = 0; c < 3; c++) {
+        drive[c] = channel_drive(c, enc[c]);
+        uint32_t full = channel_drive(c, 0xFF00);
+        if (full > 0 && (uint64_t)drive[c] * 0xFFFF / full > gain) {
+            gain = (uint64_t)drive[c] * 0xFFFF / full;
+        }
+    }
+    if (gain == 0) {
+        set_segment_color(seg, (rgb_color_t){ 0, 0, 0 }, 0xFFFF);
+        return;
+    }
+    if (gain > 0xFFFF) {
+        gain = 0xFFFF;
+    }
+    rgb_color_t color;
+    color.r = channel_from_drive(0, (uint64_t)drive[0] * 0xFFFF / gain);
+    color.g = channel_from_drive(1, (uint64_t)drive[1] * 0xFFFF / gain);
+    color.b = channel_from_drive(2, (uint64_t)drive[2] * 0xFFFF / gain);
+    set_segment_color(seg, color, gain);
+}
+
+/* Fait avancer le fondu d'un segment a partir du temps ecoule */
+static void step_fade(segment_t *seg, int64_t now_us)
+{
+    fade_t *fade = &seg->fade;
+    int64_t elapsed = now_us - fade->start_us;
+    uint32_t t = 0x10000;   // Progression en 16.16
+    if (elapsed < fade->duration_us) {
+        t = (elapsed > 0) ? (uint32_t)((elapsed << 16) / fade->duration_us) : 0;
+    }
+
+    uint16_t v[4];
+    for (int k = 0; k < 4; k++) {
+        v[k] = fade->from[k] + (((int64_t)fade->to[k] - fade->from[k]) * t >> 16);
+    }
+
+    if (v[0] != seg->brightness) {
+        seg->brightness = v[0];
+        if (g_hw_output) {
+            g_output_dirty = true;
+        } else {
+            seg->dirty = true;
+        }
+    }
+    // Couleur interpolee en lumiere lineaire, reencodee en sRGB sur 16 bits
+    uint32_t enc[3];
+    for (int c = 0; c < 3; c++) {
+        enc[c] = linear16_to_srgb88(v[c + 1]);
+    }
+    fade->color = (rgb_color_t){ (enc[0] + 128) >> 8, (enc[1] + 128) >> 8, (enc[2] + 128) >> 8 };
+
+    if (t < 0x10000) {
+        set_fade_color(seg, enc);
+    } else {
+        set_segment_color(seg, fade->to_color, 0xFFFF);
+        fade->running = false;
+        ESP_LOGI(TAG, "Segment %d: fondu termine", (int)(seg - g_segments));
+    }
+}
+
+/* Identification : 4 clignotements blancs par seconde sur tout le ruban */
+static void render_identify(TickType_t now)
+{
+    bool on = ((now / pdMS_TO_TICKS(250)) % 2) == 0;
+    uint8_t v = on ? 255 : 0;
+    g_identify_level = v;
+    if (g_generator) {
+        return;
+    }
+    if (!g_hw_output) {
+        v = (v * g_power_status.scale) / 255;
+    }
+    if (g_indexed) {
+        for (int s = 0; s < g_num_segments; s++) {
+            segment_t *seg = &g_segments[s];
+            set_layout(seg, LAYOUT_FLAT);
+            led_strip_set_palette_entry(g_led_strip, s * g_palette_entries, v, v, v, 0);
+        }
+        return;
+    }
+    for (int i = 0; i < g_num_leds; i++) {
+        led_strip_set_pixel(g_led_strip, i, v, v, v);
+    }
+}
+
+/* Tache FreeRTOS de rendu : compose tous les segments puis un seul rafraichissement */
+static void effect_task(void *pvParameters)
+{
+    UBaseType_t stack_margin = EFFECT_TASK_STACK_MARGIN;
+
+    ESP_LOGI(TAG, "Tache de rendu demarree");
+
+    while (1) {
+        TickType_t now = xTaskGetTickCount();
+        TickType_t wait = portMAX_DELAY;
+        bool changed = false;
+
+        lock();
+        if (g_identify_running) {
+            if ((int32_t)(now - g_identify_until) < 0) {
+                render_identify(now);
+                changed = true;
+                wait = pdMS_TO_TICKS(250) - (now % pdMS_TO_TICKS(250));
+            } else {
+                // Fin de l'identification : tout redessiner
+                g_identify_running = false;
+                g_output_dirty = true;
+                for (int s = 0; s < g_num_segments; s++) {
+                    g_segments[s].dirty = true;
+                }
+            }
+        }
+
+        // Fondus longs : luminosite et couleur suivent le temps ecoule
+        int64_t now_us = esp_timer_get_time();
+        for (int s = 0; s < g_num_segments; s++) {
+            if (g_segments[s].fade.running) {
+                step_fade(&g_segments[s], now_us);
+                TickType_t step = pdMS_TO_TICKS(FADE_PERIOD_MS) ? pdMS_TO_TICKS(FADE_PERIOD_MS) : 1;
+                if (g_segments[s].fade.running && (wait == portMAX_DELAY || step < wait)) {
+                    wait = step;
+                }
+            }
+        }
+
+        // Changement de luminosite seul : il suffit de renvoyer la trame
+        if (g_output_dirty) {
+            if (g_hw_output) {
+                apply_output();
+                changed = true;
+            }
+            g_output_dirty = false;
+        }
+
+        if (!g_identify_running) {
+            for (int s = 0; s < g_num_segments; s++) {
+                segment_t *seg = &g_segments[s];
+                changed |= render_segment(seg, now);
+
+                if (segment_animated(seg)) {
+                    TickType_t remaining = seg->next_frame - now;
+                    if ((int32_t)remaining < 1) {
+                        remaining = 1;
+                    }
+                    if (wait == portMAX_DELAY || remaining < wait) {
+                        wait = remaining;
+                    }
+                }
+            }
+        }
+
+        // Apres les segments : une trame presentee part dans la transmission qui suit
+        if (changed && g_generator) {
+            take_snapshot();
+        }
+
+        // Limiteur de courant : estimation sur la trame qui vient d'etre composee
+        if (update_limiter(now)) {
+            if (g_hw_output) {
+                apply_output();
+                changed = true;
+            } else {
+                // Luminosite appliquee au rendu : redessiner au prochain passage
+                for (int s = 0; s < g_num_segments; s++) {
+                    g_segments[s].dirty = true;
+                }
+                request_render();
+            }
+        }
+        if (g_limiter != g_limiter_target) {
+            TickType_t step = pdMS_TO_TICKS(20) ? pdMS_TO_TICKS(20) : 1;
+            if (wait == portMAX_DELAY || step < wait) {
+                wait = step;
+            }
+        }
+
+        // Dithering : renvoyer la trame a chaque periode pour moyenner les fractions
+        if (dither_needed()) {
+            TickType_t step = pdMS_TO_TICKS(DITHER_PERIOD_MS) ? pdMS_TO_TICKS(DITHER_PERIOD_MS) : 1;
+            changed = true;
+            if (wait == portMAX_DELAY || step < wait) {
+                wait = step;
+            }
+        }
+        unlock();
+
+        if (changed) {
+            int64_t start = esp_timer_get_time();
+            led_strip_refresh(g_led_strip);
+            uint32_t frame_us = esp_timer_get_time() - start;
+
+            lock();
+            if (g_generator) {
+                collect_generator_power();
+            }
+            g_frame_us = g_frame_us ? (g_frame_us * 3 + frame_us) / 4 : frame_us;
+            if (update_dither()) {
+                g_output_dirty = true;
+                request_render();
+            }
+            unlock();
+        }
+
+        // Marge de pile (octets) : le pire cas vient d'un programme d'effet pendant un rendu
+        UBaseType_t margin = uxTaskGetStackHighWaterMark(NULL);
+        if (margin < stack_margin) {
+            stack_margin = margin;
+            ESP_LOGW(TAG, "Pile de rendu: %u octets libres au minimum", (unsigned)margin);
+        }
+
+        // Attendre la prochaine echeance ou une notification de changement d'etat
+        ulTaskNotifyTake(pdTRUE, wait);
+    }
+}
+
+void effects_init(led_strip_handle_t strip, uint16_t num_leds, uint8_t num_segments, effects_render_mode_t mode)
+{
+    g_led_strip = strip;
+    g_num_leds = num_leds;
+
+    if (num_segments == 0) {
+        num_segments = 1;
+    }
+    if (num_segments > EFFECTS_MAX_SEGMENTS) {
+        ESP_LOGW(TAG, "Trop de segments (%d), limite a %d", num_segments, EFFECTS_MAX_SEGMENTS);
+        num_segments = EFFECTS_MAX_SEGMENTS;
+    }
+    g_num_segments = num_segments;
+    build_level_curve(g_level_curve_id);
+
+    // Decoupage en segments de tailles egales, le dernier prend le reste
+    uint16_t seg_len = num_leds / num_segments;
+    g_segment_len = seg_len;
+    for (int s = 0; s < num_segments; s++) {
+        segment_t *seg = &g_segments[s];
+        rgb_color_t *gradient = seg->gradient;
+        rgb_color_t *gradient_back = seg->gradient_back;
+        memset(seg, 0, sizeof(*seg));
+        seg->gradient = gradient;
+        seg->gradient_back = gradient_back;
+        seg->start = s * seg_len;
+        seg->count = (s == num_segments - 1) ? (num_leds - seg->start) : seg_len;
+        seg->config.type = EFFECT_NONE;
+        seg->config.speed = 50;
+        seg->base_color = (rgb_color_t){255, 255, 255};
+        seg->color_gain = 0xFFFF;
+        seg->level = EFFECTS_LEVEL_MAX;
+        seg->brightness = 0xFFFF;
+        seg->dirty = true;
+        ESP_LOGI(TAG, "Segment %d: LEDs %d-%d", s, seg->start, seg->start + seg->count - 1);
+    }
+
+    if (g_led_brightness != NULL) {
+        free(g_led_brightness);
+        g_led_brightness = NULL;
+    }
+
+    g_indexed = (mode == EFFECTS_RENDER_PALETTE_16 || mode == EFFECTS_RENDER_PALETTE_256);
+    if (g_indexed) {
+        // Chaque segment dispose d'une part egale de la palette du ruban
+        g_palette_entries = ((mode == EFFECTS_RENDER_PALETTE_16) ? 16 : 256) / num_segments;
+    } else if (mode == EFFECTS_RENDER_IN_ENCODER) {
+        // Pas de buffer par LED : l'encodeur appelle generate_pixel pendant la transmission
+        take_snapshot();
+        g_generator = (led_strip_set_pixel_generator(strip, generate_pixel, NULL) == ESP_OK);
+        if (!g_generator) {
+            ESP_LOGE(TAG, "Rendu dans l'encodeur non supporte par le ruban");
+        }
+    } else {
+        // Allouer le buffer pour twinkle
+        g_led_brightness = (uint8_t *)calloc(num_leds, sizeof(uint8_t));
+        if (g_led_brightness == NULL) {
+            ESP_LOGE(TAG, "Echec allocation buffer LED");
+        }
+    }
+
+    // Etage de sortie du ruban : la luminosite ne demande plus de redessiner les segments
+    g_hw_output = (led_strip_set_output(strip, &(led_strip_output_config_t){0}) == ESP_OK);
+    if (!g_hw_output) {
+        ESP_LOGW(TAG, "Etage de sortie non supporte, luminosite appliquee au rendu");
+    }
+    g_output_dirty = true;
+
+    g_lock = xSemaphoreCreateRecursiveMutex();
+    if (g_lock == NULL) {
+        ESP_LOGE(TAG, "Echec creation mutex de rendu");
+        return;
+    }
+
+    // Creer la tache de rendu
+    BaseType_t ret = xTaskCreate(
+        effect_task,
+        "effect_task",
+        EFFECT_TASK_STACK,
+        NULL,
+        5,
+        &g_effect_task_handle
+    );
+
+    if (ret != pdPASS) {
+        ESP_LOGE(TAG, "Echec creation tache d'effet");
+        g_effect_task_handle = NULL;
+    } else {
+        ESP_LOGI(TAG, "Systeme d'effets initialise (%d LEDs, %d segments, rendu %s)", num_leds, num_segments,
+                 g_generator ? "dans l'encodeur" : (g_indexed ? "palette" : "framebuffer"));
+    }
+}
+
+void effects_start(uint8_t segment, effect_type_t type, uint8_t speed)
+{
+    if (type >= EFFECT_MAX) {
+        ESP_LOGW(TAG, "Type d'effet invalide: %d", type);
+        return;
+    }
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+
+    lock();
+    // Reset le buffer twinkle du segment quand on demarre un effet
+    if (g_led_brightness != NULL) {
+        memset(&g_led_brightness[seg->start], 0, seg->count * sizeof(uint8_t));
+    }
+
+    seg->config.type = type;
+    seg->config.speed = (speed == 0) ? 50 : speed;
+    seg->config.active = (type != EFFECT_NONE);
+    seg->stream.active = false;
+    seg->frame = 0;
+    seg->dirty = true;
+    unlock();
+    request_render();
+
+    const char *effect_names[] = {"None", "Rainbow", "Strobe", "Twinkle", "Program"};
+    ESP_LOGI(TAG, "Segment %d: effet demarre: %s (vitesse=%d)", segment, effect_names[type], seg->config.speed);
+}
+
+void effects_stop(uint8_t segment)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    seg->config.active = false;
+    seg->config.type = EFFECT_NONE;
+    seg->stream.active = false;
+    seg->dirty = true;
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Segment %d: effet arrete", segment);
+}
+
+void effects_set_power(uint8_t segment, bool on)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    seg->on = on;
+    seg->dirty = true;
+    unlock();
+    request_render();
+}
+
+void effects_set_base_color(uint8_t segment, uint8_t r, uint8_t g, uint8_t b)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    // Une nouvelle couleur reprend la main sur le flux (la luminosite seule ne l'arrete pas)
+    if (seg->base_color.r != r || seg->base_color.g != g || seg->base_color.b != b) {
+        seg->stream.active = false;
+    }
+    set_segment_color(seg, (rgb_color_t){ r, g, b }, 0xFFFF);
+    seg->dirty = true;
+    unlock();
+    request_render();
+}
+
+/* Developpe un degrade dans la table du segment (verrou pris). NULL / 0 point : pas de degrade. */
+static bool set_gradient_locked(segment_t *seg, const gradient_stop_t *stops, uint8_t num_stops)
+{
+    if (stops == NULL || num_stops == 0) {
+        seg->gradient_on = false;
+        return true;
+    }
+    if (seg->gradient == NULL) {
+        // Jamais liberee : l'encodeur peut lire la table pendant une transmission
+        seg->gradient = (rgb_color_t *)calloc(EFFECTS_GRADIENT_SIZE, sizeof(rgb_color_t));
+        if (seg->gradient == NULL) {
+            ESP_LOGE(TAG, "Echec allocation table du degrade");
+            return false;
+        }
+        expand_gradient(seg->gradient, stops, num_stops);
+        seg->gradient_on = true;
+        return true;
+    }
+    if (!g_generator) {
+        expand_gradient(seg->gradient, stops, num_stops);
+        seg->gradient_on = true;
+        return true;
+    }
+
+    // Rendu dans l'encodeur : la table affichee peut etre lue pendant une transmission, le degrade
+    // est developpe dans la seconde table puis echange par take_snapshot()
+    if (seg->gradient_back == NULL) {
+        seg->gradient_back = (rgb_color_t *)calloc(EFFECTS_GRADIENT_SIZE, sizeof(rgb_color_t));
+        if (seg->gradient_back == NULL) {
+            ESP_LOGE(TAG, "Echec allocation table du degrade");
+            return false;
+        }
+    }
+    expand_gradient(seg->gradient_back, stops, num_stops);
+    seg->gradient_pending = true;
+    seg->gradient_on = true;
+    return true;
+}
+
+void effects_set_gradient(uint8_t segment, const gradient_stop_t *stops, uint8_t num_stops)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    if (stops == NULL) {
+        num_stops = 0;
+    }
+    if (num_stops > EFFECTS_GRADIENT_MAX_STOPS) {
+        ESP_LOGW(TAG, "Degrade trop grand (%d points), limite a %d", num_stops, EFFECTS_GRADIENT_MAX_STOPS);
+        num_stops = EFFECTS_GRADIENT_MAX_STOPS;
+    }
+    for (int k = 1; k < num_stops; k++) {
+        if (stops[k].pos < stops[k - 1].pos) {
+            ESP_LOGW(TAG, "Degrade ignore : points non tries");
+            return;
+        }
+    }
+    lock();
+    bool ok = set_gradient_locked(seg, stops, num_stops);
+    seg->layout = LAYOUT_NONE;
+    seg->dirty = true;
+    unlock();
+    request_render();
+    if (ok) {
+        ESP_LOGI(TAG, "Segment %d: degrade de %d points", segment, num_stops);
+    }
+}
+
+void effects_set_gradient_preset(uint8_t segment, gradient_preset_t preset)
+{
+    if (preset >= GRADIENT_MAX) {
+        ESP_LOGW(TAG, "Degrade invalide: %d", preset);
+        return;
+    }
+    effects_set_gradient(segment, s_gradient_presets[preset].stops, s_gradient_presets[preset].num_stops);
+    ESP_LOGI(TAG, "Segment %d: degrade %s", segment, s_gradient_presets[preset].name);
+}
+
+void effects_set_palette(uint8_t segment, const rgb_color_t *colors, uint8_t num_colors)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    if (colors == NULL) {
+        num_colors = 0;
+    }
+    if (num_colors > EFFECTS_PALETTE_MAX_COLORS) {
+        ESP_LOGW(TAG, "Palette trop grande (%d), limitee a %d couleurs", num_colors, EFFECTS_PALETTE_MAX_COLORS);
+        num_colors = EFFECTS_PALETTE_MAX_COLORS;
+    }
+
+    // Couleurs reparties uniformement, un point de plus en 255 pour revenir a la premiere
+    gradient_stop_t stops[EFFECTS_PALETTE_MAX_COLORS + 1];
+    for (int k = 0; k < num_colors; k++) {
+        stops[k].pos = k * EFFECTS_GRADIENT_SIZE / num_colors;
+        stops[k].color = colors[k];
+    }
+    if (num_colors > 0) {
+        stops[num_colors].pos = EFFECTS_GRADIENT_SIZE - 1;
+        stops[num_colors].color = colors[0];
+    }
+
+    lock();
+    set_gradient_locked(seg, stops, num_colors ? num_colors + 1 : 0);
+    seg->layout = LAYOUT_NONE;
+    seg->dirty = true;
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Segment %d: palette de %d couleurs", segment, num_colors);
+}
+
+void effects_set_brightness(uint8_t segment, uint8_t brightness)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    seg->level = brightness;
+    seg->brightness = level_to_brightness(brightness);
+    if (g_hw_output) {
+        g_output_dirty = true;
+    } else {
+        seg->dirty = true;
+    }
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Segment %d: luminosite effet: %d", segment, brightness);
+}
+
+void effects_fade_start(uint8_t segment, const effects_fade_t *fade)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL || fade == NULL) {
+        return;
+    }
+    lock();
+    fade_t *f = &seg->fade;
+    f->from[0] = level_to_brightness(fade->from_level);
+    f->from[1] = srgb_to_linear16(fade->from_color.r);
+    f->from[2] = srgb_to_linear16(fade->from_color.g);
+    f->from[3] = srgb_to_linear16(fade->from_color.b);
+    f->to[0] = level_to_brightness(fade->to_level);
+    f->to[1] = srgb_to_linear16(fade->to_color.r);
+    f->to[2] = srgb_to_linear16(fade->to_color.g);
+    f->to[3] = srgb_to_linear16(fade->to_color.b);
+    f->to_color = fade->to_color;
+    f->duration_us = (int64_t)fade->duration_ms * 1000;
+    f->start_us = esp_timer_get_time();
+    f->running = true;
+    seg->on = true;
+    seg->stream.active = false;
+    seg->dirty = true;
+    step_fade(seg, f->start_us);
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Segment %d: fondu %d -> %d en %lu s", segment, fade->from_level, fade->to_level,
+             (unsigned long)(fade->duration_ms / 1000));
+}
+
+void effects_fade_stop(uint8_t segment)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    bool was_running = seg->fade.running;
+    seg->fade.running = false;
+    if (was_running) {
+        // La couleur atteinte reprend sa forme 8 bits, pleine intensite
+        set_segment_color(seg, seg->fade.color, 0xFFFF);
+    }
+    unlock();
+    if (was_running) {
+        ESP_LOGI(TAG, "Segment %d: fondu arrete", segment);
+    }
+}
+
+bool effects_fade_running(uint8_t segment, uint8_t *level)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return false;
+    }
+    lock();
+    bool running = seg->fade.running;
+    if (level != NULL) {
+        *level = brightness_to_level(seg->brightness);
+    }
+    unlock();
+    return running;
+}
+
+/* Reapplique la courbe aux segments (verrou pris) ; les fondus en cours gardent leurs bornes */
+static void apply_level_curve(void)
+{
+    for (int s = 0; s < g_num_segments; s++) {
+        segment_t *seg = &g_segments[s];
+        if (!seg->fade.running) {
+            seg->brightness = level_to_brightness(seg->level);
+            if (!g_hw_output) {
+                seg->dirty = true;
+            }
+        }
+    }
+    g_output_dirty = true;
+}
+
+void effects_set_level_curve(effects_level_curve_t curve)
+{
+    if (curve >= EFFECTS_CURVE_MAX) {
+        ESP_LOGW(TAG, "Courbe de luminosite invalide: %d", curve);
+        return;
+    }
+    lock();
+    build_level_curve(curve);
+    apply_level_curve();
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Courbe de luminosite: %d", curve);
+}
+
+void effects_set_custom_level_curve(const curve_point_t *points, uint8_t num_points)
+{
+    if (points == NULL) {
+        num_points = 0;
+    }
+    if (num_points > EFFECTS_CURVE_MAX_POINTS) {
+        ESP_LOGW(TAG, "Courbe trop grande (%d points), limitee a %d", num_points, EFFECTS_CURVE_MAX_POINTS);
+        num_points = EFFECTS_CURVE_MAX_POINTS;
+    }
+    for (int k = 1; k < num_points; k++) {
+        if (points[k].level < points[k - 1].level) {
+            ESP_LOGW(TAG, "Courbe ignoree : points non tries");
+            return;
+        }
+    }
+    lock();
+    if (num_points > 0) {
+        memcpy(g_custom_curve, points, num_points * sizeof(curve_point_t));
+    }
+    g_custom_curve_len = num_points;
+    if (g_level_curve_id == EFFECTS_CURVE_CUSTOM) {
+        build_level_curve(EFFECTS_CURVE_CUSTOM);
+        apply_level_curve();
+    }
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Courbe personnalisee de %d points", num_points);
+}
+
+void effects_set_dither(bool enable)
+{
+    lock();
+    g_dither_enabled = enable;
+    if (update_dither()) {
+        g_output_dirty = true;
+    }
+    unlock();
+    request_render();
+}
+
+void effects_set_color_lut(const uint16_t (*lut)[256])
+{
+    if (!g_hw_output) {
+        ESP_LOGW(TAG, "Etage de sortie indisponible, correction des couleurs ignoree");
+        return;
+    }
+    lock();
+    g_color_lut = lut;
+    g_output_dirty = true;
+    unlock();
+    request_render();
+}
+
+void effects_set_white_point(const rgb_color_t *white_point)
+{
+    if (!g_hw_output) {
+        ESP_LOGW(TAG, "Etage de sortie indisponible, extraction du blanc ignoree");
+        return;
+    }
+    lock();
+    g_extract_white = (white_point != NULL);
+    if (white_point) {
+        g_white_point = *white_point;
+    }
+    g_output_dirty = true;
+    unlock();
+    request_render();
+    if (white_point) {
+        ESP_LOGI(TAG, "Extraction du blanc: point blanc (%d,%d,%d)", white_point->r, white_point->g, white_point->b);
+    }
+}
+
+void effects_set_speed(uint8_t segment, uint8_t speed)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    seg->config.speed = (speed == 0) ? 50 : speed;
+    unlock();
+    ESP_LOGI(TAG, "Segment %d: vitesse effet: %d", segment, seg->config.speed);
+}
+
+void effects_set_power_config(const effects_power_config_t *config)
+{
+    if (config == NULL) {
+        return;
+    }
+    lock();
+    g_power_config = *config;
+    unlock();
+    request_render();
+    ESP_LOGI(TAG, "Limiteur de courant: %d mA (canaux %d/%d/%d mA)", config->max_current_ma,
+             config->channel_ma[0], config->channel_ma[1], config->channel_ma[2]);
+}
+
+void effects_get_power_status(effects_power_status_t *status)
+{
+    if (status == NULL) {
+        return;
+    }
+    lock();
+    *status = g_power_status;
+    unlock();
+}
+
+/* Decode un bloc dans le buffer arriere. Retourne false si le bloc est invalide ou deborde du segment. */
+static bool decode_stream_chunk(rgb_color_t *dst, uint16_t count, uint16_t offset,
+                                effects_stream_encoding_t encoding, const uint8_t *data, uint16_t len)
+{
+    uint32_t pos = offset;
+
+    switch (encoding) {
+        case EFFECTS_STREAM_RAW:
+            if (len % 3 != 0 || pos + len / 3 > count) {
+                return false;
+            }
+            for (uint16_t i = 0; i < len; i += 3) {
+                dst[pos++] = (rgb_color_t){ data[i], data[i + 1], data[i + 2] };
+            }
+            return true;
+
+        case EFFECTS_STREAM_RLE:
+            if (len % 4 != 0) {
+                return false;
+            }
+            for (uint16_t i = 0; i < len; i += 4) {
+                uint8_t run = data[i];
+                if (run == 0 || pos + run > count) {
+                    return false;
+                }
+                rgb_color_t c = { data[i + 1], data[i + 2], data[i + 3] };
+                while (run--) {
+                    dst[pos++] = c;
+                }
+            }
+            return true;
+
+        case EFFECTS_STREAM_PALETTE_DELTA: {
+            uint8_t num_colors = (len > 0) ? data[0] : 0;
+            if (num_colors == 0 || num_colors > EFFECTS_STREAM_PALETTE_MAX || len < 1 + num_colors * 3) {
+                return false;
+            }
+            const uint8_t *palette = &data[1];
+            for (uint16_t i = 1 + num_colors * 3; i < len; i++) {
+                uint8_t index = data[i] >> 4;
+                uint8_t run = (data[i] & 0x0F) + 1;
+                if (pos + run > count || (index != EFFECTS_STREAM_SKIP && index >= num_colors)) {
+                    return false;
+                }
+                if (index == EFFECTS_STREAM_SKIP) {
+                    pos += run;
+                    continue;
+                }
+                rgb_color_t c = { palette[index * 3], palette[index * 3 + 1], palette[index * 3 + 2] };
+                while (run--) {
+                    dst[pos++] = c;
+                }
+            }
+            return true;
+        }
+
+        default:
+            return false;
+    }
+}
+
+/* Ecrit un bloc dans le buffer arriere du segment (verrou pris) */
+static esp_err_t stream_write_locked(segment_t *seg, uint8_t frame, uint16_t offset,
+                                     effects_stream_encoding_t encoding, const uint8_t *data, uint16_t len)
+{
+    stream_t *st = &seg->stream;
+
+    if (st->presented && (int8_t)(frame - st->last_frame) <= 0) {
+        g_stream_stats.late++;
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (st->front == NULL) {
+        // Jamais liberes : l'encodeur lit la copie de la trame affichee pendant une transmission
+        st->front = (rgb_color_t *)calloc(seg->count, sizeof(rgb_color_t));
+        st->back = (rgb_color_t *)calloc(seg->count, sizeof(rgb_color_t));
+        st->shown = g_generator ? (rgb_color_t *)calloc(seg->count, sizeof(rgb_color_t)) : NULL;
+        if (st->front == NULL || st->back == NULL || (g_generator && st->shown == NULL)) {
+            ESP_LOGE(TAG, "Echec allocation buffers du flux");
+            free(st->front);
+            free(st->back);
+            free(st->shown);
+            st->front = st->back = st->shown = NULL;
+            g_stream_stats.dropped++;
+            return ESP_ERR_NO_MEM;
         }
     }
-    
-    // Restaurer l'effet precedent si actif
-    if (saved_active && saved_type != EFFECT_NONE) {
-        g_effect_config.type = saved_type;
-        g_effect_config.active = true;
+    if (st->pending && st->back_frame != frame) {
+        // La trame precedente n'a jamais ete presentee : ses blocs sont ecrases
+        g_stream_stats.dropped++;
+    }
+    if (!decode_stream_chunk(st->back, seg->count, offset, encoding, data, len)) {
+        g_stream_stats.dropped++;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    st->pending = true;
+    st->back_frame = frame;
+    g_stream_stats.chunks++;
+    return ESP_OK;
+}
+
+esp_err_t effects_stream_write(uint8_t segment, uint8_t frame, uint16_t offset, effects_stream_encoding_t encoding,
+                               const uint8_t *data, uint16_t len)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL || (data == NULL && len > 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (g_indexed) {
+        // Une palette par segment : pas de couleur arbitraire par LED
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    lock();
+    esp_err_t ret = stream_write_locked(seg, frame, offset, encoding, data, len);
+    unlock();
+    return ret;
+}
+
+void effects_stream_present(uint32_t segment_mask, uint8_t frame)
+{
+    bool presented = false;
+
+    lock();
+    for (int s = 0; s < g_num_segments; s++) {
+        segment_t *seg = &g_segments[s];
+        stream_t *st = &seg->stream;
+        if (!(segment_mask & (1U << s)) || st->front == NULL) {
+            continue;
+        }
+        if (st->presented && (int8_t)(frame - st->last_frame) <= 0) {
+            g_stream_stats.late++;
+            continue;
+        }
+        rgb_color_t *shown = st->back;
+        st->back = st->front;
+        st->front = shown;
+        memcpy(st->back, st->front, seg->count * sizeof(rgb_color_t));
+        st->active = true;
+        st->pending = false;
+        st->presented = true;
+        st->last_frame = frame;
+        seg->dirty = true;
+        g_stream_stats.frames++;
+        presented = true;
+    }
+    unlock();
+    if (presented) {
+        request_render();
+    }
+}
+
+void effects_get_stream_stats(effects_stream_stats_t *stats)
+{
+    lock();
+    *stats = g_stream_stats;
+    unlock();
+}
+
+void effects_set_program(uint8_t segment, const effect_vm_program_t *program, const uint8_t *params)
+{
+    segment_t *seg = get_segment(segment);
+    if (seg == NULL) {
+        return;
+    }
+    lock();
+    seg->program = program;
+    if (params != NULL) {
+        memcpy(seg->program_params, params, sizeof(seg->program_params));
+    } else {
+        memset(seg->program_params, 0, sizeof(seg->program_params));
+    }
+    seg->program_fault = false;
+    seg->dirty = true;
+    unlock();
+    request_render();
+}
+
+void effects_set_sync(bool enabled, int64_t epoch_us)
+{
+    lock();
+    bool changed = (enabled != g_sync_enabled);
+    g_sync_enabled = enabled;
+    g_sync_epoch_us = epoch_us;
+    if (changed) {
+        for (int s = 0; s < g_num_segments; s++) {
+            g_segments[s].dirty = true;
+        }
+    }
+    unlock();
+    if (changed) {
+        request_render();
+        ESP_LOGI(TAG, "Animations %s", enabled ? "synchronisees" : "locales");
+    }
+}
+
+void effects_begin_update(void)
+{
+    lock();
+}
+
+void effects_end_update(void)
+{
+    unlock();
+    request_render();
+}
+
+void effects_identify(uint16_t duration_sec)
+{
+    ESP_LOGI(TAG, "Identify: clignotement pendant %d secondes", duration_sec);
+
+    lock();
+    if (duration_sec > 0) {
+        g_identify_running = true;
+        g_output_dirty = true;
+        g_identify_until = xTaskGetTickCount() + pdMS_TO_TICKS(duration_sec * 1000);
+    } else {
+        // Arret anticipe : la boucle de rendu restaure les segments
+        g_identify_until = xTaskGetTickCount();
     }
+    unlock();
+    request_render();
 }
 
-const effect_config_t* effects_get_config(void)
+const effect_config_t* effects_get_config(uint8_t segment)
 {
-    return &g_effect_config;
+    segment_t *seg = get_segment(segment);
+    return seg ? &seg->config : NULL;
 }
 
-bool effects_is_active(void)
+bool effects_is_active(uint8_t segment)
 {
-    return g_effect_config.active;
+    segment_t *seg = get_segment(segment);
+    return seg ? seg->config.active : false;
 }
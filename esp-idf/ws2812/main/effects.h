@@ -4,6 +4,19 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "led_strip.h"
+#include "effect_vm.h"
+
+/* Nombre maximum de segments geres par le moteur de rendu */
+#define EFFECTS_MAX_SEGMENTS    8
+
+/* Nombre maximum de couleurs de la palette d'un segment */
+#define EFFECTS_PALETTE_MAX_COLORS  16
+
+/* Nombre maximum de points d'un dgrad personnalis */
+#define EFFECTS_GRADIENT_MAX_STOPS  16
+
+/* Taille de la table d'un dgrad (une entre par position 0-255) */
+#define EFFECTS_GRADIENT_SIZE       256
 
 /* Types d'effets disponibles */
 typedef enum {
@@ -11,6 +24,7 @@ typedef enum {
     EFFECT_RAINBOW,         // Arc-en-ciel qui dfile
     EFFECT_STROBE,          // Clignotement rapide
     EFFECT_TWINKLE,         // Scintillement alatoire (toiles)
+    EFFECT_PROGRAM,         // Programme tlcharg (bytecode effect_vm)
     EFFECT_MAX              // Nombre total d'effets
 } effect_type_t;
 
@@ -21,6 +35,29 @@ typedef struct {
     bool active;            // true si l'effet est en cours
 } effect_config_t;
 
+/* Instructions effect_vm excutes au plus par segment et par pas d'animation */
+#define EFFECTS_PROGRAM_FRAME_BUDGET    16384
+
+/* Dgrads prdfinis */
+typedef enum {
+    GRADIENT_NONE = 0,      // Pas de dgrad : roue HSV / couleur de base
+    GRADIENT_OCEAN,         // Bleus et turquoises
+    GRADIENT_LAVA,          // Rouges, oranges et jaunes
+    GRADIENT_FOREST,        // Verts
+    GRADIENT_PARTY,         // Violets, roses et oranges
+    GRADIENT_SUNSET,        // Rouge, orange, violet
+    GRADIENT_HEAT,          // Noir, rouge, jaune, blanc
+    GRADIENT_MAX            // Nombre total de dgrads
+} gradient_preset_t;
+
+/* Mode de rendu */
+typedef enum {
+    EFFECTS_RENDER_FRAMEBUFFER = 0, // Les segments sont dessines dans le buffer du ruban
+    EFFECTS_RENDER_IN_ENCODER,      // Pas de framebuffer : les pixels sont calcules pendant la transmission
+    EFFECTS_RENDER_PALETTE_16,      // Framebuffer indexe 4 bits par LED, palette de 16 couleurs
+    EFFECTS_RENDER_PALETTE_256,     // Framebuffer indexe 8 bits par LED, palette de 256 couleurs
+} effects_render_mode_t;
+
 /* Couleur RGB */
 typedef struct {
     uint8_t r;
@@ -28,69 +65,412 @@ typedef struct {
     uint8_t b;
 } rgb_color_t;
 
+/* Point d'un dgrad : couleur  une position (0-255) */
+typedef struct {
+    uint8_t pos;
+    rgb_color_t color;
+} gradient_stop_t;
+
+/* Niveau maximal (CurrentLevel ZCL) : pleine luminosit */
+#define EFFECTS_LEVEL_MAX           254
+
+/* Nombre maximum de points d'une courbe de luminosit personnalise */
+#define EFFECTS_CURVE_MAX_POINTS    16
+
+/* Courbe niveau -> luminosit */
+typedef enum {
+    EFFECTS_CURVE_LINEAR = 0,   // Proportionnelle au niveau
+    EFFECTS_CURVE_CIE_LSTAR,    // Clart perue CIE L* (pas rguliers  l'oeil)
+    EFFECTS_CURVE_GAMMA_2_2,    // Gamma 2.2
+    EFFECTS_CURVE_CUSTOM,       // Points dfinis par effects_set_custom_level_curve()
+    EFFECTS_CURVE_MAX           // Nombre total de courbes
+} effects_level_curve_t;
+
+/* Point d'une courbe personnalise : luminosit 16 bits (0-65535) pour un niveau (0-254) */
+typedef struct {
+    uint8_t level;
+    uint16_t output;
+} curve_point_t;
+
+/* Fondu long (lever / coucher de soleil) */
+typedef struct {
+    rgb_color_t from_color;     // Couleur de dpart
+    rgb_color_t to_color;       // Couleur d'arrive
+    uint8_t from_level;         // Luminosit de dpart (0-255)
+    uint8_t to_level;           // Luminosit d'arrive (0-255)
+    uint32_t duration_ms;       // Dure (jusqu' plusieurs heures)
+} effects_fade_t;
+
+/* Limiteur de courant : estimation de la consommation du ruban */
+typedef struct {
+    uint16_t max_current_ma;    // Budget de l'alimentation pour le ruban (0 = pas de limite)
+    uint8_t channel_ma[3];      // Courant d'un canal R, G, B  255 (mA)
+    uint16_t idle_ua;           // Courant de repos d'une LED teinte (A)
+    uint16_t attack_ms;         // Temps de rduction de la luminosit lors d'un dpassement
+    uint16_t release_ms;        // Temps de retour  la luminosit demande
+} effects_power_config_t;
+
+/* Valeurs typiques WS2812B : ~20 mA par canal, ~1 mA au repos */
+#define EFFECTS_POWER_CONFIG_DEFAULT(max_ma)    \
+    {                                           \
+        .max_current_ma = (max_ma),             \
+        .channel_ma = {20, 20, 20},             \
+        .idle_ua = 1000,                        \
+        .attack_ms = 20,                        \
+        .release_ms = 1000,                     \
+    }
+
+/* tat du limiteur de courant */
+typedef struct {
+    uint32_t requested_ma;      // Courant estim sans limitation
+    uint32_t output_ma;         // Courant estim de la trame transmise (aprs limitation)
+    uint8_t scale;              // Facteur appliqu par le limiteur (255 = aucune limitation)
+} effects_power_status_t;
+
+/* Flux de trames : encodage d'un bloc de pixels */
+typedef enum {
+    EFFECTS_STREAM_RAW = 0,         // R, G, B par pixel
+    EFFECTS_STREAM_RLE,             // Plages : nombre (1-255), R, G, B
+    EFFECTS_STREAM_PALETTE_DELTA,   // Palette (nombre, R, G, B...) puis plages : index << 4 | (longueur - 1)
+    EFFECTS_STREAM_ENCODING_MAX
+} effects_stream_encoding_t;
+
+/* Palette d'un bloc EFFECTS_STREAM_PALETTE_DELTA : l'index 15 garde les pixels de la trame prcdente */
+#define EFFECTS_STREAM_PALETTE_MAX  15
+#define EFFECTS_STREAM_SKIP         0x0F
+
+/* Compteurs du flux de trames (tous segments) */
+typedef struct {
+    uint32_t chunks;            // Blocs dcods dans le buffer arrire
+    uint32_t frames;            // Trames prsentes
+    uint32_t dropped;           // Blocs rejets (invalides, hors segment) et trames crases avant prsentation
+    uint32_t late;              // Blocs et prsentations d'une trame dj prsente (ou plus ancienne)
+} effects_stream_stats_t;
+
 /**
- * @brief Initialise le systme d'effets
- * 
+ * @brief Initialise le systme d'effets et la tche de rendu
+ *
+ * Le ruban est dcoup en segments de tailles gales (le dernier prend le reste).
+ * Toutes les modifications d'tat passent par une seule boucle de rendu :
+ * un seul rafrachissement du ruban par tick, quel que soit le nombre de segments.
+ *
+ * En mode EFFECTS_RENDER_IN_ENCODER, le ruban doit avoir t cr sans framebuffer :
+ * les effets sont calculs pixel par pixel par l'encodeur (aucune mmoire par LED),
+ * Twinkle utilise alors une variante sans tat.
+ *
+ * En mode palette (EFFECTS_RENDER_PALETTE_16/256), le ruban doit avoir t cr avec
+ * une palette de mme taille : chaque segment dispose d'une part gale des entres,
+ * les animations modifient la palette plutt que les pixels.
+ *
  * @param strip Handle du ruban LED
  * @param num_leds Nombre de LEDs sur le ruban
+ * @param num_segments Nombre de segments (1-EFFECTS_MAX_SEGMENTS)
+ * @param mode Mode de rendu
  */
-void effects_init(led_strip_handle_t strip, uint16_t num_leds);
+void effects_init(led_strip_handle_t strip, uint16_t num_leds, uint8_t num_segments, effects_render_mode_t mode);
 
 /**
- * @brief Dmarre un effet
- * 
+ * @brief Dmarre un effet sur un segment
+ *
+ * @param segment Index du segment
  * @param type Type d'effet  dmarrer
  * @param speed Vitesse de l'effet (1-255)
  */
-void effects_start(effect_type_t type, uint8_t speed);
+void effects_start(uint8_t segment, effect_type_t type, uint8_t speed);
 
 /**
- * @brief Arrte l'effet en cours
+ * @brief Arrte l'effet en cours sur un segment
+ *
+ * @param segment Index du segment
  */
-void effects_stop(void);
+void effects_stop(uint8_t segment);
+
+/**
+ * @brief Allume ou teint un segment
+ *
+ * @param segment Index du segment
+ * @param on true pour allumer
+ */
+void effects_set_power(uint8_t segment, bool on);
 
 /**
  * @brief Dfinit la couleur de base (pour EFFECT_NONE ou comme base pour certains effets)
- * 
+ *
+ * @param segment Index du segment
  * @param r Rouge (0-255)
  * @param g Vert (0-255)
  * @param b Bleu (0-255)
  */
-void effects_set_base_color(uint8_t r, uint8_t g, uint8_t b);
+void effects_set_base_color(uint8_t segment, uint8_t r, uint8_t g, uint8_t b);
+
+/**
+ * @brief Dfinit le dgrad d'un segment
+ *
+ * Les points (tris par position croissante) sont dvelopps une fois pour toutes en une table
+ * de EFFECTS_GRADIENT_SIZE couleurs : chaque effet n'y fait ensuite qu'une lecture par LED.
+ * Rainbow parcourt le dgrad au lieu de la roue HSV, Twinkle y tire la couleur de chaque toile,
+ * Strobe change de couleur  chaque flash. La couleur fixe (None) n'est pas concerne.
+ *
+ * @param segment Index du segment
+ * @param stops Points du dgrad (NULL pour revenir  la roue HSV / couleur de base)
+ * @param num_stops Nombre de points (0-EFFECTS_GRADIENT_MAX_STOPS)
+ */
+void effects_set_gradient(uint8_t segment, const gradient_stop_t *stops, uint8_t num_stops);
 
 /**
- * @brief Dfinit la luminosit globale des effets
- * 
- * @param brightness Luminosit (0-255)
+ * @brief Slectionne un dgrad prdfini pour un segment
+ *
+ * @param segment Index du segment
+ * @param preset Dgrad (GRADIENT_NONE pour revenir  la roue HSV / couleur de base)
  */
-void effects_set_brightness(uint8_t brightness);
+void effects_set_gradient_preset(uint8_t segment, gradient_preset_t preset);
 
 /**
- * @brief Dfinit la vitesse des effets
- * 
+ * @brief Dfinit la palette d'un segment
+ *
+ * Raccourci de effects_set_gradient() : les couleurs sont rparties uniformment sur un dgrad
+ * cyclique (la dernire rejoint la premire).
+ * En mode palette, l'animation ne fait que tourner les entres du segment : le cot d'un pas
+ * dpend de la taille de la palette, pas du nombre de LEDs.
+ *
+ * @param segment Index du segment
+ * @param colors Couleurs de la palette (NULL pour revenir  la roue HSV)
+ * @param num_colors Nombre de couleurs (0-EFFECTS_PALETTE_MAX_COLORS, 0 = roue HSV)
+ */
+void effects_set_palette(uint8_t segment, const rgb_color_t *colors, uint8_t num_colors);
+
+/**
+ * @brief Dfinit la luminosit des effets d'un segment
+ *
+ * Le niveau passe par la courbe de luminosit (effects_set_level_curve()) ; EFFECTS_LEVEL_MAX
+ * et au-del donnent la pleine luminosit.
+ *
+ * @param segment Index du segment
+ * @param brightness Niveau (0-255)
+ */
+void effects_set_brightness(uint8_t segment, uint8_t brightness);
+
+/**
+ * @brief Dfinit la vitesse des effets d'un segment
+ *
+ * @param segment Index du segment
  * @param speed Vitesse (1-255, plus haut = plus rapide)
  */
-void effects_set_speed(uint8_t speed);
+void effects_set_speed(uint8_t segment, uint8_t speed);
+
+/**
+ * @brief Dmarre un fondu long sur un segment (rveil lumineux)
+ *
+ * La luminosit et la couleur de base sont interpoles sur 16 bits  partir du temps coul,
+ * la couleur en lumire linaire. Avec l'tage de sortie, le buffer ne porte que la teinte et
+ * l'intensit de la couleur passe par le gain 16 bits du segment jusqu'au dithering : un fondu
+ * de 0  254 sur 30 minutes n'a pas de marche visible. Sans tage de sortie, la couleur est
+ * arrondie  8 bits  chaque pas. Le segment
+ * est allum. Toute commande explicite (luminosit, couleur, ON/OFF) doit arrter le fondu
+ * avec effects_fade_stop(), sinon elle est crase au pas suivant.
+ *
+ * @param segment Index du segment
+ * @param fade Paramtres du fondu (copis)
+ */
+void effects_fade_start(uint8_t segment, const effects_fade_t *fade);
+
+/**
+ * @brief Arrte le fondu en cours d'un segment,  l'tat atteint
+ *
+ * @param segment Index du segment
+ */
+void effects_fade_stop(uint8_t segment);
+
+/**
+ * @brief Indique si un fondu est en cours et la luminosit atteinte
+ *
+ * @param segment Index du segment
+ * @param[out] level Luminosit courante du segment (0-255), peut tre NULL
+ * @return true si un fondu est en cours
+ */
+bool effects_fade_running(uint8_t segment, uint8_t *level);
+
+/**
+ * @brief Slectionne la courbe niveau -> luminosit de tous les segments
+ *
+ * La courbe est prcalcule en une table de EFFECTS_LEVEL_MAX + 1 entres sur 16 bits, applique
+ * au seul endroit o un niveau devient une luminosit (segments et fondus).
+ *
+ * @param curve Courbe  utiliser
+ */
+void effects_set_level_curve(effects_level_curve_t curve);
+
+/**
+ * @brief Dfinit les points de la courbe EFFECTS_CURVE_CUSTOM (interpols linairement)
+ *
+ * Sans point, la courbe personnalise est linaire. Si elle est slectionne, la table est recalcule.
+ *
+ * @param points Points tris par niveau croissant (NULL pour la courbe linaire)
+ * @param num_points Nombre de points (0-EFFECTS_CURVE_MAX_POINTS)
+ */
+void effects_set_custom_level_curve(const curve_point_t *points, uint8_t num_points);
+
+/**
+ * @brief Active le dithering temporel (actif par dfaut)
+ *
+ * La luminosit (niveau, limiteur) garde 16 bits jusqu' l'encodeur, qui reporte d'une trame
+ *  l'autre la fraction perdue en passant sur 8 bits : les faibles niveaux et les fondus n'ont
+ * plus de marches visibles. La trame est alors renvoye en continu (~100 Hz) tant qu'un segment
+ * allum n'est pas  pleine luminosit. Le dithering se coupe de lui-mme si l'envoi d'une trame
+ * est trop long pour ce rythme (ruban trop long).
+ *
+ * @param enable true pour autoriser le dithering
+ */
+void effects_set_dither(bool enable);
+
+/**
+ * @brief Dfinit les tables de correction par canal de l'tage de sortie
+ *
+ * Une table de 256 entres par canal (R, G, B, puis W pour un ruban RGBW), en virgule fixe 8.8, applique  l'encodage
+ * avant la luminosit des segments : un seul accs par canal et par LED, quel que soit l'effet.
+ * La partie fractionnaire profite du dithering temporel.
+ *
+ * @param lut Tables (NULL pour aucune correction). Elles doivent rester valides et inchanges tant
+ *            qu'elles sont utilises, c'est--dire jusqu' la trame qui suit l'appel suivant
+ */
+void effects_set_color_lut(const uint16_t (*lut)[256]);
+
+/**
+ * @brief Active l'extraction du blanc pour les rubans RGBW
+ *
+ * L'tage de sortie transfre  la LED blanche la part de R, G, B qu'elle sait reproduire, avant
+ * les tables de correction : vrais blancs et moins de courant par lumen, sans changer les effets.
+ * Sans effet sur un ruban RGB.
+ *
+ * @param white_point Couleur de la LED blanche  pleine puissance exprime en R, G, B
+ *                    ({255, 255, 255} : extraction de min(R, G, B)), NULL pour dsactiver
+ */
+void effects_set_white_point(const rgb_color_t *white_point);
+
+/**
+ * @brief Configure le limiteur de courant
+ *
+ * Le courant est estim  chaque trame  partir de la somme des canaux de chaque segment,
+ * tenue  jour pendant le rendu (aucun parcours supplmentaire du ruban). Au-del du budget,
+ * la luminosit de tous les segments est rduite par l'tage de sortie, puis rtablie
+ * progressivement.
+ *
+ * @param config Configuration (copie)
+ */
+void effects_set_power_config(const effects_power_config_t *config);
+
+/**
+ * @brief Rcupre l'estimation du courant et l'tat du limiteur
+ *
+ * @param[out] status tat courant
+ */
+void effects_get_power_status(effects_power_status_t *status);
+
+/**
+ * @brief Programme excut par l'effet EFFECT_PROGRAM d'un segment
+ *
+ * Le programme calcule chaque LED  chaque pas d'animation (en mode palette : chaque entre
+ * de la palette du segment). Une erreur d'excution ou un dpassement de
+ * EFFECTS_PROGRAM_FRAME_BUDGET arrte le programme : le segment affiche sa couleur de base
+ * jusqu'au prochain appel. En rendu dans l'encodeur, le programme n'est pas excut.
+ *
+ * @param segment Index du segment
+ * @param program Programme vrifi, qui doit rester valide (NULL : aucun)
+ * @param params Paramtres P0-P3 du programme (NULL : 0)
+ */
+void effects_set_program(uint8_t segment, const effect_vm_program_t *program, const uint8_t *params);
+
+/**
+ * @brief Origine commune des animations (effets synchroniss entre appareils)
+ *
+ * Active, le pas d'animation de chaque segment est calcul  partir du temps coul depuis
+ * l'origine et de la priode de sa vitesse au lieu d'tre compt, Twinkle tire ses toiles sans
+ * hasard et l'entre temps des programmes part de l'origine : deux appareils qui partagent
+ * l'origine affichent le mme pas au mme instant. Un appel par correction d'horloge suffit, un
+ * petit dplacement de l'origine dcale l'animation sans la redmarrer.
+ *
+ * @param enabled false : pas compts par chaque segment (par dfaut)
+ * @param epoch_us Origine en temps local (esp_timer_get_time())
+ */
+void effects_set_sync(bool enabled, int64_t epoch_us);
+
+/**
+ * @brief Dbut d'une mise  jour groupe
+ *
+ * Les appels suivants de l'API (effet, couleur, luminosit, fondu...) sont vus par la boucle
+ * de rendu en une seule fois,  effects_end_update(). Les appels peuvent tre imbriqus.
+ */
+void effects_begin_update(void);
+
+/**
+ * @brief Fin d'une mise  jour groupe : une seule trame est rendue avec tous les changements
+ */
+void effects_end_update(void);
+
+/**
+ * @brief Dcode un bloc de pixels dans le buffer arrire d'un segment
+ *
+ * Les buffers (deux trames du segment) sont allous au premier bloc. La trame n'est affiche
+ * qu' effects_stream_present(). Les numros de trame sont compars modulo 256 : un bloc
+ * d'une trame dj prsente est compt en retard et ignor.
+ *
+ * @param segment Index du segment
+ * @param frame Numro de la trame
+ * @param offset Premier pixel du bloc dans le segment
+ * @param encoding Encodage du bloc
+ * @param data Donnes du bloc
+ * @param len Taille des donnes
+ * @return
+ *      - ESP_OK en cas de succs
+ *      - ESP_ERR_INVALID_STATE si la trame est en retard
+ *      - ESP_ERR_INVALID_SIZE si le bloc est invalide ou dborde du segment
+ *      - ESP_ERR_NO_MEM si les buffers n'ont pas pu tre allous
+ *      - ESP_ERR_NOT_SUPPORTED en mode palette
+ */
+esp_err_t effects_stream_write(uint8_t segment, uint8_t frame, uint16_t offset, effects_stream_encoding_t encoding,
+                               const uint8_t *data, uint16_t len);
+
+/**
+ * @brief Affiche la trame reue sur un ou plusieurs segments
+ *
+ * Les buffers sont changs pour tous les segments du masque dans une mme trame du ruban,
+ * puis la trame affiche est recopie dans le buffer arrire (base des blocs delta suivants).
+ * Les segments affichent le flux jusqu' effects_start(), effects_stop(), un changement de
+ * couleur de base ou un fondu. La luminosit et le limiteur de courant restent appliqus.
+ *
+ * @param segment_mask Segments  prsenter (bit 0 = segment 0)
+ * @param frame Numro de la trame
+ */
+void effects_stream_present(uint32_t segment_mask, uint8_t frame);
+
+/**
+ * @brief Compteurs du flux de trames
+ *
+ * @param[out] stats Compteurs
+ */
+void effects_get_stream_stats(effects_stream_stats_t *stats);
 
 /**
- * @brief Dmarre l'effet d'identification (clignotement)
- * 
- * @param duration_sec Dure en secondes
+ * @brief Dmarre l'effet d'identification (clignotement de tout le ruban)
+ *
+ * @param duration_sec Dure en secondes (0 = arrt)
  */
 void effects_identify(uint16_t duration_sec);
 
 /**
- * @brief Rcupre la configuration actuelle de l'effet
- * 
+ * @brief Rcupre la configuration actuelle de l'effet d'un segment
+ *
+ * @param segment Index du segment
  * @return Pointeur vers la configuration (lecture seule)
  */
-const effect_config_t* effects_get_config(void);
+const effect_config_t* effects_get_config(uint8_t segment);
 
 /**
- * @brief Vrifie si un effet est actif
- * 
+ * @brief Vrifie si un effet est actif sur un segment
+ *
+ * @param segment Index du segment
  * @return true si un effet (autre que NONE) est en cours
  */
-bool effects_is_active(void);
+bool effects_is_active(uint8_t segment);
 
 #endif /* EFFECTS_H */
@@ -0,0 +1,269 @@
+/*
+ * Sorties paralleles : un ruban logique reparti sur plusieurs canaux RMT
+ */
+
+#include "led_output.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/cdefs.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "driver/rmt_tx.h"
+#include "led_strip_interface.h"
+
+static const char *TAG = "LED_OUTPUT";
+
+typedef struct led_output {
+    led_strip_t base;
+    uint32_t num_leds;
+    uint32_t shard_len;                     // LEDs par sortie (la derniere prend le reste)
+    uint8_t num_outputs;
+    led_strip_handle_t outputs[LED_OUTPUT_MAX_CHANNELS];
+    rmt_sync_manager_handle_t synchro;      // Demarrage simultane des transmissions (NULL si une seule sortie)
+    bool without_framebuffer;
+    uint8_t palette_bits;
+    led_strip_pixel_generator_t generator;  // Generateur du ruban logique (index global)
+    void *generator_ctx;
+    struct led_output_shard {
+        struct led_output *out;
+        uint32_t first;                     // Index global de la premiere LED de la sortie
+    } shards[LED_OUTPUT_MAX_CHANNELS];
+} led_output_t;
+
+/* Sortie et index local d'un pixel du ruban logique */
+static inline led_strip_handle_t locate(led_output_t *out, uint32_t index, uint32_t *local)
+{
+    uint32_t o = index / out->shard_len;
+    if (o >= out->num_outputs) {
+        o = out->num_outputs - 1;
+    }
+    *local = index - o * out->shard_len;
+    return out->outputs[o];
+}
+
+static esp_err_t led_output_set_pixel(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    ESP_RETURN_ON_FALSE(index < out->num_leds, ESP_ERR_INVALID_ARG, TAG, "index hors du ruban");
+    uint32_t local;
+    led_strip_handle_t shard = locate(out, index, &local);
+    return led_strip_set_pixel(shard, local, red, green, blue);
+}
+
+static esp_err_t led_output_set_pixel_rgbw(led_strip_t *strip, uint32_t index, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    ESP_RETURN_ON_FALSE(index < out->num_leds, ESP_ERR_INVALID_ARG, TAG, "index hors du ruban");
+    uint32_t local;
+    led_strip_handle_t shard = locate(out, index, &local);
+    return led_strip_set_pixel_rgbw(shard, local, red, green, blue, white);
+}
+
+static esp_err_t led_output_set_pixel_index(led_strip_t *strip, uint32_t index, uint32_t color_index)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    ESP_RETURN_ON_FALSE(index < out->num_leds, ESP_ERR_INVALID_ARG, TAG, "index hors du ruban");
+    uint32_t local;
+    led_strip_handle_t shard = locate(out, index, &local);
+    return led_strip_set_pixel_index(shard, local, color_index);
+}
+
+static esp_err_t led_output_set_palette_entry(led_strip_t *strip, uint32_t entry, uint32_t red, uint32_t green, uint32_t blue, uint32_t white)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    // Chaque sortie a sa copie de la palette
+    for (int o = 0; o < out->num_outputs; o++) {
+        ESP_RETURN_ON_ERROR(led_strip_set_palette_entry(out->outputs[o], entry, red, green, blue, white), TAG, "sortie %d: echec palette", o);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_output_refresh_async(led_strip_t *strip)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    if (out->synchro) {
+        rmt_sync_reset(out->synchro);
+    }
+    // Avec le sync manager, aucune sortie ne demarre avant que la derniere ait ete lancee
+    for (int o = 0; o < out->num_outputs; o++) {
+        esp_err_t err = led_strip_refresh_async(out->outputs[o]);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Sortie %d: echec transmission: %s", o, esp_err_to_name(err));
+            return err;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_output_refresh_wait(led_strip_t *strip)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    esp_err_t ret = ESP_OK;
+    for (int o = 0; o < out->num_outputs; o++) {
+        esp_err_t err = led_strip_refresh_wait(out->outputs[o]);
+        if (err != ESP_OK) {
+            ret = err;
+        }
+    }
+    return ret;
+}
+
+static esp_err_t led_output_refresh(led_strip_t *strip)
+{
+    ESP_RETURN_ON_ERROR(led_output_refresh_async(strip), TAG, "echec demarrage rafraichissement");
+    return led_output_refresh_wait(strip);
+}
+
+static esp_err_t led_output_set_output(led_strip_t *strip, const led_strip_output_config_t *config)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    ESP_RETURN_ON_FALSE(config->num_zones <= LED_STRIP_MAX_ZONES, ESP_ERR_INVALID_ARG, TAG, "trop de zones");
+    // Chaque sortie recoit les zones decoupees a sa tranche, en index local
+    for (int o = 0; o < out->num_outputs; o++) {
+        uint32_t first = o * out->shard_len;
+        uint32_t last = (o == out->num_outputs - 1) ? out->num_leds : first + out->shard_len;
+        led_strip_output_config_t shard = *config;
+        shard.num_zones = 0;
+        for (int z = 0; z < config->num_zones; z++) {
+            uint32_t start = config->zones[z].start;
+            uint32_t end = start + config->zones[z].count;
+            if (start < first) {
+                start = first;
+            }
+            if (end > last) {
+                end = last;
+            }
+            if (start >= end) {
+                continue;
+            }
+            shard.zones[shard.num_zones].start = start - first;
+            shard.zones[shard.num_zones].count = end - start;
+            shard.zones[shard.num_zones].scale = config->zones[z].scale;
+            shard.num_zones++;
+        }
+        ESP_RETURN_ON_ERROR(led_strip_set_output(out->outputs[o], &shard), TAG, "sortie %d: echec etage de sortie", o);
+    }
+    return ESP_OK;
+}
+
+/* Generateur d'une sortie : traduit l'index local en index du ruban logique */
+static void led_output_shard_generator(uint32_t index, uint32_t time_ms, uint8_t *color, void *user_ctx)
+{
+    struct led_output_shard *shard = user_ctx;
+    shard->out->generator(shard->first + index, time_ms, color, shard->out->generator_ctx);
+}
+
+static esp_err_t led_output_set_pixel_generator(led_strip_t *strip, led_strip_pixel_generator_t generator, void *user_ctx)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    out->generator = generator;
+    out->generator_ctx = user_ctx;
+    for (int o = 0; o < out->num_outputs; o++) {
+        ESP_RETURN_ON_ERROR(led_strip_set_pixel_generator(out->outputs[o], generator ? led_output_shard_generator : NULL,
+                                                          &out->shards[o]), TAG, "sortie %d: echec generateur", o);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t led_output_clear(led_strip_t *strip)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    if (out->without_framebuffer) {
+        // Sans framebuffer, sans generateur les sorties envoient du noir
+        led_output_set_pixel_generator(strip, NULL, NULL);
+        return led_output_refresh(strip);
+    }
+    // Pas de led_strip_clear() par sortie : il rafraichirait chaque sortie seule et bloquerait le groupe synchronise
+    if (out->palette_bits) {
+        // Palette : tous les pixels sur l'entree 0, mise au noir
+        led_output_set_palette_entry(strip, 0, 0, 0, 0, 0);
+    }
+    for (uint32_t i = 0; i < out->num_leds; i++) {
+        if (out->palette_bits) {
+            led_output_set_pixel_index(strip, i, 0);
+        } else {
+            led_output_set_pixel(strip, i, 0, 0, 0);
+        }
+    }
+    return led_output_refresh(strip);
+}
+
+static esp_err_t led_output_del(led_strip_t *strip)
+{
+    led_output_t *out = __containerof(strip, led_output_t, base);
+    if (out->synchro) {
+        rmt_del_sync_manager(out->synchro);
+    }
+    for (int o = 0; o < out->num_outputs; o++) {
+        if (out->outputs[o]) {
+            led_strip_del(out->outputs[o]);
+        }
+    }
+    free(out);
+    return ESP_OK;
+}
+
+esp_err_t led_output_new(const led_output_config_t *config, led_strip_handle_t *ret_strip)
+{
+    esp_err_t ret = ESP_OK;
+    led_output_t *out = NULL;
+    ESP_RETURN_ON_FALSE(config && config->gpios && ret_strip, ESP_ERR_INVALID_ARG, TAG, "argument invalide");
+    ESP_RETURN_ON_FALSE(config->num_outputs >= 1 && config->num_outputs <= LED_OUTPUT_MAX_CHANNELS,
+                        ESP_ERR_INVALID_ARG, TAG, "nombre de sorties invalide (1-%d)", LED_OUTPUT_MAX_CHANNELS);
+    ESP_RETURN_ON_FALSE(config->num_leds >= config->num_outputs, ESP_ERR_INVALID_ARG, TAG, "pas assez de LEDs");
+
+    out = calloc(1, sizeof(led_output_t));
+    ESP_RETURN_ON_FALSE(out, ESP_ERR_NO_MEM, TAG, "pas de memoire pour les sorties");
+    out->num_leds = config->num_leds;
+    out->num_outputs = config->num_outputs;
+    out->shard_len = config->num_leds / config->num_outputs;
+    out->without_framebuffer = config->without_framebuffer;
+    out->palette_bits = config->palette_bits;
+
+    for (int o = 0; o < config->num_outputs; o++) {
+        uint32_t len = (o == config->num_outputs - 1) ? (config->num_leds - o * out->shard_len) : out->shard_len;
+        led_strip_config_t strip_config = {
+            .strip_gpio_num = config->gpios[o],
+            .max_leds = len,
+            .led_pixel_format = config->led_pixel_format,
+            .led_model = config->led_model,
+            .flags.invert_out = false,
+        };
+        led_strip_rmt_config_t rmt_config = {
+            .clk_src = RMT_CLK_SRC_DEFAULT,
+            .resolution_hz = 10 * 1000 * 1000,
+            .flags.with_dma = false,
+            .flags.without_framebuffer = config->without_framebuffer,
+            .palette_bits = config->palette_bits,
+        };
+        out->shards[o].out = out;
+        out->shards[o].first = o * out->shard_len;
+        ESP_GOTO_ON_ERROR(led_strip_new_rmt_device(&strip_config, &rmt_config, &out->outputs[o]), err, TAG,
+                          "echec creation sortie %d (GPIO %d)", o, config->gpios[o]);
+        ESP_LOGI(TAG, "Sortie %d: GPIO %d, LEDs %lu-%lu", o, config->gpios[o],
+                 (unsigned long)(o * out->shard_len), (unsigned long)(o * out->shard_len + len - 1));
+    }
+
+    if (config->num_outputs > 1) {
+        ESP_GOTO_ON_ERROR(led_strip_rmt_new_sync_group(out->outputs, config->num_outputs, &out->synchro), err, TAG,
+                          "echec synchronisation des sorties");
+    }
+
+    out->base.set_pixel = led_output_set_pixel;
+    out->base.set_pixel_rgbw = led_output_set_pixel_rgbw;
+    out->base.set_pixel_index = led_output_set_pixel_index;
+    out->base.set_palette_entry = led_output_set_palette_entry;
+    out->base.refresh = led_output_refresh;
+    out->base.refresh_async = led_output_refresh_async;
+    out->base.refresh_wait = led_output_refresh_wait;
+    out->base.set_output = led_output_set_output;
+    out->base.set_pixel_generator = led_output_set_pixel_generator;
+    out->base.clear = led_output_clear;
+    out->base.del = led_output_del;
+
+    *ret_strip = &out->base;
+    return ESP_OK;
+err:
+    led_output_del(&out->base);
+    return ret;
+}
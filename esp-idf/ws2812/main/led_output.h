@@ -0,0 +1,41 @@
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include <stdint.h>
+#include "led_strip.h"
+#include "soc/soc_caps.h"
+
+/* Nombre maximum de sorties paralleles (un canal RMT TX par sortie) */
+#define LED_OUTPUT_MAX_CHANNELS     SOC_RMT_TX_CANDIDATES_PER_GROUP
+
+/* Configuration des sorties paralleles */
+typedef struct {
+    const int *gpios;                       // GPIO de chaque sortie
+    uint8_t num_outputs;                    // Nombre de sorties (1-LED_OUTPUT_MAX_CHANNELS)
+    uint32_t num_leds;                      // Nombre total de LEDs du ruban logique
+    led_pixel_format_t led_pixel_format;    // Format des pixels (identique pour toutes les sorties)
+    led_model_t led_model;                  // Modele de LED (identique pour toutes les sorties)
+    bool without_framebuffer;               // Pas de framebuffer : pixels produits par un generateur
+                                            // (led_strip_set_pixel_generator) pendant la transmission
+    uint8_t palette_bits;                   // 0 : couleur par pixel, 4 ou 8 : index dans une palette de 16 ou 256 couleurs
+} led_output_config_t;
+
+/**
+ * @brief Crée un ruban logique réparti sur plusieurs canaux RMT
+ *
+ * Le framebuffer logique est découpé en tranches contiguës de tailles égales
+ * (la dernière prend le reste), une par sortie. Le handle retourné s'utilise
+ * comme un ruban classique (led_strip_set_pixel / led_strip_refresh) : un
+ * rafraîchissement démarre toutes les transmissions en même temps, le temps
+ * de transmission d'une trame est donc divisé par le nombre de sorties.
+ *
+ * @param config Configuration des sorties
+ * @param ret_strip Handle du ruban logique
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - ESP_ERR_INVALID_ARG si la configuration est invalide
+ *      - ESP_ERR_NO_MEM si l'allocation a échoué
+ */
+esp_err_t led_output_new(const led_output_config_t *config, led_strip_handle_t *ret_strip);
+
+#endif /* LED_OUTPUT_H */
@@ -0,0 +1,337 @@
+/*
+ * Synchronisation des effets entre appareils d'un groupe : balise de temps group-cast
+ * (meneur elu ou coordinateur), origine commune des animations et correction de derive
+ */
+
+#include "light_sync.h"
+#include <stdlib.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "nvs.h"
+#include "effects.h"
+#include "main.h"
+
+static const char *TAG = "SYNC";
+
+#define MANUFACTURER_CODE   0x1234
+#define NVS_NAMESPACE       "sync"
+#define NVS_KEY_GROUP       "group"
+
+#define COORDINATOR_ADDR    0x0000
+#define NO_SOURCE           0xFFFF
+#define TICK_PERIOD_MS      1000    // Derive appliquee a l'origine des animations, attributs publies
+#define BEACON_PERIOD_MS    5000    // Balise du meneur (broadcast de groupe : pas plus souvent)
+#define SOURCE_TIMEOUT_MS   (3 * BEACON_PERIOD_MS)  // Reference perdue apres 3 balises manquees
+#define ELECTION_JITTER_MS  2000    // Tirage pour eviter deux candidatures simultanees
+#define WINDOW_BEACONS      4       // Balises par fenetre d'estimation (enveloppe haute)
+#define DRIFT_MAX_PPB       500000  // 500 ppm : au-dela, mesure ecartee
+
+static uint8_t s_endpoint;
+static uint16_t s_group = 0;
+static bool s_started = false;
+static light_sync_state_t s_state = LIGHT_SYNC_OFF;
+static uint16_t s_source = NO_SOURCE;       // Adresse de la reference suivie
+static int64_t s_source_seen_us = 0;        // Derniere balise de la reference (ou debut de l'attente)
+static int64_t s_timeout_us = 0;            // Attente avant de perdre la reference / se proposer
+static int64_t s_next_beacon_us = 0;
+
+// Temps du groupe (us) = temps local + offset, l'offset avancant de la derive entre deux mises a jour
+static int64_t s_offset_us = 0;
+static int64_t s_offset_at_us = 0;
+static int32_t s_drift_ppb = 0;             // Avance de l'horloge de reference sur l'horloge locale
+static uint32_t s_epoch_ms = 0;             // Origine des animations (temps du groupe)
+static int32_t s_error_ms = 0;              // Ecart de la derniere balise a l'horloge corrigee
+
+// Fenetre d'estimation : echantillon le moins retarde (ecart le plus grand) et sa date locale
+static uint8_t s_window_count = 0;
+static int64_t s_window_best_us;
+static int64_t s_window_best_at_us;
+static bool s_has_envelope = false;
+static int64_t s_envelope_us;
+static int64_t s_envelope_at_us;
+
+// Derniere balise traitee : une balise de groupe arrive sur chaque endpoint membre
+static uint16_t s_last_src = NO_SOURCE;
+static uint32_t s_last_time_ms = 0;
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+// Offset a l'instant local now, derive comprise
+static int64_t offset_at(int64_t now_us)
+{
+    return s_offset_us + (now_us - s_offset_at_us) * s_drift_ppb / 1000000000;
+}
+
+static void set_offset(int64_t now_us, int64_t offset_us)
+{
+    s_offset_us = offset_us;
+    s_offset_at_us = now_us;
+}
+
+static void set_attr(uint16_t attr_id, void *value)
+{
+    esp_zb_zcl_set_attribute_val(s_endpoint, LIGHT_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id, value, false);
+}
+
+// Origine des animations en temps local, attributs de mesure
+static void apply_sync(void)
+{
+    if (s_state == LIGHT_SYNC_OFF) {
+        effects_set_sync(false, 0);
+    } else {
+        int64_t now = esp_timer_get_time();
+        int64_t group_us = now + offset_at(now);
+        uint32_t elapsed_ms = (uint32_t)(group_us / 1000) - s_epoch_ms;
+        effects_set_sync(true, now - (int64_t)elapsed_ms * 1000 - group_us % 1000);
+    }
+
+    uint8_t state = s_state;
+    int32_t offset_ms = offset_at(esp_timer_get_time()) / 1000;
+    int16_t drift_ppm = s_drift_ppb / 1000;
+    int16_t error_ms = (s_error_ms > INT16_MAX) ? INT16_MAX : (s_error_ms < INT16_MIN) ? INT16_MIN : s_error_ms;
+    uint16_t source = (s_state == LIGHT_SYNC_LEADER) ? esp_zb_get_short_address() : s_source;
+    set_attr(LIGHT_CLUSTER_ATTR_SYNC_STATE, &state);
+    set_attr(LIGHT_CLUSTER_ATTR_SYNC_OFFSET, &offset_ms);
+    set_attr(LIGHT_CLUSTER_ATTR_SYNC_DRIFT, &drift_ppm);
+    set_attr(LIGHT_CLUSTER_ATTR_SYNC_ERROR, &error_ms);
+    set_attr(LIGHT_CLUSTER_ATTR_SYNC_SOURCE, &source);
+}
+
+static void set_state(light_sync_state_t state)
+{
+    static const char *names[] = {"desactivee", "recherche", "suiveur", "meneur"};
+
+    if (state == LIGHT_SYNC_SEARCHING || state == LIGHT_SYNC_FOLLOWER) {
+        s_source_seen_us = esp_timer_get_time();
+        s_timeout_us = (int64_t)(SOURCE_TIMEOUT_MS + esp_random() % ELECTION_JITTER_MS) * 1000;
+    }
+    if (state != LIGHT_SYNC_FOLLOWER) {
+        s_source = NO_SOURCE;
+    }
+    if (state == s_state) {
+        return;
+    }
+    s_state = state;
+    s_window_count = 0;
+    s_has_envelope = false;
+    s_next_beacon_us = 0;
+    ESP_LOGI(TAG, "Synchronisation %s (groupe 0x%04X)", names[state], s_group);
+}
+
+static void send_beacon(int64_t now_us)
+{
+    uint8_t payload[LIGHT_CMD_TIME_SYNC_LEN];
+    put_le32(&payload[0], (uint32_t)((now_us + offset_at(now_us)) / 1000));
+    put_le32(&payload[4], s_epoch_ms);
+
+    esp_zb_zcl_custom_cluster_cmd_req_t req = {
+        .zcl_basic_cmd = {
+            .dst_addr_u.addr_short = s_group,
+            .src_endpoint = s_endpoint,
+        },
+        .address_mode = ESP_ZB_APS_ADDR_MODE_16_GROUP_ENDP_NOT_PRESENT,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cluster_id = LIGHT_CLUSTER_ID,
+        .manuf_specific = 1,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
+        .dis_defalut_resp = 1,
+        .manuf_code = MANUFACTURER_CODE,
+        .custom_cmd_id = LIGHT_CMD_TIME_SYNC,
+        .data = {
+            .type = ESP_ZB_ZCL_ATTR_TYPE_SET,
+            .size = sizeof(payload),
+            .value = payload,
+        },
+    };
+    esp_zb_zcl_custom_cluster_cmd_req(&req);
+}
+
+// Suivi de la reference, election et balises du meneur
+static void sync_tick_cb(uint8_t param)
+{
+    if (s_state == LIGHT_SYNC_OFF) {
+        apply_sync();
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    if (s_state != LIGHT_SYNC_LEADER && now - s_source_seen_us > s_timeout_us) {
+        // Suiveur : reference perdue, l'horloge continue sur la derive estimee ; en recherche : candidature
+        if (s_state == LIGHT_SYNC_FOLLOWER) {
+            ESP_LOGW(TAG, "Reference 0x%04X perdue", s_source);
+            set_state(LIGHT_SYNC_SEARCHING);
+        } else {
+            set_state(LIGHT_SYNC_LEADER);
+        }
+    }
+    if (s_state == LIGHT_SYNC_LEADER && now >= s_next_beacon_us) {
+        send_beacon(now);
+        s_next_beacon_us = now + (int64_t)BEACON_PERIOD_MS * 1000;
+    }
+    apply_sync();
+    esp_zb_scheduler_alarm(sync_tick_cb, 0, TICK_PERIOD_MS);
+}
+
+static void schedule_tick(void)
+{
+    esp_zb_scheduler_alarm_cancel(sync_tick_cb, 0);
+    esp_zb_scheduler_alarm(sync_tick_cb, 0, TICK_PERIOD_MS);
+}
+
+// Fin d'une fenetre : l'offset rejoint l'enveloppe haute, la derive suit la pente entre deux enveloppes
+static void close_window(int64_t now_us)
+{
+    if (s_has_envelope && s_window_best_at_us > s_envelope_at_us) {
+        int64_t measured = (s_window_best_us - s_envelope_us) * 1000000000 / (s_window_best_at_us - s_envelope_at_us);
+        if (llabs(measured) <= DRIFT_MAX_PPB) {
+            s_drift_ppb += (int32_t)((measured - s_drift_ppb) / 4);
+        }
+    }
+    s_has_envelope = true;
+    s_envelope_us = s_window_best_us;
+    s_envelope_at_us = s_window_best_at_us;
+    s_window_count = 0;
+
+    // Echantillon le moins retarde ramene a maintenant avec la derive corrigee
+    set_offset(now_us, s_window_best_us + (now_us - s_window_best_at_us) * s_drift_ppb / 1000000000);
+}
+
+void light_sync_init(void)
+{
+    nvs_handle_t nvs;
+    if (nvs_open(NVS_NAMESPACE, NVS_READONLY, &nvs) != ESP_OK) {
+        return;
+    }
+    if (nvs_get_u16(nvs, NVS_KEY_GROUP, &s_group) == ESP_OK && s_group != 0) {
+        ESP_LOGI(TAG, "Groupe de synchronisation: 0x%04X", s_group);
+    }
+    nvs_close(nvs);
+}
+
+void light_sync_add_attrs(esp_zb_attribute_list_t *light_cluster, uint8_t endpoint)
+{
+    uint8_t state = LIGHT_SYNC_OFF;
+    int32_t offset_ms = 0;
+    int16_t zero = 0;
+    uint16_t source = NO_SOURCE;
+
+    s_endpoint = endpoint;
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_GROUP, ESP_ZB_ZCL_ATTR_TYPE_U16,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE, &s_group);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_STATE, ESP_ZB_ZCL_ATTR_TYPE_U8,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &state);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_OFFSET, ESP_ZB_ZCL_ATTR_TYPE_S32,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &offset_ms);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_DRIFT, ESP_ZB_ZCL_ATTR_TYPE_S16,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &zero);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_ERROR, ESP_ZB_ZCL_ATTR_TYPE_S16,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING, &zero);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_SYNC_SOURCE, ESP_ZB_ZCL_ATTR_TYPE_U16,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &source);
+}
+
+void light_sync_start(void)
+{
+    s_started = true;
+    if (s_group != 0 && s_state == LIGHT_SYNC_OFF) {
+        set_state(LIGHT_SYNC_SEARCHING);
+    }
+    schedule_tick();
+}
+
+esp_err_t light_sync_set_group(uint16_t group_id)
+{
+    if (group_id != s_group) {
+        s_group = group_id;
+        s_last_src = NO_SOURCE;
+        set_state(group_id != 0 ? LIGHT_SYNC_SEARCHING : LIGHT_SYNC_OFF);
+        if (s_started) {
+            schedule_tick();
+        }
+    }
+
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "echec ouverture NVS");
+    esp_err_t err = nvs_set_u16(nvs, NVS_KEY_GROUP, group_id);
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    ESP_RETURN_ON_ERROR(err, TAG, "echec enregistrement du groupe");
+    return ESP_OK;
+}
+
+esp_err_t light_sync_handle_beacon(const esp_zb_zcl_cmd_info_t *info, const uint8_t *data, uint16_t len)
+{
+    ESP_RETURN_ON_FALSE(len >= LIGHT_CMD_TIME_SYNC_LEN, ESP_ERR_INVALID_SIZE, TAG, "TimeSync trop court (%d)", len);
+
+    int64_t now = esp_timer_get_time();
+    uint16_t src = info->src_address.u.short_addr;
+    uint32_t time_ms = get_le32(&data[0]);
+    uint32_t epoch_ms = get_le32(&data[4]);
+
+    if (s_state == LIGHT_SYNC_OFF || src == esp_zb_get_short_address() ||
+        (src == s_last_src && time_ms == s_last_time_ms)) {
+        return ESP_OK;
+    }
+    s_last_src = src;
+    s_last_time_ms = time_ms;
+
+    // La plus petite adresse prime (coordinateur en premier) : un meneur cede, un suiveur change de reference
+    bool new_source = (s_state != LIGHT_SYNC_FOLLOWER || src != s_source);
+    if (new_source) {
+        if ((s_state == LIGHT_SYNC_FOLLOWER && src > s_source) ||
+            (s_state == LIGHT_SYNC_LEADER && src > esp_zb_get_short_address())) {
+            return ESP_OK;
+        }
+        set_state(LIGHT_SYNC_FOLLOWER);
+        s_source = src;
+        ESP_LOGI(TAG, "Reference: 0x%04X", src);
+    }
+    s_source_seen_us = now;
+
+    // Ecart de la balise a l'horloge corrigee (demi-milliseconde : le temps est tronque a l'emission)
+    int64_t predicted_us = now + offset_at(now);
+    int64_t residual_us = (int64_t)(int32_t)(time_ms - (uint32_t)(predicted_us / 1000)) * 1000 +
+                          500 - predicted_us % 1000;
+    int64_t sample_us = offset_at(now) + residual_us;
+    s_error_ms = residual_us / 1000;
+
+    if (new_source) {
+        // Nouvelle reference : calage direct sur la balise, estimation reprise a zero
+        set_offset(now, sample_us);
+        s_window_count = 0;
+        s_has_envelope = false;
+    } else if (residual_us > 0) {
+        // Une balise en avance ne peut pas venir d'un retard radio : l'horloge locale est en retard
+        set_offset(now, sample_us);
+    }
+
+    if (s_window_count == 0 || sample_us > s_window_best_us + (now - s_window_best_at_us) * s_drift_ppb / 1000000000) {
+        s_window_best_us = sample_us;
+        s_window_best_at_us = now;
+    }
+    if (++s_window_count >= WINDOW_BEACONS) {
+        close_window(now);
+    }
+
+    if (epoch_ms != s_epoch_ms) {
+        s_epoch_ms = epoch_ms;
+        ESP_LOGI(TAG, "Nouvelle origine des animations (%lu ms)", (unsigned long)epoch_ms);
+    }
+    apply_sync();
+    return ESP_OK;
+}
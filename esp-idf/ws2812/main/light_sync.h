@@ -0,0 +1,80 @@
+#ifndef LIGHT_SYNC_H
+#define LIGHT_SYNC_H
+
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_zigbee_core.h"
+
+/*
+ * Synchronisation des effets entre les appareils d'un groupe Zigbee
+ *
+ * Les appareils partagent un temps du groupe (ms) et une origine des animations : chacun calcule
+ * son pas d'animation à partir de ce temps (effects_set_sync()), les effets restent en phase
+ * quel que soit l'instant où chaque commande est arrivée. Le temps vient d'une balise TimeSync
+ * (LIGHT_CMD_TIME_SYNC) envoyée au groupe par le meneur : l'appareil de plus petite adresse
+ * courte qui en émet, ou le coordinateur (adresse 0) qui prime sur tous. Sans balise d'un meilleur
+ * candidat, un appareil prend la relève en continuant le même temps.
+ *
+ * Chaque balise donne un échantillon de l'écart entre le temps du groupe et l'horloge locale,
+ * retardé par le trajet radio : l'écart suit l'enveloppe haute des échantillons (seules les
+ * balises les moins retardées le corrigent) et la pente entre deux enveloppes donne la dérive
+ * de l'horloge locale, appliquée entre deux balises.
+ */
+
+/* État de la synchronisation (attribut LIGHT_CLUSTER_ATTR_SYNC_STATE) */
+typedef enum {
+    LIGHT_SYNC_OFF = 0,         // Aucun groupe : animations locales
+    LIGHT_SYNC_SEARCHING,       // En attente d'une balise avant de se proposer comme meneur
+    LIGHT_SYNC_FOLLOWER,        // Calé sur les balises du meneur ou du coordinateur
+    LIGHT_SYNC_LEADER,          // Émet les balises du groupe
+} light_sync_state_t;
+
+/**
+ * @brief Lit le groupe de synchronisation enregistré en NVS
+ *
+ * À appeler avant la création des endpoints.
+ */
+void light_sync_init(void);
+
+/**
+ * @brief Ajoute les attributs LIGHT_CLUSTER_ATTR_SYNC_* au cluster fabricant d'un endpoint
+ *
+ * Une seule horloge par appareil : à appeler pour un seul endpoint, qui émet aussi les balises.
+ *
+ * @param light_cluster Liste d'attributs du cluster LIGHT_CLUSTER_ID
+ * @param endpoint Endpoint portant le cluster
+ */
+void light_sync_add_attrs(esp_zb_attribute_list_t *light_cluster, uint8_t endpoint);
+
+/**
+ * @brief Démarre la synchronisation une fois l'appareil sur le réseau
+ *
+ * Sans effet si aucun groupe n'est configuré. À appeler depuis le contexte Zigbee.
+ */
+void light_sync_start(void);
+
+/**
+ * @brief Change le groupe de synchronisation (attribut LIGHT_CLUSTER_ATTR_SYNC_GROUP)
+ *
+ * Le groupe est enregistré en NVS ; l'appareil doit aussi en être membre pour recevoir les balises.
+ *
+ * @param group_id Groupe des balises (0 : synchronisation désactivée)
+ * @return
+ *      - ESP_OK en cas de succès
+ *      - Erreur NVS si l'enregistrement a échoué (le groupe est tout de même appliqué)
+ */
+esp_err_t light_sync_set_group(uint16_t group_id);
+
+/**
+ * @brief Traite une balise TimeSync reçue sur le cluster fabricant
+ *
+ * @param info En-tête de la commande (adresse de l'émetteur)
+ * @param data Contenu de la commande
+ * @param len Taille du contenu
+ * @return
+ *      - ESP_OK en cas de succès (y compris balise ignorée : autre meneur, doublon)
+ *      - ESP_ERR_INVALID_SIZE si la balise est trop courte
+ */
+esp_err_t light_sync_handle_beacon(const esp_zb_zcl_cmd_info_t *info, const uint8_t *data, uint16_t len);
+
+#endif /* LIGHT_SYNC_H */
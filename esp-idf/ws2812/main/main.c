@@ -11,154 +11,1612 @@
 #include "freertos/task.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_system.h"
 #include "esp_check.h"
 #include "ha/esp_zigbee_ha_standard.h"
 #include "led_strip.h"
+#include "led_output.h"
+#include "color_correction.h"
+#include "poll_control.h"
+#include "light_sync.h"
+#include "commissioning.h"
+#include "zboss_api.h"
 
 // Configuration
-#define LED_STRIP_GPIO      5
+#define LED_STRIP_GPIO      CONFIG_LIGHT_STRIP_GPIO
 #define LED_STRIP_LENGTH    60
+// Sorties paralleles (menuconfig, WS2812 Light) : une GPIO par canal RMT (2 max sur ESP32-H2). Le ruban est
+// reparti en parts egales, ex. GPIO 5 et 4 : LEDs 0-29 sur GPIO 5, 30-59 sur GPIO 4
+#if CONFIG_LIGHT_STRIP_GPIO_2 >= 0
+#define LED_STRIP_GPIOS     { LED_STRIP_GPIO, CONFIG_LIGHT_STRIP_GPIO_2 }
+#else
+#define LED_STRIP_GPIOS     { LED_STRIP_GPIO }
+#endif
+// Type de ruban par defaut (light_strip_type_t) : enregistre en NVS et modifiable via 0xF009, applique au redemarrage
+#define LED_STRIP_TYPE              LIGHT_STRIP_WS2812
+// Rubans RGBW : couleur de la LED blanche a pleine puissance en R, G, B ({ 255, 255, 255 } : min(R, G, B))
+#define LED_STRIP_WHITE_POINT       { 255, 255, 255 }
+// 1 : pas de framebuffer, les effets sont calcules pendant la transmission (rubans tres longs)
+#define LED_STRIP_RENDER_IN_ENCODER 0
+// 4 ou 8 : framebuffer indexe (palette de 16 ou 256 couleurs), 0 : couleur par LED
+#define LED_STRIP_PALETTE_BITS      0
+// 1 : dithering temporel (faibles niveaux sans marches), coupe automatiquement si le ruban est trop long
+#define LED_STRIP_DITHER            1
+// Budget de l'alimentation pour le ruban (mA) : la luminosite est reduite au-dela, 0 = pas de limite
+#define LED_STRIP_MAX_CURRENT_MA    2000
+// Calibrage de l'estimation du courant : courant d'un canal R, G, B a 255 (mA) et tension du ruban
+#define LED_STRIP_CHANNEL_MA        { 20, 20, 20 }
+#define LED_STRIP_VOLTAGE_MV        5000
+// Courbe niveau -> luminosite par defaut (EFFECTS_CURVE_LINEAR, _CIE_LSTAR, _GAMMA_2_2), modifiable via 0xF006
+#define LED_STRIP_LEVEL_CURVE       EFFECTS_CURVE_CIE_LSTAR
+
+// Mesure electrique estimee (cluster Electrical Measurement sur le premier endpoint, tout le ruban)
+#define POWER_MEASURE_PERIOD_MS     1000
+#define POWER_REPORT_MIN_INTERVAL   5       // s
+#define POWER_REPORT_MAX_INTERVAL   300     // s
+#define POWER_REPORT_DELTA          5       // 0.5 W
+#define CURRENT_REPORT_DELTA        50      // mA
+
+// Reporting de l'etat de chaque segment : un report au plus par intervalle min, au-dela du seuil
+#define LIGHT_REPORT_MIN_INTERVAL   1       // s
+#define LIGHT_REPORT_MAX_INTERVAL   600     // s
+#define LEVEL_REPORT_DELTA          3       // ~1 % de CurrentLevel
+#define COLOR_XY_REPORT_DELTA       328     // 0.005 en x / y
+#define COLOR_TEMP_REPORT_DELTA     10      // mireds
+
+// Types de ruban : format des pixels et timings
+typedef enum {
+    LIGHT_STRIP_WS2812 = 0,     // WS2812 / WS2812B, GRB
+    LIGHT_STRIP_SK6812_RGB,     // SK6812, GRB
+    LIGHT_STRIP_SK6812_RGBW,    // SK6812 RGBW, GRBW avec extraction du blanc
+    LIGHT_STRIP_TYPE_MAX
+} light_strip_type_t;
+
+static const struct {
+    led_pixel_format_t format;
+    led_model_t model;
+} light_strip_types[LIGHT_STRIP_TYPE_MAX] = {
+    [LIGHT_STRIP_WS2812]      = { LED_PIXEL_FORMAT_GRB,  LED_MODEL_WS2812 },
+    [LIGHT_STRIP_SK6812_RGB]  = { LED_PIXEL_FORMAT_GRB,  LED_MODEL_SK6812 },
+    [LIGHT_STRIP_SK6812_RGBW] = { LED_PIXEL_FORMAT_GRBW, LED_MODEL_SK6812 },
+};
+
+// Configuration du ruban (0xF009, octet string, enregistree en NVS) : type puis point blanc R, G, B.
+// Le type est pris en compte au redemarrage, le point blanc immediatement
+#define LIGHT_STRIP_CONFIG_LEN  4
+#define STRIP_NVS_NAMESPACE     "strip"
+#define STRIP_NVS_KEY           "config"
+#define STRIP_RESTART_DELAY_MS  1000
+
+static uint8_t strip_config[LIGHT_STRIP_CONFIG_LEN];
+static light_strip_type_t strip_type;    // Type du ruban en cours d'utilisation
+
+static const int led_strip_gpios[] = LED_STRIP_GPIOS;
+#define LED_STRIP_OUTPUTS   (sizeof(led_strip_gpios) / sizeof(led_strip_gpios[0]))
 
 static const char *TAG = "ZIGBEE_WS2812";
 static led_strip_handle_t led_strip = NULL;
 
-static light_state_t light_state = {
-    .on_off = false,
-    .level = 0,
-    .color_x = 0x616B,
-    .color_y = 0x607D,
-    .effect_id = 0,
-    .speed_rainbow = 128,
-    .speed_strobe = 128,
-    .speed_twinkle = 128
-};
+_Static_assert(LIGHT_SEGMENT_COUNT >= 1 && LIGHT_SEGMENT_COUNT <= EFFECTS_MAX_SEGMENTS,
+               "LIGHT_SEGMENT_COUNT doit etre entre 1 et EFFECTS_MAX_SEGMENTS");
+
+static light_state_t light_state[LIGHT_SEGMENT_COUNT];
+
+// Dernier niveau non nul pour eviter le blocage a 0% au premier ON
+static uint8_t last_level_non_zero[LIGHT_SEGMENT_COUNT];
+
+// Fondu long (0xF005, octet string) : duree (s, u32), niveau d'arrivee (u8), [X, Y d'arrivee (u16)],
+// [niveau, X, Y de depart] ; entiers en little-endian, duree 0 = arret du fondu
+#define LIGHT_FADE_LEN_LEVEL    5
+#define LIGHT_FADE_LEN_COLOR    9
+#define LIGHT_FADE_LEN_FROM     14
+#define FADE_REPORT_PERIOD_MS   10000   // Mise a jour de CurrentLevel pendant un fondu
+
+// Flux de trames : compteurs publies au plus une fois par periode pendant le flux
+#define STREAM_STATS_PERIOD_MS  1000
+static bool stream_stats_scheduled = false;
+
+// Fondu long en cours : etat d'arrivee publie sur les attributs ZCL a la fin
+typedef struct {
+    bool running;
+    uint8_t level;
+    uint16_t color_x;
+    uint16_t color_y;
+} light_fade_t;
+
+static light_fade_t light_fade[LIGHT_SEGMENT_COUNT];
+
+// Calibrage des couleurs (0xF008, octet string) : x, y des primaires R, G, B, gains R, G, B
+// (65535 = 1) et gamma R, G, B (centiemes), tous en u16 little-endian ; vide = calibrage par defaut
+#define LIGHT_CALIBRATION_LEN   24
+
+// Etat complet d'un segment (0xF00A, octet string, lecture seule, reporte) : version, on/off, level,
+// x (u16), y (u16), color mode, temperature (u16), effet, vitesses rainbow / strobe / twinkle, degrade
+#define LIGHT_STATE_VERSION     1
+#define LIGHT_STATE_LEN         15
+
+// Stockage persistant des attributs manufacturer-specific (un jeu par endpoint)
+typedef struct {
+    uint8_t effect_value;
+    uint8_t speed_rainbow;
+    uint8_t speed_strobe;
+    uint8_t speed_twinkle;
+    // Degrade (octet string ZCL : longueur puis contenu). [id] : degrade predefini,
+    // [0xFF, pos, r, g, b, ...] : jusqu'a EFFECTS_GRADIENT_MAX_STOPS points personnalises
+    uint8_t gradient[1 + 1 + EFFECTS_GRADIENT_MAX_STOPS * 4];
+    uint8_t fade[1 + LIGHT_FADE_LEN_FROM];
+    // Courbe de luminosite (globale, recopiee sur tous les endpoints) et ses points
+    // personnalises : [niveau (u8), luminosite (u16 LE), ...]
+    uint8_t level_curve;
+    uint8_t level_curve_points[1 + EFFECTS_CURVE_MAX_POINTS * 3];
+    // Calibrage des couleurs (global, persistant), voir LIGHT_CALIBRATION_LEN
+    uint8_t color_calibration[1 + LIGHT_CALIBRATION_LEN];
+    // Type de ruban et point blanc (global, persistant), voir LIGHT_STRIP_CONFIG_LEN
+    uint8_t strip_config[1 + LIGHT_STRIP_CONFIG_LEN];
+    // Etat complet du segment, voir LIGHT_STATE_LEN
+    uint8_t state[1 + LIGHT_STATE_LEN];
+} light_attr_storage_t;
+
+#define LIGHT_GRADIENT_CUSTOM   0xFF
+
+
+static light_attr_storage_t attr_storage[LIGHT_SEGMENT_COUNT];
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+// Etat du segment au format de l'attribut 0xF00A (octet string : longueur puis contenu)
+static void encode_light_state(const light_state_t *ls, uint8_t *value)
+{
+    uint8_t *data = &value[1];
+
+    value[0] = LIGHT_STATE_LEN;
+    data[0] = LIGHT_STATE_VERSION;
+    data[1] = ls->on_off;
+    data[2] = ls->level;
+    put_le16(&data[3], ls->color_x);
+    put_le16(&data[5], ls->color_y);
+    data[7] = ls->color_mode;
+    put_le16(&data[8], ls->color_temp);
+    data[10] = ls->effect_id;
+    data[11] = ls->speed_rainbow;
+    data[12] = ls->speed_strobe;
+    data[13] = ls->speed_twinkle;
+    data[14] = ls->gradient_id;
+}
+
+// Etat initial de chaque segment
+static void light_state_init(void)
+{
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        light_state[i] = (light_state_t){
+            .on_off = false,
+            .level = 0,
+            .color_x = 0x616B,
+            .color_y = 0x607D,
+            .color_mode = LIGHT_COLOR_MODE_XY,
+            .color_temp = ESP_ZB_ZCL_COLOR_CONTROL_COLOR_TEMPERATURE_DEF_VALUE,
+            .effect_id = 0,
+            .speed_rainbow = 128,
+            .speed_strobe = 128,
+            .speed_twinkle = 128,
+            .speed_program = 128,
+            .program_slot = EFFECT_PROGRAMS_SLOTS,
+            .gradient_id = GRADIENT_NONE
+        };
+        last_level_non_zero[i] = 200;
+        attr_storage[i] = (light_attr_storage_t){
+            .effect_value = 0,
+            .speed_rainbow = 128,
+            .speed_strobe = 128,
+            .speed_twinkle = 128,
+            .gradient = {1, GRADIENT_NONE},
+            .level_curve = LED_STRIP_LEVEL_CURVE,
+        };
+        encode_light_state(&light_state[i], attr_storage[i].state);
+    }
+}
+
+// Endpoint Zigbee d'un segment
+static inline uint8_t segment_endpoint(uint8_t segment)
+{
+    return HA_ESP_LIGHT_ENDPOINT + segment;
+}
+
+// Publie l'etat complet du segment s'il a change (un seul report pour tout l'etat)
+static void publish_light_state(uint8_t seg)
+{
+    uint8_t value[1 + LIGHT_STATE_LEN];
+
+    encode_light_state(&light_state[seg], value);
+    if (memcmp(value, attr_storage[seg].state, sizeof(value)) == 0) {
+        return;
+    }
+    memcpy(attr_storage[seg].state, value, sizeof(value));
+    esp_zb_zcl_set_attribute_val(segment_endpoint(seg), ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, 0xF00A, attr_storage[seg].state, false);
+}
+
+// Envoie l'etat complet de chaque segment aux destinataires lies (apres un redemarrage ou un appairage)
+static void report_light_state(void)
+{
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        esp_zb_zcl_report_attr_cmd_t report = {
+            .zcl_basic_cmd.src_endpoint = segment_endpoint(seg),
+            .address_mode = ESP_ZB_APS_ADDR_MODE_DST_ADDR_ENDP_NOT_PRESENT,
+            .clusterID = ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            .manuf_specific = 1,
+            .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+            .manuf_code = 0x1234,
+            .attributeID = 0xF00A,
+        };
+        esp_err_t err = esp_zb_zcl_report_attr_cmd_req(&report);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "[%d] Report de l'etat non envoye: %s", seg, esp_err_to_name(err));
+        }
+    }
+}
+
+// Valeur courante d'un attribut serveur (NULL si absent)
+static const void *get_zcl_attr_value(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id)
+{
+    esp_zb_zcl_attr_t *attr = esp_zb_zcl_get_attribute(endpoint, cluster_id, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id);
+    return attr ? attr->data_p : NULL;
+}
+
+// Helper pour mettre à jour un attribut ZCL U8 avec log d'erreur (ignoré si la valeur ne change pas)
+static void set_zcl_attr_u8(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id, uint8_t value)
+{
+    const uint8_t *current = get_zcl_attr_value(endpoint, cluster_id, attr_id);
+    if (current && *current == value) {
+        return;
+    }
+    esp_err_t err = esp_zb_zcl_set_attribute_val(endpoint,
+        cluster_id,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+        attr_id,
+        &value,
+        false);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "set_attr 0x%04X/0x%04X failed: %s", cluster_id, attr_id, esp_err_to_name(err));
+    }
+}
+
+// Mesure electrique estimee a partir du rendu (puissance en 0.1 W, courant en mA)
+static void power_measure_cb(uint8_t param)
+{
+    static int16_t last_power = -1;
+    static uint16_t last_current = 0;
+    effects_power_status_t status;
+
+    effects_get_power_status(&status);
+    uint16_t current = status.output_ma > UINT16_MAX ? UINT16_MAX : status.output_ma;
+    uint32_t power = (uint64_t)status.output_ma * LED_STRIP_VOLTAGE_MV / 100000;
+    int16_t active_power = power > INT16_MAX ? INT16_MAX : power;
+
+    // Le moteur de reporting du stack n'envoie que les changements au-dela du seuil configure
+    if (active_power != last_power) {
+        esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT,
+            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACTIVE_POWER_ID,
+            &active_power, false);
+        last_power = active_power;
+    }
+    if (current != last_current) {
+        esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT,
+            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID,
+            &current, false);
+        last_current = current;
+    }
+
+    esp_zb_scheduler_alarm(power_measure_cb, 0, POWER_MEASURE_PERIOD_MS);
+}
+
+// Reporting par defaut d'un attribut : intervalle min/max (s) et seuil de variation
+typedef struct {
+    uint16_t cluster_id;
+    uint16_t attr_id;
+    uint16_t manuf_code;
+    uint16_t min_interval;
+    uint16_t max_interval;
+    union esp_zb_zcl_attr_var_u delta;  // Ignore pour les attributs discrets (booleen, enum)
+} attr_report_config_t;
+
+// Etat de chaque segment (le coordinateur peut toujours reconfigurer par Configure Reporting)
+static const attr_report_config_t light_reports[] = {
+    { ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      0, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 0 } },
+    { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u8 = LEVEL_REPORT_DELTA } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u16 = COLOR_XY_REPORT_DELTA } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u16 = COLOR_XY_REPORT_DELTA } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u16 = COLOR_TEMP_REPORT_DELTA } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID, ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC,
+      0, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 0 } },
+    // Effet et vitesses (0xF000 - 0xF003)
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF000, 0x1234, 0, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 1 } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF001, 0x1234, LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 1 } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF002, 0x1234, LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 1 } },
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF003, 0x1234, LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 1 } },
+    // Etat complet (0xF00A) : reporte a chaque changement, au plus une fois par intervalle min
+    { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF00A, 0x1234, LIGHT_REPORT_MIN_INTERVAL, LIGHT_REPORT_MAX_INTERVAL, { .u8 = 0 } },
+};
+
+// Puissance et courant estimes, sur le premier endpoint
+static const attr_report_config_t power_reports[] = {
+    { ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACTIVE_POWER_ID,
+      ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC, POWER_REPORT_MIN_INTERVAL, POWER_REPORT_MAX_INTERVAL, { .u16 = POWER_REPORT_DELTA } },
+    { ESP_ZB_ZCL_CLUSTER_ID_ELECTRICAL_MEASUREMENT, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID,
+      ESP_ZB_ZCL_ATTR_NON_MANUFACTURER_SPECIFIC, POWER_REPORT_MIN_INTERVAL, POWER_REPORT_MAX_INTERVAL, { .u16 = CURRENT_REPORT_DELTA } },
+};
+
+static void configure_reporting(uint8_t endpoint, const attr_report_config_t *reports, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        esp_zb_zcl_reporting_info_t reporting_info = {
+            .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_SRV,
+            .ep = endpoint,
+            .cluster_id = reports[i].cluster_id,
+            .cluster_role = ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+            .attr_id = reports[i].attr_id,
+            .dst.profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+            .u.send_info.min_interval = reports[i].min_interval,
+            .u.send_info.max_interval = reports[i].max_interval,
+            .u.send_info.def_min_interval = reports[i].min_interval,
+            .u.send_info.def_max_interval = reports[i].max_interval,
+            .u.send_info.delta = reports[i].delta,
+            .manuf_code = reports[i].manuf_code,
+        };
+        esp_err_t err = esp_zb_zcl_update_reporting_info(&reporting_info);
+        if (err != ESP_OK) {
+            ESP_LOGW(TAG, "Reporting 0x%04X/0x%04X non configure: %s", reports[i].cluster_id, reports[i].attr_id,
+                     esp_err_to_name(err));
+        }
+    }
+}
+
+// Reporting par defaut : etat de chaque segment, puissance et courant du ruban
+static void reporting_init(void)
+{
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        configure_reporting(segment_endpoint(seg), light_reports, sizeof(light_reports) / sizeof(light_reports[0]));
+    }
+    configure_reporting(HA_ESP_LIGHT_ENDPOINT, power_reports, sizeof(power_reports) / sizeof(power_reports[0]));
+}
+
+// Helper pour mettre à jour un attribut ZCL U16 avec log d'erreur (ignoré si la valeur ne change pas)
+static void set_zcl_attr_u16(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id, uint16_t value)
+{
+    const uint16_t *current = get_zcl_attr_value(endpoint, cluster_id, attr_id);
+    if (current && *current == value) {
+        return;
+    }
+    esp_err_t err = esp_zb_zcl_set_attribute_val(endpoint,
+        cluster_id,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+        attr_id,
+        &value,
+        false);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "set_attr 0x%04X/0x%04X failed: %s", cluster_id, attr_id, esp_err_to_name(err));
+    }
+}
+
+// Fonction helper pour remettre l'effet sur none et notifier Z2M
+static void reset_effect_to_none(uint8_t seg)
+{
+    light_state_t *ls = &light_state[seg];
+    light_attr_storage_t *attrs = &attr_storage[seg];
+    uint8_t endpoint = segment_endpoint(seg);
+
+    if (ls->effect_id != EFFECT_NONE) {
+        ls->effect_id = EFFECT_NONE;
+        effects_stop(seg);
+        attrs->effect_value = 0;
+        set_zcl_attr_u8(endpoint,
+            ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            0xF000,
+            attrs->effect_value);
+        ESP_LOGI(TAG, "Effet remis sur none");
+    }
+}
+
+// Fonction helper pour obtenir la vitesse de l'effet actuel
+static uint8_t get_current_effect_speed(const light_state_t *ls)
+{
+    switch (ls->effect_id) {
+        case EFFECT_RAINBOW: return ls->speed_rainbow;
+        case EFFECT_STROBE:  return ls->speed_strobe;
+        case EFFECT_TWINKLE: return ls->speed_twinkle;
+        case EFFECT_PROGRAM: return ls->speed_program;
+        default: return 128;
+    }
+}
+
+// Applique le degrade recu sur l'attribut 0xF004 (octet string : longueur puis contenu)
+static bool apply_gradient_attr(uint8_t seg, const uint8_t *value)
+{
+    uint8_t len = value[0];
+    const uint8_t *data = &value[1];
+
+    if (len == 1 && data[0] < GRADIENT_MAX) {
+        effects_set_gradient_preset(seg, (gradient_preset_t)data[0]);
+        light_state[seg].gradient_id = data[0];
+        return true;
+    }
+    if (len < 1 + 4 || data[0] != LIGHT_GRADIENT_CUSTOM || (len - 1) % 4 != 0 ||
+        (len - 1) / 4 > EFFECTS_GRADIENT_MAX_STOPS) {
+        ESP_LOGW(TAG, "Degrade invalide (%d octets)", len);
+        return false;
+    }
+
+    gradient_stop_t stops[EFFECTS_GRADIENT_MAX_STOPS];
+    uint8_t num_stops = (len - 1) / 4;
+    for (int k = 0; k < num_stops; k++) {
+        const uint8_t *p = &data[1 + k * 4];
+        stops[k] = (gradient_stop_t){ .pos = p[0], .color = { p[1], p[2], p[3] } };
+    }
+    effects_set_gradient(seg, stops, num_stops);
+    light_state[seg].gradient_id = LIGHT_GRADIENT_CUSTOM;
+    return true;
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Suivi des fondus longs : CurrentLevel mis a jour de loin en loin, etat d'arrivee publie a la fin
+static void fade_report_cb(uint8_t param)
+{
+    bool running = false;
+
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        light_fade_t *fade = &light_fade[seg];
+        light_state_t *ls = &light_state[seg];
+        uint8_t endpoint = segment_endpoint(seg);
+        uint8_t level;
+
+        if (!fade->running) {
+            continue;
+        }
+        if (effects_fade_running(seg, &level)) {
+            running = true;
+            if (level != ls->level) {
+                ls->level = level;
+                if (level > 0) {
+                    last_level_non_zero[seg] = level;
+                }
+                set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+                    ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ls->level);
+                publish_light_state(seg);
+            }
+            continue;
+        }
+
+        fade->running = false;
+        ls->level = fade->level;
+        ls->color_x = fade->color_x;
+        ls->color_y = fade->color_y;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+            ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ls->level);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ls->color_x);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ls->color_y);
+        if (ls->level == 0) {
+            // Coucher de soleil termine : eteindre
+            ls->on_off = false;
+            set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, 0);
+            effects_set_power(seg, false);
+        } else {
+            last_level_non_zero[seg] = ls->level;
+        }
+        publish_light_state(seg);
+        ESP_LOGI(TAG, "[%d] Fondu termine: level=%d", seg, ls->level);
+    }
+
+    if (running) {
+        esp_zb_scheduler_alarm(fade_report_cb, 0, FADE_REPORT_PERIOD_MS);
+    }
+}
+
+// Premier passage de fade_report_cb : a la fin d'un fondu court, sinon a la periode de suivi
+static void schedule_fade_report(uint32_t duration_ms)
+{
+    uint32_t delay_ms = FADE_REPORT_PERIOD_MS;
+    if (duration_ms < FADE_REPORT_PERIOD_MS) {
+        delay_ms = duration_ms + 50;
+    }
+    esp_zb_scheduler_alarm_cancel(fade_report_cb, 0);
+    esp_zb_scheduler_alarm(fade_report_cb, 0, delay_ms);
+}
+
+// Arret d'un fondu par une commande explicite : l'etat reste celui atteint
+static void cancel_fade(uint8_t seg)
+{
+    uint8_t level;
+
+    if (!light_fade[seg].running) {
+        return;
+    }
+    light_fade[seg].running = false;
+    effects_fade_running(seg, &level);
+    effects_fade_stop(seg);
+    light_state[seg].level = level;
+    ESP_LOGI(TAG, "[%d] Fondu interrompu a level=%d", seg, level);
+}
+
+// Calibrage courant au format de l'attribut 0xF008 (octet string : longueur puis contenu)
+static void encode_calibration(uint8_t *value)
+{
+    color_calibration_t cal;
+    color_correction_get(&cal);
+    uint8_t *p = &value[1];
+    for (int c = 0; c < 3; c++) {
+        put_le16(&p[c * 4], cal.primaries[c][0]);
+        put_le16(&p[c * 4 + 2], cal.primaries[c][1]);
+        put_le16(&p[12 + c * 2], cal.gain[c]);
+        put_le16(&p[18 + c * 2], cal.gamma[c]);
+    }
+    value[0] = LIGHT_CALIBRATION_LEN;
+}
+
+// Recopie un attribut global (courbe, configuration du ruban) sur les endpoints des autres segments
+static void mirror_global_attr(uint8_t seg, uint16_t attr_id, void *value)
+{
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        if (i == seg) {
+            continue;
+        }
+        esp_zb_zcl_set_attribute_val(segment_endpoint(i), ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id, value, false);
+    }
+}
+
+// Charge la configuration du ruban enregistree (ou celle par defaut)
+static void strip_config_load(void)
+{
+    const uint8_t white_point[] = LED_STRIP_WHITE_POINT;
+    nvs_handle_t nvs;
+    size_t len = sizeof(strip_config);
+
+    strip_config[0] = LED_STRIP_TYPE;
+    memcpy(&strip_config[1], white_point, sizeof(white_point));
+    if (nvs_open(STRIP_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        uint8_t stored[LIGHT_STRIP_CONFIG_LEN];
+        if (nvs_get_blob(nvs, STRIP_NVS_KEY, stored, &len) == ESP_OK && len == sizeof(stored) &&
+            stored[0] < LIGHT_STRIP_TYPE_MAX) {
+            memcpy(strip_config, stored, sizeof(strip_config));
+        }
+        nvs_close(nvs);
+    }
+    strip_type = strip_config[0];
+}
+
+static esp_err_t strip_config_save(void)
+{
+    nvs_handle_t nvs;
+    ESP_RETURN_ON_ERROR(nvs_open(STRIP_NVS_NAMESPACE, NVS_READWRITE, &nvs), TAG, "echec ouverture NVS");
+    esp_err_t err = nvs_set_blob(nvs, STRIP_NVS_KEY, strip_config, sizeof(strip_config));
+    if (err == ESP_OK) {
+        err = nvs_commit(nvs);
+    }
+    nvs_close(nvs);
+    return err;
+}
+
+// Extraction du blanc sur les rubans RGBW, avec le point blanc configure
+static void apply_white_point(void)
+{
+    if (light_strip_types[strip_type].format != LED_PIXEL_FORMAT_GRBW) {
+        return;
+    }
+    rgb_color_t white_point = { strip_config[1], strip_config[2], strip_config[3] };
+    effects_set_white_point(&white_point);
+}
+
+static void restart_cb(uint8_t param)
+{
+    esp_restart();
+}
+
+// Applique la configuration du ruban recue sur l'attribut 0xF009 : [type] ou [type, R, G, B]
+static bool apply_strip_config_attr(uint8_t seg, const uint8_t *value)
+{
+    uint8_t len = value[0];
+    const uint8_t *data = &value[1];
+
+    if ((len != 1 && len != LIGHT_STRIP_CONFIG_LEN) || data[0] >= LIGHT_STRIP_TYPE_MAX) {
+        ESP_LOGW(TAG, "Configuration du ruban invalide (%d octets)", len);
+        return false;
+    }
+    memcpy(strip_config, data, len);
+    esp_err_t err = strip_config_save();
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Configuration du ruban non enregistree: %s", esp_err_to_name(err));
+    }
+
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        attr_storage[i].strip_config[0] = LIGHT_STRIP_CONFIG_LEN;
+        memcpy(&attr_storage[i].strip_config[1], strip_config, LIGHT_STRIP_CONFIG_LEN);
+    }
+    mirror_global_attr(seg, 0xF009, attr_storage[seg].strip_config);
+
+    apply_white_point();
+    if (strip_config[0] != strip_type && err == ESP_OK) {
+        // Le format des pixels et les timings sont fixes a la creation du ruban
+        ESP_LOGI(TAG, "Type de ruban %d -> %d, redemarrage", strip_type, strip_config[0]);
+        esp_zb_scheduler_alarm(restart_cb, 0, STRIP_RESTART_DELAY_MS);
+    }
+    return true;
+}
+
+// Applique la courbe recue sur l'attribut 0xF006
+static bool apply_level_curve_attr(uint8_t seg, uint8_t curve)
+{
+    if (curve >= EFFECTS_CURVE_MAX) {
+        ESP_LOGW(TAG, "Courbe de luminosite invalide: %d", curve);
+        return false;
+    }
+    effects_set_level_curve((effects_level_curve_t)curve);
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        attr_storage[i].level_curve = curve;
+    }
+    mirror_global_attr(seg, 0xF006, &curve);
+    return true;
+}
+
+// Applique les points de courbe personnalises recus sur l'attribut 0xF007 (octet string)
+static bool apply_level_curve_points_attr(uint8_t seg, const uint8_t *value)
+{
+    uint8_t len = value[0];
+    const uint8_t *data = &value[1];
+
+    if (len % 3 != 0 || len / 3 > EFFECTS_CURVE_MAX_POINTS) {
+        ESP_LOGW(TAG, "Points de courbe invalides (%d octets)", len);
+        return false;
+    }
+
+    curve_point_t points[EFFECTS_CURVE_MAX_POINTS];
+    uint8_t num_points = len / 3;
+    for (int k = 0; k < num_points; k++) {
+        const uint8_t *p = &data[k * 3];
+        points[k] = (curve_point_t){ .level = p[0], .output = get_le16(&p[1]) };
+        if (k > 0 && points[k].level < points[k - 1].level) {
+            ESP_LOGW(TAG, "Points de courbe non tries");
+            return false;
+        }
+    }
+    effects_set_custom_level_curve(points, num_points);
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        memcpy(attr_storage[i].level_curve_points, value, 1 + len);
+    }
+    mirror_global_attr(seg, 0xF007, attr_storage[seg].level_curve_points);
+    return true;
+}
+
+// Couleur fixe d'un segment : table de temperature ou conversion X/Y selon le mode
+static void light_color_rgb(const light_state_t *ls, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+    if (ls->color_mode == LIGHT_COLOR_MODE_TEMPERATURE) {
+        color_correction_mired_to_rgb(ls->color_temp, r, g, b);
+    } else {
+        color_correction_xy_to_rgb(ls->color_x, ls->color_y, r, g, b);
+    }
+}
+
+// Mode couleur d'un segment, publie sur ColorMode et EnhancedColorMode
+static void set_color_mode(uint8_t seg, uint8_t mode)
+{
+    uint8_t endpoint = segment_endpoint(seg);
+
+    light_state[seg].color_mode = mode;
+    set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_MODE_ID, mode);
+    set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_ENHANCED_COLOR_MODE_ID, mode);
+}
+
+// MoveToColorTemperature : transition interpolee par le moteur de fondu (16 bits, sans pas d'attribut)
+static void move_to_color_temperature(uint8_t seg, uint16_t mireds, uint32_t duration_ms)
+{
+    light_state_t *ls = &light_state[seg];
+    light_fade_t *target = &light_fade[seg];
+    uint8_t endpoint = segment_endpoint(seg);
+    effects_fade_t fade = {
+        .from_level = ls->level,
+        .to_level = ls->level,
+        .duration_ms = duration_ms,
+    };
+
+    if (mireds < COLOR_CORRECTION_MIREDS_MIN) {
+        mireds = COLOR_CORRECTION_MIREDS_MIN;
+    }
+    if (mireds > COLOR_CORRECTION_MIREDS_MAX) {
+        mireds = COLOR_CORRECTION_MIREDS_MAX;
+    }
+    cancel_fade(seg);
+    light_color_rgb(ls, &fade.from_color.r, &fade.from_color.g, &fade.from_color.b);
+
+    ls->color_temp = mireds;
+    set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+        ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ls->color_temp);
+    set_color_mode(seg, LIGHT_COLOR_MODE_TEMPERATURE);
+    color_correction_mired_to_rgb(mireds, &fade.to_color.r, &fade.to_color.g, &fade.to_color.b);
+    ESP_LOGI(TAG, "[%d] Temperature -> %d mireds en %lu ms", seg, mireds, (unsigned long)duration_ms);
+
+    // X/Y suivent la temperature, publies a la fin de la transition
+    target->level = ls->level;
+    color_correction_mired_to_xy(mireds, &target->color_x, &target->color_y);
+    if (duration_ms == 0 || !ls->on_off || ls->effect_id != EFFECT_NONE) {
+        ls->color_x = target->color_x;
+        ls->color_y = target->color_y;
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ls->color_x);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ls->color_y);
+        effects_set_base_color(seg, fade.to_color.r, fade.to_color.g, fade.to_color.b);
+        return;
+    }
+
+    effects_fade_start(seg, &fade);
+    target->running = true;
+    schedule_fade_report(duration_ms);
+    poll_control_activity(duration_ms);
+}
+
+// Demarre le fondu recu sur l'attribut 0xF005 (octet string : longueur puis contenu)
+static bool start_fade_from_attr(uint8_t seg, const uint8_t *value)
+{
+    uint8_t len = value[0];
+    const uint8_t *data = &value[1];
+    light_state_t *ls = &light_state[seg];
+    light_fade_t *target = &light_fade[seg];
+    uint8_t endpoint = segment_endpoint(seg);
+
+    if (len != LIGHT_FADE_LEN_LEVEL && len != LIGHT_FADE_LEN_COLOR && len != LIGHT_FADE_LEN_FROM) {
+        ESP_LOGW(TAG, "Fondu invalide (%d octets)", len);
+        return false;
+    }
+    uint32_t duration_s = get_le32(&data[0]);
+    if (duration_s == 0) {
+        cancel_fade(seg);
+        return true;
+    }
+
+    // Depart : etat affiche, ou etat donne dans la commande
+    uint8_t from_level = ls->on_off ? ls->level : 0;
+    uint16_t from_x = ls->color_x;
+    uint16_t from_y = ls->color_y;
+    target->level = data[4];
+    target->color_x = ls->color_x;
+    target->color_y = ls->color_y;
+    if (len >= LIGHT_FADE_LEN_COLOR) {
+        target->color_x = get_le16(&data[5]);
+        target->color_y = get_le16(&data[7]);
+    }
+    if (len == LIGHT_FADE_LEN_FROM) {
+        from_level = data[9];
+        from_x = get_le16(&data[10]);
+        from_y = get_le16(&data[12]);
+    }
+
+    effects_fade_t fade = {
+        .from_level = from_level,
+        .to_level = target->level,
+        .duration_ms = (duration_s > UINT32_MAX / 1000) ? UINT32_MAX : duration_s * 1000,
+    };
+    color_correction_xy_to_rgb(from_x, from_y, &fade.from_color.r, &fade.from_color.g, &fade.from_color.b);
+    color_correction_xy_to_rgb(target->color_x, target->color_y, &fade.to_color.r, &fade.to_color.g, &fade.to_color.b);
+
+    // Le fondu pilote la couleur de base : pas d'effet anime
+    reset_effect_to_none(seg);
+    if (!ls->on_off) {
+        ls->on_off = true;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, 1);
+    }
+    ls->level = from_level;
+    set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
+        ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ls->level);
+
+    if (len >= LIGHT_FADE_LEN_COLOR) {
+        set_color_mode(seg, LIGHT_COLOR_MODE_XY);
+    }
+
+    effects_fade_start(seg, &fade);
+    target->running = true;
+    schedule_fade_report(fade.duration_ms);
+    poll_control_activity(fade.duration_ms);
+    ESP_LOGI(TAG, "[%d] Fondu %d -> %d en %lu s", seg, from_level, target->level, (unsigned long)duration_s);
+    return true;
+}
+
+// Mise à jour d'un segment du ruban LED (le rendu est fait par la boucle d'effets)
+static void update_led_strip(uint8_t seg)
+{
+    const light_state_t *ls = &light_state[seg];
+
+    if (!ls->on_off) {
+        ESP_LOGI(TAG, "[%d] LED OFF", seg);
+        effects_stop(seg);
+        effects_set_power(seg, false);
+        return;
+    }
+
+    effects_set_power(seg, true);
+    // La luminosite est appliquee par l'etage de sortie, pour la couleur fixe comme pour les effets
+    effects_set_brightness(seg, ls->level);
+
+    // Si un effet est actif, le système d'effets gère l'affichage
+    if (ls->effect_id != EFFECT_NONE && effects_is_active(seg)) {
+        ESP_LOGI(TAG, "[%d] Effet actif: %d", seg, ls->effect_id);
+        return;
+    }
+    
+    // Mode couleur fixe (pas d'effet)
+    uint8_t r, g, b;
+    light_color_rgb(ls, &r, &g, &b);
+    
+    ESP_LOGI(TAG, "[%d] LED ON - Level=%d, XY=(0x%04X,0x%04X) -> RGB(%d,%d,%d)",
+             seg, ls->level, ls->color_x, ls->color_y, r, g, b);
+
+    effects_set_base_color(seg, r, g, b);
+}
+
+// Changement complet d'un segment recu sur le cluster fabricant (SetEffect, SetSegment)
+typedef struct {
+    uint8_t on_off;             // 0, 1 ou LIGHT_KEEP_U8
+    uint8_t level;              // LIGHT_KEEP_U8 = inchange
+    uint16_t color_x;           // LIGHT_KEEP_U16 = couleur inchangee
+    uint16_t color_y;
+    uint16_t color_temp;        // Mode temperature si different de LIGHT_KEEP_U16 (avec X/Y correspondants)
+    uint8_t effect_id;          // LIGHT_KEEP_U8 = inchange
+    uint8_t speed;              // 0 = vitesse de l'effet inchangee
+    uint32_t transition_ms;     // Couleur fixe uniquement
+} light_command_t;
+
+#define LIGHT_KEEP_U8   0xFF
+#define LIGHT_KEEP_U16  0xFFFF
+
+// Vitesse d'un effet (attribut 0xF001 - 0xF003 correspondant)
+static void set_effect_speed(uint8_t seg, uint8_t effect_id, uint8_t speed)
+{
+    light_state_t *ls = &light_state[seg];
+    light_attr_storage_t *attrs = &attr_storage[seg];
+    uint8_t endpoint = segment_endpoint(seg);
+
+    switch (effect_id) {
+    case EFFECT_RAINBOW:
+        ls->speed_rainbow = attrs->speed_rainbow = speed;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF001, speed);
+        break;
+    case EFFECT_STROBE:
+        ls->speed_strobe = attrs->speed_strobe = speed;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF002, speed);
+        break;
+    case EFFECT_TWINKLE:
+        ls->speed_twinkle = attrs->speed_twinkle = speed;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF003, speed);
+        break;
+    case EFFECT_PROGRAM:
+        // Pas d'attribut : vitesse donnee par ProgramRun
+        ls->speed_program = speed;
+        break;
+    default:
+        break;
+    }
+}
+
+// Applique un changement complet en une seule trame : l'etat et les attributs sont mis a jour,
+// puis le moteur d'effets recoit tous les changements sous un meme verrou (effects_start une fois)
+static void apply_light_command(uint8_t seg, const light_command_t *cmd)
+{
+    light_state_t *ls = &light_state[seg];
+    light_attr_storage_t *attrs = &attr_storage[seg];
+    light_fade_t *target = &light_fade[seg];
+    uint8_t endpoint = segment_endpoint(seg);
+    effects_fade_t fade = {
+        .from_level = ls->on_off ? ls->level : 0,
+        .duration_ms = cmd->transition_ms,
+    };
+
+    cancel_fade(seg);
+    light_color_rgb(ls, &fade.from_color.r, &fade.from_color.g, &fade.from_color.b);
+
+    if (cmd->effect_id != LIGHT_KEEP_U8 && cmd->effect_id < EFFECT_MAX) {
+        ls->effect_id = cmd->effect_id;
+        attrs->effect_value = ls->effect_id;
+        set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF000, attrs->effect_value);
+    }
+    if (cmd->speed != 0) {
+        set_effect_speed(seg, ls->effect_id, cmd->speed);
+    }
+    if (cmd->color_x != LIGHT_KEEP_U16 && cmd->color_y != LIGHT_KEEP_U16) {
+        ls->color_x = cmd->color_x;
+        ls->color_y = cmd->color_y;
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ls->color_x);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ls->color_y);
+        set_color_mode(seg, LIGHT_COLOR_MODE_XY);
+    }
+    if (cmd->color_temp != LIGHT_KEEP_U16) {
+        ls->color_temp = cmd->color_temp;
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, ls->color_temp);
+        // X/Y suivent la temperature, comme pour MoveToColorTemperature
+        color_correction_mired_to_xy(ls->color_temp, &ls->color_x, &ls->color_y);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID, ls->color_x);
+        set_zcl_attr_u16(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID, ls->color_y);
+        set_color_mode(seg, LIGHT_COLOR_MODE_TEMPERATURE);
+    }
+    if (cmd->level != LIGHT_KEEP_U8) {
+        ls->level = cmd->level;
+    }
+    if (cmd->on_off != LIGHT_KEEP_U8) {
+        ls->on_off = cmd->on_off;
+    } else if (ls->effect_id != EFFECT_NONE) {
+        ls->on_off = true;
+    }
+    // Memes regles que les attributs : un effet allume a 200 si le niveau est nul
+    if (ls->on_off && ls->level == 0 && ls->effect_id != EFFECT_NONE) {
+        ls->level = 200;
+    }
+    if (ls->level > 0) {
+        last_level_non_zero[seg] = ls->level;
+    }
+    set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID, ls->on_off);
+    set_zcl_attr_u8(endpoint, ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID, ls->level);
+
+    effects_begin_update();
+    if (!ls->on_off) {
+        reset_effect_to_none(seg);
+        update_led_strip(seg);
+    } else if (ls->effect_id != EFFECT_NONE) {
+        effects_start(seg, (effect_type_t)ls->effect_id, get_current_effect_speed(ls));
+        update_led_strip(seg);
+    } else if (cmd->transition_ms > 0) {
+        // Couleur fixe avec transition : moteur de fondu, etat d'arrivee publie a la fin
+        effects_stop(seg);
+        fade.to_level = ls->level;
+        light_color_rgb(ls, &fade.to_color.r, &fade.to_color.g, &fade.to_color.b);
+        target->level = ls->level;
+        target->color_x = ls->color_x;
+        target->color_y = ls->color_y;
+        effects_set_power(seg, true);
+        effects_fade_start(seg, &fade);
+        target->running = true;
+    } else {
+        effects_stop(seg);
+        update_led_strip(seg);
+    }
+    effects_end_update();
+
+    if (target->running) {
+        schedule_fade_report(cmd->transition_ms);
+        poll_control_activity(cmd->transition_ms);
+    }
+    publish_light_state(seg);
+    ESP_LOGI(TAG, "[%d] Commande groupee: on=%d level=%d effet=%d", seg, ls->on_off, ls->level, ls->effect_id);
+}
+
+// Compteurs du flux de trames, publies au plus une fois par periode
+static void stream_stats_cb(uint8_t param)
+{
+    effects_stream_stats_t stats;
+    effects_get_stream_stats(&stats);
+    const struct {
+        uint16_t attr_id;
+        uint32_t value;
+    } counters[] = {
+        { LIGHT_CLUSTER_ATTR_STREAM_CHUNKS, stats.chunks },
+        { LIGHT_CLUSTER_ATTR_STREAM_FRAMES, stats.frames },
+        { LIGHT_CLUSTER_ATTR_STREAM_DROPPED, stats.dropped },
+        { LIGHT_CLUSTER_ATTR_STREAM_LATE, stats.late },
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        uint32_t value = counters[i].value;
+        esp_zb_zcl_set_attribute_val(HA_ESP_LIGHT_ENDPOINT, LIGHT_CLUSTER_ID, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
+            counters[i].attr_id, &value, false);
+    }
+    stream_stats_scheduled = false;
+}
+
+static void schedule_stream_stats(void)
+{
+    if (!stream_stats_scheduled) {
+        stream_stats_scheduled = true;
+        esp_zb_scheduler_alarm(stream_stats_cb, 0, STREAM_STATS_PERIOD_MS);
+    }
+}
+
+// Commandes du cluster fabricant LIGHT_CLUSTER_ID
+static esp_err_t zb_custom_cluster_handler(const esp_zb_zcl_custom_cluster_command_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Message vide");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG,
+                        "Statut d'erreur (%d)", message->info.status);
+
+    uint8_t endpoint = message->info.dst_endpoint;
+    const uint8_t *data = message->data.value;
+    uint16_t size = data ? message->data.size : 0;
+    if (message->info.cluster != LIGHT_CLUSTER_ID ||
+        endpoint < HA_ESP_LIGHT_ENDPOINT || endpoint >= HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint8_t seg = endpoint - HA_ESP_LIGHT_ENDPOINT;
+    uint32_t mask = 1U << seg;
+    light_command_t cmd = { .on_off = LIGHT_KEEP_U8, .color_temp = LIGHT_KEEP_U16 };
+    esp_err_t err;
+
+    switch (message->info.command.id) {
+    case LIGHT_CMD_STREAM_CHUNK:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_STREAM_CHUNK_LEN, ESP_ERR_INVALID_SIZE, TAG, "StreamChunk trop court (%d)", size);
+        // Erreurs comptees par le moteur d'effets (LIGHT_CLUSTER_ATTR_STREAM_*), pas de log par bloc
+        err = effects_stream_write(data[1], data[0], get_le16(&data[2]), (effects_stream_encoding_t)data[4],
+                                   &data[LIGHT_CMD_STREAM_CHUNK_LEN], size - LIGHT_CMD_STREAM_CHUNK_LEN);
+        return (err == ESP_ERR_INVALID_STATE) ? ESP_OK : err;
+    case LIGHT_CMD_PROGRAM_WRITE:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_PROGRAM_WRITE_LEN, ESP_ERR_INVALID_SIZE, TAG, "ProgramWrite trop court (%d)", size);
+        return effect_programs_write(data[0], get_le16(&data[1]), &data[LIGHT_CMD_PROGRAM_WRITE_LEN],
+                                     size - LIGHT_CMD_PROGRAM_WRITE_LEN);
+    case LIGHT_CMD_PROGRAM_COMMIT:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_PROGRAM_COMMIT_LEN, ESP_ERR_INVALID_SIZE, TAG, "ProgramCommit trop court (%d)", size);
+        // Les segments qui executent l'emplacement passent au nouveau code dans la meme trame
+        effects_begin_update();
+        err = effect_programs_commit(data[0], get_le16(&data[1]));
+        for (uint8_t i = 0; err == ESP_OK && i < LIGHT_SEGMENT_COUNT; i++) {
+            if (light_state[i].program_slot == data[0]) {
+                effects_set_program(i, effect_programs_get(data[0]), light_state[i].program_params);
+            }
+        }
+        effects_end_update();
+        return err;
+    case LIGHT_CMD_PROGRAM_RUN: {
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_PROGRAM_RUN_LEN, ESP_ERR_INVALID_SIZE, TAG, "ProgramRun trop court (%d)", size);
+        const effect_vm_program_t *program = effect_programs_get(data[0]);
+        ESP_RETURN_ON_FALSE(program && program->code_len > 0, ESP_ERR_NOT_FOUND, TAG, "Emplacement %d vide", data[0]);
+        light_state_t *ls = &light_state[seg];
+        ls->program_slot = data[0];
+        memcpy(ls->program_params, &data[2], EFFECT_VM_PARAMS);
+        cmd = (light_command_t){
+            .on_off = LIGHT_KEEP_U8, .level = LIGHT_KEEP_U8, .color_x = LIGHT_KEEP_U16, .color_y = LIGHT_KEEP_U16,
+            .color_temp = LIGHT_KEEP_U16, .effect_id = EFFECT_PROGRAM, .speed = data[1],
+        };
+        effects_begin_update();
+        effects_set_program(seg, program, ls->program_params);
+        apply_light_command(seg, &cmd);
+        effects_end_update();
+        return ESP_OK;
+    }
+    case LIGHT_CMD_TIME_SYNC:
+        return light_sync_handle_beacon(&message->info, data, size);
+    case LIGHT_CMD_COMMISSION:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_COMMISSION_LEN, ESP_ERR_INVALID_SIZE, TAG, "Commission trop court (%d)", size);
+        return commissioning_open(data[0], get_le16(&data[1]));
+    case LIGHT_CMD_STREAM_PRESENT:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_STREAM_PRESENT_LEN, ESP_ERR_INVALID_SIZE, TAG, "StreamPresent trop court (%d)", size);
+        if (data[1] != 0) {
+            mask = data[1] & ((1U << LIGHT_SEGMENT_COUNT) - 1);
+        }
+        effects_stream_present(mask, data[0]);
+        schedule_stream_stats();
+        return ESP_OK;
+    case LIGHT_CMD_SET_SEGMENT:
+        ESP_RETURN_ON_FALSE(size >= LIGHT_CMD_SET_SEGMENT_LEN, ESP_ERR_INVALID_SIZE, TAG, "SetSegment trop court (%d)", size);
+        if (data[0] != 0) {
+            mask = data[0] & ((1U << LIGHT_SEGMENT_COUNT) - 1);
+        }
+        cmd.on_off = data[1];
+        data += 2;
+        // Suite identique a SetEffect
+        /* fall through */
+    case LIGHT_CMD_SET_EFFECT:
+        ESP_RETURN_ON_FALSE(message->info.command.id == LIGHT_CMD_SET_SEGMENT || size >= LIGHT_CMD_SET_EFFECT_LEN,
+                            ESP_ERR_INVALID_SIZE, TAG, "SetEffect trop court (%d)", size);
+        cmd.effect_id = data[0];
+        cmd.speed = data[1];
+        cmd.color_x = get_le16(&data[2]);
+        cmd.color_y = get_le16(&data[4]);
+        cmd.level = data[6];
+        cmd.transition_ms = get_le16(&data[7]) * 100;
+        break;
+    default:
+        ESP_LOGW(TAG, "Commande 0x%02X du cluster 0x%04X non geree", message->info.command.id, LIGHT_CLUSTER_ID);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    for (uint8_t i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        if (mask & (1U << i)) {
+            apply_light_command(i, &cmd);
+        }
+    }
+    return ESP_OK;
+}
 
-// Dernier niveau non nul pour eviter le blocage a 0% au premier ON
-static uint8_t last_level_non_zero = 200;
+// Scenes : copie en RAM de l'etat de chaque scene, remplie par StoreScene ou au premier rappel (champs
+// d'extension fournis par le stack), oubliee quand la scene est modifiee par une autre commande
+#define LIGHT_SCENE_COLOR_LEN   13      // X, Y, hue (u16), saturation, color loop (3 x u8), loop time, temperature (u16)
 
-// Stockage persistant des attributs manufacturer-specific
-static uint8_t attr_effect_value = 0;
-static uint8_t attr_speed_rainbow = 128;
-static uint8_t attr_speed_strobe  = 128;
-static uint8_t attr_speed_twinkle = 128;
+typedef struct {
+    bool used;
+    bool loaded;                // Etat valide (sinon : entree qui vient d'etre creee)
+    uint8_t seg;
+    uint16_t group_id;
+    uint8_t scene_id;
+    bool on_off;
+    uint8_t level;
+    uint8_t color_mode;
+    uint16_t color_x;
+    uint16_t color_y;
+    uint16_t color_temp;
+    uint8_t effect_id;
+    uint8_t speed;
+    uint8_t program_slot;
+    uint8_t program_params[EFFECT_VM_PARAMS];
+    uint8_t gradient[sizeof(((light_attr_storage_t *)0)->gradient)];
+} light_scene_t;
 
-// Helper pour mettre à jour un attribut ZCL U8 avec log d'erreur
-static void set_zcl_attr_u8(uint8_t endpoint, uint16_t cluster_id, uint16_t attr_id, uint8_t value)
+static light_scene_t scene_cache[LIGHT_SCENE_CACHE_SIZE];
+static uint8_t scene_cache_next = 0;    // Entree remplacee quand la table est pleine
+
+// Transitions des scenes (1/10 s), enregistrees en NVS : la table du stack ne se relit pas, StoreScene doit
+// pourtant y garder la transition d'une scene existante, meme absente de la copie en RAM
+#define SCENE_TRANSITION_MAX    ZB_ZCL_MAX_SCENE_TABLE_RECORDS
+#define SCENE_NVS_NAMESPACE     "scenes"
+#define SCENE_NVS_KEY           "transitions"
+#define SCENE_TRANSITION_FREE   0xFF
+
+typedef struct {
+    uint16_t group_id;
+    uint8_t seg;                // SCENE_TRANSITION_FREE : entree libre
+    uint8_t scene_id;
+    uint16_t transition;
+} scene_transition_t;
+
+static scene_transition_t scene_transitions[SCENE_TRANSITION_MAX];
+
+// Entree d'une scene ; si absente et create, entree libre (ou la plus ancienne), sinon NULL
+static void scene_transitions_load(void)
 {
-    esp_err_t err = esp_zb_zcl_set_attribute_val(endpoint,
-        cluster_id,
-        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE,
-        attr_id,
-        &value,
-        false);
+    nvs_handle_t nvs;
+    size_t len = sizeof(scene_transitions);
+
+    memset(scene_transitions, SCENE_TRANSITION_FREE, sizeof(scene_transitions));
+    if (nvs_open(SCENE_NVS_NAMESPACE, NVS_READONLY, &nvs) == ESP_OK) {
+        if (nvs_get_blob(nvs, SCENE_NVS_KEY, scene_transitions, &len) != ESP_OK || len != sizeof(scene_transitions)) {
+            memset(scene_transitions, SCENE_TRANSITION_FREE, sizeof(scene_transitions));
+        }
+        nvs_close(nvs);
+    }
+}
+
+static void scene_transitions_save(void)
+{
+    nvs_handle_t nvs;
+    esp_err_t err = nvs_open(SCENE_NVS_NAMESPACE, NVS_READWRITE, &nvs);
+    if (err == ESP_OK) {
+        err = nvs_set_blob(nvs, SCENE_NVS_KEY, scene_transitions, sizeof(scene_transitions));
+        if (err == ESP_OK) {
+            err = nvs_commit(nvs);
+        }
+        nvs_close(nvs);
+    }
     if (err != ESP_OK) {
-        ESP_LOGW(TAG, "set_attr 0x%04X/0x%04X failed: %s", cluster_id, attr_id, esp_err_to_name(err));
+        ESP_LOGW(TAG, "Echec enregistrement des transitions de scenes: %s", esp_err_to_name(err));
     }
 }
 
-// Fonction helper pour remettre l'effet sur none et notifier Z2M
-static void reset_effect_to_none(void)
+static scene_transition_t *scene_transition_find(uint8_t seg, uint16_t group_id, uint8_t scene_id)
 {
-    if (light_state.effect_id != EFFECT_NONE) {
-        light_state.effect_id = EFFECT_NONE;
-        effects_stop();
-        attr_effect_value = 0;
-        set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
-            ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
-            0xF000,
-            attr_effect_value);
-        ESP_LOGI(TAG, "Effet remis sur none");
+    for (int i = 0; i < SCENE_TRANSITION_MAX; i++) {
+        scene_transition_t *entry = &scene_transitions[i];
+        if (entry->seg == seg && entry->group_id == group_id && entry->scene_id == scene_id) {
+            return entry;
+        }
     }
+    return NULL;
 }
 
-// Fonction helper pour obtenir la vitesse de l'effet actuel
-static uint8_t get_current_effect_speed(void)
+// Retourne true si la table a change
+static bool scene_transition_set(uint8_t seg, uint16_t group_id, uint8_t scene_id, uint16_t transition)
 {
-    switch (light_state.effect_id) {
-        case EFFECT_RAINBOW: return light_state.speed_rainbow;
-        case EFFECT_STROBE:  return light_state.speed_strobe;
-        case EFFECT_TWINKLE: return light_state.speed_twinkle;
-        default: return 128;
+    scene_transition_t *entry = scene_transition_find(seg, group_id, scene_id);
+    if (entry == NULL) {
+        entry = scene_transition_find(SCENE_TRANSITION_FREE, 0xFFFF, 0xFF);
+    }
+    if (entry == NULL) {
+        ESP_LOGW(TAG, "[%d] Table des transitions pleine, scene %d non suivie", seg, scene_id);
+        return false;
     }
+    if (entry->seg == seg && entry->transition == transition) {
+        return false;
+    }
+    *entry = (scene_transition_t){ .group_id = group_id, .seg = seg, .scene_id = scene_id, .transition = transition };
+    return true;
 }
 
-// Conversion XY (CIE 1931) vers RGB
-static void xy_to_rgb(uint16_t x, uint16_t y, uint8_t brightness, uint8_t *r, uint8_t *g, uint8_t *b)
+// Oublie les transitions d'un groupe sur les segments du masque (toutes si all_scenes, sinon scene_id)
+static bool scene_transition_remove(uint32_t mask, uint16_t group_id, bool all_scenes, uint8_t scene_id)
 {
-    float fx = (float)x / 65535.0f;
-    float fy = (float)y / 65535.0f;
-    
-    if (fy < 0.0001f) fy = 0.0001f;
-    
-    float z = 1.0f - fx - fy;
-    float Y = (float)brightness / 254.0f;
-    float X = (Y / fy) * fx;
-    float Z = (Y / fy) * z;
-    
-    float fr = X * 3.2406f + Y * -1.5372f + Z * -0.4986f;
-    float fg = X * -0.9689f + Y * 1.8758f + Z * 0.0415f;
-    float fb = X * 0.0557f + Y * -0.2040f + Z * 1.0570f;
-    
-    // Correction gamma (sRGB)
-    fr = (fr > 0.0031308f) ? (1.055f * powf(fr, 1.0f/2.4f) - 0.055f) : (12.92f * fr);
-    fg = (fg > 0.0031308f) ? (1.055f * powf(fg, 1.0f/2.4f) - 0.055f) : (12.92f * fg);
-    fb = (fb > 0.0031308f) ? (1.055f * powf(fb, 1.0f/2.4f) - 0.055f) : (12.92f * fb);
-    
-    // Clamping
-    if (fr < 0.0f) {
-        fr = 0.0f;
+    bool changed = false;
+
+    for (int i = 0; i < SCENE_TRANSITION_MAX; i++) {
+        scene_transition_t *entry = &scene_transitions[i];
+        if (entry->seg != SCENE_TRANSITION_FREE && (mask & (1U << entry->seg)) && entry->group_id == group_id &&
+            (all_scenes || entry->scene_id == scene_id)) {
+            memset(entry, SCENE_TRANSITION_FREE, sizeof(*entry));
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// CopyScene : transitions du groupe source (toutes si all_scenes, sinon scene_from) vers la destination
+static bool scene_transition_copy(uint32_t mask, bool all_scenes, uint16_t group_from, uint8_t scene_from,
+                                  uint16_t group_to, uint8_t scene_to)
+{
+    scene_transition_t copies[SCENE_TRANSITION_MAX];
+    int count = 0;
+    bool changed = false;
+
+    if (all_scenes && group_from == group_to) {
+        return false;
     }
-    if (fr > 1.0f) {
-        fr = 1.0f;
+    for (int i = 0; i < SCENE_TRANSITION_MAX; i++) {
+        const scene_transition_t *entry = &scene_transitions[i];
+        if (entry->seg != SCENE_TRANSITION_FREE && (mask & (1U << entry->seg)) && entry->group_id == group_from &&
+            (all_scenes || entry->scene_id == scene_from)) {
+            copies[count] = *entry;
+            copies[count].group_id = group_to;
+            copies[count].scene_id = all_scenes ? entry->scene_id : scene_to;
+            count++;
+        }
     }
-    if (fg < 0.0f) {
-        fg = 0.0f;
+    for (int i = 0; i < count; i++) {
+        changed |= scene_transition_set(copies[i].seg, copies[i].group_id, copies[i].scene_id, copies[i].transition);
     }
-    if (fg > 1.0f) {
-        fg = 1.0f;
+    return changed;
+}
+
+static light_scene_t *scene_cache_get(uint8_t seg, uint16_t group_id, uint8_t scene_id, bool create)
+{
+    light_scene_t *entry = NULL;
+
+    for (int i = 0; i < LIGHT_SCENE_CACHE_SIZE; i++) {
+        light_scene_t *scene = &scene_cache[i];
+        if (scene->used && scene->seg == seg && scene->group_id == group_id && scene->scene_id == scene_id) {
+            return scene;
+        }
+        if (!scene->used && entry == NULL) {
+            entry = scene;
+        }
     }
-    if (fb < 0.0f) {
-        fb = 0.0f;
+    if (!create) {
+        return NULL;
     }
-    if (fb > 1.0f) {
-        fb = 1.0f;
+    if (entry == NULL) {
+        entry = &scene_cache[scene_cache_next];
+        scene_cache_next = (scene_cache_next + 1) % LIGHT_SCENE_CACHE_SIZE;
     }
-    
-    *r = (uint8_t)(fr * 255.0f);
-    *g = (uint8_t)(fg * 255.0f);
-    *b = (uint8_t)(fb * 255.0f);
+    *entry = (light_scene_t){ .used = true, .seg = seg, .group_id = group_id, .scene_id = scene_id };
+    return entry;
 }
 
-// Mise à jour du ruban LED
-static void update_led_strip(void)
+// Oublie les scenes d'un groupe sur les segments du masque (toutes si all_scenes, sinon scene_id)
+static void scene_cache_remove(uint32_t mask, uint16_t group_id, bool all_scenes, uint8_t scene_id)
 {
-    if (!light_state.on_off) {
-        ESP_LOGI(TAG, "LED OFF");
-        effects_stop();
-        led_strip_clear(led_strip);
-        led_strip_refresh(led_strip);
-        return;
+    for (int i = 0; i < LIGHT_SCENE_CACHE_SIZE; i++) {
+        light_scene_t *scene = &scene_cache[i];
+        if (scene->used && (mask & (1U << scene->seg)) && scene->group_id == group_id &&
+            (all_scenes || scene->scene_id == scene_id)) {
+            scene->used = false;
+        }
     }
-    
-    // Si un effet est actif, le système d'effets gère l'affichage
-    if (light_state.effect_id != EFFECT_NONE && effects_is_active()) {
-        ESP_LOGI(TAG, "Effet actif: %d", light_state.effect_id);
-        return;
+}
+
+// Commandes Scenes qui modifient la table sans callback (vues avant le stack, qui les traite ensuite)
+static void scene_cache_command(uint8_t endpoint, uint8_t cmd_id, const uint8_t *payload, uint16_t len)
+{
+    uint32_t mask = (1U << LIGHT_SEGMENT_COUNT) - 1;
+    bool changed = false;
+
+    if (endpoint >= HA_ESP_LIGHT_ENDPOINT && endpoint < HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT) {
+        mask = 1U << (endpoint - HA_ESP_LIGHT_ENDPOINT);
     }
-    
-    // Mode couleur fixe (pas d'effet)
-    uint8_t r, g, b;
-    xy_to_rgb(light_state.color_x, light_state.color_y, light_state.level, &r, &g, &b);
-    
-    ESP_LOGI(TAG, "LED ON - Level=%d, XY=(0x%04X,0x%04X) -> RGB(%d,%d,%d)", 
-             light_state.level, light_state.color_x, light_state.color_y, r, g, b);
-    
-    effects_set_base_color(r, g, b);
-    
-    for (int i = 0; i < LED_STRIP_LENGTH; i++) {
-        led_strip_set_pixel(led_strip, i, r, g, b);
+    switch (cmd_id) {
+    case ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE:
+    case ESP_ZB_ZCL_CMD_SCENES_ENHANCED_ADD_SCENE:
+        // Groupe (u16), scene (u8), transition (u16, s ou 1/10 s) : l'etat viendra des champs au rappel,
+        // la transition est gardee pour un StoreScene ulterieur
+        if (len < 5) {
+            return;
+        }
+        scene_cache_remove(mask, get_le16(&payload[0]), false, payload[2]);
+        for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+            if (mask & (1U << seg)) {
+                changed |= scene_transition_set(seg, get_le16(&payload[0]), payload[2],
+                    get_le16(&payload[3]) * (cmd_id == ESP_ZB_ZCL_CMD_SCENES_ADD_SCENE ? 10 : 1));
+            }
+        }
+        break;
+    case ESP_ZB_ZCL_CMD_SCENES_REMOVE_SCENE:
+        if (len >= 3) {
+            scene_cache_remove(mask, get_le16(&payload[0]), false, payload[2]);
+            changed = scene_transition_remove(mask, get_le16(&payload[0]), false, payload[2]);
+        }
+        break;
+    case ESP_ZB_ZCL_CMD_SCENES_REMOVE_ALL_SCENES:
+        if (len >= 2) {
+            scene_cache_remove(mask, get_le16(&payload[0]), true, 0);
+            changed = scene_transition_remove(mask, get_le16(&payload[0]), true, 0);
+        }
+        break;
+    case ESP_ZB_ZCL_CMD_SCENES_COPY_SCENE:
+        // Mode (bit 0 : toutes les scenes du groupe), groupe et scene source, groupe et scene destination
+        if (len >= 7) {
+            scene_cache_remove(mask, get_le16(&payload[4]), payload[0] & 0x01, payload[6]);
+            changed = scene_transition_copy(mask, payload[0] & 0x01, get_le16(&payload[1]), payload[3],
+                                            get_le16(&payload[4]), payload[6]);
+        }
+        break;
+    default:
+        break;
+    }
+    if (changed) {
+        scene_transitions_save();
+    }
+}
+
+// StoreScene : etat du segment en RAM et champs d'extension (standards et fabricant) dans la table du stack
+static esp_err_t zb_store_scene_handler(const esp_zb_zcl_store_scene_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Message vide");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG,
+                        "Statut d'erreur (%d)", message->info.status);
+
+    uint8_t endpoint = message->info.dst_endpoint;
+    if (endpoint < HA_ESP_LIGHT_ENDPOINT || endpoint >= HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint8_t seg = endpoint - HA_ESP_LIGHT_ENDPOINT;
+    const light_state_t *ls = &light_state[seg];
+    const light_fade_t *target = &light_fade[seg];
+    light_scene_t *scene = scene_cache_get(seg, message->group_id, message->scene_id, true);
+    // Scene existante : sa transition est gardee ; nouvelle scene : transition nulle
+    const scene_transition_t *known = scene_transition_find(seg, message->group_id, message->scene_id);
+    uint16_t transition = known ? known->transition : 0;
+
+    scene->loaded = true;
+    scene->on_off = ls->on_off;
+    scene->color_mode = ls->color_mode;
+    scene->color_temp = ls->color_temp;
+    scene->effect_id = ls->effect_id;
+    scene->speed = get_current_effect_speed(ls);
+    scene->program_slot = ls->program_slot;
+    memcpy(scene->program_params, ls->program_params, EFFECT_VM_PARAMS);
+    // Fondu en cours : la scene garde l'etat d'arrivee
+    scene->level = target->running ? target->level : ls->level;
+    scene->color_x = target->running ? target->color_x : ls->color_x;
+    scene->color_y = target->running ? target->color_y : ls->color_y;
+    const uint8_t *gradient = get_zcl_attr_value(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF004);
+    if (gradient && gradient[0] < sizeof(scene->gradient)) {
+        memcpy(scene->gradient, gradient, 1 + gradient[0]);
+    } else {
+        scene->gradient[0] = 1;
+        scene->gradient[1] = ls->gradient_id;
+    }
+
+    uint8_t on_off = scene->on_off;
+    uint8_t color[LIGHT_SCENE_COLOR_LEN] = { 0 };
+    uint8_t light[LIGHT_SCENE_FIELD_LEN + sizeof(scene->gradient)];
+    put_le16(&color[0], scene->color_x);
+    put_le16(&color[2], scene->color_y);
+    put_le16(&color[11], scene->color_temp);
+    light[0] = LIGHT_SCENE_FIELD_VERSION;
+    light[1] = scene->color_mode;
+    put_le16(&light[2], scene->color_temp);
+    light[4] = scene->effect_id;
+    light[5] = scene->speed;
+    light[6] = scene->program_slot;
+    memcpy(&light[7], scene->program_params, EFFECT_VM_PARAMS);
+    memcpy(&light[LIGHT_SCENE_FIELD_LEN], scene->gradient, 1 + scene->gradient[0]);
+
+    esp_zb_zcl_scenes_extension_field_t fields[] = {
+        { ESP_ZB_ZCL_CLUSTER_ID_ON_OFF, 1, &on_off, &fields[1] },
+        { ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL, 1, &scene->level, &fields[2] },
+        { ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, sizeof(color), color, &fields[3] },
+        { LIGHT_CLUSTER_ID, LIGHT_SCENE_FIELD_LEN + 1 + scene->gradient[0], light, NULL },
+    };
+    ESP_RETURN_ON_ERROR(esp_zb_zcl_scenes_table_store(endpoint, message->group_id, message->scene_id,
+                                                      transition, fields),
+                        TAG, "Echec enregistrement de la scene %d", message->scene_id);
+    if (known == NULL && scene_transition_set(seg, message->group_id, message->scene_id, transition)) {
+        scene_transitions_save();
+    }
+    ESP_LOGI(TAG, "[%d] Scene %d (groupe 0x%04X) enregistree: on=%d level=%d effet=%d",
+             seg, message->scene_id, message->group_id, scene->on_off, scene->level, scene->effect_id);
+    return ESP_OK;
+}
+
+// Etat d'une scene absente de la RAM (ajoutee par AddScene ou enregistree avant un redemarrage) a partir
+// des champs d'extension ; sans champ fabricant, la scene est une couleur fixe X/Y
+static void scene_from_fields(uint8_t seg, light_scene_t *scene, const esp_zb_zcl_scenes_extension_field_t *field)
+{
+    const light_state_t *ls = &light_state[seg];
+    const uint8_t *gradient = get_zcl_attr_value(segment_endpoint(seg), ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF004);
+
+    scene->loaded = true;
+    scene->on_off = ls->on_off;
+    scene->level = ls->level;
+    scene->color_mode = LIGHT_COLOR_MODE_XY;
+    scene->color_x = ls->color_x;
+    scene->color_y = ls->color_y;
+    scene->color_temp = ls->color_temp;
+    scene->effect_id = EFFECT_NONE;
+    scene->speed = 0;
+    scene->program_slot = EFFECT_PROGRAMS_SLOTS;
+    if (gradient && gradient[0] < sizeof(scene->gradient)) {
+        memcpy(scene->gradient, gradient, 1 + gradient[0]);
+    } else {
+        scene->gradient[0] = 1;
+        scene->gradient[1] = ls->gradient_id;
+    }
+
+    for (; field; field = field->next) {
+        const uint8_t *value = field->extension_field_attribute_value_list;
+        uint8_t len = value ? field->length : 0;
+        switch (field->cluster_id) {
+        case ESP_ZB_ZCL_CLUSTER_ID_ON_OFF:
+            if (len >= 1) {
+                scene->on_off = value[0] != 0;
+            }
+            break;
+        case ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL:
+            if (len >= 1) {
+                scene->level = value[0];
+            }
+            break;
+        case ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL:
+            if (len >= 4) {
+                scene->color_x = get_le16(&value[0]);
+                scene->color_y = get_le16(&value[2]);
+            }
+            if (len >= LIGHT_SCENE_COLOR_LEN && get_le16(&value[11]) != 0) {
+                scene->color_temp = get_le16(&value[11]);
+            }
+            break;
+        case LIGHT_CLUSTER_ID:
+            if (len < LIGHT_SCENE_FIELD_LEN || value[0] != LIGHT_SCENE_FIELD_VERSION) {
+                ESP_LOGW(TAG, "[%d] Champ fabricant de la scene %d ignore (%d octets)", seg, scene->scene_id, len);
+                break;
+            }
+            scene->color_mode = value[1];
+            scene->color_temp = get_le16(&value[2]);
+            scene->effect_id = value[4];
+            scene->speed = value[5];
+            scene->program_slot = value[6];
+            memcpy(scene->program_params, &value[7], EFFECT_VM_PARAMS);
+            if (len > LIGHT_SCENE_FIELD_LEN && value[LIGHT_SCENE_FIELD_LEN] < sizeof(scene->gradient) &&
+                LIGHT_SCENE_FIELD_LEN + 1 + value[LIGHT_SCENE_FIELD_LEN] <= len) {
+                memcpy(scene->gradient, &value[LIGHT_SCENE_FIELD_LEN], 1 + value[LIGHT_SCENE_FIELD_LEN]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+// RecallScene : etat lu en RAM, applique en un seul rendu (degrade, programme, effet, couleur et niveau)
+static esp_err_t zb_recall_scene_handler(const esp_zb_zcl_recall_scene_message_t *message)
+{
+    ESP_RETURN_ON_FALSE(message, ESP_FAIL, TAG, "Message vide");
+    ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG,
+                        "Statut d'erreur (%d)", message->info.status);
+
+    uint8_t endpoint = message->info.dst_endpoint;
+    if (endpoint < HA_ESP_LIGHT_ENDPOINT || endpoint >= HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    uint8_t seg = endpoint - HA_ESP_LIGHT_ENDPOINT;
+    light_state_t *ls = &light_state[seg];
+    light_scene_t *scene = scene_cache_get(seg, message->group_id, message->scene_id, true);
+    if (!scene->loaded) {
+        scene_from_fields(seg, scene, message->field_set);
+    }
+    // Transition lue dans la table du stack : suivie pour les scenes enregistrees avant la table en NVS
+    if (scene_transition_find(seg, message->group_id, message->scene_id) == NULL &&
+        scene_transition_set(seg, message->group_id, message->scene_id, message->transition_time)) {
+        scene_transitions_save();
+    }
+
+    light_command_t cmd = {
+        .on_off = scene->on_off,
+        .level = scene->level,
+        .color_x = scene->color_x,
+        .color_y = scene->color_y,
+        .color_temp = (scene->color_mode == LIGHT_COLOR_MODE_TEMPERATURE) ? scene->color_temp : LIGHT_KEEP_U16,
+        .effect_id = scene->effect_id,
+        .speed = scene->speed,
+        .transition_ms = message->transition_time * 100,
+    };
+    const effect_vm_program_t *program = NULL;
+    if (cmd.effect_id == EFFECT_PROGRAM) {
+        program = effect_programs_get(scene->program_slot);
+        if (program == NULL || program->code_len == 0) {
+            ESP_LOGW(TAG, "[%d] Programme %d de la scene absent : couleur fixe", seg, scene->program_slot);
+            program = NULL;
+            cmd.effect_id = EFFECT_NONE;
+        }
+    }
+
+    // Tout sous le meme verrou : la scene apparait dans une seule trame (ou demarre un seul fondu)
+    effects_begin_update();
+    const uint8_t *gradient = get_zcl_attr_value(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL, 0xF004);
+    if ((gradient == NULL || memcmp(gradient, scene->gradient, 1 + scene->gradient[0]) != 0) &&
+        apply_gradient_attr(seg, scene->gradient)) {
+        esp_zb_zcl_set_attribute_val(endpoint, ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, 0xF004, scene->gradient, false);
+    }
+    if (program) {
+        ls->program_slot = scene->program_slot;
+        memcpy(ls->program_params, scene->program_params, EFFECT_VM_PARAMS);
+        effects_set_program(seg, program, ls->program_params);
     }
-    led_strip_refresh(led_strip);
+    apply_light_command(seg, &cmd);
+    effects_end_update();
+
+    ESP_LOGI(TAG, "[%d] Scene %d (groupe 0x%04X) rappelee en %d ms", seg, message->scene_id, message->group_id,
+             message->transition_time * 100);
+    return ESP_OK;
+}
+
+// Applique et enregistre le calibrage recu sur l'attribut 0xF008
+static bool apply_calibration_attr(uint8_t seg, const uint8_t *value)
+{
+    uint8_t len = value[0];
+    const uint8_t *data = &value[1];
+    esp_err_t err;
+
+    if (len == 0) {
+        err = color_correction_set(NULL);
+    } else if (len == LIGHT_CALIBRATION_LEN) {
+        color_calibration_t cal;
+        for (int c = 0; c < 3; c++) {
+            cal.primaries[c][0] = get_le16(&data[c * 4]);
+            cal.primaries[c][1] = get_le16(&data[c * 4 + 2]);
+            cal.gain[c] = get_le16(&data[12 + c * 2]);
+            cal.gamma[c] = get_le16(&data[18 + c * 2]);
+        }
+        err = color_correction_set(&cal);
+    } else {
+        ESP_LOGW(TAG, "Calibrage invalide (%d octets)", len);
+        return false;
+    }
+    if (err == ESP_ERR_INVALID_ARG) {
+        return false;
+    }
+
+    // Attribut relu avec le calibrage effectif, couleurs fixes recalculees avec la nouvelle matrice
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        encode_calibration(attr_storage[i].color_calibration);
+    }
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        esp_zb_zcl_set_attribute_val(segment_endpoint(i), ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+            ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, 0xF008, attr_storage[i].color_calibration, false);
+        if (light_state[i].on_off && !light_fade[i].running) {
+            update_led_strip(i);
+        }
+    }
+    return true;
 }
 
 // Gestionnaire des attributs Zigbee
@@ -171,33 +1629,49 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
     ESP_RETURN_ON_FALSE(message->info.status == ESP_ZB_ZCL_STATUS_SUCCESS, ESP_ERR_INVALID_ARG, TAG,
                         "Statut d'erreur (%d)", message->info.status);
 
-    if (message->info.dst_endpoint == HA_ESP_LIGHT_ENDPOINT) {
+    // Un endpoint par segment : 10 -> segment 0, 11 -> segment 1, ...
+    uint8_t endpoint = message->info.dst_endpoint;
+    if (endpoint >= HA_ESP_LIGHT_ENDPOINT && endpoint < HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT) {
+        uint8_t seg = endpoint - HA_ESP_LIGHT_ENDPOINT;
+        light_state_t *ls = &light_state[seg];
+        light_attr_storage_t *attrs = &attr_storage[seg];
+
+        // Une commande explicite de luminosite, couleur ou ON/OFF interrompt le fondu en cours
+        if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF ||
+            message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL ||
+            (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL &&
+             (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID ||
+              message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID ||
+              message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID))) {
+            cancel_fade(seg);
+        }
+
         if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_ON_OFF) {
             if (message->attribute.id == ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID &&
                 message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_BOOL) {
-                bool new_on = message->attribute.data.value ? *(bool *)message->attribute.data.value : light_state.on_off;
-                ESP_LOGI(TAG, "ON/OFF -> %s (level=%d)", new_on ? "ON" : "OFF", light_state.level);
+                bool new_on = message->attribute.data.value ? *(bool *)message->attribute.data.value : ls->on_off;
+                ESP_LOGI(TAG, "ON/OFF -> %s (level=%d)", new_on ? "ON" : "OFF", ls->level);
                 
-                if (new_on && !light_state.on_off) {
+                if (new_on && !ls->on_off) {
                     // Passage de OFF a ON
-                    light_state.on_off = true;
+                    ls->on_off = true;
                     // Si niveau a 0, appliquer un niveau par defaut 128 (50%)
-                    if (light_state.level == 0) {
-                        light_state.level = 128;
-                        last_level_non_zero = light_state.level;
-                        set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                    if (ls->level == 0) {
+                        ls->level = 128;
+                        last_level_non_zero[seg] = ls->level;
+                        set_zcl_attr_u8(endpoint,
                             ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
                             ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
-                            light_state.level);
-                        effects_set_brightness(light_state.level);
+                            ls->level);
+                        effects_set_brightness(seg, ls->level);
                         ESP_LOGI(TAG, "Auto level = 128 (50%) au premier ON");
                     }
-                } else if (!new_on && light_state.on_off) {
+                } else if (!new_on && ls->on_off) {
                     // Passage de ON a OFF
-                    light_state.on_off = false;
-                    reset_effect_to_none();
+                    ls->on_off = false;
+                    reset_effect_to_none(seg);
                 } else {
-                    light_state.on_off = new_on;
+                    ls->on_off = new_on;
                 }
                 
                 light_changed = true;
@@ -206,26 +1680,26 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
         else if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL) {
             if (message->attribute.id == ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID &&
                 message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
-                light_state.level = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : light_state.level;
-                if (light_state.level > 0) {
-                    last_level_non_zero = light_state.level;
+                ls->level = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : ls->level;
+                if (ls->level > 0) {
+                    last_level_non_zero[seg] = ls->level;
                 }
-                ESP_LOGI(TAG, "LEVEL -> %d", light_state.level);
+                ESP_LOGI(TAG, "LEVEL -> %d", ls->level);
                 
                 // Mettre a jour la luminosite des effets
-                effects_set_brightness(light_state.level);
+                effects_set_brightness(seg, ls->level);
                 
                 // Si on change la luminosite a une valeur > 0, allumer automatiquement
-                if (light_state.level > 0 && !light_state.on_off) {
-                    light_state.on_off = true;
-                    set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                if (ls->level > 0 && !ls->on_off) {
+                    ls->on_off = true;
+                    set_zcl_attr_u8(endpoint,
                         ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
                         ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
                         1);
                     ESP_LOGI(TAG, "Auto ON (level > 0)");
                 }
                 // Ne pas forcer OFF quand level=0, on laisse la lampe allumee mais noire
-                else if (light_state.level == 0 && light_state.on_off) {
+                else if (ls->level == 0 && ls->on_off) {
                     ESP_LOGI(TAG, "Level = 0 (lamp will stay ON but black)");
                 }
                 
@@ -235,35 +1709,35 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
         else if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL) {
             if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_X_ID &&
                 message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
-                light_state.color_x = message->attribute.data.value ? *(uint16_t *)message->attribute.data.value : light_state.color_x;
-                ESP_LOGI(TAG, "COLOR_X -> 0x%04X", light_state.color_x);
+                ls->color_x = message->attribute.data.value ? *(uint16_t *)message->attribute.data.value : ls->color_x;
+                ls->color_mode = LIGHT_COLOR_MODE_XY;
+                ESP_LOGI(TAG, "COLOR_X -> 0x%04X", ls->color_x);
                 
                 uint8_t r, g, b;
-                xy_to_rgb(light_state.color_x, light_state.color_y, light_state.level, &r, &g, &b);
-                effects_set_base_color(r, g, b);
-                
-                if (light_state.on_off && light_state.effect_id == EFFECT_NONE) {
-                    for (int i = 0; i < LED_STRIP_LENGTH; i++) {
-                        led_strip_set_pixel(led_strip, i, r, g, b);
-                    }
-                    led_strip_refresh(led_strip);
-                }
+                color_correction_xy_to_rgb(ls->color_x, ls->color_y, &r, &g, &b);
+                effects_set_base_color(seg, r, g, b);
             }
             else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_CURRENT_Y_ID &&
                      message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
-                light_state.color_y = message->attribute.data.value ? *(uint16_t *)message->attribute.data.value : light_state.color_y;
-                ESP_LOGI(TAG, "COLOR_Y -> 0x%04X", light_state.color_y);
+                ls->color_y = message->attribute.data.value ? *(uint16_t *)message->attribute.data.value : ls->color_y;
+                ls->color_mode = LIGHT_COLOR_MODE_XY;
+                ESP_LOGI(TAG, "COLOR_Y -> 0x%04X", ls->color_y);
                 
                 uint8_t r, g, b;
-                xy_to_rgb(light_state.color_x, light_state.color_y, light_state.level, &r, &g, &b);
-                effects_set_base_color(r, g, b);
-                
-                if (light_state.on_off && light_state.effect_id == EFFECT_NONE) {
-                    for (int i = 0; i < LED_STRIP_LENGTH; i++) {
-                        led_strip_set_pixel(led_strip, i, r, g, b);
-                    }
-                    led_strip_refresh(led_strip);
-                }
+                color_correction_xy_to_rgb(ls->color_x, ls->color_y, &r, &g, &b);
+                effects_set_base_color(seg, r, g, b);
+            }
+            // Temperature de couleur (Move/StepColorTemperature du stack, ecriture directe) : lecture de table
+            else if (message->attribute.id == ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16) {
+                ls->color_temp = message->attribute.data.value ? *(uint16_t *)message->attribute.data.value : ls->color_temp;
+                ls->color_mode = LIGHT_COLOR_MODE_TEMPERATURE;
+                color_correction_mired_to_xy(ls->color_temp, &ls->color_x, &ls->color_y);
+                ESP_LOGI(TAG, "COLOR_TEMP -> %d mireds", ls->color_temp);
+
+                uint8_t r, g, b;
+                color_correction_mired_to_rgb(ls->color_temp, &r, &g, &b);
+                effects_set_base_color(seg, r, g, b);
             }
             // Attribut personnalisé pour l'effet (ID 0xF000)
             else if (message->attribute.id == 0xF000 &&
@@ -273,39 +1747,39 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
                 ESP_LOGI(TAG, "Effet recu via attribut 0xF000: %d", new_effect);
                 
                 if (new_effect < EFFECT_MAX) {
-                    light_state.effect_id = new_effect;
-                    attr_effect_value = light_state.effect_id;
-                    set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                    ls->effect_id = new_effect;
+                    attrs->effect_value = ls->effect_id;
+                    set_zcl_attr_u8(endpoint,
                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                         0xF000,
-                        attr_effect_value);
+                        attrs->effect_value);
                     
-                    if (light_state.effect_id == EFFECT_NONE) {
-                        effects_stop();
+                    if (ls->effect_id == EFFECT_NONE) {
+                        effects_stop(seg);
                         ESP_LOGI(TAG, "Effet arrete");
                         light_changed = true;
                     } else {
-                        if (!light_state.on_off) {
-                            light_state.on_off = true;
-                            set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                        if (!ls->on_off) {
+                            ls->on_off = true;
+                            set_zcl_attr_u8(endpoint,
                                 ESP_ZB_ZCL_CLUSTER_ID_ON_OFF,
                                 ESP_ZB_ZCL_ATTR_ON_OFF_ON_OFF_ID,
                                 1);
                             ESP_LOGI(TAG, "Auto ON (effet active)");
                         }
-                        if (light_state.level == 0) {
-                            light_state.level = 200;
-                            last_level_non_zero = light_state.level;
-                            set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                        if (ls->level == 0) {
+                            ls->level = 200;
+                            last_level_non_zero[seg] = ls->level;
+                            set_zcl_attr_u8(endpoint,
                                 ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL,
                                 ESP_ZB_ZCL_ATTR_LEVEL_CONTROL_CURRENT_LEVEL_ID,
-                                light_state.level);
-                            effects_set_brightness(light_state.level);
+                                ls->level);
+                            effects_set_brightness(seg, ls->level);
                             ESP_LOGI(TAG, "Auto level = 200 (effet active)");
                         }
-                        uint8_t speed = get_current_effect_speed();
-                        effects_start((effect_type_t)light_state.effect_id, speed);
-                        ESP_LOGI(TAG, "Effet demarre: %d, vitesse: %d", light_state.effect_id, speed);
+                        uint8_t speed = get_current_effect_speed(ls);
+                        effects_start(seg, (effect_type_t)ls->effect_id, speed);
+                        ESP_LOGI(TAG, "Effet demarre: %d, vitesse: %d", ls->effect_id, speed);
                     }
                 }
             }
@@ -315,17 +1789,17 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
                 uint8_t new_speed = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : 0;
                 ESP_LOGI(TAG, "Vitesse Rainbow recu: %d", new_speed);
                 if (new_speed > 0) {
-                    light_state.speed_rainbow = new_speed;
-                    attr_speed_rainbow = light_state.speed_rainbow;
-                    set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                    ls->speed_rainbow = new_speed;
+                    attrs->speed_rainbow = ls->speed_rainbow;
+                    set_zcl_attr_u8(endpoint,
                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                         0xF001,
-                        attr_speed_rainbow);
-                    if (light_state.effect_id == EFFECT_RAINBOW) {
-                        effects_set_brightness(light_state.level);
-                        uint8_t speed = get_current_effect_speed();
-                        effects_start(EFFECT_RAINBOW, speed);
-                        ESP_LOGI(TAG, "Vitesse Rainbow ajuste: %d", light_state.speed_rainbow);
+                        attrs->speed_rainbow);
+                    if (ls->effect_id == EFFECT_RAINBOW) {
+                        effects_set_brightness(seg, ls->level);
+                        uint8_t speed = get_current_effect_speed(ls);
+                        effects_start(seg, EFFECT_RAINBOW, speed);
+                        ESP_LOGI(TAG, "Vitesse Rainbow ajuste: %d", ls->speed_rainbow);
                     }
                 }
             }
@@ -335,17 +1809,17 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
                 uint8_t new_speed = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : 0;
                 ESP_LOGI(TAG, "Vitesse Strobe recu: %d", new_speed);
                 if (new_speed > 0) {
-                    light_state.speed_strobe = new_speed;
-                    attr_speed_strobe = light_state.speed_strobe;
-                    set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                    ls->speed_strobe = new_speed;
+                    attrs->speed_strobe = ls->speed_strobe;
+                    set_zcl_attr_u8(endpoint,
                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                         0xF002,
-                        attr_speed_strobe);
-                    if (light_state.effect_id == EFFECT_STROBE) {
-                        effects_set_brightness(light_state.level);
-                        uint8_t speed = get_current_effect_speed();
-                        effects_start(EFFECT_STROBE, speed);
-                        ESP_LOGI(TAG, "Vitesse Strobe ajuste: %d", light_state.speed_strobe);
+                        attrs->speed_strobe);
+                    if (ls->effect_id == EFFECT_STROBE) {
+                        effects_set_brightness(seg, ls->level);
+                        uint8_t speed = get_current_effect_speed(ls);
+                        effects_start(seg, EFFECT_STROBE, speed);
+                        ESP_LOGI(TAG, "Vitesse Strobe ajuste: %d", ls->speed_strobe);
                     }
                 }
             }
@@ -355,30 +1829,145 @@ static esp_err_t zb_attribute_handler(const esp_zb_zcl_set_attr_value_message_t
                 uint8_t new_speed = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : 0;
                 ESP_LOGI(TAG, "Vitesse Twinkle recu: %d", new_speed);
                 if (new_speed > 0) {
-                    light_state.speed_twinkle = new_speed;
-                    attr_speed_twinkle = light_state.speed_twinkle;
-                    set_zcl_attr_u8(HA_ESP_LIGHT_ENDPOINT,
+                    ls->speed_twinkle = new_speed;
+                    attrs->speed_twinkle = ls->speed_twinkle;
+                    set_zcl_attr_u8(endpoint,
                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                         0xF003,
-                        attr_speed_twinkle);
-                    if (light_state.effect_id == EFFECT_TWINKLE) {
-                        effects_set_brightness(light_state.level);
-                        uint8_t speed = get_current_effect_speed();
-                        effects_start(EFFECT_TWINKLE, speed);
-                        ESP_LOGI(TAG, "Vitesse Twinkle ajuste: %d", light_state.speed_twinkle);
+                        attrs->speed_twinkle);
+                    if (ls->effect_id == EFFECT_TWINKLE) {
+                        effects_set_brightness(seg, ls->level);
+                        uint8_t speed = get_current_effect_speed(ls);
+                        effects_start(seg, EFFECT_TWINKLE, speed);
+                        ESP_LOGI(TAG, "Vitesse Twinkle ajuste: %d", ls->speed_twinkle);
                     }
                 }
             }
+            // Degrade des effets (0xF004)
+            else if (message->attribute.id == 0xF004 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING) {
+                const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+                if (value && apply_gradient_attr(seg, value)) {
+                    ESP_LOGI(TAG, "Degrade recu via attribut 0xF004: %d", ls->gradient_id);
+                }
+            }
+            // Fondu long (0xF005)
+            else if (message->attribute.id == 0xF005 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING) {
+                const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+                if (value) {
+                    start_fade_from_attr(seg, value);
+                }
+            }
+            // Courbe de luminosite (0xF006)
+            else if (message->attribute.id == 0xF006 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U8) {
+                uint8_t curve = message->attribute.data.value ? *(uint8_t *)message->attribute.data.value : 0;
+                if (apply_level_curve_attr(seg, curve)) {
+                    ESP_LOGI(TAG, "Courbe de luminosite recue: %d", curve);
+                }
+            }
+            // Points de la courbe personnalisee (0xF007)
+            else if (message->attribute.id == 0xF007 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING) {
+                const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+                if (value && apply_level_curve_points_attr(seg, value)) {
+                    ESP_LOGI(TAG, "Courbe personnalisee recue: %d points", value[0] / 3);
+                }
+            }
+            // Calibrage des couleurs (0xF008)
+            else if (message->attribute.id == 0xF008 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING) {
+                const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+                if (value && apply_calibration_attr(seg, value)) {
+                    ESP_LOGI(TAG, "Calibrage des couleurs recu (%d octets)", value[0]);
+                }
+            }
+            // Type de ruban et point blanc (0xF009)
+            else if (message->attribute.id == 0xF009 &&
+                     message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING) {
+                const uint8_t *value = (const uint8_t *)message->attribute.data.value;
+                if (value && apply_strip_config_attr(seg, value)) {
+                    ESP_LOGI(TAG, "Configuration du ruban recue: type %d", strip_config[0]);
+                }
+            }
+        }
+        // Groupe des effets synchronises (cluster fabricant)
+        else if (message->info.cluster == LIGHT_CLUSTER_ID &&
+                 message->attribute.id == LIGHT_CLUSTER_ATTR_SYNC_GROUP &&
+                 message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U16 && message->attribute.data.value) {
+            ret = light_sync_set_group(*(uint16_t *)message->attribute.data.value);
+        }
+        // Intervalle des Check-in ecrit par le coordinateur : les Check-in reprennent sans attendre l'ancien
+        else if (message->info.cluster == ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL &&
+                 message->attribute.id == ZB_ZCL_ATTR_POLL_CONTROL_CHECKIN_INTERVAL_ID &&
+                 message->attribute.data.type == ESP_ZB_ZCL_ATTR_TYPE_U32 && message->attribute.data.value) {
+            poll_control_set_check_in_interval(*(uint32_t *)message->attribute.data.value);
         }
-    }
 
-    if (light_changed) {
-        update_led_strip();
+        if (light_changed) {
+            update_led_strip(seg);
+        }
+        publish_light_state(seg);
     }
 
     return ret;
 }
 
+// Duree de transition (ms) des commandes Level / Color Control traitees par le stack
+static uint32_t command_transition_ms(const zb_zcl_parsed_hdr_t *cmd_info, const uint8_t *payload, uint16_t len)
+{
+    if (cmd_info->is_common_command) {
+        return 0;
+    }
+    if (cmd_info->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_LEVEL_CONTROL && len >= 3 &&
+        (cmd_info->cmd_id == ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL ||
+         cmd_info->cmd_id == ESP_ZB_ZCL_CMD_LEVEL_CONTROL_MOVE_TO_LEVEL_WITH_ON_OFF)) {
+        return get_le16(&payload[1]) * 100;
+    }
+    if (cmd_info->cluster_id == ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL && len >= 6 &&
+        cmd_info->cmd_id == ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR) {
+        return get_le16(&payload[4]) * 100;
+    }
+    return 0;
+}
+
+// Commandes traitees avant le stack : MoveToColorTemperature passe par le moteur de fondu,
+// Poll Control par le module de poll, les commandes Scenes mettent a jour la copie en RAM ;
+// toute commande relance le poll rapide (end device)
+static bool zb_raw_command_handler(uint8_t bufid)
+{
+    zb_zcl_parsed_hdr_t cmd_info;
+
+    ZB_ZCL_COPY_PARSED_HEADER(bufid, &cmd_info);
+    uint8_t endpoint = cmd_info.addr_data.common_data.dst_endpoint;
+    if (cmd_info.cmd_direction == ZB_ZCL_FRAME_DIRECTION_TO_SRV) {
+        poll_control_activity(command_transition_ms(&cmd_info, zb_buf_begin(bufid), zb_buf_len(bufid)));
+    }
+    if (cmd_info.cluster_id == ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL) {
+        return poll_control_handle_command(bufid, &cmd_info);
+    }
+    if (cmd_info.cluster_id == ESP_ZB_ZCL_CLUSTER_ID_SCENES && !cmd_info.is_common_command &&
+        cmd_info.cmd_direction == ZB_ZCL_FRAME_DIRECTION_TO_SRV) {
+        scene_cache_command(endpoint, cmd_info.cmd_id, zb_buf_begin(bufid), zb_buf_len(bufid));
+        return false;
+    }
+    if (cmd_info.cluster_id != ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL || cmd_info.is_common_command ||
+        cmd_info.cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV ||
+        cmd_info.cmd_id != ESP_ZB_ZCL_CMD_COLOR_CONTROL_MOVE_TO_COLOR_TEMPERATURE ||
+        endpoint < HA_ESP_LIGHT_ENDPOINT || endpoint >= HA_ESP_LIGHT_ENDPOINT + LIGHT_SEGMENT_COUNT ||
+        zb_buf_len(bufid) < 4) {
+        return false;
+    }
+
+    // Temperature (mireds) puis duree de transition (1/10 s)
+    const uint8_t *payload = zb_buf_begin(bufid);
+    move_to_color_temperature(endpoint - HA_ESP_LIGHT_ENDPOINT, get_le16(&payload[0]), get_le16(&payload[2]) * 100);
+    publish_light_state(endpoint - HA_ESP_LIGHT_ENDPOINT);
+    ZB_ZCL_PROCESS_COMMAND_FINISH(bufid, &cmd_info, ZB_ZCL_STATUS_SUCCESS);
+    return true;
+}
+
 // Gestionnaire des actions Zigbee
 static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id, const void *message)
 {
@@ -387,6 +1976,15 @@ static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id,
     case ESP_ZB_CORE_SET_ATTR_VALUE_CB_ID:
         ret = zb_attribute_handler((esp_zb_zcl_set_attr_value_message_t *)message);
         break;
+    case ESP_ZB_CORE_CMD_CUSTOM_CLUSTER_REQ_CB_ID:
+        ret = zb_custom_cluster_handler((esp_zb_zcl_custom_cluster_command_message_t *)message);
+        break;
+    case ESP_ZB_CORE_SCENES_STORE_SCENE_CB_ID:
+        ret = zb_store_scene_handler((esp_zb_zcl_store_scene_message_t *)message);
+        break;
+    case ESP_ZB_CORE_SCENES_RECALL_SCENE_CB_ID:
+        ret = zb_recall_scene_handler((esp_zb_zcl_recall_scene_message_t *)message);
+        break;
     default:
         ESP_LOGW(TAG, "Callback Zigbee non gere (0x%x)", callback_id);
         break;
@@ -395,12 +1993,11 @@ static esp_err_t zb_action_handler(esp_zb_core_action_callback_id_t callback_id,
 }
 
 // Gestionnaire des signaux Zigbee
-static void bdb_start_network_steering_cb(uint8_t param)
+static void network_started(void)
 {
-    esp_err_t ret = esp_zb_bdb_start_top_level_commissioning(param);
-    if (ret != ESP_OK) {
-        ESP_LOGE(TAG, "Echec relance network steering : %s", esp_err_to_name(ret));
-    }
+    poll_control_start();
+    light_sync_start();
+    report_light_state();
 }
 
 void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
@@ -418,11 +2015,16 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
     case ESP_ZB_BDB_SIGNAL_DEVICE_REBOOT:
         if (err_status == ESP_OK) {
             if (esp_zb_bdb_is_factory_new()) {
-                ESP_LOGI(TAG, "Demarrage reseau (appairage)");
-                esp_zb_bdb_start_top_level_commissioning(ESP_ZB_BDB_MODE_NETWORK_STEERING);
+                // Une telecommande Touchlink peut appairer l'appareil avant l'appairage classique
+                ESP_LOGI(TAG, "Demarrage reseau (Touchlink puis appairage)");
+                commissioning_touchlink_target();
             } else {
                 ESP_LOGI(TAG, "Redemarrage appareil");
+                network_started();
             }
+            // Mesure electrique : mise a jour periodique des attributs (une seule boucle)
+            esp_zb_scheduler_alarm_cancel(power_measure_cb, 0);
+            esp_zb_scheduler_alarm(power_measure_cb, 0, POWER_MEASURE_PERIOD_MS);
         } else {
             ESP_LOGW(TAG, "Echec redemarrage: %s", esp_err_to_name(err_status));
         }
@@ -433,37 +2035,54 @@ void esp_zb_app_signal_handler(esp_zb_app_signal_t *signal_struct)
             esp_zb_get_extended_pan_id(extended_pan_id);
             ESP_LOGI(TAG, "Connecte au reseau Zigbee - PAN:0x%04hx, Canal:%d, Addr:0x%04hx",
                      esp_zb_get_pan_id(), esp_zb_get_current_channel(), esp_zb_get_short_address());
+            network_started();
         } else {
+            // Nouvel essai apres une fenetre Touchlink
             ESP_LOGI(TAG, "Echec connexion reseau: %s", esp_err_to_name(err_status));
-            esp_zb_scheduler_alarm((esp_zb_callback_t)bdb_start_network_steering_cb, ESP_ZB_BDB_MODE_NETWORK_STEERING, 1000);
+            commissioning_touchlink_target();
+        }
+        break;
+    case ESP_ZB_BDB_SIGNAL_TOUCHLINK_NWK:
+        if (err_status == ESP_OK) {
+            ESP_LOGI(TAG, "Reseau rejoint par Touchlink - PAN:0x%04hx, Canal:%d, Addr:0x%04hx",
+                     esp_zb_get_pan_id(), esp_zb_get_current_channel(), esp_zb_get_short_address());
+            network_started();
+        } else {
+            ESP_LOGW(TAG, "Echec Touchlink: %s", esp_err_to_name(err_status));
         }
         break;
     default:
-        ESP_LOGI(TAG, "Signal ZDO: %s (0x%x)", esp_zb_zdo_signal_to_string(sig_type), sig_type);
+        if (!commissioning_handle_signal(signal_struct)) {
+            ESP_LOGI(TAG, "Signal ZDO: %s (0x%x)", esp_zb_zdo_signal_to_string(sig_type), sig_type);
+        }
         break;
     }
 }
 
-// Tache Zigbee principale
-static void esp_zb_task(void *pvParameters)
+// Creation d'un endpoint Color Dimmable Light pour un segment
+static void create_light_endpoint(esp_zb_ep_list_t *ep_list, uint8_t seg)
 {
-    esp_zb_cfg_t zb_nwk_cfg = ESP_ZB_ZED_CONFIG();
-    esp_zb_init(&zb_nwk_cfg);
+    const light_state_t *ls = &light_state[seg];
+    light_attr_storage_t *attrs = &attr_storage[seg];
 
     esp_zb_color_dimmable_light_cfg_t light_cfg = ESP_ZB_DEFAULT_COLOR_DIMMABLE_LIGHT_CONFIG();
 
-    // Configuration : SEULEMENT XY (pas de HS, pas de Color Temperature)
-    light_cfg.color_cfg.color_mode = 1;
-    light_cfg.color_cfg.enhanced_color_mode = 1;
-    light_cfg.color_cfg.color_capabilities = 0x0008;
-    light_cfg.color_cfg.current_x = light_state.color_x;
-    light_cfg.color_cfg.current_y = light_state.color_y;
+    // Configuration : XY et Color Temperature (pas de HS)
+    light_cfg.color_cfg.color_mode = ls->color_mode;
+    light_cfg.color_cfg.enhanced_color_mode = ls->color_mode;
+    light_cfg.color_cfg.color_capabilities = 0x0018;
+    light_cfg.color_cfg.current_x = ls->color_x;
+    light_cfg.color_cfg.current_y = ls->color_y;
     
     // Forcer ON/OFF a OFF et luminosite a 0 au demarrage
     light_cfg.on_off_cfg.on_off = false;
     light_cfg.level_cfg.current_level = 0;
 
-    // ===== Endpoint 10 : LIGHT =====
+#if CONFIG_ZB_ZCZR
+    // Routeur : toujours alimente, annonce secteur (coordinateurs et Z2M l'utilisent comme relais)
+    light_cfg.basic_cfg.power_source = ZB_ZCL_BASIC_POWER_SOURCE_MAINS_SINGLE_PHASE;
+#endif
+
     esp_zb_attribute_list_t *basic_cluster = esp_zb_basic_cluster_create(&light_cfg.basic_cfg);
     
     char manufacturer[] = {11, 'E', 'S', 'P', '3', '2', '-', 'Z', 'i', 'g', 'b', 'e'};
@@ -478,6 +2097,14 @@ static void esp_zb_task(void *pvParameters)
     esp_zb_attribute_list_t *on_off_cluster = esp_zb_on_off_cluster_create(&light_cfg.on_off_cfg);
     esp_zb_attribute_list_t *level_cluster = esp_zb_level_cluster_create(&light_cfg.level_cfg);
     esp_zb_attribute_list_t *color_cluster = esp_zb_color_control_cluster_create(&light_cfg.color_cfg);
+
+    // Temperature de couleur : valeur courante et plage supportee (table du lieu de Planck)
+    uint16_t color_temp = ls->color_temp;
+    uint16_t color_temp_min = COLOR_CORRECTION_MIREDS_MIN;
+    uint16_t color_temp_max = COLOR_CORRECTION_MIREDS_MAX;
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMPERATURE_ID, &color_temp);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MIN_MIREDS_ID, &color_temp_min);
+    esp_zb_color_control_cluster_add_attr(color_cluster, ESP_ZB_ZCL_ATTR_COLOR_CONTROL_COLOR_TEMP_PHYSICAL_MAX_MIREDS_ID, &color_temp_max);
     
     // Attribut personnalisé pour l'effet (ID 0xF000)
     esp_zb_cluster_add_manufacturer_attr(color_cluster, 
@@ -485,8 +2112,8 @@ static void esp_zb_task(void *pvParameters)
                                         0xF000,
                                         0x1234,
                                         ESP_ZB_ZCL_ATTR_TYPE_U8,
-                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
-                                        &attr_effect_value);
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING,
+                                        &attrs->effect_value);
 
     // Attributs personnalises pour la vitesse de chaque effet
     esp_zb_cluster_add_manufacturer_attr(color_cluster, 
@@ -494,22 +2121,77 @@ static void esp_zb_task(void *pvParameters)
                                         0xF001,
                                         0x1234,
                                         ESP_ZB_ZCL_ATTR_TYPE_U8,
-                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
-                                        &attr_speed_rainbow);
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING,
+                                        &attrs->speed_rainbow);
     esp_zb_cluster_add_manufacturer_attr(color_cluster, 
                                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                                         0xF002,
                                         0x1234,
                                         ESP_ZB_ZCL_ATTR_TYPE_U8,
-                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
-                                        &attr_speed_strobe);
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING,
+                                        &attrs->speed_strobe);
     esp_zb_cluster_add_manufacturer_attr(color_cluster, 
                                         ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
                                         0xF003,
                                         0x1234,
                                         ESP_ZB_ZCL_ATTR_TYPE_U8,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING,
+                                        &attrs->speed_twinkle);
+    // Degrade des effets : id predefini ou points personnalises (octet string)
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF004,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+                                        attrs->gradient);
+    // Fondu long (lever / coucher de soleil), voir LIGHT_FADE_LEN_*
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF005,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+                                        attrs->fade);
+    // Courbe niveau -> luminosite (EFFECTS_CURVE_*) et points de la courbe personnalisee
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF006,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_U8,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+                                        &attrs->level_curve);
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF007,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+                                        attrs->level_curve_points);
+    // Calibrage des couleurs : primaires, gains et gamma par canal (persistant en NVS)
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF008,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
+                                        attrs->color_calibration);
+    // Type de ruban (format des pixels, timings) et point blanc des rubans RGBW
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF009,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
                                         ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE,
-                                        &attr_speed_twinkle);
+                                        attrs->strip_config);
+    // Etat complet du segment en une lecture / un report, voir LIGHT_STATE_LEN
+    esp_zb_cluster_add_manufacturer_attr(color_cluster,
+                                        ESP_ZB_ZCL_CLUSTER_ID_COLOR_CONTROL,
+                                        0xF00A,
+                                        0x1234,
+                                        ESP_ZB_ZCL_ATTR_TYPE_OCTET_STRING,
+                                        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY | ESP_ZB_ZCL_ATTR_ACCESS_REPORTING,
+                                        attrs->state);
 
     esp_zb_cluster_list_t *cluster_list_light = esp_zb_zcl_cluster_list_create();
     esp_zb_cluster_list_add_basic_cluster(cluster_list_light, basic_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
@@ -520,21 +2202,103 @@ static void esp_zb_task(void *pvParameters)
     esp_zb_cluster_list_add_level_cluster(cluster_list_light, level_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
     esp_zb_cluster_list_add_color_control_cluster(cluster_list_light, color_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
 
-    esp_zb_ep_list_t *ep_list = esp_zb_ep_list_create();
-    
+    // Cluster fabricant : changement complet (effet, couleur, niveau, transition) en une commande
+    uint8_t light_cluster_version = LIGHT_CLUSTER_VERSION;
+    esp_zb_attribute_list_t *light_cluster = esp_zb_zcl_attr_list_create(LIGHT_CLUSTER_ID);
+    esp_zb_custom_cluster_add_custom_attr(light_cluster, LIGHT_CLUSTER_ATTR_VERSION, ESP_ZB_ZCL_ATTR_TYPE_U8,
+        ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &light_cluster_version);
+    if (seg == 0) {
+        // Compteurs du flux de trames (tous segments) sur le premier endpoint
+        uint32_t zero = 0;
+        const uint16_t counters[] = {
+            LIGHT_CLUSTER_ATTR_STREAM_CHUNKS, LIGHT_CLUSTER_ATTR_STREAM_FRAMES,
+            LIGHT_CLUSTER_ATTR_STREAM_DROPPED, LIGHT_CLUSTER_ATTR_STREAM_LATE,
+        };
+        for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+            esp_zb_custom_cluster_add_custom_attr(light_cluster, counters[i], ESP_ZB_ZCL_ATTR_TYPE_U32,
+                ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &zero);
+        }
+        // Horloge du groupe pour les effets synchronises : une par appareil
+        light_sync_add_attrs(light_cluster, segment_endpoint(seg));
+    }
+    esp_zb_cluster_list_add_custom_cluster(cluster_list_light, light_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+
+    // Mesure electrique estimee : une seule alimentation, exposee sur le premier endpoint
+    if (seg == 0) {
+        esp_zb_electrical_meas_cluster_cfg_t meas_cfg = {
+            .measured_type = ESP_ZB_ZCL_ELECTRICAL_MEASUREMENT_ACTIVE_MEASUREMENT,
+        };
+        esp_zb_attribute_list_t *meas_cluster = esp_zb_electrical_meas_cluster_create(&meas_cfg);
+        int16_t active_power = 0;
+        uint16_t rms_current = 0;
+        uint16_t rms_voltage = LED_STRIP_VOLTAGE_MV / 100;    // 0.1 V
+        uint16_t one = 1;
+        uint16_t ten = 10;
+        uint16_t thousand = 1000;
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACTIVE_POWER_ID, &active_power);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSCURRENT_ID, &rms_current);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_RMSVOLTAGE_ID, &rms_voltage);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_MULTIPLIER_ID, &one);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACPOWER_DIVISOR_ID, &ten);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_MULTIPLIER_ID, &one);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACCURRENT_DIVISOR_ID, &thousand);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_MULTIPLIER_ID, &one);
+        esp_zb_electrical_meas_cluster_add_attr(meas_cluster, ESP_ZB_ZCL_ATTR_ELECTRICAL_MEASUREMENT_ACVOLTAGE_DIVISOR_ID, &ten);
+        esp_zb_cluster_list_add_electrical_meas_cluster(cluster_list_light, meas_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+
+        // End device : poll adaptatif pilotable par le coordinateur (sans effet en routeur)
+        poll_control_cluster_add(cluster_list_light, segment_endpoint(seg), ED_KEEP_ALIVE);
+
+        // Touchlink : une telecommande decouvre l'appareil par son premier endpoint
+        commissioning_cluster_add(cluster_list_light);
+    }
+
     esp_zb_endpoint_config_t endpoint_light_config = {
-        .endpoint = HA_ESP_LIGHT_ENDPOINT,
+        .endpoint = segment_endpoint(seg),
         .app_profile_id = ESP_ZB_AF_HA_PROFILE_ID,
         .app_device_id = ESP_ZB_HA_COLOR_DIMMABLE_LIGHT_DEVICE_ID,
         .app_device_version = 0
     };
     esp_zb_ep_list_add_ep(ep_list, cluster_list_light, endpoint_light_config);
-    
+}
+
+// Identification (commande Identify, Finding & Binding) : le ruban clignote tant qu'un endpoint s'identifie
+static void identify_notify_cb(uint8_t identify_on)
+{
+    uint16_t remaining = 0;
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        const uint16_t *time = get_zcl_attr_value(segment_endpoint(seg), ESP_ZB_ZCL_CLUSTER_ID_IDENTIFY,
+                                                  ESP_ZB_ZCL_ATTR_IDENTIFY_IDENTIFY_TIME_ID);
+        if (time && *time > remaining) {
+            remaining = *time;
+        }
+    }
+    effects_identify((identify_on && remaining == 0) ? 1 : remaining);
+}
+
+// Tache Zigbee principale
+static void esp_zb_task(void *pvParameters)
+{
+    esp_zb_cfg_t zb_nwk_cfg = ESP_ZB_LIGHT_CONFIG();
+    esp_zb_init(&zb_nwk_cfg);
+
+    // ===== Endpoints 10, 11, ... : un LIGHT par segment =====
+    esp_zb_ep_list_t *ep_list = esp_zb_ep_list_create();
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        create_light_endpoint(ep_list, seg);
+    }
+
     esp_zb_device_register(ep_list);
+    reporting_init();
+    for (uint8_t seg = 0; seg < LIGHT_SEGMENT_COUNT; seg++) {
+        esp_zb_identify_notify_handler_register(segment_endpoint(seg), identify_notify_cb);
+    }
+    commissioning_init();
 
-    ESP_LOGI(TAG, "Appareil enregistre: Color Dimmable Light (XY only)");
+    ESP_LOGI(TAG, "Appareil enregistre: %d x Color Dimmable Light (XY only)", LIGHT_SEGMENT_COUNT);
 
     esp_zb_core_action_handler_register(zb_action_handler);
+    esp_zb_raw_command_handler_register(zb_raw_command_handler);
     esp_zb_set_primary_network_channel_set(ESP_ZB_PRIMARY_CHANNEL_MASK);
     ESP_ERROR_CHECK(esp_zb_start(false));
     esp_zb_stack_main_loop();
@@ -549,34 +2313,64 @@ void app_main(void)
     };
 
     ESP_ERROR_CHECK(nvs_flash_init());
+    light_state_init();
     ESP_ERROR_CHECK(esp_zb_platform_config(&config));
 
-    // Configuration LED Strip WS2812
-    led_strip_config_t strip_config = {
-        .strip_gpio_num = LED_STRIP_GPIO,
-        .max_leds = LED_STRIP_LENGTH,
-        .led_pixel_format = LED_PIXEL_FORMAT_GRB,
-        .led_model = LED_MODEL_WS2812,
-        .flags.invert_out = false,
-    };
-    
-    led_strip_rmt_config_t rmt_config = {
-        .clk_src = RMT_CLK_SRC_DEFAULT,
-        .resolution_hz = 10 * 1000 * 1000,
-        .flags.with_dma = false,
+    // Configuration LED Strip (une ou plusieurs sorties RMT synchronisees), type enregistre en NVS
+    strip_config_load();
+    scene_transitions_load();
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        attr_storage[i].strip_config[0] = LIGHT_STRIP_CONFIG_LEN;
+        memcpy(&attr_storage[i].strip_config[1], strip_config, LIGHT_STRIP_CONFIG_LEN);
+    }
+    led_output_config_t output_config = {
+        .gpios = led_strip_gpios,
+        .num_outputs = LED_STRIP_OUTPUTS,
+        .num_leds = LED_STRIP_LENGTH,
+        .led_pixel_format = light_strip_types[strip_type].format,
+        .led_model = light_strip_types[strip_type].model,
+        .without_framebuffer = LED_STRIP_RENDER_IN_ENCODER,
+        .palette_bits = LED_STRIP_PALETTE_BITS,
     };
     
-    ESP_ERROR_CHECK(led_strip_new_rmt_device(&strip_config, &rmt_config, &led_strip));
+    ESP_ERROR_CHECK(led_output_new(&output_config, &led_strip));
     
     led_strip_clear(led_strip);
-    led_strip_refresh(led_strip);
     
     // Initialiser le systeme d'effets
-    effects_init(led_strip, LED_STRIP_LENGTH);
+    effects_render_mode_t render_mode = EFFECTS_RENDER_FRAMEBUFFER;
+    if (LED_STRIP_RENDER_IN_ENCODER) {
+        render_mode = EFFECTS_RENDER_IN_ENCODER;
+    } else if (LED_STRIP_PALETTE_BITS == 4) {
+        render_mode = EFFECTS_RENDER_PALETTE_16;
+    } else if (LED_STRIP_PALETTE_BITS == 8) {
+        render_mode = EFFECTS_RENDER_PALETTE_256;
+    }
+    effects_init(led_strip, LED_STRIP_LENGTH, LIGHT_SEGMENT_COUNT, render_mode);
+    effects_set_dither(LED_STRIP_DITHER);
+    effects_set_level_curve(LED_STRIP_LEVEL_CURVE);
+    apply_white_point();
+
+    // Correction des couleurs : matrice des primaires et tables par canal enregistrees en NVS
+    color_correction_init();
+    // Programmes d'effets telecharges (EFFECT_PROGRAM)
+    effect_programs_init();
+    // Groupe des effets synchronises
+    light_sync_init();
+    for (int i = 0; i < LIGHT_SEGMENT_COUNT; i++) {
+        encode_calibration(attr_storage[i].color_calibration);
+    }
+
+    // Limiteur de courant : evite qu'une trame blanche a pleine luminosite depasse l'alimentation
+    effects_power_config_t power_config = EFFECTS_POWER_CONFIG_DEFAULT(LED_STRIP_MAX_CURRENT_MA);
+    const uint8_t channel_ma[] = LED_STRIP_CHANNEL_MA;
+    memcpy(power_config.channel_ma, channel_ma, sizeof(power_config.channel_ma));
+    effects_set_power_config(&power_config);
 
     ESP_LOGI(TAG, "===================================");
     ESP_LOGI(TAG, "  Zigbee WS2812 LED Strip Controller");
-    ESP_LOGI(TAG, "  GPIO: %d | LEDs: %d", LED_STRIP_GPIO, LED_STRIP_LENGTH);
+    ESP_LOGI(TAG, "  GPIO: %d | Sorties: %d | LEDs: %d | Segments: %d",
+             LED_STRIP_GPIO, (int)LED_STRIP_OUTPUTS, LED_STRIP_LENGTH, LIGHT_SEGMENT_COUNT);
     ESP_LOGI(TAG, "  Demarrage: OFF (0%%)");
     ESP_LOGI(TAG, "===================================");
 
@@ -4,6 +4,7 @@
 #include "esp_zigbee_core.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "effect_programs.h"
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -12,6 +13,8 @@
 // Politique d'install code (sécurité pour l'appairage)
 #define INSTALLCODE_POLICY_ENABLE       false   // false = appairage classique (plus simple pour HA/Z2M)
 
+// Rôle Zigbee : End Device par défaut, routeur si CONFIG_ZB_ZCZR (sdkconfig.defaults.router)
+
 // Timeout pour End Device (ZED) - évite d'être exclu du réseau si endormi trop longtemps
 #define ED_AGING_TIMEOUT                ESP_ZB_ED_AGING_TIMEOUT_64MIN
 #define ED_KEEP_ALIVE                   3000    // ms - poll rate vers parent
@@ -19,6 +22,10 @@
 // Endpoint Zigbee pour la lumière (doit être unique si plusieurs endpoints)
 #define HA_ESP_LIGHT_ENDPOINT           10
 
+// Nombre de segments du ruban : chaque segment est exposé comme un endpoint
+// Color Dimmable Light distinct (10, 11, 12, ...). Le ruban est découpé en parts égales.
+#define LIGHT_SEGMENT_COUNT             1
+
 // Canaux autorisés pour le réseau Zigbee (11-26)
 #define ESP_ZB_PRIMARY_CHANNEL_MASK     ESP_ZB_TRANSCEIVER_ALL_CHANNELS_MASK
 
@@ -33,6 +40,95 @@
         },                                                              \
     }
 
+/* ================ Configuration rôle ZR (Router) =================== */
+// Nombre d'end devices acceptés comme enfants (menuconfig > WS2812 Light)
+#ifdef CONFIG_LIGHT_ZB_MAX_CHILDREN
+#define ZR_MAX_CHILDREN                 CONFIG_LIGHT_ZB_MAX_CHILDREN
+#else
+#define ZR_MAX_CHILDREN                 10
+#endif
+
+#define ESP_ZB_ZR_CONFIG()                                              \
+    {                                                                   \
+        .esp_zb_role = ESP_ZB_DEVICE_TYPE_ROUTER,                       \
+        .install_code_policy = INSTALLCODE_POLICY_ENABLE,               \
+        .nwk_cfg.zczr_cfg = {                                           \
+            .max_children = ZR_MAX_CHILDREN,                            \
+        },                                                              \
+    }
+
+// Configuration correspondant au rôle compilé
+#if CONFIG_ZB_ZCZR
+#define ESP_ZB_LIGHT_CONFIG()           ESP_ZB_ZR_CONFIG()
+#else
+#define ESP_ZB_LIGHT_CONFIG()           ESP_ZB_ZED_CONFIG()
+#endif
+
+/* ============ Cluster fabricant : commandes de la lumière ============ */
+// Cluster serveur de chaque endpoint (code fabricant 0x1234) : un changement complet en une trame
+#define LIGHT_CLUSTER_ID                0xFC00
+#define LIGHT_CLUSTER_ATTR_VERSION      0x0000  // Version du protocole du cluster (U8)
+#define LIGHT_CLUSTER_VERSION           5
+// Compteurs du flux de trames (U32, lecture seule, tous segments)
+#define LIGHT_CLUSTER_ATTR_STREAM_CHUNKS    0x0010  // Blocs décodés
+#define LIGHT_CLUSTER_ATTR_STREAM_FRAMES    0x0011  // Trames présentées
+#define LIGHT_CLUSTER_ATTR_STREAM_DROPPED   0x0012  // Blocs rejetés et trames jamais présentées
+#define LIGHT_CLUSTER_ATTR_STREAM_LATE      0x0013  // Blocs et présentations en retard
+// Synchronisation des effets entre appareils (premier endpoint, voir light_sync.h)
+#define LIGHT_CLUSTER_ATTR_SYNC_GROUP       0x0020  // Groupe des balises de temps (U16, écriture, 0 = désactivée)
+#define LIGHT_CLUSTER_ATTR_SYNC_STATE       0x0021  // light_sync_state_t (U8, reporté)
+#define LIGHT_CLUSTER_ATTR_SYNC_OFFSET      0x0022  // Temps du groupe - temps local (S32, ms, reporté)
+#define LIGHT_CLUSTER_ATTR_SYNC_DRIFT       0x0023  // Avance de l'horloge de référence (S16, ppm)
+#define LIGHT_CLUSTER_ATTR_SYNC_ERROR       0x0024  // Écart de la dernière balise à l'horloge corrigée (S16, ms, reporté)
+#define LIGHT_CLUSTER_ATTR_SYNC_SOURCE      0x0025  // Adresse courte de la référence (U16)
+
+// SetEffect : effet (u8, 0xFF = inchangé), vitesse (u8, 0 = inchangée), x, y (u16, 0xFFFF = inchangés),
+// level (u8, 0xFF = inchangé), transition (u16, 1/10 s, couleur fixe uniquement)
+#define LIGHT_CMD_SET_EFFECT            0x00
+#define LIGHT_CMD_SET_EFFECT_LEN        9
+// SetSegment : masque des segments (u8, bit 0 = segment 0, 0 = segment de l'endpoint), on/off (u8,
+// 0xFF = inchangé), puis les champs de SetEffect
+#define LIGHT_CMD_SET_SEGMENT           0x01
+#define LIGHT_CMD_SET_SEGMENT_LEN       11
+// StreamChunk : trame (u8), segment (u8, index), offset (u16, premier pixel dans le segment), encodage (u8,
+// effects_stream_encoding_t), puis les pixels encodés. Les blocs plus longs qu'une trame radio
+// arrivent par fragmentation APS, réassemblés par la pile.
+#define LIGHT_CMD_STREAM_CHUNK          0x02
+#define LIGHT_CMD_STREAM_CHUNK_LEN      5
+// StreamPresent : trame (u8), masque des segments (u8, 0 = segment de l'endpoint). Tous les segments
+// du masque affichent la trame reçue dans le même rafraîchissement.
+#define LIGHT_CMD_STREAM_PRESENT        0x03
+#define LIGHT_CMD_STREAM_PRESENT_LEN    2
+// ProgramWrite : emplacement (u8), offset (u16), puis un morceau du programme effect_vm (en-tête compris).
+// Les morceaux arrivent dans l'ordre à partir de l'offset 0.
+#define LIGHT_CMD_PROGRAM_WRITE         0x04
+#define LIGHT_CMD_PROGRAM_WRITE_LEN     3
+// ProgramCommit : emplacement (u8), taille totale (u16, 0 = efface l'emplacement). Le programme est
+// vérifié puis enregistré en NVS.
+#define LIGHT_CMD_PROGRAM_COMMIT        0x05
+#define LIGHT_CMD_PROGRAM_COMMIT_LEN    3
+// ProgramRun : emplacement (u8), vitesse (u8, 0 = inchangée), paramètres P0-P3 (u8). Lance l'effet
+// EFFECT_PROGRAM sur le segment de l'endpoint.
+#define LIGHT_CMD_PROGRAM_RUN           0x06
+#define LIGHT_CMD_PROGRAM_RUN_LEN       6
+// TimeSync : temps du groupe à l'émission (u32, ms), origine des animations (u32, ms, temps du groupe).
+// Balise envoyée au groupe de synchronisation par le meneur, ou par le coordinateur.
+#define LIGHT_CMD_TIME_SYNC             0x07
+#define LIGHT_CMD_TIME_SYNC_LEN         8
+// Commission : modes (u8, masque de commissioning_mode_t), durée (u16, s, 0 = 180). Ouvre une fenêtre
+// d'appairage pour les télécommandes (Finding & Binding, Touchlink) et les interrupteurs Green Power.
+#define LIGHT_CMD_COMMISSION            0x08
+#define LIGHT_CMD_COMMISSION_LEN        3
+
+/* ============ Scènes : champ d'extension fabricant ============ */
+// Ajouté aux champs On/Off, Level et Color Control de chaque scène, sous l'identifiant LIGHT_CLUSTER_ID :
+// version (u8), mode couleur (u8), température (u16), effet (u8), vitesse de l'effet (u8),
+// emplacement du programme (u8), paramètres P0-P3 (u8), puis le dégradé (attribut 0xF004, longueur comprise)
+#define LIGHT_SCENE_FIELD_VERSION       1
+#define LIGHT_SCENE_FIELD_LEN           11      // Sans le dégradé
+// Scènes gardées en RAM (tous segments) : un rappel n'attend ni la flash ni le décodage des champs
+#define LIGHT_SCENE_CACHE_SIZE          16
+
 /* ================= Configuration radio et hôte par défaut =========== */
 #define ESP_ZB_DEFAULT_RADIO_CONFIG()                           \
     {                                                           \
@@ -44,17 +140,28 @@
         .host_connection_mode = ZB_HOST_CONNECTION_MODE_NONE,   \
     }
 
-/* ====================== Structure pour l'état de la lumière ====================== */
+/* ============ Structure pour l'état de la lumière (une par segment) ============ */
+
+// Valeurs de l'attribut ColorMode (ZCL)
+#define LIGHT_COLOR_MODE_XY             1
+#define LIGHT_COLOR_MODE_TEMPERATURE    2
+
 
 typedef struct {
     bool on_off;
     uint8_t level;
     uint16_t color_x;           // Coordonnee X CIE 1931 (0-65535, represente 0.0-1.0)
     uint16_t color_y;           // Coordonnee Y CIE 1931 (0-65535, represente 0.0-1.0)
+    uint8_t color_mode;         // Couleur pilotée par X/Y ou par la température (LIGHT_COLOR_MODE_*)
+    uint16_t color_temp;        // Température de couleur (mireds)
     uint8_t effect_id;          // ID de l'effet actif (0=None, 1=Rainbow, 2=Strobe, 3=Twinkle)
     uint8_t speed_rainbow;      // Vitesse Rainbow (1-255)
     uint8_t speed_strobe;       // Vitesse Strobe (1-255)
     uint8_t speed_twinkle;      // Vitesse Twinkle (1-255)
+    uint8_t speed_program;      // Vitesse du programme (1-255)
+    uint8_t program_slot;       // Emplacement du programme lancé (EFFECT_PROGRAMS_SLOTS : aucun)
+    uint8_t program_params[EFFECT_VM_PARAMS];   // Paramètres P0-P3 du programme
+    uint8_t gradient_id;        // Dégradé des effets (0=aucun, 1-6=prédéfini, 0xFF=personnalisé)
 } light_state_t;
 
 #endif /* MAIN_H */
\ No newline at end of file
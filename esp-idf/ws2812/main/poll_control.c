@@ -0,0 +1,301 @@
+/*
+ * Poll adaptatif de l'end device : poll rapide apres une commande ou pendant
+ * une transition, poll long sinon, et cluster Poll Control (0x0020)
+ */
+
+#include "poll_control.h"
+
+#if CONFIG_ZB_ZED
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+static const char *TAG = "POLL";
+
+#define MANUFACTURER_CODE   0x1234
+#define QS_TO_MS(qs)        ((uint32_t)(qs) * 250)
+
+// Coordinateur : destinataire des Check-in
+#define CHECK_IN_DST_ADDR   0x0000
+#define CHECK_IN_DST_EP     1
+
+static uint8_t s_endpoint;
+static bool s_started = false;
+static bool s_fast = false;
+static uint32_t s_long_ms;                  // Intervalle hors activite
+static uint32_t s_short_ms = CONFIG_LIGHT_POLL_FAST_INTERVAL_MS;
+static int64_t s_fast_until_us;             // Fin du poll rapide en cours
+static int64_t s_mode_since_us;             // Debut du mode courant
+static poll_control_stats_t s_stats;
+
+static uint32_t get_attr_u32(uint16_t attr_id)
+{
+    esp_zb_zcl_attr_t *attr = esp_zb_zcl_get_attribute(s_endpoint, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id);
+    return (attr && attr->data_p) ? *(uint32_t *)attr->data_p : 0;
+}
+
+static uint16_t get_attr_u16(uint16_t attr_id)
+{
+    esp_zb_zcl_attr_t *attr = esp_zb_zcl_get_attribute(s_endpoint, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id);
+    return (attr && attr->data_p) ? *(uint16_t *)attr->data_p : 0;
+}
+
+static void set_attr(uint16_t attr_id, void *value)
+{
+    esp_zb_zcl_set_attribute_val(s_endpoint, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+        ESP_ZB_ZCL_CLUSTER_SERVER_ROLE, attr_id, value, false);
+}
+
+// Cumule le temps passe dans le mode courant et publie les compteurs
+static void account_mode(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint64_t elapsed_ms = (now - s_mode_since_us) / 1000;
+
+    if (s_fast) {
+        s_stats.fast_ms += elapsed_ms;
+    } else {
+        s_stats.long_ms += elapsed_ms;
+    }
+    s_mode_since_us = now;
+
+    uint32_t fast_s = s_stats.fast_ms / 1000;
+    uint32_t long_s = s_stats.long_ms / 1000;
+    set_attr(POLL_CONTROL_ATTR_FAST_TIME, &fast_s);
+    set_attr(POLL_CONTROL_ATTR_LONG_TIME, &long_s);
+    set_attr(POLL_CONTROL_ATTR_FAST_BURSTS, &s_stats.fast_bursts);
+}
+
+static void fast_poll_end_cb(uint8_t param);
+
+static void fast_poll_stop(void)
+{
+    esp_zb_scheduler_alarm_cancel(fast_poll_end_cb, 0);
+    if (!s_fast) {
+        return;
+    }
+    account_mode();
+    s_fast = false;
+    zb_zdo_pim_set_long_poll_interval(s_long_ms);
+    ESP_LOGD(TAG, "Poll long (%lu ms)", (unsigned long)s_long_ms);
+}
+
+static void fast_poll_end_cb(uint8_t param)
+{
+    fast_poll_stop();
+}
+
+// Poll rapide pendant duration_ms au moins (prolonge le poll en cours, ne le raccourcit pas)
+static void fast_poll_start(uint32_t duration_ms)
+{
+    int64_t until_us = esp_timer_get_time() + (int64_t)duration_ms * 1000;
+
+    if (!s_started || duration_ms == 0) {
+        return;
+    }
+    if (s_fast && until_us <= s_fast_until_us) {
+        return;
+    }
+    if (!s_fast) {
+        account_mode();
+        s_fast = true;
+        s_stats.fast_bursts++;
+        zb_zdo_pim_set_long_poll_interval(s_short_ms);
+        ESP_LOGD(TAG, "Poll rapide (%lu ms) pendant %lu ms", (unsigned long)s_short_ms, (unsigned long)duration_ms);
+    }
+    s_fast_until_us = until_us;
+    esp_zb_scheduler_alarm_cancel(fast_poll_end_cb, 0);
+    esp_zb_scheduler_alarm(fast_poll_end_cb, 0, duration_ms);
+}
+
+// Check-in periodique : le coordinateur peut y repondre pour demander une rafale de poll rapide
+static void check_in_cb(uint8_t param)
+{
+    uint32_t interval_qs = get_attr_u32(ZB_ZCL_ATTR_POLL_CONTROL_CHECKIN_INTERVAL_ID);
+
+    if (interval_qs == ZB_ZCL_POLL_CONTROL_CHECKIN_INTERVAL_NO_CHECK_IN_VALUE) {
+        return;
+    }
+
+    esp_zb_zcl_custom_cluster_cmd_req_t req = {
+        .zcl_basic_cmd = {
+            .dst_addr_u.addr_short = CHECK_IN_DST_ADDR,
+            .dst_endpoint = CHECK_IN_DST_EP,
+            .src_endpoint = s_endpoint,
+        },
+        .address_mode = ESP_ZB_APS_ADDR_MODE_16_ENDP_PRESENT,
+        .profile_id = ESP_ZB_AF_HA_PROFILE_ID,
+        .cluster_id = ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL,
+        .direction = ESP_ZB_ZCL_CMD_DIRECTION_TO_CLI,
+        .custom_cmd_id = ZB_ZCL_CMD_POLL_CONTROL_CHECK_IN_ID,
+        .data = { .type = ESP_ZB_ZCL_ATTR_TYPE_NULL, .size = 0, .value = NULL },
+    };
+    esp_zb_zcl_custom_cluster_cmd_req(&req);
+
+    // Attente de la reponse en poll rapide
+    fast_poll_start(CONFIG_LIGHT_POLL_FAST_WINDOW_MS);
+    esp_zb_scheduler_alarm(check_in_cb, 0, QS_TO_MS(interval_qs));
+}
+
+void poll_control_set_check_in_interval(uint32_t interval_qs)
+{
+    // Le prochain Check-in part un intervalle apres l'ecriture ; 0 les arrete jusqu'a la prochaine ecriture
+    esp_zb_scheduler_alarm_cancel(check_in_cb, 0);
+    if (!s_started || interval_qs == ZB_ZCL_POLL_CONTROL_CHECKIN_INTERVAL_NO_CHECK_IN_VALUE) {
+        return;
+    }
+    esp_zb_scheduler_alarm(check_in_cb, 0, QS_TO_MS(interval_qs));
+    ESP_LOGI(TAG, "Check-in toutes les %lu ms", (unsigned long)QS_TO_MS(interval_qs));
+}
+
+void poll_control_cluster_add(esp_zb_cluster_list_t *cluster_list, uint8_t endpoint, uint32_t long_poll_ms)
+{
+    uint32_t check_in_interval = ZB_ZCL_POLL_CONTROL_CHECKIN_INTERVAL_DEFAULT_VALUE;
+    uint32_t long_poll_interval = long_poll_ms / 250;
+    uint16_t short_poll_interval = (CONFIG_LIGHT_POLL_FAST_INTERVAL_MS + 249) / 250;
+    uint16_t fast_poll_timeout = (CONFIG_LIGHT_POLL_FAST_WINDOW_MS + 249) / 250;
+    uint32_t zero = 0;
+
+    s_endpoint = endpoint;
+    s_long_ms = long_poll_ms;
+
+    esp_zb_attribute_list_t *poll_cluster = esp_zb_zcl_attr_list_create(ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL);
+    esp_zb_cluster_add_attr(poll_cluster, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL, ZB_ZCL_ATTR_POLL_CONTROL_CHECKIN_INTERVAL_ID,
+        ESP_ZB_ZCL_ATTR_TYPE_U32, ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE, &check_in_interval);
+    esp_zb_cluster_add_attr(poll_cluster, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL, ZB_ZCL_ATTR_POLL_CONTROL_LONG_POLL_INTERVAL_ID,
+        ESP_ZB_ZCL_ATTR_TYPE_U32, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &long_poll_interval);
+    esp_zb_cluster_add_attr(poll_cluster, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL, ZB_ZCL_ATTR_POLL_CONTROL_SHORT_POLL_INTERVAL_ID,
+        ESP_ZB_ZCL_ATTR_TYPE_U16, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &short_poll_interval);
+    esp_zb_cluster_add_attr(poll_cluster, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL, ZB_ZCL_ATTR_POLL_CONTROL_FAST_POLL_TIMEOUT_ID,
+        ESP_ZB_ZCL_ATTR_TYPE_U16, ESP_ZB_ZCL_ATTR_ACCESS_READ_WRITE, &fast_poll_timeout);
+
+    // Compteurs : temps passe dans chaque mode
+    const uint16_t counters[] = {
+        POLL_CONTROL_ATTR_FAST_TIME, POLL_CONTROL_ATTR_LONG_TIME, POLL_CONTROL_ATTR_FAST_BURSTS,
+    };
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        esp_zb_cluster_add_manufacturer_attr(poll_cluster, ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL, counters[i],
+            MANUFACTURER_CODE, ESP_ZB_ZCL_ATTR_TYPE_U32, ESP_ZB_ZCL_ATTR_ACCESS_READ_ONLY, &zero);
+    }
+
+    esp_zb_cluster_list_add_custom_cluster(cluster_list, poll_cluster, ESP_ZB_ZCL_CLUSTER_SERVER_ROLE);
+}
+
+void poll_control_start(void)
+{
+    if (!s_started) {
+        s_started = true;
+        s_mode_since_us = esp_timer_get_time();
+    }
+
+    // L'intervalle long est remis a sa valeur par defaut a chaque appairage
+    fast_poll_stop();
+    zb_zdo_pim_set_long_poll_interval(s_long_ms);
+    ESP_LOGI(TAG, "Poll long %lu ms, rapide %lu ms pendant %d ms apres une commande",
+             (unsigned long)s_long_ms, (unsigned long)s_short_ms, CONFIG_LIGHT_POLL_FAST_WINDOW_MS);
+
+    esp_zb_scheduler_alarm_cancel(check_in_cb, 0);
+    check_in_cb(0);
+}
+
+void poll_control_activity(uint32_t duration_ms)
+{
+    // Un fondu long (reveil lumineux) ne garde pas le poll rapide
+    if (duration_ms > CONFIG_LIGHT_POLL_TRANSITION_MAX_MS) {
+        duration_ms = 0;
+    }
+    uint32_t window_ms = QS_TO_MS(get_attr_u16(ZB_ZCL_ATTR_POLL_CONTROL_FAST_POLL_TIMEOUT_ID));
+    fast_poll_start(duration_ms > window_ms ? duration_ms : window_ms);
+}
+
+bool poll_control_handle_command(uint8_t bufid, zb_zcl_parsed_hdr_t *cmd_info)
+{
+    const uint8_t *payload = zb_buf_begin(bufid);
+    uint16_t len = zb_buf_len(bufid);
+    uint8_t status = ZB_ZCL_STATUS_SUCCESS;
+
+    if (cmd_info->cluster_id != ESP_ZB_ZCL_CLUSTER_ID_POLL_CONTROL || cmd_info->is_common_command ||
+        cmd_info->cmd_direction != ZB_ZCL_FRAME_DIRECTION_TO_SRV ||
+        cmd_info->addr_data.common_data.dst_endpoint != s_endpoint) {
+        return false;
+    }
+
+    switch (cmd_info->cmd_id) {
+    case ZB_ZCL_CMD_POLL_CONTROL_CHECK_IN_RESPONSE_ID:
+        // Start Fast Polling (bool) puis Fast Poll Timeout (qs, 0 = attribut FastPollTimeout)
+        if (len < 3) {
+            status = ZB_ZCL_STATUS_MALFORMED_CMD;
+        } else if (payload[0]) {
+            uint16_t timeout_qs = payload[1] | (payload[2] << 8);
+            if (timeout_qs == 0) {
+                timeout_qs = get_attr_u16(ZB_ZCL_ATTR_POLL_CONTROL_FAST_POLL_TIMEOUT_ID);
+            }
+            fast_poll_start(QS_TO_MS(timeout_qs));
+        } else {
+            fast_poll_stop();
+        }
+        break;
+    case ZB_ZCL_CMD_POLL_CONTROL_FAST_POLL_STOP_ID:
+        fast_poll_stop();
+        break;
+    case ZB_ZCL_CMD_POLL_CONTROL_SET_LONG_POLL_INTERVAL_ID: {
+        if (len < 4) {
+            status = ZB_ZCL_STATUS_MALFORMED_CMD;
+            break;
+        }
+        uint32_t interval_qs = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t)payload[3] << 24);
+        if (interval_qs < ZB_ZCL_POLL_CONTROL_LONG_POLL_INTERVAL_MIN_VALUE ||
+            interval_qs > ZB_ZCL_POLL_CONTROL_LONG_POLL_INTERVAL_MAX_VALUE || QS_TO_MS(interval_qs) < s_short_ms) {
+            status = ZB_ZCL_STATUS_INVALID_VALUE;
+            break;
+        }
+        s_long_ms = QS_TO_MS(interval_qs);
+        set_attr(ZB_ZCL_ATTR_POLL_CONTROL_LONG_POLL_INTERVAL_ID, &interval_qs);
+        if (!s_fast) {
+            zb_zdo_pim_set_long_poll_interval(s_long_ms);
+        }
+        ESP_LOGI(TAG, "Poll long -> %lu ms", (unsigned long)s_long_ms);
+        break;
+    }
+    case ZB_ZCL_CMD_POLL_CONTROL_SET_SHORT_POLL_INTERVAL_ID: {
+        if (len < 2) {
+            status = ZB_ZCL_STATUS_MALFORMED_CMD;
+            break;
+        }
+        uint16_t interval_qs = payload[0] | (payload[1] << 8);
+        if (interval_qs < ZB_ZCL_POLL_CONTROL_SHORT_POLL_INTERVAL_MIN_VALUE || QS_TO_MS(interval_qs) > s_long_ms) {
+            status = ZB_ZCL_STATUS_INVALID_VALUE;
+            break;
+        }
+        s_short_ms = QS_TO_MS(interval_qs);
+        set_attr(ZB_ZCL_ATTR_POLL_CONTROL_SHORT_POLL_INTERVAL_ID, &interval_qs);
+        if (s_fast) {
+            zb_zdo_pim_set_long_poll_interval(s_short_ms);
+        }
+        ESP_LOGI(TAG, "Poll rapide -> %lu ms", (unsigned long)s_short_ms);
+        break;
+    }
+    default:
+        status = ZB_ZCL_STATUS_UNSUP_CMD;
+        break;
+    }
+
+    ZB_ZCL_PROCESS_COMMAND_FINISH(bufid, cmd_info, status);
+    return true;
+}
+
+void poll_control_get_stats(poll_control_stats_t *stats)
+{
+    int64_t elapsed_ms = s_started ? (esp_timer_get_time() - s_mode_since_us) / 1000 : 0;
+
+    *stats = s_stats;
+    if (s_fast) {
+        stats->fast_ms += elapsed_ms;
+    } else {
+        stats->long_ms += elapsed_ms;
+    }
+}
+
+#endif /* CONFIG_ZB_ZED */
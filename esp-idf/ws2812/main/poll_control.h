@@ -0,0 +1,95 @@
+#ifndef POLL_CONTROL_H
+#define POLL_CONTROL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+#include "esp_zigbee_core.h"
+#include "zboss_api.h"
+
+/* Attributs fabricant du cluster Poll Control : compteurs de temps par mode */
+#define POLL_CONTROL_ATTR_FAST_TIME     0xF000  // Temps passé en poll rapide (s, U32)
+#define POLL_CONTROL_ATTR_LONG_TIME     0xF001  // Temps passé en poll long (s, U32)
+#define POLL_CONTROL_ATTR_FAST_BURSTS   0xF002  // Nombre de passages en poll rapide (U32)
+
+/* Temps passé dans chaque mode depuis le démarrage */
+typedef struct {
+    uint64_t fast_ms;           // Poll rapide (après une commande, pendant une transition)
+    uint64_t long_ms;           // Poll long (ED_KEEP_ALIVE ou SetLongPollInterval)
+    uint32_t fast_bursts;       // Nombre de passages en poll rapide
+} poll_control_stats_t;
+
+#if CONFIG_ZB_ZED
+
+/**
+ * @brief Ajoute le cluster Poll Control (serveur) à un endpoint
+ *
+ * Attributs standard (intervalles en quarts de seconde) et compteurs fabricant POLL_CONTROL_ATTR_*.
+ * À appeler pour un seul endpoint, avant esp_zb_device_register().
+ *
+ * @param cluster_list Liste des clusters de l'endpoint
+ * @param endpoint Endpoint portant le cluster
+ * @param long_poll_ms Intervalle de poll long (hors activité)
+ */
+void poll_control_cluster_add(esp_zb_cluster_list_t *cluster_list, uint8_t endpoint, uint32_t long_poll_ms);
+
+/**
+ * @brief Démarre la gestion du poll une fois l'appareil sur le réseau
+ *
+ * Applique l'intervalle long et programme les Check-in. À appeler depuis le contexte Zigbee
+ * après l'appairage ou le redémarrage.
+ */
+void poll_control_start(void);
+
+/**
+ * @brief Signale une activité : poll rapide pendant la fenêtre configurée
+ *
+ * Appelée à chaque commande reçue et au début d'une transition. Le poll rapide dure
+ * jusqu'à la fin de la fenêtre ou de la transition (au-delà de CONFIG_LIGHT_POLL_TRANSITION_MAX_MS,
+ * seule la fenêtre compte : un réveil lumineux ne garde pas le poll rapide).
+ *
+ * @param duration_ms Durée de la transition en cours (0 si aucune)
+ */
+void poll_control_activity(uint32_t duration_ms);
+
+/**
+ * @brief Traite une commande du cluster Poll Control reçue par le gestionnaire brut
+ *
+ * CheckInResponse, FastPollStop, SetLongPollInterval et SetShortPollInterval.
+ *
+ * @param bufid Buffer de la commande
+ * @param cmd_info En-tête ZCL de la commande
+ * @return true si la commande a été traitée (buffer libéré)
+ */
+bool poll_control_handle_command(uint8_t bufid, zb_zcl_parsed_hdr_t *cmd_info);
+
+/**
+ * @brief Reprogramme les Check-in après une écriture de CheckInInterval
+ *
+ * Le prochain Check-in part un intervalle après l'écriture. Un intervalle nul les arrête
+ * jusqu'à la prochaine écriture non nulle.
+ *
+ * @param interval_qs Nouvel intervalle (quarts de seconde)
+ */
+void poll_control_set_check_in_interval(uint32_t interval_qs);
+
+/**
+ * @brief Temps passé dans chaque mode
+ *
+ * @param stats Compteurs à remplir
+ */
+void poll_control_get_stats(poll_control_stats_t *stats);
+
+#else
+
+/* Routeur : toujours à l'écoute, pas de poll */
+static inline void poll_control_cluster_add(esp_zb_cluster_list_t *cluster_list, uint8_t endpoint, uint32_t long_poll_ms) {}
+static inline void poll_control_start(void) {}
+static inline void poll_control_activity(uint32_t duration_ms) {}
+static inline void poll_control_set_check_in_interval(uint32_t interval_qs) {}
+static inline bool poll_control_handle_command(uint8_t bufid, zb_zcl_parsed_hdr_t *cmd_info) { return false; }
+static inline void poll_control_get_stats(poll_control_stats_t *stats) { *stats = (poll_control_stats_t){ 0 }; }
+
+#endif /* CONFIG_ZB_ZED */
+
+#endif /* POLL_CONTROL_H */
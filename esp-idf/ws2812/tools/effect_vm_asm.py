@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""
+Assembleur des programmes d'effets (bytecode effect_vm)
+
+Les opcodes et les entrees sont lus dans main/effect_vm.h : l'assembleur suit le firmware.
+
+Syntaxe : une instruction par ligne, ';' commente la fin de ligne.
+    .budget 48          ; instructions par pixel (1-255, 64 par defaut)
+    boucle:             ; etiquette (cible de jmp / jz / jnz)
+    in index            ; index, count, time, frame, p0-p3, r, g, b
+    push 300            ; push8 / push16 / push32 choisi selon la valeur
+    st r0               ; registres r0-r7
+    jz boucle
+    end                 ; R, G, B au sommet de la pile
+
+Usage :
+    effect_vm_asm.py effet.fxa -o effet.fx      ; programme binaire (banc de test, NVS)
+    effect_vm_asm.py effet.fxa --hex            ; hexadecimal pour le converter (program_upload)
+"""
+
+import argparse
+import os
+import re
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'main', 'effect_vm.h')
+
+
+def parse_header(path):
+    """Valeurs des enums et des defines de effect_vm.h"""
+    with open(path, encoding='utf-8') as f:
+        text = f.read()
+    defines = {m.group(1): m.group(2) for m in re.finditer(r'#define\s+EFFECT_VM_(\w+)\s+(\S+)', text)}
+    enums = {}
+    for prefix in ('OP', 'IN'):
+        value = 0
+        for m in re.finditer(r'^\s*EFFECT_VM_%s_(\w+)\s*(?:=\s*(\w+))?\s*,' % prefix, text, re.M):
+            if m.group(2):
+                value = int(m.group(2), 0)
+            enums.setdefault(prefix, {})[m.group(1).lower()] = value
+            value += 1
+    return defines, enums['OP'], enums['IN']
+
+
+DEFINES, OPCODES, INPUTS = parse_header(HEADER)
+MAX_CODE = int(DEFINES['MAX_CODE'])
+REGS = int(DEFINES['REGS'])
+JUMPS = ('jmp', 'jz', 'jnz')
+OPERAND_SIZE = {'push8': 1, 'push16': 2, 'push32': 4, 'in': 1, 'ld': 1, 'st': 1, 'jmp': 2, 'jz': 2, 'jnz': 2}
+
+
+class AsmError(Exception):
+    pass
+
+
+def parse_int(text, line):
+    try:
+        return int(text, 0)
+    except ValueError:
+        raise AsmError('ligne %d : nombre invalide "%s"' % (line, text))
+
+
+def push_opcode(value):
+    if -128 <= value <= 127:
+        return 'push8'
+    if -32768 <= value <= 32767:
+        return 'push16'
+    return 'push32'
+
+
+def assemble(source):
+    """Retourne le programme (en-tete compris)"""
+    budget = 0
+    labels = {}
+    items = []      # (ligne, mnemonique, operande)
+    pc = 0
+
+    # Premiere passe : adresses des etiquettes
+    for line, raw in enumerate(source.splitlines(), 1):
+        text = raw.split(';', 1)[0].strip()
+        while text:
+            m = re.match(r'^([A-Za-z_]\w*):\s*(.*)$', text)
+            if not m:
+                break
+            if m.group(1) in labels:
+                raise AsmError('ligne %d : etiquette "%s" deja definie' % (line, m.group(1)))
+            labels[m.group(1)] = pc
+            text = m.group(2)
+        if not text:
+            continue
+        parts = text.split()
+        name = parts[0].lower()
+        arg = parts[1] if len(parts) > 1 else None
+        if len(parts) > 2:
+            raise AsmError('ligne %d : trop d\'operandes' % line)
+        if name == '.budget':
+            budget = parse_int(arg or '', line)
+            if not 1 <= budget <= 255:
+                raise AsmError('ligne %d : budget hors de 1-255' % line)
+            continue
+        if name == 'push':
+            if arg is None:
+                raise AsmError('ligne %d : push sans valeur' % line)
+            value = parse_int(arg, line)
+            if not -2**31 <= value < 2**32:
+                raise AsmError('ligne %d : valeur hors de 32 bits' % line)
+            name = push_opcode(value if value < 2**31 else value - 2**32)
+        if name not in OPCODES:
+            raise AsmError('ligne %d : instruction inconnue "%s"' % (line, parts[0]))
+        if (arg is None) != (name not in OPERAND_SIZE):
+            raise AsmError('ligne %d : operande %s pour "%s"' % (line, 'manquant' if arg is None else 'en trop', name))
+        items.append((line, name, arg))
+        pc += 1 + OPERAND_SIZE.get(name, 0)
+
+    # Seconde passe : encodage
+    code = bytearray()
+    for line, name, arg in items:
+        code.append(OPCODES[name])
+        size = OPERAND_SIZE.get(name, 0)
+        if name in JUMPS:
+            if arg not in labels:
+                raise AsmError('ligne %d : etiquette inconnue "%s"' % (line, arg))
+            value = labels[arg]
+        elif name == 'in':
+            value = INPUTS[arg.lower()] if arg.lower() in INPUTS else parse_int(arg, line)
+            if not 0 <= value < len(INPUTS):
+                raise AsmError('ligne %d : entree inconnue "%s"' % (line, arg))
+        elif name in ('ld', 'st'):
+            m = re.match(r'^[rR](\d+)$', arg)
+            value = int(m.group(1)) if m else parse_int(arg, line)
+            if not 0 <= value < REGS:
+                raise AsmError('ligne %d : registre r0-r%d attendu' % (line, REGS - 1))
+        elif size:
+            value = parse_int(arg, line)
+        if size:
+            code += (value & ((1 << (8 * size)) - 1)).to_bytes(size, 'little')
+
+    if not code:
+        raise AsmError('programme vide')
+    if len(code) > MAX_CODE:
+        raise AsmError('code trop long : %d octets (%d max)' % (len(code), MAX_CODE))
+    header = bytes([ord(DEFINES['MAGIC_0'].strip("'")), ord(DEFINES['MAGIC_1'].strip("'")),
+                    int(DEFINES['VERSION']), budget]) + len(code).to_bytes(2, 'little')
+    return header + bytes(code)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Assembleur effect_vm')
+    parser.add_argument('source', help='programme source (.fxa)')
+    parser.add_argument('-o', '--output', help='programme binaire (.fx)')
+    parser.add_argument('--hex', action='store_true', help='affiche le programme en hexadecimal')
+    args = parser.parse_args()
+
+    with open(args.source, encoding='utf-8') as f:
+        source = f.read()
+    try:
+        program = assemble(source)
+    except AsmError as e:
+        sys.exit('%s: %s' % (args.source, e))
+
+    if args.output:
+        with open(args.output, 'wb') as f:
+            f.write(program)
+    if args.hex or not args.output:
+        print(program.hex())
+    print('%s: %d octets de code' % (args.source, len(program) - int(DEFINES['HEADER_LEN'])), file=sys.stderr)
+
+
+if __name__ == '__main__':
+    main()
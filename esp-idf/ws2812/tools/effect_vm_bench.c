@@ -0,0 +1,93 @@
+/*
+ * Banc de test des programmes d'effets sur l'hote : verification, instructions par pixel
+ * et temps d'execution de l'interpreteur du firmware (main/effect_vm.c)
+ *
+ * cc -O2 -I../main -o effect_vm_bench effect_vm_bench.c ../main/effect_vm.c
+ * ./effect_vm_bench effet.fx [leds] [pas] [p0 p1 p2 p3]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "effect_vm.h"
+
+// Meme limite que EFFECTS_PROGRAM_FRAME_BUDGET (main/effects.h)
+#define FRAME_BUDGET    16384
+
+static const char *s_status[] = {"ok", "format", "opcode", "operande", "saut", "pile", "budget"};
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s effet.fx [leds] [pas] [p0 p1 p2 p3]\n", argv[0]);
+        return 2;
+    }
+    int leds = (argc > 2) ? atoi(argv[2]) : 60;
+    int frames = (argc > 3) ? atoi(argv[3]) : 1000;
+
+    FILE *f = fopen(argv[1], "rb");
+    if (f == NULL) {
+        perror(argv[1]);
+        return 2;
+    }
+    uint8_t data[EFFECT_VM_HEADER_LEN + EFFECT_VM_MAX_CODE + 1];
+    size_t len = fread(data, 1, sizeof(data), f);
+    fclose(f);
+
+    effect_vm_program_t program;
+    uint16_t pc;
+    effect_vm_status_t status = effect_vm_load(&program, data, len, &pc);
+    if (status != EFFECT_VM_OK) {
+        printf("%s: refuse (%s a l'adresse %u)\n", argv[1], s_status[status], pc);
+        return 1;
+    }
+    printf("%s: %u octets de code, budget %u instructions par pixel\n", argv[1], program.code_len, program.budget);
+
+    int32_t in[EFFECT_VM_IN_MAX] = {
+        [EFFECT_VM_IN_COUNT] = leds,
+        [EFFECT_VM_IN_R] = 255,
+        [EFFECT_VM_IN_G] = 160,
+        [EFFECT_VM_IN_B] = 60,
+    };
+    for (int p = 0; p < EFFECT_VM_PARAMS && 4 + p < argc; p++) {
+        in[EFFECT_VM_IN_P0 + p] = atoi(argv[4 + p]) & 0xFF;
+    }
+
+    uint64_t total_steps = 0;
+    uint32_t max_steps = 0;
+    uint32_t max_frame_steps = 0;
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int frame = 0; frame < frames; frame++) {
+        uint32_t frame_steps = 0;
+        in[EFFECT_VM_IN_FRAME] = frame;
+        in[EFFECT_VM_IN_TIME] = frame * 20;
+        for (int i = 0; i < leds; i++) {
+            uint8_t rgb[3];
+            uint32_t steps = 0;
+            in[EFFECT_VM_IN_INDEX] = i;
+            status = effect_vm_run(&program, in, rgb, &steps);
+            if (status != EFFECT_VM_OK) {
+                printf("erreur d'execution (%s) : pas %d, LED %d, %u instructions\n", s_status[status], frame, i, steps);
+                return 1;
+            }
+            frame_steps += steps;
+            if (steps > max_steps) {
+                max_steps = steps;
+            }
+        }
+        total_steps += frame_steps;
+        if (frame_steps > max_frame_steps) {
+            max_frame_steps = frame_steps;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double ns = (t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec);
+    double pixels = (double)leds * frames;
+    printf("%d LEDs x %d pas : %.1f instructions/pixel (max %u), %.1f ns/pixel, %.2f ns/instruction\n",
+           leds, frames, total_steps / pixels, max_steps, ns / pixels, ns / total_steps);
+    printf("pas le plus long : %u instructions sur %d (%s)\n", max_frame_steps, FRAME_BUDGET,
+           max_frame_steps <= FRAME_BUDGET ? "ok" : "depasse : le firmware arretera le programme");
+    return max_frame_steps <= FRAME_BUDGET ? 0 : 1;
+}